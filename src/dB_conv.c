@@ -0,0 +1,123 @@
+/* dB_conv.c - table driven conversions between Notepad values and dB
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "dB_conv.h"
+
+#include "auto-config.h"
+
+#include <math.h>
+
+#include "dB_tables.h"
+
+
+/* Index of the most significant bit set in value, which must not be 0. */
+static
+unsigned int msb_index(const uint32_t value);
+
+static
+unsigned int msb_index(const uint32_t value)
+{
+#if defined(__GNUC__)
+    return 31U - (unsigned int) __builtin_clz(value);
+#else
+    unsigned int index = 0;
+    for (uint32_t v = value; v > 1; v >>= 1) {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+
+double dB_conv_meter(const uint32_t meter_value)
+{
+    if (meter_value == 0) {
+        return -INFINITY;
+    }
+
+    /* meter_value = mantissa * 2^(exponent-DB_TABLE_MANTISSA_BITS),
+     * with mantissa in [2^DB_TABLE_MANTISSA_BITS, 2^(DB_TABLE_MANTISSA_BITS+1)) */
+    const unsigned int exponent = msb_index(meter_value);
+    if (exponent <= DB_TABLE_MANTISSA_BITS) {
+        const uint32_t mantissa =
+            meter_value << (DB_TABLE_MANTISSA_BITS - exponent);
+        return (dB_table_mantissa[mantissa - (1U << DB_TABLE_MANTISSA_BITS)] +
+                dB_table_meter_exponent[exponent]);
+    }
+
+    const unsigned int shift = exponent - DB_TABLE_MANTISSA_BITS;
+    const uint32_t mantissa = meter_value >> shift;
+    const uint32_t index = mantissa - (1U << DB_TABLE_MANTISSA_BITS);
+    const double fraction =
+        ((double) (meter_value & ((1U << shift) - 1U))) * dB_table_inverse_pow2[shift];
+    const double lower = dB_table_mantissa[index];
+    const double upper = dB_table_mantissa[index+1];
+    return lower + fraction * (upper - lower) + dB_table_meter_exponent[exponent];
+}
+
+
+/* Look up value for dB in a table starting at min_dB. */
+static
+bool table_lookup(uint32_t *value, const double dB,
+                  const uint32_t *table, const long min_dB, const long max_dB)
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+bool table_lookup(uint32_t *value, const double dB,
+                  const uint32_t *table, const long min_dB, const long max_dB)
+{
+    if (!(dB >= ((double) min_dB)) || !(dB <= ((double) max_dB))) {
+        return false;
+    }
+    const long index = lround(dB) - min_dB;
+    if (((double) (index + min_dB)) != dB) {
+        return false;
+    }
+    *value = table[index];
+    return true;
+}
+
+
+bool dB_conv_range(uint32_t *value, const double range_dB)
+{
+    return table_lookup(value, range_dB, dB_table_range,
+                        DB_TABLE_RANGE_MIN_dB, DB_TABLE_RANGE_MAX_dB);
+}
+
+
+bool dB_conv_threshold(uint32_t *value, const double thresh_dB)
+{
+    return table_lookup(value, thresh_dB, dB_table_threshold,
+                        DB_TABLE_THRESHOLD_MIN_dB, DB_TABLE_THRESHOLD_MAX_dB);
+}
+
+
+bool dB_conv_meter_value(uint32_t *value, const double meter_dB)
+{
+    return table_lookup(value, meter_dB, dB_table_meter,
+                        DB_TABLE_METER_MIN_dB, DB_TABLE_METER_MAX_dB);
+}
@@ -0,0 +1,70 @@
+/* dB_conv.h - table driven conversions between Notepad values and dB
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DB_CONV_H
+#define DB_CONV_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* The reference values for 0dB. dB_tables.awk reads these lines to
+ * generate the tables in dB_tables.h at build time, so keep them in
+ * this format. */
+#define REF_VALUE_RANGE     0x1fffffffUL
+#define REF_VALUE_THRESHOLD 0x007fffffUL
+#define REF_VALUE_METER     0x00ffffffUL
+
+
+/* dB_conv_meter() interpolates linearly between 257 values of
+ * 20*log10(x) for every octave of meter values, which is good to
+ * about 0.00002dB. Values below 512 are exact. The check-tables
+ * command compares all meter values against libm. */
+#define DB_CONV_METER_MAX_ERROR_dB 0.0001
+
+
+/* 20*log10(meter_value/REF_VALUE_METER), without calling libm. */
+extern
+double dB_conv_meter(const uint32_t meter_value);
+
+
+/* Look up the value for a whole number of dB in the tables, which
+ * hold the same values dB_to_uint() calculates. Return false for dB
+ * values not in the tables, i.e. not whole numbers or outside the
+ * range of the parameter. */
+extern
+bool dB_conv_range(uint32_t *value, const double range_dB);
+
+extern
+bool dB_conv_threshold(uint32_t *value, const double thresh_dB);
+
+extern
+bool dB_conv_meter_value(uint32_t *value, const double meter_dB);
+
+
+#endif /* !defined(DB_CONV_H) */
@@ -0,0 +1,100 @@
+# dB_tables.awk - generate dB_tables.h from the REF_VALUE_* in dB_conv.h
+#
+# Usage: awk -f dB_tables.awk dB_conv.h > dB_tables.h
+#
+# Generating the tables with awk instead of a C program keeps them
+# working when cross compiling.
+
+function hex_value(str,    i, digit, value)
+{
+    str = tolower(str)
+    sub(/^0x/, "", str)
+    sub(/ul$/, "", str)
+    value = 0
+    for (i = 1; i <= length(str); ++i) {
+        digit = index("0123456789abcdef", substr(str, i, 1)) - 1
+        value = value * 16 + digit
+    }
+    return value
+}
+
+function log10(x)
+{
+    return log(x) / log(10)
+}
+
+function round(x)
+{
+    return (x < 0) ? -int(-x + 0.5) : int(x + 0.5)
+}
+
+# the value table for whole dB from min_dB to max_dB, like dB_to_uint()
+function value_table(name, ref_value, sign, min_dB, max_dB,    dB, value)
+{
+    printf("#define DB_TABLE_%s_MIN_dB (%dL)\n", toupper(name), min_dB)
+    printf("#define DB_TABLE_%s_MAX_dB (%dL)\n", toupper(name), max_dB)
+    printf("\n")
+    printf("static\n")
+    printf("const uint32_t dB_table_%s[%d] = {\n", name, max_dB - min_dB + 1)
+    for (dB = min_dB; dB <= max_dB; ++dB) {
+        value = round(ref_value * exp(log(10) * sign * dB / 20))
+        printf("    %10.0fU, /* %4ddB */\n", value, dB)
+    }
+    printf("};\n")
+    printf("\n")
+    printf("\n")
+}
+
+/^#define REF_VALUE_[A-Z]+ / {
+    ref[$2] = hex_value($3)
+}
+
+END {
+    if (!("REF_VALUE_METER" in ref) || !("REF_VALUE_RANGE" in ref) ||
+        !("REF_VALUE_THRESHOLD" in ref)) {
+        print "dB_tables.awk: REF_VALUE_* definitions not found" > "/dev/stderr"
+        exit 1
+    }
+
+    mantissa_bits = 8
+    mantissa_count = 2 ^ mantissa_bits
+
+    printf("/* dB_tables.h - generated by dB_tables.awk from dB_conv.h, do not edit */\n")
+    printf("\n")
+    printf("\n")
+    printf("#define DB_TABLE_MANTISSA_BITS %dU\n", mantissa_bits)
+    printf("\n")
+    printf("\n")
+    printf("/* 20*log10(1 + i/%d) */\n", mantissa_count)
+    printf("static\n")
+    printf("const double dB_table_mantissa[%d] = {\n", mantissa_count + 1)
+    for (i = 0; i <= mantissa_count; ++i) {
+        printf("    %.17g,\n", 20 * log10(1 + i / mantissa_count))
+    }
+    printf("};\n")
+    printf("\n")
+    printf("\n")
+    printf("/* 20*log10(2^e / REF_VALUE_METER) */\n")
+    printf("static\n")
+    printf("const double dB_table_meter_exponent[32] = {\n")
+    for (e = 0; e < 32; ++e) {
+        printf("    %.17g,\n", 20 * (e * log10(2) - log10(ref["REF_VALUE_METER"])))
+    }
+    printf("};\n")
+    printf("\n")
+    printf("\n")
+
+    printf("/* 2^-i, to avoid dividing */\n")
+    printf("static\n")
+    printf("const double dB_table_inverse_pow2[32] = {\n")
+    for (i = 0; i < 32; ++i) {
+        printf("    %.17g,\n", 2 ^ -i)
+    }
+    printf("};\n")
+    printf("\n")
+    printf("\n")
+
+    value_table("range",     ref["REF_VALUE_RANGE"],     -1,    0, 90)
+    value_table("threshold", ref["REF_VALUE_THRESHOLD"],  1,  -60,  0)
+    value_table("meter",     ref["REF_VALUE_METER"],      1, -100,  0)
+}
@@ -0,0 +1,302 @@
+/* device_cache.c - on-disk cache of Notepad device identity strings
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "device_cache.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+#define DEVICE_CACHE_HEADER "# scnp-cli device cache 1\n"
+
+
+const char *device_cache_path(void)
+{
+    static char path[1024];
+    static bool initialized = false;
+    if (initialized) {
+        return (path[0] != '\0') ? path : NULL;
+    }
+    initialized = true;
+    path[0] = '\0';
+
+    const char *const env_cache = getenv("SCNP_CLI_CACHE");
+    const char *const env_xdg   = getenv("XDG_CACHE_HOME");
+    const char *const env_home  = getenv("HOME");
+    int len = 0;
+    if (env_cache != NULL) {
+        len = snprintf(path, sizeof(path), "%s", env_cache);
+    } else if ((env_xdg != NULL) && (env_xdg[0] == '/')) {
+        len = snprintf(path, sizeof(path), "%s/scnp-cli/devices", env_xdg);
+    } else if ((env_home != NULL) && (env_home[0] != '\0')) {
+        len = snprintf(path, sizeof(path), "%s/.cache/scnp-cli/devices", env_home);
+    }
+    if ((len < 0) || (((size_t) len) >= sizeof(path))) {
+        path[0] = '\0';
+    }
+    return (path[0] != '\0') ? path : NULL;
+}
+
+
+/* Split off the next tab separated field from *pos. */
+static
+const char *next_field(char **pos)
+{
+    char *const field = *pos;
+    if (field == NULL) {
+        return NULL;
+    }
+    char *const tab = strchr(field, '\t');
+    if (tab != NULL) {
+        *tab = '\0';
+        *pos = tab + 1;
+    } else {
+        *pos = NULL;
+    }
+    return field;
+}
+
+
+/* Copy a tab separated field, which must not be empty. */
+static
+bool copy_field(char *dest, const char *const src)
+{
+    if (src == NULL) {
+        return false;
+    }
+    const size_t len = strlen(src);
+    if ((len == 0) || (len >= DEVICE_CACHE_STRING_MAX)) {
+        return false;
+    }
+    memcpy(dest, src, len + 1);
+    return true;
+}
+
+
+void device_cache_load(device_cache_T *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    const char *const path = device_cache_path();
+    if (path == NULL) {
+        return;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[512];
+    if ((fgets(line, sizeof(line), file) == NULL) ||
+        (strcmp(line, DEVICE_CACHE_HEADER) != 0)) {
+        fclose(file);
+        return;
+    }
+
+    while ((cache->count < DEVICE_CACHE_ENTRIES_MAX) &&
+           (fgets(line, sizeof(line), file) != NULL)) {
+        char *const newline = strchr(line, '\n');
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+
+        /* PORT_PATH ADDR IDPRODUCT BCDDEVICE <TAB> M <TAB> P <TAB> S,
+         * with empty strings stored as "-" */
+        device_cache_entry_T *entry = &cache->entries[cache->count];
+        unsigned int devaddr, idProduct, bcdDevice;
+        char *pos = line;
+        const char *const key = next_field(&pos);
+        if ((key == NULL) ||
+            (sscanf(key, "%31s %u %x %x", entry->port_path,
+                    &devaddr, &idProduct, &bcdDevice) != 4) ||
+            (devaddr > 255) || (idProduct > 0xffff) || (bcdDevice > 0xffff) ||
+            !copy_field(entry->manufacturer, next_field(&pos)) ||
+            !copy_field(entry->product,      next_field(&pos)) ||
+            !copy_field(entry->serial,       next_field(&pos))) {
+            /* ignore broken lines */
+            continue;
+        }
+        entry->devaddr   = (uint8_t)  devaddr;
+        entry->idProduct = (uint16_t) idProduct;
+        entry->bcdDevice = (uint16_t) bcdDevice;
+        if (strcmp(entry->manufacturer, "-") == 0) { entry->manufacturer[0] = '\0'; }
+        if (strcmp(entry->product,      "-") == 0) { entry->product[0]      = '\0'; }
+        if (strcmp(entry->serial,       "-") == 0) { entry->serial[0]       = '\0'; }
+        ++cache->count;
+    }
+    fclose(file);
+}
+
+
+/* Create the directory the cache file is in, and its parent. */
+static
+void make_parent_dirs(const char *const path)
+{
+    char dir[1024];
+    const size_t len = strlen(path);
+    if (len >= sizeof(dir)) {
+        return;
+    }
+    memcpy(dir, path, len + 1);
+
+    char *slashes[2] = { NULL, NULL };
+    for (int i=0; i<2; ++i) {
+        slashes[i] = strrchr(dir, '/');
+        if ((slashes[i] == NULL) || (slashes[i] == dir)) {
+            slashes[i] = NULL;
+            break;
+        }
+        *slashes[i] = '\0';
+    }
+    for (int i=1; i>=0; --i) {
+        if (slashes[i] == NULL) {
+            continue;
+        }
+#if defined(HAVE_WINDOWS_H)
+        mkdir(dir);
+#else
+        mkdir(dir, 0700);
+#endif
+        *slashes[i] = '/';
+    }
+}
+
+
+static
+const char *field_or_dash(const char *const str)
+{
+    return (str[0] != '\0') ? str : "-";
+}
+
+
+void device_cache_save(device_cache_T *cache)
+{
+    if (!cache->dirty) {
+        return;
+    }
+    const char *const path = device_cache_path();
+    if (path == NULL) {
+        return;
+    }
+    make_parent_dirs(path);
+
+    /* Write a new file and rename it over the old one, so that other
+     * scnp-cli processes never read a half written cache. */
+    char tmp_path[1100];
+    const int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld",
+                             path, (long) getpid());
+    if ((len < 0) || (((size_t) len) >= sizeof(tmp_path))) {
+        return;
+    }
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        return;
+    }
+    fputs(DEVICE_CACHE_HEADER, file);
+    for (size_t i=0; i<cache->count; ++i) {
+        const device_cache_entry_T *const entry = &cache->entries[i];
+        fprintf(file, "%s %u %04x %04x\t%s\t%s\t%s\n",
+                entry->port_path, entry->devaddr,
+                entry->idProduct, entry->bcdDevice,
+                field_or_dash(entry->manufacturer),
+                field_or_dash(entry->product),
+                field_or_dash(entry->serial));
+    }
+    if ((fclose(file) != 0) || (rename(tmp_path, path) != 0)) {
+        remove(tmp_path);
+        return;
+    }
+    cache->dirty = false;
+}
+
+
+const device_cache_entry_T *
+device_cache_lookup(const device_cache_T *cache,
+                    const char *const port_path, const uint8_t devaddr,
+                    const uint16_t idProduct, const uint16_t bcdDevice)
+{
+    for (size_t i=0; i<cache->count; ++i) {
+        const device_cache_entry_T *const entry = &cache->entries[i];
+        if (strcmp(entry->port_path, port_path) == 0) {
+            if ((entry->devaddr == devaddr) &&
+                (entry->idProduct == idProduct) &&
+                (entry->bcdDevice == bcdDevice)) {
+                return entry;
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+
+/* Strings from the device end up in a tab separated line based file. */
+static
+void sanitize_string(char *str)
+{
+    for (char *p = str; *p != '\0'; ++p) {
+        if ((*p < 0x20) || (*p >= 0x7f)) {
+            *p = '?';
+        }
+    }
+}
+
+
+void device_cache_store(device_cache_T *cache,
+                        const device_cache_entry_T *entry)
+{
+    size_t i;
+    for (i=0; i<cache->count; ++i) {
+        if (strcmp(cache->entries[i].port_path, entry->port_path) == 0) {
+            break;
+        }
+    }
+    if (i == cache->count) {
+        if (cache->count == DEVICE_CACHE_ENTRIES_MAX) {
+            /* forget the oldest entry */
+            memmove(&cache->entries[0], &cache->entries[1],
+                    (DEVICE_CACHE_ENTRIES_MAX - 1) * sizeof(cache->entries[0]));
+            i = DEVICE_CACHE_ENTRIES_MAX - 1;
+        } else {
+            ++cache->count;
+        }
+    }
+    cache->entries[i] = *entry;
+    sanitize_string(cache->entries[i].manufacturer);
+    sanitize_string(cache->entries[i].product);
+    sanitize_string(cache->entries[i].serial);
+    cache->dirty = true;
+}
@@ -0,0 +1,108 @@
+/* device_cache.h - on-disk cache of Notepad device identity strings
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef DEVICE_CACHE_H
+#define DEVICE_CACHE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Reading the string descriptors (manufacturer, product, serial)
+ * means opening the device and doing three control transfers. The
+ * device cache remembers them per USB port, so that only a device
+ * which is new on its port needs to be asked again.
+ *
+ * An entry is only valid for the same device address, idProduct, and
+ * bcdDevice: the address changes whenever a device is plugged in
+ * again, so swapping devices on a port cannot return a stale serial.
+ */
+
+
+#define DEVICE_CACHE_ENTRIES_MAX 64
+#define DEVICE_CACHE_STRING_MAX  64
+#define DEVICE_CACHE_PORT_PATH_MAX 32
+
+
+typedef struct {
+    /* "BUS-PORT.PORT..." like the Linux sysfs device names */
+    char port_path[DEVICE_CACHE_PORT_PATH_MAX];
+    uint8_t devaddr;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    /* empty for devices without the respective string descriptor */
+    char manufacturer[DEVICE_CACHE_STRING_MAX];
+    char product[DEVICE_CACHE_STRING_MAX];
+    char serial[DEVICE_CACHE_STRING_MAX];
+} device_cache_entry_T;
+
+
+typedef struct {
+    device_cache_entry_T entries[DEVICE_CACHE_ENTRIES_MAX];
+    size_t count;
+    /* set when entries have changed since loading */
+    bool dirty;
+} device_cache_T;
+
+
+/* Return the cache file name, or NULL when there is no place for one.
+ * SCNP_CLI_CACHE overrides the default of
+ * $XDG_CACHE_HOME/scnp-cli/devices or ~/.cache/scnp-cli/devices, and
+ * an empty SCNP_CLI_CACHE disables the cache file. */
+extern
+const char *device_cache_path(void);
+
+
+/* Load the cache file. A missing or unreadable cache file just gives
+ * an empty cache. */
+extern
+void device_cache_load(device_cache_T *cache);
+
+
+/* Save the cache file if it is dirty. Failing to save is silently
+ * ignored, as the cache only saves time. */
+extern
+void device_cache_save(device_cache_T *cache);
+
+
+/* Find the valid entry for the device, or NULL. */
+extern
+const device_cache_entry_T *
+device_cache_lookup(const device_cache_T *cache,
+                    const char *const port_path, const uint8_t devaddr,
+                    const uint16_t idProduct, const uint16_t bcdDevice);
+
+
+/* Add the entry, replacing any entry for the same port. */
+extern
+void device_cache_store(device_cache_T *cache,
+                        const device_cache_entry_T *entry);
+
+
+#endif /* !defined(DEVICE_CACHE_H) */
@@ -0,0 +1,186 @@
+/* meter_stats.c - streaming statistics of the meter samples
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "meter_stats.h"
+
+#include "auto-config.h"
+
+#include <math.h>
+#include <string.h>
+
+
+/* 20*log10(e), the dB the held peak falls per decay time */
+#define DB_PER_NEPER 8.685889638065035
+
+
+void meter_stats_init(meter_stats_T *stats,
+                      const unsigned int *rms_window_ms,
+                      const unsigned int rms_window_count,
+                      const unsigned int peak_decay_ms)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->rms_window_count =
+        (rms_window_count < METER_STATS_RMS_WINDOWS_MAX) ?
+        rms_window_count : METER_STATS_RMS_WINDOWS_MAX;
+    for (unsigned int i=0; i<stats->rms_window_count; ++i) {
+        stats->rms_window_ns[i] = ((double) rms_window_ms[i]) * 1.0e6;
+    }
+    stats->peak_decay_ns = ((double) peak_decay_ms) * 1.0e6;
+    stats->peak_hold_dB = -INFINITY;
+    stats->floor_hold_dB = INFINITY;
+}
+
+
+void meter_stats_set_floor_rise(meter_stats_T *stats,
+                                const unsigned int floor_rise_ms)
+{
+    stats->floor_rise_ns = ((double) floor_rise_ms) * 1.0e6;
+}
+
+
+void meter_stats_add(meter_stats_T *stats,
+                     const double linear, const double dB, const uint64_t t_ns)
+{
+    const double power = linear * linear;
+
+    if (stats->count == 0) {
+        for (unsigned int i=0; i<stats->rms_window_count; ++i) {
+            stats->rms_power[i] = power;
+        }
+    } else {
+        const double dt_ns = (double) (t_ns - stats->last_ns);
+        for (unsigned int i=0; i<stats->rms_window_count; ++i) {
+            /* first order approximation of 1-exp(-dt/window), which
+             * keeps exp() out of the per sample path */
+            const double alpha = dt_ns / (stats->rms_window_ns[i] + dt_ns);
+            stats->rms_power[i] += alpha * (power - stats->rms_power[i]);
+        }
+        if (stats->peak_decay_ns > 0.0) {
+            stats->peak_hold_dB -= DB_PER_NEPER * dt_ns / stats->peak_decay_ns;
+        }
+        if (stats->floor_rise_ns > 0.0) {
+            stats->floor_hold_dB += DB_PER_NEPER * dt_ns / stats->floor_rise_ns;
+        }
+    }
+    stats->sum_power += power;
+    stats->last_ns = t_ns;
+    ++stats->count;
+
+    if (dB > stats->peak_hold_dB) {
+        stats->peak_hold_dB = dB;
+    }
+    if (dB < stats->floor_hold_dB) {
+        stats->floor_hold_dB = dB;
+    }
+
+    const double d_bucket =
+        (dB - METER_STATS_HIST_MIN_dB) / METER_STATS_HIST_STEP_dB;
+    size_t bucket;
+    if (!(d_bucket >= 0.0)) {
+        bucket = 0;
+    } else if (d_bucket >= ((double) METER_STATS_HIST_BUCKETS)) {
+        bucket = METER_STATS_HIST_BUCKETS + 1;
+    } else {
+        bucket = 1 + (size_t) d_bucket;
+    }
+    ++stats->hist[bucket];
+}
+
+
+static
+double power_to_dB(const double power);
+
+static
+double power_to_dB(const double power)
+{
+    return (power > 0.0) ? (10.0 * log10(power)) : -INFINITY;
+}
+
+
+double meter_stats_rms_dB(const meter_stats_T *stats, const unsigned int window)
+{
+    if ((stats->count == 0) || (window >= stats->rms_window_count)) {
+        return -INFINITY;
+    }
+    return power_to_dB(stats->rms_power[window]);
+}
+
+
+double meter_stats_session_rms_dB(const meter_stats_T *stats)
+{
+    if (stats->count == 0) {
+        return -INFINITY;
+    }
+    return power_to_dB(stats->sum_power / ((double) stats->count));
+}
+
+
+double meter_stats_peak_hold_dB(const meter_stats_T *stats)
+{
+    return stats->peak_hold_dB;
+}
+
+
+double meter_stats_floor_hold_dB(const meter_stats_T *stats)
+{
+    return stats->floor_hold_dB;
+}
+
+
+double meter_stats_quantile_dB(const meter_stats_T *stats, const double q)
+{
+    if (stats->count == 0) {
+        return -INFINITY;
+    }
+
+    /* the rank of the sample we are looking for, counting from 1 */
+    double d_rank = ceil(q * ((double) stats->count));
+    if (d_rank < 1.0) {
+        d_rank = 1.0;
+    }
+    const uint64_t rank = (uint64_t) d_rank;
+
+    uint64_t seen = 0;
+    size_t bucket;
+    for (bucket=0; bucket<(METER_STATS_HIST_BUCKETS+1); ++bucket) {
+        seen += stats->hist[bucket];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    if (bucket == 0) {
+        return -INFINITY;
+    }
+    if (bucket > METER_STATS_HIST_BUCKETS) {
+        return METER_STATS_HIST_MIN_dB +
+            METER_STATS_HIST_BUCKETS * METER_STATS_HIST_STEP_dB;
+    }
+    /* the middle of the bucket */
+    return METER_STATS_HIST_MIN_dB +
+        (((double) bucket) - 0.5) * METER_STATS_HIST_STEP_dB;
+}
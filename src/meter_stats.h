@@ -0,0 +1,130 @@
+/* meter_stats.h - streaming statistics of the meter samples
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef METER_STATS_H
+#define METER_STATS_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Running statistics of the meter samples which take the same small
+ * amount of memory however long the meter runs:
+ *
+ *   - RMS levels as exponential moving averages of the power, with
+ *     the window length as the time constant,
+ *   - the peak level, held and then falling with a decay time,
+ *   - the floor level, the same upside down: the quietest level, held
+ *     and then rising with a rise time,
+ *   - quantiles of the level over the whole session, from a dB
+ *     histogram with 0.1dB buckets. The quantiles are accurate to
+ *     half a bucket, i.e. 0.05dB.
+ *
+ * Adding a sample does not call libm.
+ */
+
+
+#define METER_STATS_RMS_WINDOWS_MAX 3
+
+#define METER_STATS_HIST_MIN_dB     (-150.0)
+#define METER_STATS_HIST_STEP_dB    0.1
+#define METER_STATS_HIST_BUCKETS    1600
+
+
+typedef struct {
+    unsigned int rms_window_count;
+    double rms_window_ns[METER_STATS_RMS_WINDOWS_MAX];
+    /* mean power relative to the reference value, per window */
+    double rms_power[METER_STATS_RMS_WINDOWS_MAX];
+    /* mean power over the whole session */
+    double sum_power;
+
+    /* the held peak falls by 20*log10(e) dB (about 8.7dB) per
+     * peak_decay_ns, i.e. exponentially in the linear value */
+    double peak_decay_ns;
+    double peak_hold_dB;
+
+    /* the held floor rises the same way, by about 8.7dB per
+     * floor_rise_ns */
+    double floor_rise_ns;
+    double floor_hold_dB;
+
+    uint64_t count;
+    uint64_t last_ns;
+
+    /* [0] is for levels below METER_STATS_HIST_MIN_dB (including 0,
+     * i.e. -infinity dB), [METER_STATS_HIST_BUCKETS+1] for levels
+     * above the highest bucket. */
+    uint64_t hist[METER_STATS_HIST_BUCKETS+2];
+} meter_stats_T;
+
+
+extern
+void meter_stats_init(meter_stats_T *stats,
+                      const unsigned int *rms_window_ms,
+                      const unsigned int rms_window_count,
+                      const unsigned int peak_decay_ms);
+
+
+/* Let the held floor rise with a time constant of floor_rise_ms. It
+ * is held forever with 0, which meter_stats_init() sets. */
+extern
+void meter_stats_set_floor_rise(meter_stats_T *stats,
+                                const unsigned int floor_rise_ms);
+
+
+/* Add a sample with the linear value relative to the reference value
+ * (i.e. 1.0 is 0dB), and the same level in dB. */
+extern
+void meter_stats_add(meter_stats_T *stats,
+                     const double linear, const double dB, const uint64_t t_ns);
+
+
+extern
+double meter_stats_rms_dB(const meter_stats_T *stats, const unsigned int window);
+
+
+extern
+double meter_stats_session_rms_dB(const meter_stats_T *stats);
+
+
+extern
+double meter_stats_peak_hold_dB(const meter_stats_T *stats);
+
+
+/* +infinity before the first sample */
+extern
+double meter_stats_floor_hold_dB(const meter_stats_T *stats);
+
+
+/* The level q (0.0 to 1.0) of all samples are at or below. */
+extern
+double meter_stats_quantile_dB(const meter_stats_T *stats, const double q);
+
+
+#endif /* !defined(METER_STATS_H) */
@@ -0,0 +1,109 @@
+/* monotonic_time.c - implement the monotonic clock helper functions
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "monotonic_time.h"
+
+#include "auto-config.h"
+
+#if   defined(HAVE_WINDOWS_H)
+# include <windows.h>
+#elif defined(HAVE_TIME_H)
+# include <time.h>
+#endif
+
+
+uint64_t monotonic_ns(void)
+{
+#if   defined(HAVE_WINDOWS_H)
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    const uint64_t secs = ((uint64_t) count.QuadPart) / ((uint64_t) freq.QuadPart);
+    const uint64_t frac = ((uint64_t) count.QuadPart) % ((uint64_t) freq.QuadPart);
+    return secs * 1000000000ULL + (frac * 1000000000ULL) / ((uint64_t) freq.QuadPart);
+#elif defined(HAVE_TIME_H)
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000ULL + ((uint64_t) ts.tv_nsec);
+#else
+# error Requires POSIX clock_gettime() or Windows QueryPerformanceCounter() at this time.
+#endif
+}
+
+
+uint64_t realtime_ns(void)
+{
+#if   defined(HAVE_WINDOWS_H)
+    /* FILETIME counts 100ns intervals since 1601-01-01 */
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    const uint64_t ticks =
+        (((uint64_t) ft.dwHighDateTime) << 32) | ((uint64_t) ft.dwLowDateTime);
+    return (ticks - 116444736000000000ULL) * 100ULL;
+#elif defined(HAVE_TIME_H)
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000ULL + ((uint64_t) ts.tv_nsec);
+#else
+# error Requires POSIX clock_gettime() or Windows GetSystemTimeAsFileTime() at this time.
+#endif
+}
+
+
+void sleep_until_ns(const uint64_t deadline_ns)
+{
+#if   defined(HAVE_WINDOWS_H)
+    const uint64_t now_ns = monotonic_ns();
+    if (deadline_ns > now_ns) {
+        Sleep((DWORD) ((deadline_ns - now_ns) / 1000000ULL));
+    }
+#elif defined(HAVE_TIME_H) && defined(HAVE_CLOCK_NANOSLEEP)
+    /* An absolute deadline does not accumulate the drift caused by
+     * the time spent between computing and starting a relative sleep. */
+    struct timespec req;
+    req.tv_sec  = (time_t) (deadline_ns / 1000000000ULL);
+    req.tv_nsec = (long) (deadline_ns % 1000000000ULL);
+    (void) clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL);
+#elif defined(HAVE_TIME_H)
+    const uint64_t now_ns = monotonic_ns();
+    if (deadline_ns > now_ns) {
+        const uint64_t delta_ns = deadline_ns - now_ns;
+        struct timespec req;
+        req.tv_sec  = (time_t) (delta_ns / 1000000000ULL);
+        req.tv_nsec = (long) (delta_ns % 1000000000ULL);
+        (void) nanosleep(&req, NULL);
+    }
+#else
+# error Requires POSIX nanosleep() or Windows Sleep() at this time.
+#endif
+}
+
+
+double ns_to_ms(const uint64_t ns)
+{
+    return ((double) ns) / 1000000.0;
+}
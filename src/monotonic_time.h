@@ -0,0 +1,58 @@
+/* monotonic_time.h - declare the monotonic clock helper functions
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MONOTONIC_TIME_H
+#define MONOTONIC_TIME_H
+
+
+#include <stdint.h>
+
+
+/* Nanoseconds since some unspecified starting point which does not
+ * jump around when the wall clock time is changed. */
+extern
+uint64_t monotonic_ns(void);
+
+
+/* Nanoseconds since the Unix epoch, for labelling data with the
+ * wall clock time. Not suitable for measuring time differences. */
+extern
+uint64_t realtime_ns(void);
+
+
+/* Sleep until monotonic_ns() has reached deadline_ns. Returns early
+ * when interrupted by a signal, so the caller must check its abort
+ * condition and whether the deadline has actually been reached. */
+extern
+void sleep_until_ns(const uint64_t deadline_ns);
+
+
+/* Convert a nanosecond time difference to milliseconds for printing. */
+extern
+double ns_to_ms(const uint64_t ns);
+
+
+#endif /* !defined(MONOTONIC_TIME_H) */
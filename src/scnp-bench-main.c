@@ -0,0 +1,575 @@
+/* scnp-bench-main.c - measure the latency of scnp-cli commands and meter reads
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "auto-config.h"
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#else
+# error Requires POSIX fork() and waitpid() at this time.
+#endif
+
+
+#include "monotonic_time.h"
+#include "usb_trace.h"
+
+
+/* The stand-in when no device can be used: one simulated NOTEPAD-12FX
+ * with fixed random numbers, so results are comparable between
+ * commits. */
+#define BENCH_SIM_SPEC "12fx,seed=1"
+
+#define BENCH_ITERATIONS_DEFAULT    100UL
+#define BENCH_SAMPLES_DEFAULT      2000UL
+#define BENCH_COUNT_MAX          100000UL
+
+#define BENCH_ARGV_MAX 16U
+
+
+typedef struct {
+    const char *name;
+    const char *args[8];
+} bench_command_T;
+
+
+/* Every command type of scnp-cli which talks to the device. */
+static
+const bench_command_T bench_commands[] = {
+    { "audio-routing",    { "audio-routing", "2", NULL } },
+    { "ducker-off",       { "ducker-off", NULL } },
+    { "ducker-on",        { "ducker-on", "2", "2000ms", NULL } },
+    { "ducker-range",     { "ducker-range", "20dB", NULL } },
+    { "ducker-threshold", { "ducker-threshold", "-55dB", NULL } },
+};
+
+
+typedef struct {
+    const char *name;
+    /* number of latencies, and the latencies in ns, sorted */
+    size_t count;
+    uint64_t *latency_ns;
+    /* operations per second over the whole run */
+    double per_s;
+    /* median time per operation spent in USB control transfers */
+    uint64_t usb_p50_ns;
+} bench_result_T;
+
+
+static
+void print_version(const char *const prog)
+    __attribute__(( nonnull(1) ));
+
+static
+void print_version(const char *const prog)
+{
+    printf("%s (%s) %s\n"
+           "Copyright (C) 2022 Hans Ulrich Niedermann\n"
+           "\n"
+           "This is free software under the MIT license. There is NO warranty.\n",
+           prog, PACKAGE_NAME, PACKAGE_VERSION);
+}
+
+
+static
+void print_usage(const char *const prog)
+    __attribute__(( nonnull(1) ));
+
+static
+void print_usage(const char *const prog)
+{
+    printf("Usage: %s [--iterations <N>] [--samples <N>] [--json <FILE>] <SCNP_CLI>\n"
+           "\n"
+           "Run every command type of the scnp-cli program SCNP_CLI N times and\n"
+           "its meter for N samples, and print the p50/p90/p99/max latency and\n"
+           "the throughput. Command latencies are for the whole scnp-cli run,\n"
+           "from parsing the command line to closing the device, and the 'usb'\n"
+           "column shows how much of that is spent in USB control transfers.\n"
+           "Meter latencies are for the individual meter reads.\n"
+           "\n"
+           "If no device can be used, or SCNP_CLI_SIM is set, the simulated\n"
+           "device (SCNP_CLI_SIM=%s by default) stands in for it.\n"
+           "\n"
+           "    --iterations N  run every command N (1..%lu) times (default %lu)\n"
+           "\n"
+           "    --samples N     take N (1..%lu) meter samples (default %lu)\n"
+           "\n"
+           "    --json FILE     also write the results to FILE as JSON\n"
+           "\n"
+           "    --help          Print this usage message and exit.\n"
+           "\n"
+           "    --version       Print version message and exit.\n",
+           prog, BENCH_SIM_SPEC,
+           BENCH_COUNT_MAX, BENCH_ITERATIONS_DEFAULT,
+           BENCH_COUNT_MAX, BENCH_SAMPLES_DEFAULT);
+}
+
+
+/* Run argv[0] with stdout going to /dev/null, and return whether it
+ * has exited successfully. */
+static
+bool run_quietly(const char *const argv[])
+    __attribute__(( nonnull(1) ));
+
+static
+bool run_quietly(const char *const argv[])
+{
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fatal: fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        const int fd = open("/dev/null", O_WRONLY);
+        if ((fd < 0) || (dup2(fd, STDOUT_FILENO) < 0)) {
+            _exit(127);
+        }
+        execvp(argv[0], (char *const *) argv);
+        fprintf(stderr, "Fatal: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("Fatal: waitpid");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+
+/* Run argv[0] and exit if it fails. */
+static
+void run_or_fail(const char *const argv[])
+    __attribute__(( nonnull(1) ));
+
+static
+void run_or_fail(const char *const argv[])
+{
+    if (!run_quietly(argv)) {
+        fprintf(stderr, "Fatal: benchmark run of '%s", argv[0]);
+        for (size_t i=1; argv[i] != NULL; ++i) {
+            fprintf(stderr, " %s", argv[i]);
+        }
+        fprintf(stderr, "' has failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static
+void *calloc_or_fail(const size_t count, const size_t size);
+
+static
+void *calloc_or_fail(const size_t count, const size_t size)
+{
+    void *const ptr = calloc(count, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Fatal: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+
+/* Open the trace written by one scnp-cli run, and exit if that fails. */
+static
+void trace_open_or_fail(usb_trace_T *trace, const char *const path)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void trace_open_or_fail(usb_trace_T *trace, const char *const path)
+{
+    if (usb_trace_open(trace, path) != EXIT_SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static
+int compare_uint64(const void *a, const void *b)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int compare_uint64(const void *a, const void *b)
+{
+    const uint64_t va = *(const uint64_t *) a;
+    const uint64_t vb = *(const uint64_t *) b;
+    return (va > vb) - (va < vb);
+}
+
+
+/* The nearest rank quantile of the sorted values, per mille. */
+static
+uint64_t quantile_ns(const uint64_t *sorted, const size_t count,
+                     const unsigned int permille)
+    __attribute__(( nonnull(1) ));
+
+static
+uint64_t quantile_ns(const uint64_t *sorted, const size_t count,
+                     const unsigned int permille)
+{
+    if (count == 0) {
+        return 0;
+    }
+    const size_t rank = (count * permille + 999U) / 1000U;
+    return sorted[(rank == 0) ? 0 : (rank - 1)];
+}
+
+
+/* Sum up the transfer latencies in one trace. */
+static
+uint64_t trace_usb_ns(const char *const path)
+    __attribute__(( nonnull(1) ));
+
+static
+uint64_t trace_usb_ns(const char *const path)
+{
+    usb_trace_T trace;
+    trace_open_or_fail(&trace, path);
+    uint64_t sum_ns = 0;
+    usb_trace_record_T record;
+    while (usb_trace_read(&trace, &record) > 0) {
+        sum_ns += record.latency_ns;
+    }
+    usb_trace_close(&trace);
+    return sum_ns;
+}
+
+
+static
+void bench_command(bench_result_T *result, const char *const scnp_cli,
+                   const char *const trace_path,
+                   const bench_command_T *command, const size_t iterations)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3), nonnull(4) ));
+
+static
+void bench_command(bench_result_T *result, const char *const scnp_cli,
+                   const char *const trace_path,
+                   const bench_command_T *command, const size_t iterations)
+{
+    const char *argv[BENCH_ARGV_MAX] = { scnp_cli, "--record", trace_path };
+    for (size_t i=0; command->args[i] != NULL; ++i) {
+        argv[3+i] = command->args[i];
+    }
+
+    /* one run to warm up the caches, the device cache file included */
+    run_or_fail(argv);
+
+    result->name = command->name;
+    result->count = iterations;
+    result->latency_ns = calloc_or_fail(iterations, sizeof(uint64_t));
+    uint64_t *usb_ns = calloc_or_fail(iterations, sizeof(uint64_t));
+
+    for (size_t i=0; i<iterations; ++i) {
+        const uint64_t start_ns = monotonic_ns();
+        run_or_fail(argv);
+        result->latency_ns[i] = monotonic_ns() - start_ns;
+        usb_ns[i] = trace_usb_ns(trace_path);
+    }
+    /* the trace reading is not part of the throughput */
+    uint64_t run_ns = 0;
+    for (size_t i=0; i<iterations; ++i) {
+        run_ns += result->latency_ns[i];
+    }
+    result->per_s = (double) iterations * 1e9 / (double) ((run_ns > 0) ? run_ns : 1U);
+
+    qsort(result->latency_ns, iterations, sizeof(uint64_t), compare_uint64);
+    qsort(usb_ns, iterations, sizeof(uint64_t), compare_uint64);
+    result->usb_p50_ns = quantile_ns(usb_ns, iterations, 500);
+    free(usb_ns);
+}
+
+
+static
+void bench_meter(bench_result_T *result, const char *const scnp_cli,
+                 const char *const trace_path,
+                 const char *const name, const char *const mode_option,
+                 const char *const mode_value, const size_t samples)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3),
+                    nonnull(4), nonnull(5), nonnull(6) ));
+
+static
+void bench_meter(bench_result_T *result, const char *const scnp_cli,
+                 const char *const trace_path,
+                 const char *const name, const char *const mode_option,
+                 const char *const mode_value, const size_t samples)
+{
+    char count_str[24];
+    snprintf(count_str, sizeof(count_str), "%zu", samples);
+    const char *const argv[] = {
+        scnp_cli, "--record", trace_path,
+        "meter", "--format", "csv", "--output", "/dev/null",
+        "--count", count_str, mode_option, mode_value,
+        NULL
+    };
+    run_or_fail(argv);
+
+    /* The async meter may have a few more reads in flight than the
+     * samples it has been asked for. */
+    result->name = name;
+    result->count = 0;
+    result->latency_ns = calloc_or_fail(samples + 64U, sizeof(uint64_t));
+
+    usb_trace_T trace;
+    trace_open_or_fail(&trace, trace_path);
+    uint64_t first_ns = 0;
+    uint64_t last_done_ns = 0;
+    uint64_t usb_ns = 0;
+    usb_trace_record_T record;
+    while ((usb_trace_read(&trace, &record) > 0) &&
+           (result->count < (samples + 64U))) {
+        if ((record.request_type != USB_TRACE_IN) || (record.status != 0)) {
+            continue;
+        }
+        if (result->count == 0) {
+            first_ns = record.t_ns;
+        }
+        result->latency_ns[result->count++] = record.latency_ns;
+        usb_ns += record.latency_ns;
+        if ((record.t_ns + record.latency_ns) > last_done_ns) {
+            last_done_ns = record.t_ns + record.latency_ns;
+        }
+    }
+    usb_trace_close(&trace);
+
+    if (result->count == 0) {
+        fprintf(stderr, "Fatal: %s: no meter reads in the trace\n", name);
+        exit(EXIT_FAILURE);
+    }
+    const uint64_t span_ns = last_done_ns - first_ns;
+    result->per_s = (double) result->count * 1e9 / (double) ((span_ns > 0) ? span_ns : 1U);
+    qsort(result->latency_ns, result->count, sizeof(uint64_t), compare_uint64);
+    result->usb_p50_ns = quantile_ns(result->latency_ns, result->count, 500);
+}
+
+
+static
+void print_table(const bench_result_T *results, const size_t count,
+                 const char *const target)
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+void print_table(const bench_result_T *results, const size_t count,
+                 const char *const target)
+{
+    printf("target: %s\n", target);
+    printf("%-17s %7s %9s %9s %9s %9s %10s %9s\n",
+           "name", "n", "p50 ms", "p90 ms", "p99 ms", "max ms", "per s", "usb ms");
+    for (size_t i=0; i<count; ++i) {
+        const bench_result_T *const r = &results[i];
+        printf("%-17s %7zu %9.3f %9.3f %9.3f %9.3f %10.1f %9.3f\n",
+               r->name, r->count,
+               ns_to_ms(quantile_ns(r->latency_ns, r->count, 500)),
+               ns_to_ms(quantile_ns(r->latency_ns, r->count, 900)),
+               ns_to_ms(quantile_ns(r->latency_ns, r->count, 990)),
+               ns_to_ms(r->latency_ns[r->count-1]),
+               r->per_s,
+               ns_to_ms(r->usb_p50_ns));
+    }
+}
+
+
+static
+int write_json(const char *const path,
+               const bench_result_T *results, const size_t count,
+               const char *const target, const char *const sim_spec)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(4) ));
+
+static
+int write_json(const char *const path,
+               const bench_result_T *results, const size_t count,
+               const char *const target, const char *const sim_spec)
+{
+    FILE *const file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Fatal: cannot create %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+    fprintf(file, "  \"target\": \"%s\",\n", target);
+    if (sim_spec) {
+        fprintf(file, "  \"sim\": \"");
+        for (const char *c=sim_spec; *c != '\0'; ++c) {
+            if ((*c == '"') || (*c == '\\')) {
+                fputc('\\', file);
+            }
+            fputc(*c, file);
+        }
+        fprintf(file, "\",\n");
+    }
+    fprintf(file, "  \"results\": [\n");
+    for (size_t i=0; i<count; ++i) {
+        const bench_result_T *const r = &results[i];
+        fprintf(file,
+                "    {\"name\": \"%s\", \"n\": %zu, "
+                "\"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", "
+                "\"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", "
+                "\"per_s\": %.1f, \"usb_p50_ns\": %" PRIu64 "}%s\n",
+                r->name, r->count,
+                quantile_ns(r->latency_ns, r->count, 500),
+                quantile_ns(r->latency_ns, r->count, 900),
+                quantile_ns(r->latency_ns, r->count, 990),
+                r->latency_ns[r->count-1],
+                r->per_s, r->usb_p50_ns,
+                ((i+1) < count) ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    const bool write_error = ferror(file);
+    if ((fclose(file) != 0) || write_error) {
+        fprintf(stderr, "Fatal: error writing %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_count(size_t *count, const char *const option, const char *const str)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_count(size_t *count, const char *const option, const char *const str)
+{
+    if (str == NULL) {
+        fprintf(stderr, "Fatal: %s requires a value\n", option);
+        return EXIT_FAILURE;
+    }
+    char *endptr;
+    errno = 0;
+    const unsigned long value = strtoul(str, &endptr, 10);
+    if ((errno != 0) || (*str == '\0') || (*endptr != '\0') ||
+        (value < 1) || (value > BENCH_COUNT_MAX)) {
+        fprintf(stderr, "Fatal: %s value must be 1..%lu\n", option, BENCH_COUNT_MAX);
+        return EXIT_FAILURE;
+    }
+    *count = value;
+    return EXIT_SUCCESS;
+}
+
+
+int main(const int argc, const char *const argv[])
+{
+    const char *const prog = argv[0];
+    size_t iterations = BENCH_ITERATIONS_DEFAULT;
+    size_t samples = BENCH_SAMPLES_DEFAULT;
+    const char *json_path = NULL;
+
+    int i = 1;
+    for (; (i < argc) && (argv[i][0] == '-'); ++i) {
+        if (strcmp(argv[i], "--help") == 0) {
+            print_usage(prog);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "--version") == 0) {
+            print_version(prog);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            if (parse_count(&iterations, argv[i], argv[i+1]) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--samples") == 0) {
+            if (parse_count(&samples, argv[i], argv[i+1]) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            ++i;
+        } else if ((strcmp(argv[i], "--json") == 0) && (argv[i+1] != NULL)) {
+            json_path = argv[++i];
+        } else {
+            print_usage(prog);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((i+1) != argc) {
+        print_usage(prog);
+        return EXIT_FAILURE;
+    }
+    const char *const scnp_cli = argv[i];
+
+    /* Settings must always be sent, and actually sent. */
+    unsetenv("SCNP_CLI_DRY_RUN");
+    unsetenv("XDG_RUNTIME_DIR");
+
+    const char *const env_sim = getenv("SCNP_CLI_SIM");
+    if ((env_sim == NULL) || (*env_sim == '\0')) {
+        const char *const check_argv[] = { scnp_cli, "check-permissions", NULL };
+        if (!run_quietly(check_argv)) {
+            setenv("SCNP_CLI_SIM", BENCH_SIM_SPEC, 1);
+        }
+    }
+    const char *const sim_spec = getenv("SCNP_CLI_SIM");
+    const bool sim = (sim_spec != NULL) && (*sim_spec != '\0');
+    char target[256];
+    snprintf(target, sizeof(target), sim ? "sim (SCNP_CLI_SIM=%s)" : "usb device",
+             sim ? sim_spec : "");
+
+    char trace_path[64];
+    snprintf(trace_path, sizeof(trace_path), "scnp-bench.%ld.trace", (long) getpid());
+
+    const size_t command_count = sizeof(bench_commands)/sizeof(bench_commands[0]);
+    const size_t result_count = command_count + 2;
+    bench_result_T *const results = calloc_or_fail(result_count, sizeof(bench_result_T));
+    for (size_t c=0; c<command_count; ++c) {
+        bench_command(&results[c], scnp_cli, trace_path,
+                      &bench_commands[c], iterations);
+    }
+    bench_meter(&results[command_count], scnp_cli, trace_path,
+                "meter", "--rate", "10000", samples);
+    bench_meter(&results[command_count+1], scnp_cli, trace_path,
+                "meter --inflight", "--inflight", "4", samples);
+    remove(trace_path);
+
+    print_table(results, result_count, target);
+    int retval = EXIT_SUCCESS;
+    if (json_path) {
+        retval = write_json(json_path, results, result_count,
+                            sim ? "sim" : "usb", sim ? sim_spec : NULL);
+    }
+
+    for (size_t r=0; r<result_count; ++r) {
+        free(results[r].latency_ns);
+    }
+    free(results);
+    return retval;
+}
@@ -0,0 +1,162 @@
+/* scnp-board-main.c - print the Notepad state board published by scnp-cli
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "auto-config.h"
+
+
+#include "scnp_board.h"
+
+
+static
+void print_version(const char *const prog)
+    __attribute__(( nonnull(1) ));
+
+static
+void print_version(const char *const prog)
+{
+    printf("%s (%s) %s\n"
+           "Copyright (C) 2022 Hans Ulrich Niedermann\n"
+           "\n"
+           "This is free software under the MIT license. There is NO warranty.\n",
+           prog, PACKAGE_NAME, PACKAGE_VERSION);
+}
+
+
+static
+void print_usage(const char *const prog)
+    __attribute__(( nonnull(1) ));
+
+static
+void print_usage(const char *const prog)
+{
+    printf("Usage: %s <NAME>\n"
+           "\n"
+           "Print the settings and the latest meter sample published in the\n"
+           "shared memory board NAME by 'scnp-cli daemon <SOCKET> --board NAME'\n"
+           "or 'scnp-cli meter --board NAME'. Reading the board never talks to\n"
+           "the device or to the publishing process.\n"
+           "\n"
+           "    --help     Print this usage message and exit.\n"
+           "\n"
+           "    --version  Print version message and exit.\n",
+           prog);
+}
+
+
+static
+void print_snapshot(const scnp_board_snapshot_T *snapshot)
+    __attribute__(( nonnull(1) ));
+
+static
+void print_snapshot(const scnp_board_snapshot_T *snapshot)
+{
+    printf("update_count %" PRIu32 "\n", snapshot->update_count);
+    printf("idProduct 0x%04x\n", snapshot->idProduct);
+
+    if (snapshot->valid & SCNP_BOARD_VALID_METER) {
+        printf("meter_sample_count %" PRIu64 "\n", snapshot->meter_sample_count);
+        printf("meter_t_ns %" PRIu64 "\n", snapshot->meter_t_ns);
+        printf("meter_value 0x%08" PRIx32 "\n", snapshot->meter_value);
+        if (snapshot->meter_mdB == INT32_MIN) {
+            printf("meter_dB -inf\n");
+        } else {
+            printf("meter_dB %.3f\n", snapshot->meter_mdB / 1000.0);
+        }
+    }
+
+    if (snapshot->valid & (SCNP_BOARD_VALID_ROUTING | SCNP_BOARD_VALID_DUCKER |
+                           SCNP_BOARD_VALID_RANGE | SCNP_BOARD_VALID_THRESHOLD)) {
+        printf("state_t_ns %" PRIu64 "\n", snapshot->state_t_ns);
+    }
+    if (snapshot->valid & SCNP_BOARD_VALID_ROUTING) {
+        printf("audio_routing %u\n", snapshot->routing_source);
+    }
+    if (snapshot->valid & SCNP_BOARD_VALID_DUCKER) {
+        printf("ducker %s\n", snapshot->ducker_on ? "on" : "off");
+        if (snapshot->ducker_on) {
+            printf("ducker_inputs %u\n", snapshot->ducker_inputs);
+            printf("ducker_release_ms %u\n", snapshot->ducker_release_ms);
+        }
+    }
+    if (snapshot->valid & SCNP_BOARD_VALID_RANGE) {
+        printf("ducker_range 0x%" PRIx32 "\n", snapshot->ducker_range);
+    }
+    if (snapshot->valid & SCNP_BOARD_VALID_THRESHOLD) {
+        printf("ducker_threshold 0x%" PRIx32 "\n", snapshot->ducker_threshold);
+    }
+}
+
+
+int main(const int argc, const char *const argv[])
+{
+    const char *const prog = argv[0];
+
+    if ((argc == 2) && (strcmp(argv[1], "--help") == 0)) {
+        print_usage(prog);
+        return EXIT_SUCCESS;
+    } else if ((argc == 2) && (strcmp(argv[1], "--version") == 0)) {
+        print_version(prog);
+        return EXIT_SUCCESS;
+    } else if ((argc != 2) || (argv[1][0] == '\0')) {
+        print_usage(prog);
+        return EXIT_FAILURE;
+    }
+
+    char name[256];
+    const int len = snprintf(name, sizeof(name), "%s%s",
+                             (argv[1][0] == '/') ? "" : "/", argv[1]);
+    if ((len < 0) || (((size_t) len) >= sizeof(name))) {
+        fprintf(stderr, "Fatal: board name too long\n");
+        return EXIT_FAILURE;
+    }
+
+    scnp_board_T *board = scnp_board_open(name);
+    if (board == NULL) {
+        fprintf(stderr, "Fatal: cannot open board %s: %s\n",
+                name, (errno == EPROTO) ? "unknown board format" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    scnp_board_snapshot_T snapshot;
+    const bool consistent = scnp_board_read(board, &snapshot);
+    scnp_board_close(board);
+    if (!consistent) {
+        fprintf(stderr, "Fatal: board %s stays in the middle of an update,"
+                " its publisher may have died\n", name);
+        return EXIT_FAILURE;
+    }
+
+    printf("board %s\n", name);
+    print_snapshot(&snapshot);
+    return EXIT_SUCCESS;
+}
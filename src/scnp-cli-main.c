@@ -27,11 +27,13 @@
  */
 
 
+#include <ctype.h>
 #include <errno.h>
 #include <float.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -49,14 +51,42 @@
 #include <locale.h>
 #endif
 
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
 
 
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#if HAVE_SPAWN_H
+#include <spawn.h>
+#endif
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+
 #include <libusb.h>
 
 
+#include "dB_conv.h"
+#include "device_cache.h"
 #include "milli_sleep.h"
+#include "monotonic_time.h"
+#include "scnp_board.h"
+#include "scnp_daemon.h"
+#include "scnp_exporter.h"
+#include "meter_stats.h"
+#include "state_shadow.h"
+#include "term_line.h"
+#include "usb_sim.h"
+#include "usb_timing.h"
+#include "usb_trace.h"
+#include "usb_transport.h"
 
 
 typedef enum {
@@ -90,6 +120,31 @@ static
 uint32_t dry_run_value = 0x00001000;
 
 
+/* All USB access goes through this, see usb_transport.h. The
+ * simulator replaces libusb when SCNP_CLI_SIM is set, and --timings
+ * puts usb_transport_timing in front of either. */
+static
+const usb_transport_T *usb = &usb_transport_libusb;
+
+
+/* --timings, --timings-json, or SCNP_CLI_TIMINGS */
+typedef enum {
+    TIMINGS_OFF,
+    TIMINGS_TEXT,
+    TIMINGS_JSON
+} timings_T;
+
+
+static
+timings_T timings = TIMINGS_OFF;
+
+
+/* Only the process which has started timing prints the timings, not
+ * the child processes of --all. */
+static
+pid_t timings_pid;
+
+
 #define COND_OR_FAIL(COND, MSG)                                       \
     do {                                                              \
         const bool cond = (COND);                                     \
@@ -152,6 +207,18 @@ uint32_t dry_run_value = 0x00001000;
     } while (0)
 
 
+#define LIBUSB_OR_RETURN(LIBUSB_RETVAL, MSG)                          \
+    do {                                                              \
+        const int retval = (LIBUSB_RETVAL);                           \
+        const char *const msg = (MSG);                                \
+        if (retval < 0) {                                             \
+            fprintf(stderr, "Error: %s: %s\n", msg,                   \
+                    libusb_strerror(retval));                         \
+            return retval;                                            \
+        }                                                             \
+    } while (0)
+
+
 #ifndef HAVE_EXP10_FUNCTION
 inline static
 double exp10(double x);
@@ -197,14 +264,18 @@ double uint_to_dB(const uint32_t ref_value, const uint32_t uint_value)
 }
 
 
-#define REF_VALUE_RANGE     0x1fffffffUL
-#define REF_VALUE_THRESHOLD 0x007fffffUL
-#define REF_VALUE_METER     0x00ffffffUL
+/* The dB_to_uint_*() and uint_to_dB_meter() functions use the tables
+ * generated at build time (see dB_conv.h) where they can, and fall
+ * back to libm for everything else. */
 
 
 static
 uint32_t dB_to_uint_range(const double range_dB)
 {
+    uint32_t value;
+    if (dB_conv_range(&value, range_dB)) {
+        return value;
+    }
     /* note the tiny "negative" sign */
     return dB_to_uint(REF_VALUE_RANGE, -range_dB);
 }
@@ -213,6 +284,10 @@ uint32_t dB_to_uint_range(const double range_dB)
 static
 uint32_t dB_to_uint_threshold(const double thresh_dB)
 {
+    uint32_t value;
+    if (dB_conv_threshold(&value, thresh_dB)) {
+        return value;
+    }
     return dB_to_uint(REF_VALUE_THRESHOLD, thresh_dB);
 }
 
@@ -220,14 +295,19 @@ uint32_t dB_to_uint_threshold(const double thresh_dB)
 static
 uint32_t dB_to_uint_meter(const double range_dB)
 {
+    uint32_t value;
+    if (dB_conv_meter_value(&value, range_dB)) {
+        return value;
+    }
     return dB_to_uint(REF_VALUE_METER, range_dB);
 }
 
 
+/* Called for every meter sample, so this never calls libm. */
 static
 double uint_to_dB_meter(const uint32_t uint_value)
 {
-    return uint_to_dB(REF_VALUE_METER, uint_value);
+    return dB_conv_meter(uint_value);
 }
 
 
@@ -285,10 +365,10 @@ char *ludh_alloc_string_descriptor(libusb_device_handle *dev_handle,
 
     unsigned char buf[1024];
     const int luret_get_sd_ascii =
-        libusb_get_string_descriptor_ascii(dev_handle,
-                                           index,
-                                           buf,
-                                           sizeof(buf));
+        usb->get_string_descriptor_ascii(dev_handle,
+                                         index,
+                                         buf,
+                                         sizeof(buf));
     LIBUSB_OR_FAIL(luret_get_sd_ascii,
                    "libusb_get_string_descriptor_ascii index");
 
@@ -303,12 +383,195 @@ char *ludh_alloc_string_descriptor(libusb_device_handle *dev_handle,
 }
 
 
+/* Which of the connected Notepad devices to use, as selected by the
+ * --serial, --bus, --address, and --all options. */
+typedef struct {
+    /* NULL for any serial number */
+    const char *serial;
+    /* -1 for any bus or address */
+    int busnum;
+    int devaddr;
+    /* run the commands on all selected devices at the same time */
+    bool all;
+} device_selector_T;
+
+
+static
+device_selector_T device_selector = { NULL, -1, -1, false };
+
+
+/* --device and --fd: use the device behind this device file, or
+ * behind this inherited file descriptor of a device file, instead of
+ * discovering the devices. */
+static
+const char *sys_device_path = NULL;
+
+static
+int sys_device_fd = -1;
+
+
+/* The file descriptor opened for --device, to close with libusb. */
+static
+int sys_device_opened_fd = -1;
+
+
+/* Send settings even when the state shadow says they are in effect. */
+static
+bool force_send = false;
+
+
+/* The device cache, only loaded when a device's strings are needed. */
+static
+device_cache_T device_cache;
+
+
+static
+bool device_cache_loaded = false;
+
+
+/* Ignore the cached strings and read them from the devices again. */
+static
+bool device_cache_refresh = false;
+
+
+/* Write the port path of the device like "1-4.2" (bus 1, port 4 of
+ * the root hub, port 2 of the hub there). */
+static
+void usbdev_port_path(libusb_device *dev, char *buf, const size_t size)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void usbdev_port_path(libusb_device *dev, char *buf, const size_t size)
+{
+    uint8_t ports[7];
+    const int port_count = usb->get_port_numbers(dev, ports, sizeof(ports));
+    size_t len = (size_t) snprintf(buf, size, "%u-",
+                                   (unsigned int) usb->get_bus_number(dev));
+    if (port_count <= 0) {
+        snprintf(&buf[len], size - len, "0");
+        return;
+    }
+    for (int i=0; (i<port_count) && (len < size); ++i) {
+        len += (size_t) snprintf(&buf[len], size - len, (i == 0) ? "%u" : ".%u",
+                                 (unsigned int) ports[i]);
+    }
+}
+
+
+/* Return the manufacturer, product, and serial strings of the device,
+ * from the device cache if possible. Otherwise, read its string
+ * descriptors through open_handle, or through a handle opened just
+ * for that if open_handle is NULL, and add them to the cache. */
+static
+const device_cache_entry_T *device_identity(libusb_device *dev,
+                                            const struct libusb_device_descriptor *desc,
+                                            libusb_device_handle *open_handle)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+const device_cache_entry_T *device_identity(libusb_device *dev,
+                                            const struct libusb_device_descriptor *desc,
+                                            libusb_device_handle *open_handle)
+{
+    if (!device_cache_loaded) {
+        device_cache_load(&device_cache);
+        device_cache_loaded = true;
+    }
+
+    device_cache_entry_T entry;
+    memset(&entry, 0, sizeof(entry));
+    usbdev_port_path(dev, entry.port_path, sizeof(entry.port_path));
+    entry.devaddr   = usb->get_device_address(dev);
+    entry.idProduct = desc->idProduct;
+    entry.bcdDevice = desc->bcdDevice;
+
+    if (!device_cache_refresh) {
+        const device_cache_entry_T *const cached =
+            device_cache_lookup(&device_cache, entry.port_path, entry.devaddr,
+                                entry.idProduct, entry.bcdDevice);
+        if (cached != NULL) {
+            return cached;
+        }
+    }
+
+    libusb_device_handle *dev_handle = open_handle;
+    if (open_handle == NULL) {
+        const int luret_open =
+            usb->open(dev, &dev_handle);
+        LIBUSB_OR_FAIL(luret_open, "libusb_open");
+    }
+
+    char *buf_manufacturer = ludh_alloc_string_descriptor(dev_handle,
+                                                          desc->iManufacturer);
+    char *buf_product      = ludh_alloc_string_descriptor(dev_handle,
+                                                          desc->iProduct);
+    char *buf_serial       = ludh_alloc_string_descriptor(dev_handle,
+                                                          desc->iSerialNumber);
+
+    snprintf(entry.manufacturer, sizeof(entry.manufacturer), "%s",
+             buf_manufacturer ? buf_manufacturer : "");
+    snprintf(entry.product, sizeof(entry.product), "%s",
+             buf_product ? buf_product : "");
+    snprintf(entry.serial, sizeof(entry.serial), "%s",
+             buf_serial ? buf_serial : "");
+
+    free(buf_serial);
+    free(buf_product);
+    free(buf_manufacturer);
+
+    if (open_handle == NULL) {
+        usb->close(dev_handle);
+    }
+
+    device_cache_store(&device_cache, &entry);
+    return device_cache_lookup(&device_cache, entry.port_path, entry.devaddr,
+                               entry.idProduct, entry.bcdDevice);
+}
+
+
+/* Whether the supported device matches the device_selector. Sets
+ * *identity to the device strings if they have been needed for that. */
+static
+bool usbdev_selected(libusb_device *dev,
+                     const struct libusb_device_descriptor *desc,
+                     const device_cache_entry_T **identity)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+bool usbdev_selected(libusb_device *dev,
+                     const struct libusb_device_descriptor *desc,
+                     const device_cache_entry_T **identity)
+{
+    *identity = NULL;
+
+    const uint8_t busnum  = usb->get_bus_number(dev);
+    const uint8_t devaddr = usb->get_device_address(dev);
+    if (((device_selector.busnum >= 0) &&
+         (device_selector.busnum != busnum)) ||
+        ((device_selector.devaddr >= 0) &&
+         (device_selector.devaddr != devaddr))) {
+        return false;
+    }
+
+    /* Only read the string descriptors when selecting by serial
+     * number, and then preferably from the cache. */
+    if (device_selector.serial != NULL) {
+        *identity = device_identity(dev, desc, NULL);
+        if (strcmp(device_selector.serial, (*identity)->serial) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
 static
-ssize_t supported_device_list(libusb_device ***device_list)
+ssize_t supported_device_list(libusb_device ***device_list, const bool verbose)
     __attribute__(( nonnull(1) ));
 
 static
-ssize_t supported_device_list(libusb_device ***device_list)
+ssize_t supported_device_list(libusb_device ***device_list, const bool verbose)
 {
     libusb_device **ret_list = calloc(128, sizeof(libusb_device *));
     if (ret_list == NULL) {
@@ -319,7 +582,7 @@ ssize_t supported_device_list(libusb_device ***device_list)
 
     libusb_device **devices = NULL;
     const ssize_t luret_get_device_list =
-        libusb_get_device_list(NULL, &devices);
+        usb->get_device_list(&devices);
     if (luret_get_device_list < 0) {
         COND_OR_FAIL(luret_get_device_list >= INT_MIN,
                      "ssize_t value out of int range");
@@ -331,7 +594,7 @@ ssize_t supported_device_list(libusb_device ***device_list)
         libusb_device *dev = devices[i];
         struct libusb_device_descriptor desc;
         const int luret_get_dev_descr =
-            libusb_get_device_descriptor(dev, &desc);
+            usb->get_device_descriptor(dev, &desc);
         LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
 
         for (int k=0; supported_devices[k].idProduct != 0; ++k) {
@@ -339,50 +602,35 @@ ssize_t supported_device_list(libusb_device ***device_list)
             if ((0x05fc == desc.idVendor) &&
                 (np_dev->idProduct == desc.idProduct)) {
 
-                const uint8_t busnum  = libusb_get_bus_number(dev);
-                const uint8_t devaddr = libusb_get_device_address(dev);
-
-                libusb_device_handle *dev_handle;
-                const int luret_open =
-                    libusb_open(dev, &dev_handle);
-                LIBUSB_OR_FAIL(luret_open, "libusb_open");
-
-                const uint8_t version_maj = (desc.bcdDevice >> 8) & 0xff;
-                const uint8_t version_min = (desc.bcdDevice >> 4) & 0x0f;
-                const uint8_t version_sub = (desc.bcdDevice >> 0) & 0x0f;
-
-                char *buf_manufacturer = ludh_alloc_string_descriptor(dev_handle,
-                                                                      desc.iManufacturer);
-                char *buf_product      = ludh_alloc_string_descriptor(dev_handle,
-                                                                      desc.iProduct);
-                char *buf_serial       = ludh_alloc_string_descriptor(dev_handle,
-                                                                      desc.iSerialNumber);
+                const uint8_t busnum  = usb->get_bus_number(dev);
+                const uint8_t devaddr = usb->get_device_address(dev);
+                const device_cache_entry_T *identity = NULL;
+                if (!usbdev_selected(dev, &desc, &identity)) {
+                    continue;
+                }
 
-                if (buf_serial) {
-                    printf("Bus %03d Device %03d: ID %04x:%04x %s %s (version %d.%d.%d, serial %s)\n",
+                if (verbose) {
+                    printf("Bus %03d Device %03d: ID %04x:%04x %s (version %d.%d.%d%s%s)\n",
                            busnum, devaddr, desc.idVendor, desc.idProduct,
-                           buf_manufacturer, buf_product,
-                           version_maj, version_min, version_sub,
-                           buf_serial);
-                } else {
-                    printf("Bus %03d Device %03d: ID %04x:%04x %s %s (version %d.%d.%d)\n",
-                           busnum, devaddr, desc.idVendor, desc.idProduct,
-                           buf_manufacturer, buf_product,
-                           version_maj, version_min, version_sub);
+                           np_dev->name,
+                           (desc.bcdDevice >> 8) & 0xff,
+                           (desc.bcdDevice >> 4) & 0x0f,
+                           (desc.bcdDevice >> 0) & 0x0f,
+                           identity ? ", serial " : "",
+                           identity ? identity->serial : "");
                 }
 
-                free(buf_serial);
-                free(buf_product);
-                free(buf_manufacturer);
-
-                libusb_close(dev_handle);
-
-                libusb_ref_device(dev);
+                COND_OR_FAIL(ret_count < 127, "too many Notepad devices");
+                usb->ref_device(dev);
                 ret_list[ret_count++] = dev;
             }
         }
     }
-    libusb_free_device_list(devices, 1);
+    usb->free_device_list(devices, 1);
+
+    if (device_cache_loaded) {
+        device_cache_save(&device_cache);
+    }
 
     COND_OR_FAIL(ret_count >= 0, "device number overflow... uhm what?");
 
@@ -418,44 +666,251 @@ const notepad_device_T *notepad_device_from_idProduct(const uint16_t idProduct)
 }
 
 
+/* --record: every control transfer is written to this trace (see
+ * usb_trace.h), including the faked ones of a dry run. */
+static
+const char *record_path = NULL;
+
+static
+usb_trace_T record_trace;
+
+
+/* --replay: the IN transfers are answered from this trace instead of
+ * the device, at the original pace times replay_speed, or as fast as
+ * possible for a replay_speed of 0. Nothing is sent to the device. */
+static
+const char *replay_path = NULL;
+
+static
+usb_trace_T replay_trace;
+
+static
+unsigned int replay_speed = 1;
+
+static
+uint64_t replay_start_ns;
+
+static
+uint64_t replay_first_ns;
+
+static
+uint64_t replay_response_count = 0;
+
+
+/* --send-timeout, --read-timeout, and --retries: a control transfer
+ * failing with a transient error (timeout, stall, overflow) is tried
+ * again up to transfer_retries times, waiting TRANSFER_RETRY_DELAY_MS
+ * before the first retry and twice as long before each further one. */
+static
+unsigned int send_timeout_ms = 10000;
+
+static
+unsigned int read_timeout_ms = 10000;
+
+static
+unsigned int transfer_retries = 2;
+
+#define TRANSFER_RETRY_DELAY_MS 10U
+
+#define TRANSFER_TIMEOUT_MAX_MS 60000U
+
+#define TRANSFER_RETRIES_MAX 10U
+
+
+/* Counted over all control transfers, and reported when the device is
+ * closed if anything went wrong. */
+static
+struct {
+    unsigned long transfers;
+    unsigned long retries;
+    unsigned long timeouts;
+    unsigned long failures;
+} transfer_counters;
+
+
+/* Returned by ludh_recv_ctrl_message() at the end of a replay. */
+#define LUDH_END_OF_REPLAY 1
+
+
+/* Record a control transfer with bRequest 16 which started at
+ * start_ns and completed at end_ns, if recording. */
+static
+void usb_record(const uint64_t start_ns, const uint64_t end_ns,
+                const uint8_t request_type, const int status,
+                const uint8_t *data)
+    __attribute__(( nonnull(5) ));
+
+static
+void usb_record(const uint64_t start_ns, const uint64_t end_ns,
+                const uint8_t request_type, const int status,
+                const uint8_t *data)
+{
+    if (record_path == NULL) {
+        return;
+    }
+    if (usb_trace_write(&record_trace, start_ns, end_ns - start_ns,
+                        request_type, 16, status, data) != EXIT_SUCCESS) {
+        fprintf(stderr, "Fatal: error writing trace file %s\n", record_path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* Answer an IN transfer with the next one from the replayed trace,
+ * waiting until it is due. A recorded failure fails the same way, and
+ * as every attempt has been recorded, nothing is retried here.
+ * Returns LUDH_END_OF_REPLAY at the end of the trace. */
+static
+int usb_replay_recv(uint8_t *data)
+    __attribute__(( nonnull(1) ));
+
+static
+int usb_replay_recv(uint8_t *data)
+{
+    usb_trace_record_T record;
+    while (true) {
+        const int ret = usb_trace_read(&replay_trace, &record);
+        if (ret < 0) {
+            fprintf(stderr, "Fatal: error reading trace file %s\n", replay_path);
+            exit(EXIT_FAILURE);
+        } else if (ret == 0) {
+            fprintf(stderr, "replay: end of trace after %" PRIu64 " response(s)\n",
+                    replay_response_count);
+            return LUDH_END_OF_REPLAY;
+        } else if (record.request_type == USB_TRACE_IN) {
+            break;
+        }
+    }
+
+    /* when the transfer completed, relative to the first response */
+    const uint64_t done_ns = record.t_ns + record.latency_ns;
+    if (replay_response_count == 0) {
+        replay_start_ns = monotonic_ns();
+        replay_first_ns = done_ns;
+    }
+    ++replay_response_count;
+    if ((replay_speed > 0) && (done_ns > replay_first_ns)) {
+        sleep_until_ns(replay_start_ns +
+                       (done_ns - replay_first_ns) / replay_speed);
+    }
+
+    ++transfer_counters.transfers;
+    if (record.status == LIBUSB_ERROR_TIMEOUT) {
+        ++transfer_counters.timeouts;
+    }
+    if (record.status < 0) {
+        ++transfer_counters.failures;
+    }
+    LIBUSB_OR_RETURN(record.status, "libusb_control_transfer (replayed)");
+    memcpy(data, record.data, USB_TRACE_DATA_SIZE);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Whether trying a failed transfer again may succeed. */
+static
+bool usb_error_is_transient(const int error);
+
+static
+bool usb_error_is_transient(const int error)
+{
+    switch (error) {
+    case LIBUSB_ERROR_TIMEOUT:
+    case LIBUSB_ERROR_PIPE:
+    case LIBUSB_ERROR_OVERFLOW:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+/* Run a control transfer with bRequest 16, retrying transient errors
+ * with backoff, and recording every attempt. A short transfer counts
+ * as LIBUSB_ERROR_IO. Returns LIBUSB_SUCCESS or the last error. */
+static
+int ludh_control_transfer(libusb_device_handle *device_handle,
+                          const uint8_t request_type,
+                          uint8_t *data, const uint16_t data_size,
+                          const unsigned int timeout_ms)
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int ludh_control_transfer(libusb_device_handle *device_handle,
+                          const uint8_t request_type,
+                          uint8_t *data, const uint16_t data_size,
+                          const unsigned int timeout_ms)
+{
+    ++transfer_counters.transfers;
+    unsigned int delay_ms = TRANSFER_RETRY_DELAY_MS;
+    for (unsigned int attempt=0; true; ++attempt) {
+        const uint64_t start_ns = monotonic_ns();
+        int ret = usb->control_transfer(device_handle,
+                                        request_type /* bmRequestType */,
+                                        16 /* bRequest */,
+                                        0 /* wValue */,
+                                        0 /* wIndex */,
+                                        data, data_size,
+                                        timeout_ms);
+        if ((ret >= 0) && (ret != data_size)) {
+            ret = LIBUSB_ERROR_IO;
+        }
+        usb_record(start_ns, monotonic_ns(), request_type,
+                   (ret < 0) ? ret : 0, data);
+        if (ret >= 0) {
+            return LIBUSB_SUCCESS;
+        }
+        if (ret == LIBUSB_ERROR_TIMEOUT) {
+            ++transfer_counters.timeouts;
+        }
+        if (!usb_error_is_transient(ret) || (attempt >= transfer_retries)) {
+            ++transfer_counters.failures;
+            return ret;
+        }
+        ++transfer_counters.retries;
+        milli_sleep(delay_ms);
+        delay_ms *= 2;
+    }
+}
+
+
+/* Returns LIBUSB_SUCCESS, LUDH_END_OF_REPLAY when a replayed trace has
+ * no more responses, or a negative libusb error. */
 static
-void ludh_recv_ctrl_message(libusb_device_handle *device_handle,
-                            uint8_t *data, const size_t data_size)
+int ludh_recv_ctrl_message(libusb_device_handle *device_handle,
+                           uint8_t *data, const size_t data_size)
     __attribute__(( nonnull(1), nonnull(2) ));
 
 static
-void ludh_recv_ctrl_message(libusb_device_handle *device_handle,
-                            uint8_t *data, const size_t data_size)
+int ludh_recv_ctrl_message(libusb_device_handle *device_handle,
+                           uint8_t *data, const size_t data_size)
 {
     COND_OR_FAIL(data_size < UINT16_MAX, "data_size exceeds uint16_t range");
     const uint16_t u16_data_size = (uint16_t) data_size;
 
     COND_OR_FAIL(data_size == 8, "all known notepad messages are 8 bytes");
 
-    if (dry_run) {
-        data[0] = (dry_run_value >>  0) & 0xff;
-        data[1] = (dry_run_value >>  8) & 0xff;
-        data[2] = (dry_run_value >> 16) & 0xff;
-        data[3] = (dry_run_value >> 24) & 0xff;
-        data[4] = 0x00;
-        data[5] = 0x00;
-        data[6] = 0x00;
-        data[7] = 0x00;
-        return;
-    } else {
-        const int luret_ctrl_transfer =
-            libusb_control_transfer(device_handle,
-                                    0xc0 /* bmRequestType */,
-                                    16 /* bRequest */,
-                                    0 /* wValue */,
-                                    0 /* wIndex */,
-                                    data, u16_data_size,
-                                    10000 /* timeout in ms */);
-        LIBUSB_OR_FAIL(luret_ctrl_transfer, "libusb_control_transfer");
-        COND_OR_FAIL(((size_t) luret_ctrl_transfer) == data_size,
-                     "libusb_control_transfer");
+    if (replay_path != NULL) {
+        return usb_replay_recv(data);
+    } else if (!dry_run) {
+        LIBUSB_OR_RETURN(ludh_control_transfer(device_handle, USB_TRACE_IN,
+                                               data, u16_data_size,
+                                               read_timeout_ms),
+                         "libusb_control_transfer");
+        return LIBUSB_SUCCESS;
     }
 
+    const uint64_t start_ns = monotonic_ns();
+    data[0] = (dry_run_value >>  0) & 0xff;
+    data[1] = (dry_run_value >>  8) & 0xff;
+    data[2] = (dry_run_value >> 16) & 0xff;
+    data[3] = (dry_run_value >> 24) & 0xff;
+    data[4] = 0x00;
+    data[5] = 0x00;
+    data[6] = 0x00;
+    data[7] = 0x00;
+    usb_record(start_ns, monotonic_ns(), USB_TRACE_IN, 0, data);
+
 #if 0
     printf("ludh_recv_ctrl_message got"
            " {%02x %02x %02x %02x %02x %02x %02x %02x}%s\n",
@@ -463,17 +918,19 @@ void ludh_recv_ctrl_message(libusb_device_handle *device_handle,
            data[4], data[5], data[6], data[7],
            dry_run?" (dry-run)":"");
 #endif
+    return LIBUSB_SUCCESS;
 }
 
 
+/* Returns LIBUSB_SUCCESS or a negative libusb error. */
 static
-void ludh_send_ctrl_message(libusb_device_handle *device_handle,
-                            uint8_t *data, const size_t data_size)
+int ludh_send_ctrl_message(libusb_device_handle *device_handle,
+                           uint8_t *data, const size_t data_size)
     __attribute__(( nonnull(1), nonnull(2) ));
 
 static
-void ludh_send_ctrl_message(libusb_device_handle *device_handle,
-                            uint8_t *data, const size_t data_size)
+int ludh_send_ctrl_message(libusb_device_handle *device_handle,
+                           uint8_t *data, const size_t data_size)
 {
     COND_OR_FAIL(data_size < UINT16_MAX, "data_size exceeds uint16_t range");
     const uint16_t u16_data_size = (uint16_t) data_size;
@@ -487,124 +944,210 @@ void ludh_send_ctrl_message(libusb_device_handle *device_handle,
            dry_run?" (dry-run)":"");
 
     if (dry_run) {
-        return;
+        const uint64_t start_ns = monotonic_ns();
+        usb_record(start_ns, monotonic_ns(), USB_TRACE_OUT, 0, data);
+        return LIBUSB_SUCCESS;
     }
 
-    const int luret_ctrl_transfer =
-        libusb_control_transfer(device_handle,
-                                0x40 /* bmRequestType */,
-                                16 /* bRequest */,
-                                0 /* wValue */,
-                                0 /* wIndex */,
-                                data, u16_data_size,
-                                10000 /* timeout in ms */);
-    LIBUSB_OR_FAIL(luret_ctrl_transfer, "libusb_control_transfer");
-    COND_OR_FAIL(((size_t) luret_ctrl_transfer) == data_size,
-                 "libusb_control_transfer");
+    LIBUSB_OR_RETURN(ludh_control_transfer(device_handle, USB_TRACE_OUT,
+                                           data, u16_data_size,
+                                           send_timeout_ms),
+                     "libusb_control_transfer");
+    return LIBUSB_SUCCESS;
 }
 
 
 typedef struct {
     libusb_device *device;
-    struct libusb_device_descriptor *descriptor;
+    struct libusb_device_descriptor descriptor;
     libusb_device_handle *device_handle;
-    const notepad_device_T *const notepad_device;
+    const notepad_device_T *notepad_device;
+    /* the settings last sent to this device (see state_shadow.h) */
+    state_shadow_T shadow;
+    bool shadow_enabled;
+    unsigned long sent_count;
+    unsigned long skipped_count;
 } usbdev_T;
 
 
+/* Whether to skip sending a setting which the state shadow says is
+ * already in effect. Counts the sent and skipped settings. */
 static
-void usbdev_audio_routing(usbdev_T *usbdev, const uint8_t src_idx)
+bool usbdev_skip_unchanged(usbdev_T *usbdev, const bool unchanged)
     __attribute__(( nonnull(1) ));
 
 static
-void usbdev_audio_routing(usbdev_T *usbdev, const uint8_t src_idx)
+bool usbdev_skip_unchanged(usbdev_T *usbdev, const bool unchanged)
 {
-    printf("Setting USB audio source to %d (%s) for device %s\n",
-           src_idx,
-           usbdev->notepad_device->sources[src_idx],
-           usbdev->notepad_device->name);
-
-    uint8_t data[8];
-    data[0] = 0x00;
-    data[1] = 0x00;
-    data[2] = 0x04;
-    data[3] = 0x00;
-    data[4] = src_idx;
-    data[5] = 0x00;
-    data[6] = 0x00;
-    data[7] = 0x00;
-
-    ludh_send_ctrl_message(usbdev->device_handle, data, sizeof(data));
+    if (unchanged && usbdev->shadow_enabled && !force_send) {
+        printf("  already in effect, not sending\n");
+        ++usbdev->skipped_count;
+        return true;
+    }
+    ++usbdev->sent_count;
+    return false;
 }
 
 
+/* Record the SETTINGS (DEVICE_STATE_* bits) which have changed in the
+ * state shadow file. */
 static
-void usbdev_ducker_off(usbdev_T *usbdev)
+void usbdev_shadow_save(usbdev_T *usbdev, const uint32_t settings)
     __attribute__(( nonnull(1) ));
 
 static
-void usbdev_ducker_off(usbdev_T *usbdev)
+void usbdev_shadow_save(usbdev_T *usbdev, const uint32_t settings)
 {
-    printf("ducker-off %s\n", usbdev->notepad_device->name);
-
-    uint8_t data[8];
-    data[0] = 0x00;
-    data[1] = 0x00;
-    data[2] = 0x02;
-    data[3] = 0x80;
-    data[4] = 0x00;
-    data[5] = 0x00;
-    data[6] = 0x00;
-    data[7] = 0x00;
-
-    ludh_send_ctrl_message(usbdev->device_handle, data, sizeof(data));
+    if (usbdev->shadow_enabled) {
+        state_shadow_save(&usbdev->shadow, settings);
+    }
 }
 
 
+/* The shared memory board the latest settings and meter samples are
+ * published to (see scnp_board.h), or NULL when not publishing. */
 static
-void usbdev_ducker_on(usbdev_T *usbdev,
-                      const uint8_t inputs, const uint16_t release_ms)
-    __attribute__(( nonnull(1) ));
+scnp_board_T *board = NULL;
+
 
 static
-void usbdev_ducker_on(usbdev_T *usbdev,
-                      const uint8_t inputs, const uint16_t release_ms)
-{
-    COND_OR_FAIL(inputs < 16, "inputs bitmap out of range (0b0000 to 0b1111)");
-    COND_OR_FAIL(release_ms <= 5000, "release_ms out of range (0 to 5000ms)");
+scnp_board_snapshot_T board_snapshot;
 
-    printf("ducker-on inputs=%u release_ms=%u %s\n",
-           inputs, release_ms, usbdev->notepad_device->name);
 
-    uint8_t data[8];
-    data[0] = 0x00;
-    data[1] = 0x00;
-    data[2] = 0x02;
-    data[3] = 0x80;
-    data[4] = 0x01;
-    data[5] = inputs;
-    data[6] = ((release_ms>>8) & 0xff);
-    data[7] = ((release_ms>>0) & 0xff);
+/* Create the board NAME, with a leading '/' added if NAME lacks one. */
+static
+void board_create_or_fail(const usbdev_T *usbdev, const char *const name)
+    __attribute__(( nonnull(1, 2) ));
 
-    ludh_send_ctrl_message(usbdev->device_handle, data, sizeof(data));
+static
+void board_create_or_fail(const usbdev_T *usbdev, const char *const name)
+{
+    char shm_name[256];
+    const int len = snprintf(shm_name, sizeof(shm_name), "%s%s",
+                             (name[0] == '/') ? "" : "/", name);
+    COND_OR_FAIL((len > 1) && (((size_t) len) < sizeof(shm_name)),
+                 "board name length");
+
+    board = scnp_board_create(shm_name);
+    if (board == NULL) {
+        fprintf(stderr, "Fatal: cannot create board %s: %s\n",
+                shm_name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    memset(&board_snapshot, 0, sizeof(board_snapshot));
+    board_snapshot.idProduct = usbdev->descriptor.idProduct;
+    scnp_board_write(board, &board_snapshot);
 }
 
 
 static
-void usbdev_ducker_range(usbdev_T *usbdev,
-                         const uint32_t range_value)
-    __attribute__(( nonnull(1) ));
-
-static
-void usbdev_ducker_range(usbdev_T *usbdev,
-                         const uint32_t range_value)
+void board_close(void)
 {
-    BE_UINT32_OR_FAIL(range_value, 0x1fffffff);
+    scnp_board_close(board);
+    board = NULL;
+}
 
-    printf("ducker-range range=0x%x=%u %s\n",
-           range_value, range_value, usbdev->notepad_device->name);
 
-    uint8_t data[8];
+static
+void board_publish_state(void)
+{
+    if (board == NULL) {
+        return;
+    }
+    board_snapshot.state_t_ns = realtime_ns();
+    scnp_board_write(board, &board_snapshot);
+}
+
+
+static
+void board_publish_meter(const uint32_t value, const double raw_dB,
+                         const uint64_t rt_ns)
+{
+    if (board == NULL) {
+        return;
+    }
+    ++board_snapshot.meter_sample_count;
+    board_snapshot.meter_t_ns = rt_ns;
+    board_snapshot.meter_value = value;
+    board_snapshot.meter_mdB =
+        isfinite(raw_dB) ? ((int32_t) lround(raw_dB * 1000.0)) : INT32_MIN;
+    board_snapshot.valid |= SCNP_BOARD_VALID_METER;
+    scnp_board_write(board, &board_snapshot);
+}
+
+
+/* Encode the messages for the settings. All known Notepad messages
+ * are 8 bytes. */
+#define NOTEPAD_MSG_SIZE 8
+
+
+static
+void notepad_msg_audio_routing(uint8_t data[NOTEPAD_MSG_SIZE],
+                               const uint8_t src_idx)
+    __attribute__(( nonnull(1) ));
+
+static
+void notepad_msg_audio_routing(uint8_t data[NOTEPAD_MSG_SIZE],
+                               const uint8_t src_idx)
+{
+    data[0] = 0x00;
+    data[1] = 0x00;
+    data[2] = 0x04;
+    data[3] = 0x00;
+    data[4] = src_idx;
+    data[5] = 0x00;
+    data[6] = 0x00;
+    data[7] = 0x00;
+}
+
+
+static
+void notepad_msg_ducker_off(uint8_t data[NOTEPAD_MSG_SIZE])
+    __attribute__(( nonnull(1) ));
+
+static
+void notepad_msg_ducker_off(uint8_t data[NOTEPAD_MSG_SIZE])
+{
+    data[0] = 0x00;
+    data[1] = 0x00;
+    data[2] = 0x02;
+    data[3] = 0x80;
+    data[4] = 0x00;
+    data[5] = 0x00;
+    data[6] = 0x00;
+    data[7] = 0x00;
+}
+
+
+static
+void notepad_msg_ducker_on(uint8_t data[NOTEPAD_MSG_SIZE],
+                           const uint8_t inputs, const uint16_t release_ms)
+    __attribute__(( nonnull(1) ));
+
+static
+void notepad_msg_ducker_on(uint8_t data[NOTEPAD_MSG_SIZE],
+                           const uint8_t inputs, const uint16_t release_ms)
+{
+    data[0] = 0x00;
+    data[1] = 0x00;
+    data[2] = 0x02;
+    data[3] = 0x80;
+    data[4] = 0x01;
+    data[5] = inputs;
+    data[6] = ((release_ms>>8) & 0xff);
+    data[7] = ((release_ms>>0) & 0xff);
+}
+
+
+static
+void notepad_msg_ducker_range(uint8_t data[NOTEPAD_MSG_SIZE],
+                              const uint32_t range_value)
+    __attribute__(( nonnull(1) ));
+
+static
+void notepad_msg_ducker_range(uint8_t data[NOTEPAD_MSG_SIZE],
+                              const uint32_t range_value)
+{
     data[0] = 0x00;
     data[1] = 0x00;
     data[2] = 0x02;
@@ -613,26 +1156,18 @@ void usbdev_ducker_range(usbdev_T *usbdev,
     data[5] = ((range_value>>16) & 0xff);
     data[6] = ((range_value>> 8) & 0xff);
     data[7] = ((range_value>> 0) & 0xff);
-
-    ludh_send_ctrl_message(usbdev->device_handle, data, sizeof(data));
 }
 
 
 static
-void usbdev_ducker_threshold(usbdev_T *usbdev,
-                             const uint32_t thresh_value)
+void notepad_msg_ducker_threshold(uint8_t data[NOTEPAD_MSG_SIZE],
+                                  const uint32_t thresh_value)
     __attribute__(( nonnull(1) ));
 
 static
-void usbdev_ducker_threshold(usbdev_T *usbdev,
-                             const uint32_t thresh_value)
+void notepad_msg_ducker_threshold(uint8_t data[NOTEPAD_MSG_SIZE],
+                                  const uint32_t thresh_value)
 {
-    BE_UINT32_OR_FAIL(thresh_value, 0x007fffff);
-
-    printf("ducker-threshold thresh=0x%x=%u %s\n",
-           thresh_value, thresh_value, usbdev->notepad_device->name);
-
-    uint8_t data[8];
     data[0] = 0x00;
     data[1] = 0x00;
     data[2] = 0x02;
@@ -641,678 +1176,5635 @@ void usbdev_ducker_threshold(usbdev_T *usbdev,
     data[5] = ((thresh_value>>16) & 0xff);
     data[6] = ((thresh_value>> 8) & 0xff);
     data[7] = ((thresh_value>> 0) & 0xff);
-
-    ludh_send_ctrl_message(usbdev->device_handle, data, sizeof(data));
 }
 
 
+/* Record that the SETTING (one of the DEVICE_STATE_* bits) now has
+ * its value from VALUES on the device, in the state shadow and on the
+ * board. SENT tells whether we have just sent it, or skipped sending
+ * it because it already was in effect. */
 static
-volatile sig_atomic_t global_abort = false;
-
+void usbdev_setting_in_effect(usbdev_T *usbdev, const uint32_t setting,
+                              const device_state_T *values, const bool sent)
+    __attribute__(( nonnull(1), nonnull(3) ));
 
-extern
-void handle_signal(int unused_signum);
-
-void handle_signal(int unused_signum __attribute__(( unused )))
+static
+void usbdev_setting_in_effect(usbdev_T *usbdev, const uint32_t setting,
+                              const device_state_T *values, const bool sent)
 {
-    global_abort = true;
+    device_state_T *const state = &usbdev->shadow.state;
+    switch (setting) {
+    case DEVICE_STATE_ROUTING:
+        state->routing_source = values->routing_source;
+        board_snapshot.routing_source = values->routing_source;
+        board_snapshot.valid |= SCNP_BOARD_VALID_ROUTING;
+        break;
+    case DEVICE_STATE_DUCKER:
+        state->ducker_on = values->ducker_on;
+        state->ducker_inputs = values->ducker_inputs;
+        state->ducker_release_ms = values->ducker_release_ms;
+        board_snapshot.ducker_on = values->ducker_on;
+        board_snapshot.ducker_inputs = values->ducker_inputs;
+        board_snapshot.ducker_release_ms = values->ducker_release_ms;
+        board_snapshot.valid |= SCNP_BOARD_VALID_DUCKER;
+        /* The device resets range and threshold when enabling the
+         * ducker, and they mean nothing while it is disabled. */
+        if (sent) {
+            state->valid &= ~(DEVICE_STATE_RANGE | DEVICE_STATE_THRESHOLD);
+            board_snapshot.valid &= ~(SCNP_BOARD_VALID_RANGE |
+                                      SCNP_BOARD_VALID_THRESHOLD);
+        }
+        break;
+    case DEVICE_STATE_RANGE:
+        state->ducker_range = values->ducker_range;
+        board_snapshot.ducker_range = values->ducker_range;
+        board_snapshot.valid |= SCNP_BOARD_VALID_RANGE;
+        break;
+    case DEVICE_STATE_THRESHOLD:
+        state->ducker_threshold = values->ducker_threshold;
+        board_snapshot.ducker_threshold = values->ducker_threshold;
+        board_snapshot.valid |= SCNP_BOARD_VALID_THRESHOLD;
+        break;
+    default:
+        COND_OR_FAIL(false, "unknown setting");
+    }
+    state->valid |= setting;
+
+    if (sent) {
+        usbdev_shadow_save(usbdev, (setting == DEVICE_STATE_DUCKER)
+                           ? (DEVICE_STATE_DUCKER | DEVICE_STATE_RANGE |
+                              DEVICE_STATE_THRESHOLD)
+                           : setting);
+    }
+    board_publish_state();
 }
 
 
+/* A failed transfer may or may not have reached the device, so the
+ * setting is no longer known to be in effect. */
 static
-void usbdev_meter(usbdev_T *usbdev)
+void usbdev_setting_unknown(usbdev_T *usbdev, const uint32_t setting)
     __attribute__(( nonnull(1) ));
 
 static
-void usbdev_meter(usbdev_T *usbdev)
+void usbdev_setting_unknown(usbdev_T *usbdev, const uint32_t setting)
 {
-    const int stdout_fileno = fileno(stdout);
-    COND_OR_FAIL(isatty(stdout_fileno),
-                 "The interactive meter only works inside a TTY");
+    usbdev->shadow.state.valid &= ~setting;
+    usbdev_shadow_save(usbdev, setting);
+}
 
-    printf("meter for %s. Press Ctrl-C to quit.\n",
-           usbdev->notepad_device->name);
 
-    uint8_t data[8];
+/* Send one setting unless the state shadow says it is in effect.
+ * Returns LIBUSB_SUCCESS or a negative libusb error. */
+static
+int usbdev_send_setting(usbdev_T *usbdev, const uint32_t setting,
+                        const device_state_T *values,
+                        uint8_t data[NOTEPAD_MSG_SIZE])
+    __attribute__(( nonnull(1), nonnull(3), nonnull(4) ));
 
-    uint32_t min_value = 0xffffffff;
-    uint32_t max_value = 0x00000000;
+static
+int usbdev_send_setting(usbdev_T *usbdev, const uint32_t setting,
+                        const device_state_T *values,
+                        uint8_t data[NOTEPAD_MSG_SIZE])
+{
+    const bool unchanged =
+        device_state_matches(&usbdev->shadow.state, setting, values);
+    const bool sent = !usbdev_skip_unchanged(usbdev, unchanged);
+    if (sent) {
+        const int ret = ludh_send_ctrl_message(usbdev->device_handle,
+                                               data, NOTEPAD_MSG_SIZE);
+        if (ret < 0) {
+            usbdev_setting_unknown(usbdev, setting);
+            return ret;
+        }
+    }
+    usbdev_setting_in_effect(usbdev, setting, values, sent);
+    return LIBUSB_SUCCESS;
+}
 
-    double min_double = +DBL_MAX;
-    double max_double = -DBL_MAX;
 
-    /* We could use ANSI colors which might not be available. We could
-     * determine the terminal width. termcap is complex. And we are
-     * lazy. */
+static
+int usbdev_audio_routing(usbdev_T *usbdev, const uint8_t src_idx)
+    __attribute__(( nonnull(1) ));
 
-#define METER_WIDTH 63UL
+static
+int usbdev_audio_routing(usbdev_T *usbdev, const uint8_t src_idx)
+{
+    printf("Setting USB audio source to %d (%s) for device %s\n",
+           src_idx,
+           usbdev->notepad_device->sources[src_idx],
+           usbdev->notepad_device->name);
 
-    /* worst case: utf-8 with 3 bytes/character */
-    char meterbuf[3*76];
-    meterbuf[0] = '\0'; /* should be overwritten, but make certain */
+    uint8_t data[NOTEPAD_MSG_SIZE];
+    notepad_msg_audio_routing(data, src_idx);
 
-    signal(SIGINT, handle_signal);
+    device_state_T values;
+    memset(&values, 0, sizeof(values));
+    values.routing_source = src_idx;
+    return usbdev_send_setting(usbdev, DEVICE_STATE_ROUTING, &values, data);
+}
 
-    printf("uintval   dB    bar graph\n");
 
-    while (true) {
-        ludh_recv_ctrl_message(usbdev->device_handle, data, sizeof(data));
-        const uint32_t cur_value =
-            (((uint32_t)data[0])<< 0) |
-            (((uint32_t)data[1])<< 8) |
-            (((uint32_t)data[2])<<16) |
-            (((uint32_t)data[3])<<24);
-        if (cur_value < min_value) {
-            min_value = cur_value;
-        }
-        if (cur_value > max_value) {
-            max_value = cur_value;
-        }
-
-        /* original dB value can be slightly outside the -100.0 .. 0.0 range */
-        const double raw_dB  = uint_to_dB_meter(cur_value);
-        const double raw_dB1 = (raw_dB < -100.0) ? -100.0 : raw_dB;
-        /* dB value constrained into -100.0 to 0.0 interval */
-        const double dB      = (raw_dB1 > 0.0) ? 0.0 : raw_dB1;
-
-        if (raw_dB < min_double) {
-            min_double = raw_dB;
-        }
-        if (raw_dB > max_double) {
-            max_double = raw_dB;
-        }
-
-        /* Times 8 because of eighths granularity in the UTF-8 meter. */
-        const double d_idx8tms = ((100.0 + dB) * METER_WIDTH) * 0.01 * 8;
-        const uint32_t idx8tms = (uint32_t) d_idx8tms;
-        const uint32_t idx_int = idx8tms / 8;
-        const uint32_t idx_8th = idx8tms % 8;
-        COND_OR_FAIL(idx_int <= METER_WIDTH, "value range exceeded");
-
-        char *dst = meterbuf;
-        switch (output_charset) {
-        case CHARSET_ASCII:
-            /* produce a meterbuf string like "[#####---]" */
-            *dst++ = '[';
-            for (size_t i=1; i<1+idx_int; ++i) {
-                *dst++ = '#';
-            }
-            for (size_t i=1+idx_int; i<1+METER_WIDTH; ++i) {
-                *dst++ = '-';
-            }
-            *dst++ = ']';
-            *dst++ = '\0';
-            break;
-        case CHARSET_UTF8:
-            /* produce a meterbuf string like " █████▌  " */
-            *dst++ = ' ';
-            for (size_t i=1; i<1+idx_int; ++i) {
-                for (char *src="█"; *src; ++src) {
-                    *dst++ = *src;
-                }
-            }
-            static const char *const eighths_blocks[] = {
-                " ", /* [0] SPACE */
-                "▏", /* [1] LEFT ONE EIGHTH BLOCK */
-                "▎", /* [2] LEFT ONE QUARTER BLOCK */
-                "▍", /* [3] LEFT THREE EIGHTHS BLOCK */
-                "▌", /* [4] LEFT HALF BLOCK */
-                "▋", /* [5] LEFT FIVE EIGHTHS BLOCK */
-                "▊", /* [6] LEFT THREE QUARTERS BLOCK */
-                "▉", /* [7] LEFT SEVEN EIGHTHS BLOCK */
-                "█", /* [8] FULL BLOCK */
-            };
-            for (const char *src=eighths_blocks[idx_8th]; *src; ++src) {
-                *dst++ = *src;
-            }
-            for (size_t i=2+idx_int; i<1+METER_WIDTH; ++i) {
-                *dst++ = ' ';
-            }
-            *dst++ = '\0';
-            break;
-        }
-        printf("%07x %6.1f %s\r", cur_value, dB, meterbuf);
-        fflush(stdout);
+static
+int usbdev_ducker_off(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
 
-        milli_sleep(100UL);
-
-        if (global_abort) {
-            /* When Ctrl-C has been pressed, re-print the meter line
-             * to overwrite the "^C" shown at the beginning of the
-             * line before leaving the loop.
-             *
-             * Only put this after cur_value, dB, and meterbuf have
-             * been filled with useful values.
-             */
-            printf("\r%07x %6.1f %s  \r", cur_value, dB, meterbuf);
-            fflush(stdout);
-            break;
-        }
-    }
+static
+int usbdev_ducker_off(usbdev_T *usbdev)
+{
+    printf("ducker-off %s\n", usbdev->notepad_device->name);
 
-    printf("\n");
-    printf("meter summary:\n"
-           "  %s  %9u = 0x%08x  %6.1fdB\n"
-           "  %s  %9u = 0x%08x  %6.1fdB\n"
-           "",
-           "minimum", min_value, min_value, min_double,
-           "maximum", max_value, max_value, max_double);
+    uint8_t data[NOTEPAD_MSG_SIZE];
+    notepad_msg_ducker_off(data);
+
+    device_state_T values;
+    memset(&values, 0, sizeof(values));
+    values.ducker_on = false;
+    return usbdev_send_setting(usbdev, DEVICE_STATE_DUCKER, &values, data);
 }
 
 
 static
-void usbdev_check_permissions(usbdev_T *usbdev)
+int usbdev_ducker_on(usbdev_T *usbdev,
+                     const uint8_t inputs, const uint16_t release_ms)
     __attribute__(( nonnull(1) ));
 
 static
-void usbdev_check_permissions(usbdev_T *usbdev)
+int usbdev_ducker_on(usbdev_T *usbdev,
+                     const uint8_t inputs, const uint16_t release_ms)
 {
-    (void) usbdev;
-}
+    COND_OR_FAIL(inputs < 16, "inputs bitmap out of range (0b0000 to 0b1111)");
+    COND_OR_FAIL(release_ms <= 5000, "release_ms out of range (0 to 5000ms)");
 
+    printf("ducker-on inputs=%u release_ms=%u %s\n",
+           inputs, release_ms, usbdev->notepad_device->name);
 
-typedef union {
-    struct {
-        uint8_t source_index;
-    } audio_routing;
+    uint8_t data[NOTEPAD_MSG_SIZE];
+    notepad_msg_ducker_on(data, inputs, release_ms);
 
-    struct {
-        uint8_t inputs;
-        uint16_t release_ms;
-    } ducker_on;
+    device_state_T values;
+    memset(&values, 0, sizeof(values));
+    values.ducker_on = true;
+    values.ducker_inputs = inputs;
+    values.ducker_release_ms = release_ms;
+    return usbdev_send_setting(usbdev, DEVICE_STATE_DUCKER, &values, data);
+}
 
-    struct {
-        uint32_t range;
-    } ducker_range;
 
-    struct {
-        uint32_t thresh;
-    } ducker_threshold;
-} command_params_T;
+static
+int usbdev_ducker_range(usbdev_T *usbdev,
+                        const uint32_t range_value)
+    __attribute__(( nonnull(1) ));
 
+static
+int usbdev_ducker_range(usbdev_T *usbdev,
+                        const uint32_t range_value)
+{
+    BE_UINT32_OR_FAIL(range_value, 0x1fffffff);
 
-typedef void (*command_func_T)(usbdev_T *usbdev, command_params_T *params);
+    printf("ducker-range range=0x%x=%u %s\n",
+           range_value, range_value, usbdev->notepad_device->name);
 
+    uint8_t data[NOTEPAD_MSG_SIZE];
+    notepad_msg_ducker_range(data, range_value);
 
-static
-void commandfunc_audio_routing(usbdev_T *usbdev,
-                               command_params_T *params)
-{
-    usbdev_audio_routing(usbdev,
-                         params->audio_routing.source_index);
+    device_state_T values;
+    memset(&values, 0, sizeof(values));
+    values.ducker_range = range_value;
+    return usbdev_send_setting(usbdev, DEVICE_STATE_RANGE, &values, data);
 }
 
 
 static
-void commandfunc_ducker_off(usbdev_T *usbdev,
-                            command_params_T *params __attribute__(( unused )) )
-{
-    usbdev_ducker_off(usbdev);
-}
-
+int usbdev_ducker_threshold(usbdev_T *usbdev,
+                            const uint32_t thresh_value)
+    __attribute__(( nonnull(1) ));
 
 static
-void commandfunc_ducker_on(usbdev_T *usbdev,
-                           command_params_T *params)
+int usbdev_ducker_threshold(usbdev_T *usbdev,
+                            const uint32_t thresh_value)
 {
-    usbdev_ducker_on(usbdev,
-                     params->ducker_on.inputs,
-                     params->ducker_on.release_ms);
+    BE_UINT32_OR_FAIL(thresh_value, 0x007fffff);
+
+    printf("ducker-threshold thresh=0x%x=%u %s\n",
+           thresh_value, thresh_value, usbdev->notepad_device->name);
+
+    uint8_t data[NOTEPAD_MSG_SIZE];
+    notepad_msg_ducker_threshold(data, thresh_value);
+
+    device_state_T values;
+    memset(&values, 0, sizeof(values));
+    values.ducker_threshold = thresh_value;
+    return usbdev_send_setting(usbdev, DEVICE_STATE_THRESHOLD, &values, data);
 }
 
 
+/* A scene sets some or all of the settings at once (see the apply
+ * command). Applying it only sends the messages for the settings not
+ * known to be in effect yet, in the order the protocol description
+ * recommends: enabling the ducker resets its range and threshold, so
+ * the ducker goes before them, and they are sent again whenever the
+ * ducker is. All messages are encoded before any of them is sent. */
+#define SCENE_PLAN_MAX 4
+
+
+typedef struct {
+    uint32_t setting;
+    uint8_t data[NOTEPAD_MSG_SIZE];
+} scene_packet_T;
+
+
 static
-void commandfunc_ducker_range(usbdev_T *usbdev,
-                              command_params_T *params)
+const char *setting_name(const uint32_t setting, const bool ducker_on);
+
+static
+const char *setting_name(const uint32_t setting, const bool ducker_on)
 {
-    usbdev_ducker_range(usbdev,
-                        params->ducker_range.range);
+    switch (setting) {
+    case DEVICE_STATE_ROUTING:   return "audio-routing";
+    case DEVICE_STATE_DUCKER:    return ducker_on ? "ducker-on" : "ducker-off";
+    case DEVICE_STATE_RANGE:     return "ducker-range";
+    case DEVICE_STATE_THRESHOLD: return "ducker-threshold";
+    default:                     return "unknown";
+    }
 }
 
 
 static
-void commandfunc_ducker_threshold(usbdev_T *usbdev,
-                                  command_params_T *params)
-{
-    usbdev_ducker_threshold(usbdev,
-                            params->ducker_threshold.thresh);
-}
+const uint32_t scene_setting_order[SCENE_PLAN_MAX] = {
+    DEVICE_STATE_ROUTING,
+    DEVICE_STATE_DUCKER,
+    DEVICE_STATE_RANGE,
+    DEVICE_STATE_THRESHOLD,
+};
 
 
+/* Plan the messages to get from the CURRENT state to the SCENE, and
+ * return their number. */
 static
-void commandfunc_meter(usbdev_T *usbdev,
-                       command_params_T *params)
-    __attribute__(( nonnull(1) ));
+size_t scene_plan(scene_packet_T packets[SCENE_PLAN_MAX],
+                  const device_state_T *current, const device_state_T *scene,
+                  const bool force)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
 
 static
-void commandfunc_meter(usbdev_T *usbdev,
-                       command_params_T *params __attribute__(( unused )) )
+size_t scene_plan(scene_packet_T packets[SCENE_PLAN_MAX],
+                  const device_state_T *current, const device_state_T *scene,
+                  const bool force)
 {
-    usbdev_meter(usbdev);
+    size_t count = 0;
+    bool ducker_planned = false;
+    for (size_t i=0; i<SCENE_PLAN_MAX; ++i) {
+        const uint32_t setting = scene_setting_order[i];
+        if (!(scene->valid & setting)) {
+            continue;
+        }
+        const bool reset = ducker_planned &&
+            ((setting == DEVICE_STATE_RANGE) ||
+             (setting == DEVICE_STATE_THRESHOLD));
+        if (!force && !reset && device_state_matches(current, setting, scene)) {
+            continue;
+        }
+
+        scene_packet_T *const packet = &packets[count++];
+        packet->setting = setting;
+        switch (setting) {
+        case DEVICE_STATE_ROUTING:
+            notepad_msg_audio_routing(packet->data, scene->routing_source);
+            break;
+        case DEVICE_STATE_DUCKER:
+            if (scene->ducker_on) {
+                notepad_msg_ducker_on(packet->data, scene->ducker_inputs,
+                                      scene->ducker_release_ms);
+            } else {
+                notepad_msg_ducker_off(packet->data);
+            }
+            ducker_planned = true;
+            break;
+        case DEVICE_STATE_RANGE:
+            notepad_msg_ducker_range(packet->data, scene->ducker_range);
+            break;
+        case DEVICE_STATE_THRESHOLD:
+            notepad_msg_ducker_threshold(packet->data, scene->ducker_threshold);
+            break;
+        }
+    }
+    return count;
 }
 
 
 static
-void commandfunc_check_permissions(usbdev_T *usbdev,
-                                   command_params_T *params)
-    __attribute__(( nonnull(1) ));
+int usbdev_apply(usbdev_T *usbdev, const device_state_T *scene)
+    __attribute__(( nonnull(1), nonnull(2) ));
 
 static
-void commandfunc_check_permissions(usbdev_T *usbdev,
-                                   command_params_T *params
-                                   __attribute__(( unused )) )
+int usbdev_apply(usbdev_T *usbdev, const device_state_T *scene)
 {
-    usbdev_check_permissions(usbdev);
+    scene_packet_T packets[SCENE_PLAN_MAX];
+    const size_t count =
+        scene_plan(packets, &usbdev->shadow.state, scene, force_send);
+
+    printf("apply: %zu message(s) planned for device %s\n",
+           count, usbdev->notepad_device->name);
+    for (size_t i=0; i<count; ++i) {
+        const uint8_t *const data = packets[i].data;
+        printf("  %-16s {%02x %02x %02x %02x %02x %02x %02x %02x}\n",
+               setting_name(packets[i].setting, scene->ducker_on),
+               data[0], data[1], data[2], data[3],
+               data[4], data[5], data[6], data[7]);
+    }
+
+    /* Stop at the first failure: the messages after it may depend on
+     * it, like range and threshold on the ducker. */
+    uint32_t sent = 0;
+    for (size_t i=0; i<count; ++i) {
+        const int ret = ludh_send_ctrl_message(usbdev->device_handle,
+                                               packets[i].data,
+                                               NOTEPAD_MSG_SIZE);
+        if (ret < 0) {
+            usbdev_setting_unknown(usbdev, packets[i].setting);
+            return ret;
+        }
+        usbdev_setting_in_effect(usbdev, packets[i].setting, scene, true);
+        sent |= packets[i].setting;
+        ++usbdev->sent_count;
+    }
+
+    for (size_t i=0; i<SCENE_PLAN_MAX; ++i) {
+        const uint32_t setting = scene_setting_order[i];
+        if ((scene->valid & setting) && !(sent & setting)) {
+            usbdev_setting_in_effect(usbdev, setting, scene, false);
+            ++usbdev->skipped_count;
+        }
+    }
+    return LIBUSB_SUCCESS;
 }
 
 
 static
-void run_usbdev_command(command_func_T command_func,
-                        command_params_T *command_params)
-    __attribute__(( nonnull(1), nonnull(2) ));
+volatile sig_atomic_t global_abort = false;
 
-static
-void run_usbdev_command(command_func_T command_func,
-                        command_params_T *command_params)
+
+extern
+void handle_signal(int unused_signum);
+
+void handle_signal(int unused_signum __attribute__(( unused )))
 {
-    const int luret_init =
-        libusb_init(NULL);
-    LIBUSB_OR_FAIL(luret_init, "libusb_init");
+    global_abort = true;
+}
 
-    libusb_device **dev_list;
-    ssize_t dev_count = supported_device_list(&dev_list);
 
-    if (dev_count == 0) {
-        fprintf(stderr, "No Notepad device found\n");
-        exit(EXIT_FAILURE);
-    }
-    if (dev_count > 1) {
-        fprintf(stderr, "Cannot handle more than one Notepad device yet. Sorry.\n");
-        exit(EXIT_FAILURE);
-    }
+/* We could use ANSI colors which might not be available. We could
+ * determine the terminal width. termcap is complex. And we are
+ * lazy. */
 
-    libusb_device *device = dev_list[0];
+#define METER_WIDTH 63UL
 
-    struct libusb_device_descriptor descriptor;
-    const int luret_get_dev_descr =
-        libusb_get_device_descriptor(device, &descriptor);
-    LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
+/* The narrower bar graph leaving room for the --stats text */
+#define METER_STATS_WIDTH 32UL
 
-    const notepad_device_T *const notepad_device =
-        notepad_device_from_idProduct(descriptor.idProduct);
-    COND_OR_FAIL(notepad_device != NULL, "unhandled idProduct");
 
-    libusb_device_handle *device_handle;
-    const int luret_open =
-        libusb_open(device, &device_handle);
-    LIBUSB_OR_FAIL(luret_open, "libusb_open");
+/* Redraw the meter line at most this many times per second (--refresh),
+ * regardless of how fast the samples come in. Each redraw shows the
+ * peak of the samples since the previous one. */
+#define METER_REFRESH_DEFAULT 10U
 
-    usbdev_T usbdev = {
-        device,
-        &descriptor,
-        device_handle,
-        notepad_device
-    };
+#define METER_REFRESH_MAX 100U
 
-    command_func(&usbdev, command_params);
 
-    libusb_close(device_handle);
+/* Upper limit for the number of meter requests in flight at the same
+ * time with the asynchronous meter. */
+#define METER_INFLIGHT_MAX 32U
 
-    for (ssize_t i=0; i<dev_count; ++i) {
-        libusb_unref_device(dev_list[i]);
-    }
 
-    free(dev_list);
+/* The sample rate the meter has always used. */
+#define METER_RATE_DEFAULT 10U
 
-    libusb_exit(NULL);
-}
+#define METER_RATE_MAX 10000U
 
 
-static
-void print_version(const char *const prog);
+/* RMS window (--rms) and peak hold decay time (--peak-decay) */
+#define METER_RMS_WINDOW_DEFAULT_MS 300U
 
-static
-void print_version(const char *const prog)
-{
-    printf("%s (%s) %s\n"
-           "Copyright (C) 2021 Jim Ramsay\n"
-           "Copyright (C) 2021,2022 Hans Ulrich Niedermann\n"
-           "\n"
-           "Permission is hereby granted, free of charge, to any person obtaining a copy\n"
-           "of this software and associated documentation files (the \"Software\"), to deal\n"
-           "in the Software without restriction, including without limitation the rights\n"
-           "to use, copy, modify, merge, publish, distribute, sublicense, and/or sell\n"
-           "copies of the Software, and to permit persons to whom the Software is\n"
-           "furnished to do so, subject to the following conditions:\n"
-           "\n"
-           "The above copyright notice and this permission notice shall be included in all\n"
-           "copies or substantial portions of the Software.\n"
-           "\n"
-           "THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR\n"
-           "IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,\n"
-           "FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE\n"
-           "AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER\n"
-           "LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,\n"
-           "OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE\n"
-           "SOFTWARE.\n"
-           "",
-           prog, PACKAGE_NAME, PACKAGE_VERSION);
+#define METER_PEAK_DECAY_DEFAULT_MS 1000U
+
+#define METER_STATS_TIME_MAX_MS 60000U
+
+
+typedef enum {
+    METER_FORMAT_BAR,     /* interactive bar graph on a TTY */
+    METER_FORMAT_CSV,
+    METER_FORMAT_NDJSON,
+    METER_FORMAT_BINARY,
+} meter_format_T;
+
+
+/* Size of the block buffer for the machine readable meter output */
+#define METER_STREAM_BUFSIZE (64U*1024U)
+
+
+typedef struct {
+    /* 0 means the synchronous meter, and any other value is the
+     * number of asynchronous IN control transfers to keep in flight. */
+    unsigned int inflight;
+
+    meter_format_T format;
+
+    /* NULL for stdout, only used with the machine readable formats */
+    const char *output_path;
+
+    /* set up by meter_open_output() before the device is opened */
+    FILE *stream;
+
+    /* stop after this many samples or seconds, 0 means never */
+    uint64_t count;
+    uint64_t duration_s;
+
+    /* Samples per second, scheduled on absolute deadlines. 0 means
+     * free running, which only makes sense with inflight > 0. */
+    unsigned int rate_hz;
+
+    /* bar graph redraws per second */
+    unsigned int refresh_hz;
+
+    /* show the running statistics on the bar graph line */
+    bool stats;
+    unsigned int rms_window_count;
+    unsigned int rms_window_ms[METER_STATS_RMS_WINDOWS_MAX];
+    unsigned int peak_decay_ms;
+
+    /* 0 means normal scheduling, otherwise the SCHED_FIFO priority */
+    int rt_priority;
+
+    /* -1 means any CPU, otherwise pin the process to this CPU */
+    int cpu;
+
+    bool mlock;
+
+    /* NULL, or the name of the shared memory board to publish to */
+    const char *board_name;
+} meter_params_T;
+
+
+/* Absolute deadline schedule for taking meter samples.
+ *
+ * The deadlines are start + n*period, so the time spent transferring,
+ * drawing and waking up late never accumulates into drift. When a
+ * deadline has been missed completely, we skip to the next deadline
+ * in the future instead of trying to catch up with a burst.
+ */
+typedef struct {
+    uint64_t period_ns;
+    uint64_t next_ns;
+    uint64_t deadline_count;
+    uint64_t missed_count;
+    uint64_t max_late_ns;
+    double sum_late_ns;
+} meter_schedule_T;
+
+
+static
+void meter_schedule_init(meter_schedule_T *schedule, const unsigned int rate_hz)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_schedule_init(meter_schedule_T *schedule, const unsigned int rate_hz)
+{
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->period_ns = (rate_hz > 0) ? (1000000000ULL / rate_hz) : 0;
+    schedule->next_ns = monotonic_ns();
 }
 
 
+/* Account for a sample taken at now_ns for the current deadline, and
+ * advance to the next deadline. */
 static
-void print_usage(const char *const prog);
+void meter_schedule_advance(meter_schedule_T *schedule, const uint64_t now_ns)
+    __attribute__(( nonnull(1) ));
 
 static
-void print_usage(const char *const prog)
+void meter_schedule_advance(meter_schedule_T *schedule, const uint64_t now_ns)
 {
-    printf("Usage: %s <command> <command_params...>\n"
-           "\n"
-           "Gives command line access to the USB control commands for the Soundcraft\n"
-           "Notepad series of mixers to help verify the USB protocol description document.\n"
-           "\n"
-           "Commands:\n"
-           "\n"
-           "    --help     Print this usage message and exit.\n"
-           "\n"
-           "    --version  Print version message and exit.\n"
-           "\n"
-           "    audio-routing <NUM>\n"
-           "               Find a supported device, and set its audio sources.\n"
-           "               There must be exactly one supported device connected.\n"
-           "               The valid source numbers are specific to the device:\n"
-           "\n",
-           prog);
-    for (int i=0; supported_devices[i].idProduct != 0; ++i) {
-        printf("               %s %s\n",
-               supported_devices[i].name, supported_devices[i].source_descr);
-        for (int k=0; k<NOTEPAD_SOURCES_MAX; k++) {
-            printf("                 %d  %s\n",
-                   k, supported_devices[i].sources[k]);
-        }
-        printf("\n");
+    const uint64_t late_ns =
+        (now_ns > schedule->next_ns) ? (now_ns - schedule->next_ns) : 0;
+    ++schedule->deadline_count;
+    schedule->sum_late_ns += (double) late_ns;
+    if (late_ns > schedule->max_late_ns) {
+        schedule->max_late_ns = late_ns;
+    }
+
+    schedule->next_ns += schedule->period_ns;
+    if (now_ns >= schedule->next_ns) {
+        const uint64_t missed = (now_ns - schedule->next_ns) / schedule->period_ns + 1;
+        schedule->missed_count += missed;
+        schedule->next_ns += missed * schedule->period_ns;
     }
-    printf("               Note that on the NOTEPAD-12FX 4-channel audio capture device,\n"
-           "               capture device channels 1+2 are always fed from mixer CH 1+2.\n"
-           "\n"
-           "    check-permissions\n"
-           "               Just open the hardware device, but do not communicate.\n"
-           "\n"
-           "    ducker-off\n"
-           "               Turn off the ducker.\n"
-           "\n"
-           "    ducker-on <INPUTS> <RELEASE>ms\n"
-           "               Turn on the ducker and set the following values:\n"
-           "                 INPUTS (range 0..15) is a bitmask for the input \"selection\"\n"
-           "                         0b0000 =  0 = no inputs watched\n"
-           "                         0b1111 = 15 = all four inputs watched\n"
-           "                         where bit 0 is channel 1, bit 1 is channel 2, etc.\n"
-           "                 RELEASE (range 0..5000) is a the \"release\" time in ms\n"
-           "                         0 = release time 0, 5000 = release time 5000ms=5s\n"
-           "\n"
-           "    ducker-range <HEX_VALUE>|<RANGE>dB\n"
-           "               Set the \"duck range\" to the given value.\n"
-           "               Valid range is 0dB to 90dB, or 0 to 0x1fffffff.\n"
-           "               It may be best to only use this while ducker is on.\n"
-           "\n"
-           "    ducker-threshold <HEX_VALUE>|<THRESH>dB\n"
-           "               Set the \"threshold\" to the given value.\n"
-           "               Valid range is -60dB to 0dB, or 0x000000 to 0x7fffff.\n"
-           "               It may be best to only use this while ducker is on.\n"
-           "\n"
-           "    meter\n"
-           "               Show the meter until you press Ctrl-C\n"
-           "               It may be best to only use this while ducker is on.\n"
-           );
 }
 
 
 static
-int parse_command_audio_routing(const char *const param_sources)
+void meter_schedule_report(const meter_schedule_T *schedule)
     __attribute__(( nonnull(1) ));
 
 static
-int parse_command_audio_routing(const char *const param_sources)
+void meter_schedule_report(const meter_schedule_T *schedule)
 {
-    char *p = NULL;
-    errno = 0;
-    if (*(param_sources) == '\0') {
-        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
-        return EXIT_FAILURE;
-    }
-    const long lval = strtol(param_sources, &p, 10);
-    if ((p == NULL) || (*p != '\0')) {
-        fprintf(stderr, "Fatal: Error converting number\n");
-        return EXIT_FAILURE;
+    if (schedule->deadline_count == 0) {
+        return;
     }
-    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
-        fprintf(stderr, "Fatal: Error converting number: number range\n");
-        return EXIT_FAILURE;
+    printf("  %s  %9" PRIu64 " served, %" PRIu64 " missed"
+           " (period %.3fms, late by %.3fms avg, %.3fms max)\n",
+           "deadlines", schedule->deadline_count, schedule->missed_count,
+           ns_to_ms(schedule->period_ns),
+           schedule->sum_late_ns / ((double) schedule->deadline_count) / 1.0e6,
+           ns_to_ms(schedule->max_late_ns));
+}
+
+
+/* Set up the real-time process properties the user has asked for.
+ * As the user has explicitly asked for them, failure is fatal. */
+static
+void meter_setup_realtime(const meter_params_T *params)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_setup_realtime(const meter_params_T *params)
+{
+    if (params->mlock) {
+#if defined(HAVE_MLOCKALL) && defined(HAVE_SYS_MMAN_H)
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+            perror("mlockall");
+            exit(EXIT_FAILURE);
+        }
+#else
+        fprintf(stderr, "Fatal: --mlock is not supported on this system\n");
+        exit(EXIT_FAILURE);
+#endif
     }
-    if (lval < 0) {
-        fprintf(stderr, "Fatal: Error converting number: negative\n");
-        return EXIT_FAILURE;
+
+    if (params->cpu >= 0) {
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(HAVE_SCHED_H)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(params->cpu, &cpu_set);
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0) {
+            perror("sched_setaffinity");
+            exit(EXIT_FAILURE);
+        }
+#else
+        fprintf(stderr, "Fatal: --cpu is not supported on this system\n");
+        exit(EXIT_FAILURE);
+#endif
     }
-    if (lval > UINT8_MAX) {
-        fprintf(stderr, "Fatal: Error converting number: too large\n");
-        return EXIT_FAILURE;
+
+    if (params->rt_priority > 0) {
+#if defined(HAVE_SCHED_SETSCHEDULER) && defined(HAVE_SCHED_H)
+        struct sched_param sched_param;
+        memset(&sched_param, 0, sizeof(sched_param));
+        sched_param.sched_priority = params->rt_priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &sched_param) < 0) {
+            perror("sched_setscheduler SCHED_FIFO");
+            exit(EXIT_FAILURE);
+        }
+#else
+        fprintf(stderr, "Fatal: --rt-priority is not supported on this system\n");
+        exit(EXIT_FAILURE);
+#endif
     }
+}
 
-    // printf("audio-routing lval=%ld\n", lval);
-    const uint8_t source_index = (uint8_t) lval;
-    COND_OR_RETURN(source_index < NOTEPAD_SOURCES_MAX,
-                   "sources index must be less than 4");
 
-    command_params_T params;
-    params.audio_routing.source_index = source_index;
+typedef struct {
+    uint64_t sample_count;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint64_t last_draw_ns;
+    uint64_t draw_interval_ns;
 
-    run_usbdev_command(commandfunc_audio_routing, &params);
-    return EXIT_SUCCESS;
-}
+    uint64_t min_interval_ns;
+    uint64_t max_interval_ns;
+    double sum_interval_ns;
+    double sumsq_interval_ns;
+
+    uint32_t cur_value;
+    uint32_t min_value;
+    uint32_t max_value;
+
+    double min_double;
+    double max_double;
+
+    /* the highest value since the bar graph has last been drawn */
+    uint32_t peak_value;
+    bool peak_valid;
+
+    meter_stats_T stats;
+
+    term_line_T line;
+    term_line_frame_T frame;
+
+    const meter_params_T *params;
+
+    /* add to monotonic_ns() values to get realtime_ns() values */
+    uint64_t realtime_offset_ns;
+
+    /* set when the --count or --duration limit has been reached */
+    bool done;
+
+    /* reads which failed after all retries, and were skipped */
+    uint64_t error_count;
+} meter_T;
 
 
 static
-int parse_command_ducker_on(const char *const param_inputs,
-                            const char *const param_release_ms)
+void meter_init(meter_T *meter, const meter_params_T *params)
     __attribute__(( nonnull(1), nonnull(2) ));
 
 static
-int parse_command_ducker_on(const char *const param_inputs,
-                            const char *const param_release)
+void meter_init(meter_T *meter, const meter_params_T *params)
 {
-    command_params_T params;
+    memset(meter, 0, sizeof(*meter));
+    meter->params = params;
+    meter->realtime_offset_ns = realtime_ns() - monotonic_ns();
+    meter->min_interval_ns = UINT64_MAX;
+    meter->min_value = 0xffffffff;
+    meter->max_value = 0x00000000;
+    meter->min_double = +DBL_MAX;
+    meter->max_double = -DBL_MAX;
+    meter->draw_interval_ns = 1000000000ULL / params->refresh_hz;
+    meter_stats_init(&meter->stats,
+                     params->rms_window_ms, params->rms_window_count,
+                     params->peak_decay_ms);
+
+    /* The bar graph goes to the terminal with write(), so get
+     * everything printf()ed before it out first. */
+    fflush(stdout);
+    term_line_init(&meter->line, STDOUT_FILENO, isatty(STDOUT_FILENO));
+}
 
-    if (true) {
-        char *p = NULL;
-        errno = 0;
-        if (*(param_inputs) == '\0') {
-            fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
-            return EXIT_FAILURE;
-        }
-        long lval;
-        if (strncmp("0b", param_inputs, 2) == 0) {
-            lval = strtol(&param_inputs[2], &p, 2);
-        } else {
-            lval = strtol(param_inputs, &p, 0);
+
+/* Constrain a dB value into the -100.0 to 0.0 interval of the bar
+ * graph. Values slightly outside that range do happen. */
+static
+double meter_clamp_dB(const double dB);
+
+static
+double meter_clamp_dB(const double dB)
+{
+    const double dB1 = (dB < -100.0) ? -100.0 : dB;
+    return (dB1 > 0.0) ? 0.0 : dB1;
+}
+
+
+/* Draw the peak value since the last time as a bar graph line. With
+ * --stats, the line also shows the running statistics and marks the
+ * held peak in the bar. */
+static
+void meter_draw(meter_T *meter)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_draw(meter_T *meter)
+{
+    const uint32_t value = meter->peak_value;
+    meter->peak_valid = false;
+
+    const bool stats = meter->params->stats;
+    const size_t width = stats ? METER_STATS_WIDTH : METER_WIDTH;
+    const double dB = meter_clamp_dB(uint_to_dB_meter(value));
+
+    /* Times 8 because of eighths granularity in the UTF-8 meter. */
+    const double d_idx8tms = ((100.0 + dB) * width) * 0.01 * 8;
+    const uint32_t idx8tms = (uint32_t) d_idx8tms;
+    const uint32_t idx_int = idx8tms / 8;
+    const uint32_t idx_8th = idx8tms % 8;
+    COND_OR_FAIL(idx_int <= width, "value range exceeded");
+
+    /* the cell marking the held peak, or none if >= width */
+    size_t hold_cell = width;
+
+    term_line_frame_T *const frame = &meter->frame;
+    term_line_frame_clear(frame);
+
+    char text[64];
+    if (stats) {
+        const double hold_dB =
+            meter_clamp_dB(meter_stats_peak_hold_dB(&meter->stats));
+        hold_cell = (size_t) (((100.0 + hold_dB) * width) * 0.01);
+        if (hold_cell >= width) {
+            hold_cell = width - 1;
         }
-        // fprintf(stderr, "value conversion: %s to %ld\n", param_inputs, lval);
-        if ((p == NULL) || (*p != '\0')) {
-            fprintf(stderr, "Fatal: Error converting number\n");
-            return EXIT_FAILURE;
+        snprintf(text, sizeof(text), "%6.1f rms %6.1f hold %6.1f p95 %6.1f ",
+                 dB, meter_stats_rms_dB(&meter->stats, 0), hold_dB,
+                 meter_stats_quantile_dB(&meter->stats, 0.95));
+    } else {
+        snprintf(text, sizeof(text), "%07x %6.1f ", value, dB);
+    }
+    term_line_frame_add_text(frame, text);
+
+    switch (output_charset) {
+    case CHARSET_ASCII:
+        /* produce a line like "[#####---|-]" */
+        term_line_frame_add_cell(frame, "[");
+        for (size_t i=0; i<width; ++i) {
+            if (i < idx_int) {
+                term_line_frame_add_cell(frame, "#");
+            } else if (i == hold_cell) {
+                term_line_frame_add_cell(frame, "|");
+            } else {
+                term_line_frame_add_cell(frame, "-");
+            }
         }
-        if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
-            fprintf(stderr, "Fatal: Error converting number: number range\n");
-            return EXIT_FAILURE;
+        term_line_frame_add_cell(frame, "]");
+        break;
+    case CHARSET_UTF8:
+        /* produce a line like " █████▌  │ " */
+        term_line_frame_add_cell(frame, " ");
+        static const char *const eighths_blocks[] = {
+            " ", /* [0] SPACE */
+            "▏", /* [1] LEFT ONE EIGHTH BLOCK */
+            "▎", /* [2] LEFT ONE QUARTER BLOCK */
+            "▍", /* [3] LEFT THREE EIGHTHS BLOCK */
+            "▌", /* [4] LEFT HALF BLOCK */
+            "▋", /* [5] LEFT FIVE EIGHTHS BLOCK */
+            "▊", /* [6] LEFT THREE QUARTERS BLOCK */
+            "▉", /* [7] LEFT SEVEN EIGHTHS BLOCK */
+            "█", /* [8] FULL BLOCK */
+        };
+        for (size_t i=0; i<width; ++i) {
+            if (i < idx_int) {
+                term_line_frame_add_cell(frame, eighths_blocks[8]);
+            } else if ((i == idx_int) && (idx_8th > 0)) {
+                term_line_frame_add_cell(frame, eighths_blocks[idx_8th]);
+            } else if (i == hold_cell) {
+                term_line_frame_add_cell(frame, "│"); /* BOX DRAWINGS LIGHT VERTICAL */
+            } else {
+                term_line_frame_add_cell(frame, " ");
+            }
         }
-        if (lval < 0) {
-            fprintf(stderr, "Fatal: Error converting number: negative\n");
-            return EXIT_FAILURE;
+        break;
+    }
+
+    if (term_line_draw(&meter->line, frame) < 0) {
+        perror("Fatal: writing the meter");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static
+void put_le32(uint8_t *dst, const uint32_t value)
+    __attribute__(( nonnull(1) ));
+
+static
+void put_le32(uint8_t *dst, const uint32_t value)
+{
+    dst[0] = (value >>  0) & 0xff;
+    dst[1] = (value >>  8) & 0xff;
+    dst[2] = (value >> 16) & 0xff;
+    dst[3] = (value >> 24) & 0xff;
+}
+
+
+/* Binary meter records are 16 bytes, all fields little endian:
+ *
+ *   offset 0  uint64_t  sample time in ns since the Unix epoch
+ *   offset 8  uint32_t  raw meter value
+ *   offset 12 int32_t   meter value in 1/1000 dB, INT32_MIN for -inf
+ */
+#define METER_BINARY_RECORD_SIZE 16
+
+
+static
+void meter_write_sample(meter_T *meter, const uint64_t t_ns,
+                        const uint32_t value, const double raw_dB)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_write_sample(meter_T *meter, const uint64_t t_ns,
+                        const uint32_t value, const double raw_dB)
+{
+    FILE *stream = meter->params->stream;
+    const uint64_t rt_ns = t_ns + meter->realtime_offset_ns;
+    const bool finite = isfinite(raw_dB);
+
+    switch (meter->params->format) {
+    case METER_FORMAT_BAR:
+        break;
+    case METER_FORMAT_CSV:
+        if (finite) {
+            fprintf(stream, "%" PRIu64 ",%u,%.3f\n", rt_ns, value, raw_dB);
+        } else {
+            fprintf(stream, "%" PRIu64 ",%u,-inf\n", rt_ns, value);
         }
-        if (lval > UINT8_MAX) {
-            fprintf(stderr, "Fatal: Error converting number: too large\n");
-            return EXIT_FAILURE;
+        break;
+    case METER_FORMAT_NDJSON:
+        if (finite) {
+            fprintf(stream, "{\"t_ns\":%" PRIu64 ",\"value\":%u,\"dB\":%.3f}\n",
+                    rt_ns, value, raw_dB);
+        } else {
+            fprintf(stream, "{\"t_ns\":%" PRIu64 ",\"value\":%u,\"dB\":null}\n",
+                    rt_ns, value);
         }
-        /* range check input_set */
-        if (lval > 15) {
-            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
-            return EXIT_FAILURE;
+        break;
+    case METER_FORMAT_BINARY:
+        if (true) {
+            const int32_t mdB = finite ? ((int32_t) lround(raw_dB * 1000.0)) : INT32_MIN;
+            uint8_t record[METER_BINARY_RECORD_SIZE];
+            put_le32(&record[0],  (uint32_t) (rt_ns >>  0));
+            put_le32(&record[4],  (uint32_t) (rt_ns >> 32));
+            put_le32(&record[8],  value);
+            put_le32(&record[12], (uint32_t) mdB);
+            fwrite(record, sizeof(record), 1, stream);
         }
-        params.ducker_on.inputs = (uint8_t) lval;
+        break;
     }
+}
 
-    if (true) {
-        char *p = NULL;
-        errno = 0;
-        if (*(param_release) == '\0') {
-            fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
-            return EXIT_FAILURE;
-        }
-        const long lval = strtol(param_release, &p, 10);
-        if (p == NULL) {
-            fprintf(stderr, "Fatal: Error converting number\n");
-            return EXIT_FAILURE;
+
+static
+void meter_add_sample(meter_T *meter,
+                      const uint32_t cur_value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_add_sample(meter_T *meter,
+                      const uint32_t cur_value, const uint64_t t_ns)
+{
+    if (meter->sample_count == 0) {
+        meter->first_ns = t_ns;
+    } else {
+        const uint64_t interval_ns = t_ns - meter->last_ns;
+        if (interval_ns < meter->min_interval_ns) {
+            meter->min_interval_ns = interval_ns;
         }
-        if (strcmp(p, "ms") != 0) {
-            fprintf(stderr, "Fatal: Missing unit (ms)\n");
-            return EXIT_FAILURE;
+        if (interval_ns > meter->max_interval_ns) {
+            meter->max_interval_ns = interval_ns;
+        }
+        const double d_interval_ns = (double) interval_ns;
+        meter->sum_interval_ns += d_interval_ns;
+        meter->sumsq_interval_ns += d_interval_ns * d_interval_ns;
+    }
+    meter->last_ns = t_ns;
+    ++meter->sample_count;
+
+    meter->cur_value = cur_value;
+    if (cur_value < meter->min_value) {
+        meter->min_value = cur_value;
+    }
+    if (cur_value > meter->max_value) {
+        meter->max_value = cur_value;
+    }
+
+    const double raw_dB = uint_to_dB_meter(cur_value);
+
+    if (raw_dB < meter->min_double) {
+        meter->min_double = raw_dB;
+    }
+    if (raw_dB > meter->max_double) {
+        meter->max_double = raw_dB;
+    }
+
+    meter_stats_add(&meter->stats,
+                    ((double) cur_value) / ((double) REF_VALUE_METER),
+                    raw_dB, t_ns);
+
+    board_publish_meter(cur_value, raw_dB, t_ns + meter->realtime_offset_ns);
+
+    if (meter->params->format != METER_FORMAT_BAR) {
+        meter_write_sample(meter, t_ns, cur_value, raw_dB);
+    } else {
+        if (!meter->peak_valid || (cur_value > meter->peak_value)) {
+            meter->peak_value = cur_value;
+            meter->peak_valid = true;
+        }
+        if ((meter->sample_count == 1) ||
+            ((t_ns - meter->last_draw_ns) >= meter->draw_interval_ns)) {
+            meter->last_draw_ns = t_ns;
+            meter_draw(meter);
+        }
+    }
+
+    if ((meter->params->count > 0) &&
+        (meter->sample_count >= meter->params->count)) {
+        meter->done = true;
+    }
+    if ((meter->params->duration_s > 0) &&
+        ((t_ns - meter->first_ns) >= (meter->params->duration_s * 1000000000ULL))) {
+        meter->done = true;
+    }
+}
+
+
+static
+void meter_finish(meter_T *meter)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_finish(meter_T *meter)
+{
+    if (meter->params->format != METER_FORMAT_BAR) {
+        if ((fflush(meter->params->stream) != 0) ||
+            ferror(meter->params->stream)) {
+            fprintf(stderr, "Fatal: error writing meter output\n");
+            exit(EXIT_FAILURE);
+        }
+    } else if (meter->sample_count > 0) {
+        /* When Ctrl-C has been pressed, re-print the meter line to
+         * overwrite the "^C" shown at the beginning of the line. */
+        term_line_invalidate(&meter->line);
+        if (term_line_draw(&meter->line, &meter->frame) < 0) {
+            perror("Fatal: writing the meter");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("\n");
+    printf("meter summary:\n");
+    if (meter->sample_count > 0) {
+        printf("  %s  %9u = 0x%08x  %6.1fdB\n"
+               "  %s  %9u = 0x%08x  %6.1fdB\n"
+               "",
+               "minimum", meter->min_value, meter->min_value, meter->min_double,
+               "maximum", meter->max_value, meter->max_value, meter->max_double);
+    }
+
+    if (meter->sample_count > 1) {
+        const uint64_t duration_ns = meter->last_ns - meter->first_ns;
+        const double intervals = (double) (meter->sample_count - 1);
+        const double rate = intervals * 1.0e9 / ((double) duration_ns);
+        const double mean_ns = meter->sum_interval_ns / intervals;
+        const double var_ns = meter->sumsq_interval_ns / intervals - mean_ns * mean_ns;
+        const double jitter_ns = (var_ns > 0.0) ? sqrt(var_ns) : 0.0;
+        printf("  %s  %9" PRIu64 " in %.3fs = %.1f/s\n"
+               "  %s  %.3fms avg, %.3fms min, %.3fms max, %.3fms jitter (stddev)\n",
+               "samples", meter->sample_count,
+               ((double) duration_ns) / 1.0e9, rate,
+               "interval", mean_ns / 1.0e6,
+               ns_to_ms(meter->min_interval_ns),
+               ns_to_ms(meter->max_interval_ns),
+               jitter_ns / 1.0e6);
+    }
+
+    if (meter->error_count > 0) {
+        printf("  %s  %9" PRIu64 " failed read(s) skipped\n",
+               "errors  ", meter->error_count);
+    }
+
+    if (meter->sample_count > 0) {
+        const meter_stats_T *const stats = &meter->stats;
+        printf("  %s  %6.1fdB session", "rms    ",
+               meter_stats_session_rms_dB(stats));
+        for (unsigned int i=0; i<stats->rms_window_count; ++i) {
+            printf(", %6.1fdB %ums",
+                   meter_stats_rms_dB(stats, i), meter->params->rms_window_ms[i]);
+        }
+        printf("\n"
+               "  %s  %6.1fdB at the end (decay %ums)\n"
+               "  %s  p50 %6.1fdB, p95 %6.1fdB, p99 %6.1fdB\n",
+               "hold   ", meter_stats_peak_hold_dB(stats),
+               meter->params->peak_decay_ms,
+               "levels ",
+               meter_stats_quantile_dB(stats, 0.50),
+               meter_stats_quantile_dB(stats, 0.95),
+               meter_stats_quantile_dB(stats, 0.99));
+    }
+
+    if ((meter->params->format == METER_FORMAT_BAR) &&
+        (meter->line.frame_count > 0)) {
+        printf("  %s  %9" PRIu64 " frames, %" PRIu64 " bytes written"
+               " (%.1f bytes/frame)\n",
+               "display", meter->line.frame_count, meter->line.byte_count,
+               ((double) meter->line.byte_count) /
+               ((double) meter->line.frame_count));
+    }
+}
+
+
+static
+uint32_t meter_value_from_data(const uint8_t *data)
+    __attribute__(( nonnull(1) ));
+
+static
+uint32_t meter_value_from_data(const uint8_t *data)
+{
+    return
+        (((uint32_t)data[0])<< 0) |
+        (((uint32_t)data[1])<< 8) |
+        (((uint32_t)data[2])<<16) |
+        (((uint32_t)data[3])<<24);
+}
+
+
+/* The sampling loop all commands reading the meter share: read one
+ * sample on every deadline of the schedule, and hand it to a callback.
+ * A read failing with a transient error is counted and skipped, so one
+ * bad transfer does not end a long session.
+ *
+ * The callback returns LIBUSB_SUCCESS to go on, METER_SAMPLER_STOP to
+ * end the loop, or a negative libusb error.
+ */
+#define METER_SAMPLER_STOP 2
+
+
+typedef int (*meter_sample_func_T)(void *data,
+                                   const uint32_t value, const uint64_t t_ns);
+
+
+typedef struct {
+    /* without a period, a replayed trace sets the pace */
+    meter_schedule_T *schedule;
+    meter_sample_func_T func;
+    void *data;
+
+    uint64_t sample_count;
+    /* reads which failed after all retries, and were skipped */
+    uint64_t error_count;
+    /* the deadline of the last read, and how long it took including
+     * retries */
+    uint64_t deadline_ns;
+    uint64_t read_ns;
+} meter_sampler_T;
+
+
+static
+void meter_sampler_init(meter_sampler_T *sampler, meter_schedule_T *schedule,
+                        const meter_sample_func_T func, void *data)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+void meter_sampler_init(meter_sampler_T *sampler, meter_schedule_T *schedule,
+                        const meter_sample_func_T func, void *data)
+{
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->schedule = schedule;
+    sampler->func = func;
+    sampler->data = data;
+}
+
+
+/* Whether the sample for the current deadline is due at now_ns. */
+static
+bool meter_sampler_due(const meter_sampler_T *sampler, const uint64_t now_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+bool meter_sampler_due(const meter_sampler_T *sampler, const uint64_t now_ns)
+{
+    return (sampler->schedule->period_ns == 0) ||
+        (now_ns >= sampler->schedule->next_ns);
+}
+
+
+/* Take the sample which is due. Returns LIBUSB_SUCCESS,
+ * METER_SAMPLER_STOP, LUDH_END_OF_REPLAY, or a negative libusb error. */
+static
+int meter_sampler_sample(usbdev_T *usbdev, meter_sampler_T *sampler,
+                         const uint64_t now_ns)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int meter_sampler_sample(usbdev_T *usbdev, meter_sampler_T *sampler,
+                         const uint64_t now_ns)
+{
+    sampler->deadline_ns = now_ns;
+    if (sampler->schedule->period_ns > 0) {
+        sampler->deadline_ns = sampler->schedule->next_ns;
+        meter_schedule_advance(sampler->schedule, now_ns);
+    }
+
+    uint8_t data[8];
+    const uint64_t start_ns = monotonic_ns();
+    const int ret =
+        ludh_recv_ctrl_message(usbdev->device_handle, data, sizeof(data));
+    const uint64_t t_ns = monotonic_ns();
+    sampler->read_ns = t_ns - start_ns;
+
+    if (ret == LIBUSB_SUCCESS) {
+        ++sampler->sample_count;
+        return sampler->func(sampler->data, meter_value_from_data(data), t_ns);
+    } else if (usb_error_is_transient(ret)) {
+        ++sampler->error_count;
+        return LIBUSB_SUCCESS;
+    }
+    return ret;
+}
+
+
+/* Sample until the callback stops, the replayed trace ends, or Ctrl-C.
+ * Returns LIBUSB_SUCCESS, LUDH_END_OF_REPLAY, or a negative libusb
+ * error. */
+static
+int usbdev_meter_sampler_run(usbdev_T *usbdev, meter_sampler_T *sampler)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_meter_sampler_run(usbdev_T *usbdev, meter_sampler_T *sampler)
+{
+    while (!global_abort) {
+        const uint64_t now_ns = monotonic_ns();
+        if (!meter_sampler_due(sampler, now_ns)) {
+            sleep_until_ns(sampler->schedule->next_ns);
+            continue; /* check for Ctrl-C and an early wakeup */
+        }
+        const int ret = meter_sampler_sample(usbdev, sampler, now_ns);
+        if (ret == METER_SAMPLER_STOP) {
+            break;
+        } else if (ret != LIBUSB_SUCCESS) {
+            return ret;
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+int meter_sample(void *data, const uint32_t value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+int meter_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    meter_T *const meter = data;
+    meter_add_sample(meter, value, t_ns);
+    return meter->done ? METER_SAMPLER_STOP : LIBUSB_SUCCESS;
+}
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error. */
+static
+int usbdev_meter_sync(usbdev_T *usbdev, meter_T *meter,
+                      meter_schedule_T *schedule)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+int usbdev_meter_sync(usbdev_T *usbdev, meter_T *meter,
+                      meter_schedule_T *schedule)
+{
+    meter_sampler_T sampler;
+    meter_sampler_init(&sampler, schedule, meter_sample, meter);
+    const int ret = meter->done
+        ? LIBUSB_SUCCESS : usbdev_meter_sampler_run(usbdev, &sampler);
+    meter->error_count += sampler.error_count;
+    return (ret == LUDH_END_OF_REPLAY) ? LIBUSB_SUCCESS : ret;
+}
+
+
+typedef struct {
+    meter_T *meter;
+    struct libusb_transfer *transfers[METER_INFLIGHT_MAX];
+    bool transfer_busy[METER_INFLIGHT_MAX];
+    /* when each transfer was submitted, for --record */
+    uint64_t submit_ns[METER_INFLIGHT_MAX];
+    unsigned int transfer_count;
+    unsigned int inflight;
+    /* resubmit from the callback instead of on the next deadline */
+    bool free_running;
+    /* the first error which has ended the meter, if any */
+    int error;
+} meter_async_T;
+
+
+/* The LIBUSB_ERROR_* a synchronous transfer would have returned, for
+ * the trace. */
+static
+int usb_transfer_status_to_error(const struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+int usb_transfer_status_to_error(const struct libusb_transfer *transfer)
+{
+    switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+        return (transfer->actual_length == 8) ? 0 : LIBUSB_ERROR_IO;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+        return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_STALL:
+        return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+        return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+        return LIBUSB_ERROR_OVERFLOW;
+    default:
+        return LIBUSB_ERROR_IO;
+    }
+}
+
+
+static
+void LIBUSB_CALL meter_async_callback(struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+void LIBUSB_CALL meter_async_callback(struct libusb_transfer *transfer)
+{
+    /* Take the timestamp first thing, as close to the completion as
+     * we can get it. */
+    const uint64_t t_ns = monotonic_ns();
+    meter_async_T *async = transfer->user_data;
+
+    unsigned int index = 0;
+    while ((index < async->transfer_count) &&
+           (async->transfers[index] != transfer)) {
+        ++index;
+    }
+    COND_OR_FAIL(index < async->transfer_count, "unknown meter transfer");
+
+    const uint8_t *data = libusb_control_transfer_get_data(transfer);
+    if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+        usb_record(async->submit_ns[index], t_ns, USB_TRACE_IN,
+                   usb_transfer_status_to_error(transfer), data);
+    }
+
+    /* With more transfers in flight, a failed one is not retried but
+     * counted as a skipped read like in the synchronous meter. */
+    if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+        const int status = usb_transfer_status_to_error(transfer);
+        ++transfer_counters.transfers;
+        if (status == LIBUSB_ERROR_TIMEOUT) {
+            ++transfer_counters.timeouts;
+        }
+        if (status == LIBUSB_SUCCESS) {
+            meter_add_sample(async->meter, meter_value_from_data(data), t_ns);
+        } else if (usb_error_is_transient(status)) {
+            ++transfer_counters.failures;
+            ++async->meter->error_count;
+        } else if (async->error == LIBUSB_SUCCESS) {
+            ++transfer_counters.failures;
+            fprintf(stderr, "\nError: meter transfer: %s\n",
+                    libusb_strerror(status));
+            async->error = status;
+        }
+    }
+
+    if (async->free_running && !global_abort && !async->meter->done &&
+        (async->error == LIBUSB_SUCCESS)) {
+        async->submit_ns[index] = monotonic_ns();
+        const int luret_submit = usb->submit_transfer(transfer);
+        if (luret_submit == 0) {
+            return;
+        }
+        fprintf(stderr, "\nError: meter resubmit: %s\n",
+                libusb_strerror(luret_submit));
+        async->error = luret_submit;
+    }
+    async->transfer_busy[index] = false;
+    --async->inflight;
+}
+
+
+/* A failed submit ends the meter like a failed transfer. */
+static
+void meter_async_submit(meter_async_T *async, const unsigned int i)
+    __attribute__(( nonnull(1) ));
+
+static
+void meter_async_submit(meter_async_T *async, const unsigned int i)
+{
+    async->submit_ns[i] = monotonic_ns();
+    const int luret_submit = usb->submit_transfer(async->transfers[i]);
+    if (luret_submit < 0) {
+        fprintf(stderr, "Error: libusb_submit_transfer: %s\n",
+                libusb_strerror(luret_submit));
+        async->error = luret_submit;
+        return;
+    }
+    async->transfer_busy[i] = true;
+    ++async->inflight;
+}
+
+
+/* Keep a number of IN control transfers in flight. When free running,
+ * resubmit each one as soon as it completes. Otherwise, submit one
+ * transfer per deadline as long as not all transfers are busy.
+ *
+ * This is not limited by the sum of USB round trip time, rendering and
+ * sleeping like the synchronous meter.
+ *
+ * Returns LIBUSB_SUCCESS or a negative libusb error. */
+static
+int usbdev_meter_async(usbdev_T *usbdev, meter_T *meter,
+                       meter_schedule_T *schedule,
+                       const unsigned int inflight)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+int usbdev_meter_async(usbdev_T *usbdev, meter_T *meter,
+                       meter_schedule_T *schedule,
+                       const unsigned int inflight)
+{
+    COND_OR_FAIL(inflight <= METER_INFLIGHT_MAX, "too many transfers in flight");
+
+    const bool free_running = (schedule->period_ns == 0);
+
+    if (dry_run) {
+        /* Without a device, pretend every transfer takes 1ms. This
+         * also covers --replay. */
+        if (!free_running) {
+            return usbdev_meter_sync(usbdev, meter, schedule);
+        }
+        meter_sampler_T sampler;
+        meter_sampler_init(&sampler, schedule, meter_sample, meter);
+        int ret = LIBUSB_SUCCESS;
+        while (!global_abort && !meter->done && (ret == LIBUSB_SUCCESS)) {
+            for (unsigned int i=0;
+                 (i<inflight) && !meter->done && (ret == LIBUSB_SUCCESS); ++i) {
+                ret = meter_sampler_sample(usbdev, &sampler, monotonic_ns());
+            }
+            /* replayed responses come at their own pace */
+            if (replay_path == NULL) {
+                milli_sleep(1UL);
+            }
+        }
+        meter->error_count += sampler.error_count;
+        return (ret < 0) ? ret : LIBUSB_SUCCESS;
+    }
+
+    meter_async_T async;
+    memset(&async, 0, sizeof(async));
+    async.meter = meter;
+    async.free_running = free_running;
+
+    for (unsigned int i=0; i<inflight; ++i) {
+        struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+        COND_OR_FAIL(transfer != NULL, "libusb_alloc_transfer");
+        uint8_t *buffer = calloc(1, LIBUSB_CONTROL_SETUP_SIZE + 8);
+        COND_OR_FAIL(buffer != NULL, "calloc transfer buffer");
+        libusb_fill_control_setup(buffer,
+                                  0xc0 /* bmRequestType */,
+                                  16 /* bRequest */,
+                                  0 /* wValue */,
+                                  0 /* wIndex */,
+                                  8 /* wLength */);
+        libusb_fill_control_transfer(transfer, usbdev->device_handle, buffer,
+                                     meter_async_callback, &async,
+                                     read_timeout_ms);
+        transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+        async.transfers[async.transfer_count++] = transfer;
+
+        if (free_running) {
+            meter_async_submit(&async, i);
+        }
+    }
+
+    bool cancelled = false;
+    while ((async.inflight > 0) || (!free_running && !cancelled)) {
+        if ((global_abort || meter->done ||
+             (async.error != LIBUSB_SUCCESS)) && !cancelled) {
+            for (unsigned int i=0; i<async.transfer_count; ++i) {
+                /* Fails harmlessly for transfers not in flight. */
+                (void) usb->cancel_transfer(async.transfers[i]);
+            }
+            cancelled = true;
+            continue;
+        }
+
+        uint64_t wait_ns = 100ULL*1000ULL*1000ULL;
+        if (!free_running && !cancelled) {
+            const uint64_t now_ns = monotonic_ns();
+            if (now_ns >= schedule->next_ns) {
+                bool submitted = false;
+                for (unsigned int i=0; i<async.transfer_count; ++i) {
+                    if (!async.transfer_busy[i]) {
+                        meter_async_submit(&async, i);
+                        submitted = true;
+                        break;
+                    }
+                }
+                if (!submitted) {
+                    /* all transfers still busy: this deadline is lost */
+                    ++schedule->missed_count;
+                    schedule->next_ns += schedule->period_ns;
+                    continue;
+                }
+                meter_schedule_advance(schedule, now_ns);
+                continue;
+            }
+            if ((schedule->next_ns - now_ns) < wait_ns) {
+                wait_ns = schedule->next_ns - now_ns;
+            }
+        }
+
+        struct timeval tv = { (time_t) (wait_ns / 1000000000ULL),
+                              (suseconds_t) ((wait_ns % 1000000000ULL) / 1000ULL) };
+        const int luret_events =
+            usb->handle_events_timeout_completed(&tv, NULL);
+        if ((luret_events < 0) && (luret_events != LIBUSB_ERROR_INTERRUPTED)) {
+            LIBUSB_OR_FAIL(luret_events, "libusb_handle_events");
+        }
+    }
+
+    for (unsigned int i=0; i<async.transfer_count; ++i) {
+        libusb_free_transfer(async.transfers[i]);
+    }
+
+    return async.error;
+}
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error, after printing
+ * the summary of the samples read until then. */
+static
+int usbdev_meter(usbdev_T *usbdev, const meter_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_meter(usbdev_T *usbdev, const meter_params_T *params)
+{
+    if (params->format == METER_FORMAT_BAR) {
+        const int stdout_fileno = fileno(stdout);
+        COND_OR_FAIL(isatty(stdout_fileno),
+                     "The interactive meter only works inside a TTY");
+    }
+
+    printf("meter for %s. Press Ctrl-C to quit.\n",
+           usbdev->notepad_device->name);
+
+    meter_setup_realtime(params);
+
+    meter_T meter;
+    meter_init(&meter, params);
+
+    if (params->board_name != NULL) {
+        board_create_or_fail(usbdev, params->board_name);
+    }
+
+    signal(SIGINT, handle_signal);
+
+    switch (params->format) {
+    case METER_FORMAT_BAR:
+        printf("uintval   dB    bar graph\n");
+        break;
+    case METER_FORMAT_CSV:
+        fprintf(params->stream, "t_ns,value,dB\n");
+        break;
+    case METER_FORMAT_NDJSON:
+    case METER_FORMAT_BINARY:
+        break;
+    }
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->rate_hz);
+
+    const int ret = (params->inflight == 0)
+        ? usbdev_meter_sync(usbdev, &meter, &schedule)
+        : usbdev_meter_async(usbdev, &meter, &schedule, params->inflight);
+
+    meter_finish(&meter);
+    meter_schedule_report(&schedule);
+    board_close();
+
+    if ((params->stream != NULL) && (fclose(params->stream) != 0)) {
+        perror("Fatal: closing meter output");
+        exit(EXIT_FAILURE);
+    }
+    return ret;
+}
+
+
+/* Open the machine readable output of the meter or sweep command at
+ * PATH, or at stdout for a NULL PATH, before the device is opened.
+ *
+ * When that output goes to stdout, everything else we print to stdout
+ * (device list, command messages, summaries) goes to stderr instead,
+ * so that stdout only contains the data.
+ */
+static
+int data_output_open(FILE **stream, const char *const path)
+    __attribute__(( nonnull(1) ));
+
+static
+int data_output_open(FILE **stream, const char *const path)
+{
+    if (path != NULL) {
+        *stream = fopen(path, "wb");
+        if (*stream == NULL) {
+            fprintf(stderr, "Fatal: %s: %s\n", path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    } else {
+        fflush(stdout);
+        const int stream_fd = dup(STDOUT_FILENO);
+        if ((stream_fd < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)) {
+            perror("Fatal: redirecting stdout");
+            return EXIT_FAILURE;
+        }
+        *stream = fdopen(stream_fd, "wb");
+        if (*stream == NULL) {
+            perror("Fatal: fdopen");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static
+int meter_open_output(meter_params_T *params)
+    __attribute__(( nonnull(1) ));
+
+static
+int meter_open_output(meter_params_T *params)
+{
+    params->stream = NULL;
+    if (params->format == METER_FORMAT_BAR) {
+        return EXIT_SUCCESS;
+    }
+
+    if (data_output_open(&params->stream, params->output_path) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if ((params->format == METER_FORMAT_BINARY) &&
+        isatty(fileno(params->stream))) {
+        fprintf(stderr, "Fatal: refusing to write binary meter data to a TTY\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Write in large blocks, not a syscall per sample line. */
+    setvbuf(params->stream, NULL, _IOFBF, METER_STREAM_BUFSIZE);
+    return EXIT_SUCCESS;
+}
+
+
+/* The ramp command fades the ducker range or threshold from one value
+ * to another, on the same kind of deadline schedule as the meter. */
+#define RAMP_DURATION_DEFAULT_MS 1000U
+#define RAMP_DURATION_MAX_MS     600000U
+#define RAMP_RATE_DEFAULT        50U
+#define RAMP_RATE_MAX            1000U
+
+
+typedef enum {
+    RAMP_CURVE_DB,
+    RAMP_CURVE_UINT
+} ramp_curve_T;
+
+
+typedef struct {
+    /* DEVICE_STATE_RANGE or DEVICE_STATE_THRESHOLD */
+    uint32_t setting;
+    uint32_t from_value;
+    uint32_t to_value;
+    unsigned int duration_ms;
+    unsigned int rate_hz;
+    ramp_curve_T curve;
+} ramp_params_T;
+
+
+/* The dB value of a range or threshold value, as the ducker-range and
+ * ducker-threshold commands take it. */
+static
+double ramp_value_to_dB(const uint32_t setting, const uint32_t value);
+
+static
+double ramp_value_to_dB(const uint32_t setting, const uint32_t value)
+{
+    if (setting == DEVICE_STATE_RANGE) {
+        /* subtract instead of negating to not get -0dB */
+        return 0.0 - uint_to_dB(REF_VALUE_RANGE, value);
+    }
+    return uint_to_dB(REF_VALUE_THRESHOLD, value);
+}
+
+
+/* The value at POS (0.0 at the start to 1.0 at the end of the ramp). */
+static
+uint32_t ramp_value(const ramp_params_T *params, const double pos)
+    __attribute__(( nonnull(1) ));
+
+static
+uint32_t ramp_value(const ramp_params_T *params, const double pos)
+{
+    if (pos >= 1.0) {
+        return params->to_value;
+    }
+    switch (params->curve) {
+    case RAMP_CURVE_DB: {
+        const double from_dB = ramp_value_to_dB(params->setting, params->from_value);
+        const double to_dB = ramp_value_to_dB(params->setting, params->to_value);
+        const double dB = from_dB + (to_dB - from_dB) * pos;
+        return (params->setting == DEVICE_STATE_RANGE)
+            ? dB_to_uint_range(dB) : dB_to_uint_threshold(dB);
+    }
+    case RAMP_CURVE_UINT: {
+        const double from = (double) params->from_value;
+        const double to = (double) params->to_value;
+        return (uint32_t) lround(from + (to - from) * pos);
+    }
+    }
+    return params->to_value;
+}
+
+
+/* Send the ramp's values on the deadlines start + n*duration/steps.
+ * The value for a deadline is the one due at that deadline, so a late
+ * step does not stretch the ramp, and steps encoding to the message
+ * just sent are dropped. Returns LIBUSB_SUCCESS or a negative libusb
+ * error. */
+static
+int usbdev_ramp(usbdev_T *usbdev, const ramp_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_ramp(usbdev_T *usbdev, const ramp_params_T *params)
+{
+    const char *const name = setting_name(params->setting, false);
+    uint64_t steps = ((uint64_t) params->duration_ms) * params->rate_hz / 1000U;
+    if (steps == 0) {
+        steps = 1;
+    }
+    const uint64_t duration_ns = ((uint64_t) params->duration_ms) * 1000000ULL;
+
+    printf("ramp: %s from 0x%x (%.1fdB) to 0x%x (%.1fdB) in %" PRIu64
+           " step(s) over %ums (%s curve) for device %s\n",
+           name,
+           params->from_value,
+           ramp_value_to_dB(params->setting, params->from_value),
+           params->to_value,
+           ramp_value_to_dB(params->setting, params->to_value),
+           steps, params->duration_ms,
+           (params->curve == RAMP_CURVE_DB) ? "dB" : "uint",
+           usbdev->notepad_device->name);
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->rate_hz);
+    schedule.period_ns = duration_ns / steps;
+    const uint64_t start_ns = schedule.next_ns;
+
+    signal(SIGINT, handle_signal);
+
+    uint8_t last_data[NOTEPAD_MSG_SIZE];
+    bool last_valid = false;
+    uint32_t last_value = 0;
+    unsigned long sent_count = 0;
+    unsigned long dropped_count = 0;
+    uint64_t end_ns = start_ns;
+    while (!global_abort) {
+        const uint64_t now_ns = monotonic_ns();
+        if (now_ns < schedule.next_ns) {
+            sleep_until_ns(schedule.next_ns);
+            continue; /* check for Ctrl-C and an early wakeup */
+        }
+        const uint64_t deadline_ns = schedule.next_ns;
+        meter_schedule_advance(&schedule, now_ns);
+
+        const double pos =
+            ((double) (deadline_ns - start_ns)) / ((double) duration_ns);
+        const uint32_t value = ramp_value(params, pos);
+        uint8_t data[NOTEPAD_MSG_SIZE];
+        if (params->setting == DEVICE_STATE_RANGE) {
+            notepad_msg_ducker_range(data, value);
+        } else {
+            notepad_msg_ducker_threshold(data, value);
+        }
+
+        if (last_valid && (memcmp(data, last_data, sizeof(data)) == 0)) {
+            ++dropped_count;
+        } else {
+            const int ret = ludh_send_ctrl_message(usbdev->device_handle,
+                                                   data, NOTEPAD_MSG_SIZE);
+            if (ret < 0) {
+                usbdev_setting_unknown(usbdev, params->setting);
+                return ret;
+            }
+            memcpy(last_data, data, sizeof(data));
+            last_valid = true;
+            last_value = value;
+            ++sent_count;
+        }
+        end_ns = monotonic_ns();
+
+        if (pos >= 1.0) {
+            break;
+        }
+    }
+
+    /* Only the last value sent is in effect now. */
+    if (last_valid) {
+        device_state_T values;
+        memset(&values, 0, sizeof(values));
+        values.ducker_range = last_value;
+        values.ducker_threshold = last_value;
+        usbdev_setting_in_effect(usbdev, params->setting, &values, true);
+        ++usbdev->sent_count;
+    }
+
+    const double planned_ms = ns_to_ms(duration_ns);
+    const double actual_ms = ns_to_ms(end_ns - start_ns);
+    printf("ramp summary:\n"
+           "  %s  %9lu sent, %lu dropped as unchanged%s\n"
+           "  %s  %9.3fms, planned %.3fms, off by %+.3fms\n",
+           "packets  ", sent_count, dropped_count,
+           global_abort ? " (interrupted)" : "",
+           "duration ", actual_ms, planned_ms, actual_ms - planned_ms);
+    meter_schedule_report(&schedule);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* The sweep command steps one parameter through a grid, and reads a
+ * burst of meter samples at every step, for characterizing how the
+ * ducker and the meter behave. */
+#define SWEEP_SAMPLES_DEFAULT 100U
+#define SWEEP_SAMPLES_MAX     100000U
+#define SWEEP_RATE_DEFAULT    1000U
+#define SWEEP_SETTLE_DEFAULT_MS 200U
+#define SWEEP_SETTLE_MAX_MS   60000U
+#define SWEEP_RELEASE_DEFAULT_MS 100U
+
+
+typedef enum {
+    SWEEP_THRESHOLD,
+    SWEEP_RANGE,
+    SWEEP_INPUTS,
+    SWEEP_ROUTING
+} sweep_parameter_T;
+
+
+typedef struct {
+    sweep_parameter_T parameter;
+    /* in dB for threshold and range, plain numbers otherwise */
+    long from;
+    long to;
+    long step;
+    unsigned int samples;
+    unsigned int rate_hz;
+    unsigned int settle_ms;
+    /* for the ducker-on messages of an inputs sweep */
+    uint16_t release_ms;
+    /* only METER_FORMAT_CSV and METER_FORMAT_NDJSON */
+    meter_format_T format;
+    const char *output_path;
+    FILE *stream;
+} sweep_params_T;
+
+
+static
+const char *sweep_parameter_name(const sweep_parameter_T parameter);
+
+static
+const char *sweep_parameter_name(const sweep_parameter_T parameter)
+{
+    switch (parameter) {
+    case SWEEP_THRESHOLD: return "threshold";
+    case SWEEP_RANGE:     return "range";
+    case SWEEP_INPUTS:    return "inputs";
+    case SWEEP_ROUTING:   return "routing";
+    }
+    return "unknown";
+}
+
+
+/* Set the swept parameter to VALUE, and store the raw value sent. */
+static
+int sweep_set(usbdev_T *usbdev, const sweep_params_T *params,
+              const long value, uint32_t *raw)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(4) ));
+
+static
+int sweep_set(usbdev_T *usbdev, const sweep_params_T *params,
+              const long value, uint32_t *raw)
+{
+    switch (params->parameter) {
+    case SWEEP_THRESHOLD:
+        *raw = dB_to_uint_threshold((double) value);
+        return usbdev_ducker_threshold(usbdev, *raw);
+    case SWEEP_RANGE:
+        *raw = dB_to_uint_range((double) value);
+        return usbdev_ducker_range(usbdev, *raw);
+    case SWEEP_INPUTS:
+        *raw = (uint32_t) value;
+        return usbdev_ducker_on(usbdev, (uint8_t) value, params->release_ms);
+    case SWEEP_ROUTING:
+        *raw = (uint32_t) value;
+        return usbdev_audio_routing(usbdev, (uint8_t) value);
+    }
+    return LIBUSB_ERROR_INVALID_PARAM;
+}
+
+
+/* The statistics of the meter samples read at one step. */
+typedef struct {
+    uint64_t t_ns;
+    unsigned int sample_count;
+    unsigned int error_count;
+    uint32_t min_value;
+    uint32_t max_value;
+    meter_stats_T stats;
+} sweep_step_T;
+
+
+static
+void sweep_print_dB(FILE *stream, const double dB, const bool json)
+    __attribute__(( nonnull(1) ));
+
+static
+void sweep_print_dB(FILE *stream, const double dB, const bool json)
+{
+    if (isfinite(dB)) {
+        fprintf(stream, "%.3f", dB);
+    } else {
+        fputs(json ? "null" : "-inf", stream);
+    }
+}
+
+
+static
+void sweep_write_step(const sweep_params_T *params, const size_t index,
+                      const long value, const uint32_t raw,
+                      const sweep_step_T *step)
+    __attribute__(( nonnull(1), nonnull(5) ));
+
+static
+void sweep_write_step(const sweep_params_T *params, const size_t index,
+                      const long value, const uint32_t raw,
+                      const sweep_step_T *step)
+{
+    FILE *stream = params->stream;
+    const bool json = (params->format == METER_FORMAT_NDJSON);
+    const bool have_samples = (step->sample_count > 0);
+    const double min_dB = have_samples ? uint_to_dB_meter(step->min_value) : -INFINITY;
+    const double max_dB = have_samples ? uint_to_dB_meter(step->max_value) : -INFINITY;
+    const double dBs[6] = {
+        min_dB,
+        max_dB,
+        have_samples ? meter_stats_session_rms_dB(&step->stats) : -INFINITY,
+        have_samples ? meter_stats_quantile_dB(&step->stats, 0.50) : -INFINITY,
+        have_samples ? meter_stats_quantile_dB(&step->stats, 0.95) : -INFINITY,
+        have_samples ? meter_stats_quantile_dB(&step->stats, 0.99) : -INFINITY,
+    };
+    static const char *const dB_keys[6] = {
+        "min_dB", "max_dB", "rms_dB", "p50_dB", "p95_dB", "p99_dB"
+    };
+
+    if (json) {
+        fprintf(stream, "{\"t_ns\":%" PRIu64 ",\"step\":%zu,\"parameter\":\"%s\","
+                "\"value\":%ld,\"raw\":%" PRIu32 ",\"samples\":%u,\"errors\":%u",
+                step->t_ns, index, sweep_parameter_name(params->parameter),
+                value, raw, step->sample_count, step->error_count);
+        for (size_t i=0; i<6; ++i) {
+            fprintf(stream, ",\"%s\":", dB_keys[i]);
+            sweep_print_dB(stream, dBs[i], true);
+        }
+        fprintf(stream, "}\n");
+    } else {
+        fprintf(stream, "%" PRIu64 ",%zu,%s,%ld,%" PRIu32 ",%u,%u",
+                step->t_ns, index, sweep_parameter_name(params->parameter),
+                value, raw, step->sample_count, step->error_count);
+        for (size_t i=0; i<6; ++i) {
+            fputc(',', stream);
+            sweep_print_dB(stream, dBs[i], false);
+        }
+        fputc('\n', stream);
+    }
+}
+
+
+static
+int sweep_sample(void *data, const uint32_t value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+int sweep_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    sweep_step_T *const step = data;
+    if (value < step->min_value) {
+        step->min_value = value;
+    }
+    if (value > step->max_value) {
+        step->max_value = value;
+    }
+    meter_stats_add(&step->stats, ((double) value) / ((double) REF_VALUE_METER),
+                    uint_to_dB_meter(value), t_ns);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Read the meter samples of one step on a deadline schedule. Returns
+ * LIBUSB_SUCCESS, LUDH_END_OF_REPLAY, or a negative libusb error. */
+static
+int sweep_capture(usbdev_T *usbdev, const sweep_params_T *params,
+                  sweep_step_T *step, meter_schedule_T *schedule)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3), nonnull(4) ));
+
+static
+int sweep_capture(usbdev_T *usbdev, const sweep_params_T *params,
+                  sweep_step_T *step, meter_schedule_T *schedule)
+{
+    memset(step, 0, sizeof(*step));
+    step->t_ns = realtime_ns();
+    step->min_value = UINT32_MAX;
+    const unsigned int rms_window_ms = METER_RMS_WINDOW_DEFAULT_MS;
+    meter_stats_init(&step->stats, &rms_window_ms, 1, 0);
+
+    /* the deadlines start over at every step, after settling; the
+     * failed reads count against the step's samples too */
+    schedule->next_ns = monotonic_ns();
+    meter_sampler_T sampler;
+    meter_sampler_init(&sampler, schedule, sweep_sample, step);
+    int ret = LIBUSB_SUCCESS;
+    while (!global_abort &&
+           ((sampler.sample_count + sampler.error_count) < params->samples)) {
+        const uint64_t now_ns = monotonic_ns();
+        if (!meter_sampler_due(&sampler, now_ns)) {
+            sleep_until_ns(schedule->next_ns);
+            continue; /* check for Ctrl-C and an early wakeup */
+        }
+        ret = meter_sampler_sample(usbdev, &sampler, now_ns);
+        if (ret != LIBUSB_SUCCESS) {
+            break;
+        }
+    }
+    step->sample_count = (unsigned int) sampler.sample_count;
+    step->error_count = (unsigned int) sampler.error_count;
+    return ret;
+}
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error. The steps done
+ * until then have been written either way. */
+static
+int usbdev_sweep(usbdev_T *usbdev, const sweep_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_sweep(usbdev_T *usbdev, const sweep_params_T *params)
+{
+    const long dir = (params->to >= params->from) ? 1 : -1;
+    const long span = (params->to - params->from) * dir;
+    const size_t count = (size_t) (span / params->step) + 1 +
+        (((span % params->step) != 0) ? 1 : 0);
+
+    printf("sweep: %s from %ld to %ld in %zu step(s), %u sample(s) at %uHz"
+           " after %ums each, for device %s\n",
+           sweep_parameter_name(params->parameter),
+           params->from, params->to, count,
+           params->samples, params->rate_hz, params->settle_ms,
+           usbdev->notepad_device->name);
+
+    signal(SIGINT, handle_signal);
+
+    if (params->format == METER_FORMAT_CSV) {
+        fprintf(params->stream, "t_ns,step,parameter,value,raw,samples,errors,"
+                "min_dB,max_dB,rms_dB,p50_dB,p95_dB,p99_dB\n");
+    }
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->rate_hz);
+
+    const uint64_t start_ns = monotonic_ns();
+    int ret = LIBUSB_SUCCESS;
+    size_t done = 0;
+    unsigned long error_count = 0;
+    for (size_t i=0; (i<count) && !global_abort; ++i) {
+        const long value = (i+1 < count)
+            ? (params->from + dir * params->step * ((long) i))
+            : params->to;
+        uint32_t raw = 0;
+        ret = sweep_set(usbdev, params, value, &raw);
+        if (ret < 0) {
+            break;
+        }
+        milli_sleep(params->settle_ms);
+
+        sweep_step_T step;
+        ret = sweep_capture(usbdev, params, &step, &schedule);
+        if (ret < 0) {
+            break;
+        }
+        if (!global_abort) {
+            sweep_write_step(params, i, value, raw, &step);
+            error_count += step.error_count;
+            ++done;
+        }
+        if (ret == LUDH_END_OF_REPLAY) {
+            ret = LIBUSB_SUCCESS;
+            break;
+        }
+    }
+
+    if ((fclose(params->stream) != 0)) {
+        perror("Fatal: closing sweep output");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("sweep summary:\n"
+           "  %s  %9zu of %zu done in %.3fs\n"
+           "  %s  %9lu failed read(s) skipped\n",
+           "steps  ", done, count, ns_to_ms(monotonic_ns() - start_ns) / 1000.0,
+           "errors ", error_count);
+    meter_schedule_report(&schedule);
+    return ret;
+}
+
+
+/* Open the sweep's output before the device is opened. */
+static
+int sweep_open_output(sweep_params_T *params)
+    __attribute__(( nonnull(1) ));
+
+static
+int sweep_open_output(sweep_params_T *params)
+{
+    if (data_output_open(&params->stream, params->output_path) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    /* one line per step, so a long sweep can be watched with tail -f */
+    setvbuf(params->stream, NULL, _IOLBF, 0);
+    return EXIT_SUCCESS;
+}
+
+
+/* The auto-threshold command reads the meter, follows the noise floor
+ * and the speech level with the held floor and peak of meter_stats_T,
+ * and moves the ducker threshold along. Those are running values, so
+ * it runs for as long as needed in constant memory. */
+#define AUTO_THRESHOLD_RATE_DEFAULT           20U
+#define AUTO_THRESHOLD_MARGIN_DEFAULT_DB      10U
+#define AUTO_THRESHOLD_HYSTERESIS_DEFAULT_DB   3U
+#define AUTO_THRESHOLD_INTERVAL_DEFAULT_MS  5000U
+#define AUTO_THRESHOLD_FLOOR_RISE_DEFAULT_MS 30000U
+#define AUTO_THRESHOLD_SPEECH_DECAY_DEFAULT_MS 10000U
+#define AUTO_THRESHOLD_TIME_MAX_MS       3600000U
+
+
+typedef struct {
+    unsigned int rate_hz;
+    unsigned int margin_dB;
+    unsigned int hysteresis_dB;
+    unsigned int interval_ms;
+    unsigned int floor_rise_ms;
+    unsigned int speech_decay_ms;
+    uint64_t duration_s;
+} auto_threshold_params_T;
+
+
+typedef struct {
+    usbdev_T *usbdev;
+    const auto_threshold_params_T *params;
+    meter_stats_T stats;
+    uint64_t start_ns;
+    uint64_t update_ns;
+    long threshold_dB;
+    bool have_threshold;
+    unsigned long update_count;
+} auto_threshold_T;
+
+
+/* The floor follows quieter samples at once and rises with the
+ * --floor-rise time constant, so speech does not lift it. The speech
+ * level is the held peak falling with the --speech-decay time
+ * constant. */
+static
+int auto_threshold_sample(void *data, const uint32_t value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+int auto_threshold_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    auto_threshold_T *const at = data;
+    const auto_threshold_params_T *const params = at->params;
+    const uint64_t duration_ns = params->duration_s * 1000000000ULL;
+    if ((duration_ns > 0) && ((t_ns - at->start_ns) >= duration_ns)) {
+        return METER_SAMPLER_STOP;
+    }
+
+    meter_stats_add(&at->stats, ((double) value) / ((double) REF_VALUE_METER),
+                    meter_clamp_dB(uint_to_dB_meter(value)), t_ns);
+
+    const uint64_t interval_ns = ((uint64_t) params->interval_ms) * 1000000ULL;
+    if ((t_ns - at->update_ns) < interval_ns) {
+        return LIBUSB_SUCCESS;
+    }
+    const double floor_dB = meter_stats_floor_hold_dB(&at->stats);
+    double speech_dB = meter_stats_peak_hold_dB(&at->stats);
+    if (speech_dB < floor_dB) {
+        speech_dB = floor_dB;
+    }
+
+    /* At least the margin above the floor, and half way (in dB) up to
+     * the speech level when that is louder. */
+    double above_dB = (speech_dB - floor_dB) / 2.0;
+    if (above_dB < params->margin_dB) {
+        above_dB = params->margin_dB;
+    }
+    long target_dB = lround(floor_dB + above_dB);
+    target_dB = (target_dB < -60) ? -60 : ((target_dB > 0) ? 0 : target_dB);
+    if (at->have_threshold &&
+        ((target_dB == at->threshold_dB) ||
+         (labs(target_dB - at->threshold_dB) < (long) params->hysteresis_dB))) {
+        return LIBUSB_SUCCESS;
+    }
+
+    printf("auto-threshold: floor %.1fdB, speech %.1fdB, threshold %lddB\n",
+           floor_dB, speech_dB, target_dB);
+    const int ret =
+        usbdev_ducker_threshold(at->usbdev,
+                                dB_to_uint_threshold((double) target_dB));
+    if (ret < 0) {
+        return ret;
+    }
+    at->threshold_dB = target_dB;
+    at->have_threshold = true;
+    at->update_ns = t_ns;
+    ++at->update_count;
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error. */
+static
+int usbdev_auto_threshold(usbdev_T *usbdev,
+                          const auto_threshold_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_auto_threshold(usbdev_T *usbdev,
+                          const auto_threshold_params_T *params)
+{
+    printf("auto-threshold: margin %udB, hysteresis %udB, at most every %ums,"
+           " %uHz meter for device %s\n",
+           params->margin_dB, params->hysteresis_dB, params->interval_ms,
+           params->rate_hz, usbdev->notepad_device->name);
+
+    signal(SIGINT, handle_signal);
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->rate_hz);
+
+    auto_threshold_T at;
+    memset(&at, 0, sizeof(at));
+    at.usbdev = usbdev;
+    at.params = params;
+    at.start_ns = schedule.next_ns;
+    at.update_ns = schedule.next_ns;
+    meter_stats_init(&at.stats, NULL, 0, params->speech_decay_ms);
+    meter_stats_set_floor_rise(&at.stats, params->floor_rise_ms);
+
+    meter_sampler_T sampler;
+    meter_sampler_init(&sampler, &schedule, auto_threshold_sample, &at);
+    int ret = usbdev_meter_sampler_run(usbdev, &sampler);
+    if (ret == LUDH_END_OF_REPLAY) {
+        ret = LIBUSB_SUCCESS;
+    }
+
+    printf("auto-threshold summary:\n"
+           "  %s  %9" PRIu64 " read, %" PRIu64 " failed read(s) skipped in %.3fs%s\n"
+           "  %s  %9lu\n",
+           "samples  ", sampler.sample_count, sampler.error_count,
+           ns_to_ms(monotonic_ns() - at.start_ns) / 1000.0,
+           global_abort ? " (interrupted)" : "",
+           "updates  ", at.update_count);
+    if (at.stats.count > 0) {
+        const double floor_dB = meter_stats_floor_hold_dB(&at.stats);
+        const double speech_dB = meter_stats_peak_hold_dB(&at.stats);
+        printf("  %s  %9.1fdB floor, %.1fdB speech\n", "levels   ",
+               floor_dB, (speech_dB < floor_dB) ? floor_dB : speech_dB);
+    }
+    if (at.have_threshold) {
+        printf("  %s  %9lddB\n", "threshold", at.threshold_dB);
+    }
+    meter_schedule_report(&schedule);
+    return ret;
+}
+
+
+/* The trigger command reads the meter, and reports every time the level
+ * crosses one of the given levels, as a line on stdout, a line written
+ * to a FIFO, and/or a hook command started in the background. Only the
+ * non-blocking FIFO write happens right after the read; the stdout line
+ * and the hook are queued, and done while waiting for the next deadline,
+ * so the next sample is read on time. */
+#define TRIGGER_LEVELS_MAX 8U
+#define TRIGGER_RATE_DEFAULT 100U
+#define TRIGGER_HOLD_MAX_MS 3600000U
+#define TRIGGER_PENDING_MAX 64U
+
+
+typedef struct {
+    long level_dB[TRIGGER_LEVELS_MAX];
+    size_t level_count;
+    unsigned int hysteresis_dB;
+    unsigned int hold_ms;
+    unsigned int rate_hz;
+    const char *fifo_path;
+    const char *hook;
+    uint64_t duration_s;
+} trigger_params_T;
+
+
+typedef struct {
+    bool above;
+    uint64_t since_ns;
+    unsigned long rising_count;
+    unsigned long falling_count;
+} trigger_level_T;
+
+
+/* An event whose stdout line and hook are still to be done. */
+typedef struct {
+    char line[128];
+    bool rising;
+    long level_dB;
+    double dB;
+    uint64_t t_ns;
+} trigger_pending_T;
+
+
+typedef struct {
+    const trigger_params_T *params;
+    const meter_sampler_T *sampler;
+    uint64_t start_ns;
+    trigger_level_T levels[TRIGGER_LEVELS_MAX];
+    trigger_pending_T pending[TRIGGER_PENDING_MAX];
+    size_t pending_count;
+    unsigned long pending_dropped;
+    int fifo_fd;
+    unsigned long fifo_dropped;
+    unsigned long hook_count;
+    unsigned long hook_running;
+    unsigned long hook_failed;
+    unsigned long event_count;
+    /* from the end of the meter read, and from its deadline */
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    uint64_t deadline_latency_sum_ns;
+    uint64_t deadline_latency_max_ns;
+} trigger_T;
+
+
+/* Write LINE to the FIFO if a reader has it open, and count it as
+ * dropped otherwise, or if the reader is too slow to take it now. */
+static
+void trigger_write_fifo(trigger_T *trigger, const char *const line,
+                        const size_t len)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void trigger_write_fifo(trigger_T *trigger, const char *const line,
+                        const size_t len)
+{
+    if (trigger->fifo_fd < 0) {
+        trigger->fifo_fd = open(trigger->params->fifo_path,
+                                O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (trigger->fifo_fd < 0) {
+        ++trigger->fifo_dropped;
+        return;
+    }
+    /* lines up to PIPE_BUF bytes are written whole or not at all */
+    if (write(trigger->fifo_fd, line, len) != (ssize_t) len) {
+        ++trigger->fifo_dropped;
+        if (errno != EAGAIN) {
+            /* the reader has gone, open the FIFO again next time */
+            close(trigger->fifo_fd);
+            trigger->fifo_fd = -1;
+        }
+    }
+}
+
+
+/* Start the hook as sh -c HOOK with the event as $1 to $4, without
+ * waiting for it. */
+static
+void trigger_start_hook(trigger_T *trigger, const char *const edge,
+                        const long level_dB, const double dB,
+                        const uint64_t t_ns)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void trigger_start_hook(trigger_T *trigger, const char *const edge,
+                        const long level_dB, const double dB,
+                        const uint64_t t_ns)
+{
+#if defined(HAVE_POSIX_SPAWN) && defined(HAVE_SPAWN_H) && defined(HAVE_SYS_WAIT_H)
+    extern char **environ;
+    char level_str[32];
+    char dB_str[32];
+    char t_str[32];
+    snprintf(level_str, sizeof(level_str), "%lddB", level_dB);
+    snprintf(dB_str, sizeof(dB_str), "%.2fdB", dB);
+    snprintf(t_str, sizeof(t_str), "%" PRIu64, t_ns);
+    char *const argv[] = {
+        (char *) "sh", (char *) "-c", (char *) trigger->params->hook,
+        (char *) "scnp-cli-trigger", (char *) edge,
+        level_str, dB_str, t_str, NULL
+    };
+    pid_t pid;
+    const int ret = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ);
+    ++trigger->hook_count;
+    if (ret != 0) {
+        fprintf(stderr, "trigger: cannot start hook: %s\n", strerror(ret));
+        ++trigger->hook_failed;
+        return;
+    }
+    ++trigger->hook_running;
+#else
+    (void) trigger;
+    (void) edge;
+    (void) level_dB;
+    (void) dB;
+    (void) t_ns;
+#endif
+}
+
+
+/* Collect the hooks which have finished, without waiting. */
+static
+void trigger_reap_hooks(trigger_T *trigger)
+    __attribute__(( nonnull(1) ));
+
+static
+void trigger_reap_hooks(trigger_T *trigger)
+{
+#if defined(HAVE_POSIX_SPAWN) && defined(HAVE_SPAWN_H) && defined(HAVE_SYS_WAIT_H)
+    int status;
+    while ((trigger->hook_running > 0) && (waitpid(-1, &status, WNOHANG) > 0)) {
+        --trigger->hook_running;
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+            ++trigger->hook_failed;
+        }
+    }
+#else
+    (void) trigger;
+#endif
+}
+
+
+static
+void trigger_event(trigger_T *trigger, const size_t index,
+                   const bool rising, const double dB,
+                   const uint64_t deadline_ns, const uint64_t sample_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+void trigger_event(trigger_T *trigger, const size_t index,
+                   const bool rising, const double dB,
+                   const uint64_t deadline_ns, const uint64_t sample_ns)
+{
+    const trigger_params_T *const params = trigger->params;
+    const long level_dB = params->level_dB[index];
+    const char *const edge = rising ? "rising" : "falling";
+    const uint64_t t_ns = realtime_ns();
+
+    if (trigger->pending_count >= TRIGGER_PENDING_MAX) {
+        /* stdout has not kept up, drop the event there but not on the FIFO */
+        ++trigger->pending_dropped;
+    }
+    trigger_pending_T dropped;
+    trigger_pending_T *const pending =
+        (trigger->pending_count < TRIGGER_PENDING_MAX)
+        ? &trigger->pending[trigger->pending_count++] : &dropped;
+    const int len = snprintf(pending->line, sizeof(pending->line),
+                             "event t_ns=%" PRIu64 " edge=%s level=%lddB"
+                             " value=%.2fdB\n",
+                             t_ns, edge, level_dB, dB);
+    pending->rising = rising;
+    pending->level_dB = level_dB;
+    pending->dB = dB;
+    pending->t_ns = t_ns;
+    if (params->fifo_path != NULL) {
+        trigger_write_fifo(trigger, pending->line, (size_t) len);
+    }
+
+    const uint64_t done_ns = monotonic_ns();
+    const uint64_t latency_ns = done_ns - sample_ns;
+    const uint64_t deadline_latency_ns = done_ns - deadline_ns;
+    ++trigger->event_count;
+    trigger->latency_sum_ns += latency_ns;
+    trigger->deadline_latency_sum_ns += deadline_latency_ns;
+    if (latency_ns > trigger->latency_max_ns) {
+        trigger->latency_max_ns = latency_ns;
+    }
+    if (deadline_latency_ns > trigger->deadline_latency_max_ns) {
+        trigger->deadline_latency_max_ns = deadline_latency_ns;
+    }
+}
+
+
+/* Print the queued event lines, and start their hooks. This is only
+ * called while waiting for the next deadline. */
+static
+void trigger_flush(trigger_T *trigger)
+    __attribute__(( nonnull(1) ));
+
+static
+void trigger_flush(trigger_T *trigger)
+{
+    for (size_t i=0; i<trigger->pending_count; ++i) {
+        const trigger_pending_T *const pending = &trigger->pending[i];
+        fputs(pending->line, stdout);
+        if (trigger->params->hook != NULL) {
+            trigger_start_hook(trigger, pending->rising ? "rising" : "falling",
+                               pending->level_dB, pending->dB, pending->t_ns);
+        }
+    }
+    if (trigger->pending_count > 0) {
+        trigger->pending_count = 0;
+        fflush(stdout);
+    }
+    trigger_reap_hooks(trigger);
+}
+
+
+/* Check every level against the sample. A level goes up at its dB
+ * value, and down again below its dB value minus the hysteresis, but
+ * only after it has stayed where it is for the hold time. */
+static
+void trigger_check(trigger_T *trigger, const double dB,
+                   const uint64_t deadline_ns, const uint64_t sample_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+void trigger_check(trigger_T *trigger, const double dB,
+                   const uint64_t deadline_ns, const uint64_t sample_ns)
+{
+    const trigger_params_T *const params = trigger->params;
+    const uint64_t hold_ns = ((uint64_t) params->hold_ms) * 1000000ULL;
+    for (size_t i=0; i<params->level_count; ++i) {
+        trigger_level_T *const level = &trigger->levels[i];
+        if ((sample_ns - level->since_ns) < hold_ns) {
+            continue;
+        }
+        const double level_dB = (double) params->level_dB[i];
+        if (!level->above && (dB >= level_dB)) {
+            level->above = true;
+            level->since_ns = sample_ns;
+            ++level->rising_count;
+            trigger_event(trigger, i, true, dB, deadline_ns, sample_ns);
+        } else if (level->above &&
+                   (dB < (level_dB - (double) params->hysteresis_dB))) {
+            level->above = false;
+            level->since_ns = sample_ns;
+            ++level->falling_count;
+            trigger_event(trigger, i, false, dB, deadline_ns, sample_ns);
+        }
+    }
+}
+
+
+static
+int trigger_sample(void *data, const uint32_t value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+int trigger_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    trigger_T *const trigger = data;
+    const uint64_t duration_ns = trigger->params->duration_s * 1000000000ULL;
+    if ((duration_ns > 0) && ((t_ns - trigger->start_ns) >= duration_ns)) {
+        return METER_SAMPLER_STOP;
+    }
+    trigger_check(trigger, meter_clamp_dB(uint_to_dB_meter(value)),
+                  trigger->sampler->deadline_ns, t_ns);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error. */
+static
+int usbdev_trigger(usbdev_T *usbdev, const trigger_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_trigger(usbdev_T *usbdev, const trigger_params_T *params)
+{
+    printf("trigger: %zu level(s), hysteresis %udB, hold %ums, %uHz meter"
+           " for device %s\n",
+           params->level_count, params->hysteresis_dB, params->hold_ms,
+           params->rate_hz, usbdev->notepad_device->name);
+    fflush(stdout);
+
+    trigger_T trigger;
+    memset(&trigger, 0, sizeof(trigger));
+    trigger.params = params;
+    trigger.fifo_fd = -1;
+
+    signal(SIGINT, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->rate_hz);
+    trigger.start_ns = schedule.next_ns;
+    /* all levels start below, so a loud start is a rising edge */
+    for (size_t i=0; i<params->level_count; ++i) {
+        trigger.levels[i].since_ns =
+            trigger.start_ns - ((uint64_t) params->hold_ms) * 1000000ULL;
+    }
+
+    meter_sampler_T sampler;
+    meter_sampler_init(&sampler, &schedule, trigger_sample, &trigger);
+    trigger.sampler = &sampler;
+    int ret = LIBUSB_SUCCESS;
+    while (!global_abort) {
+        const uint64_t now_ns = monotonic_ns();
+        if (!meter_sampler_due(&sampler, now_ns)) {
+            trigger_flush(&trigger);
+            sleep_until_ns(schedule.next_ns);
+            continue; /* check for Ctrl-C and an early wakeup */
+        }
+        ret = meter_sampler_sample(usbdev, &sampler, now_ns);
+        if (ret != LIBUSB_SUCCESS) {
+            break;
+        }
+    }
+    if ((ret == METER_SAMPLER_STOP) || (ret == LUDH_END_OF_REPLAY)) {
+        ret = LIBUSB_SUCCESS;
+    }
+    trigger_flush(&trigger);
+    if (trigger.fifo_fd >= 0) {
+        close(trigger.fifo_fd);
+    }
+
+    printf("trigger summary:\n"
+           "  %s  %9" PRIu64 " read, %" PRIu64 " failed read(s) skipped in %.3fs%s\n",
+           "samples  ", sampler.sample_count, sampler.error_count,
+           ns_to_ms(monotonic_ns() - trigger.start_ns) / 1000.0,
+           global_abort ? " (interrupted)" : "");
+    for (size_t i=0; i<params->level_count; ++i) {
+        printf("  %s  %7lddB %lu rising, %lu falling\n",
+               "level    ", params->level_dB[i],
+               trigger.levels[i].rising_count, trigger.levels[i].falling_count);
+    }
+    if (trigger.event_count > 0) {
+        printf("  %s  %9.3fms avg, %.3fms max from the sample read\n"
+               "  %s  %9.3fms avg, %.3fms max from the sample deadline\n",
+               "latency  ",
+               ns_to_ms(trigger.latency_sum_ns) / (double) trigger.event_count,
+               ns_to_ms(trigger.latency_max_ns),
+               "         ",
+               ns_to_ms(trigger.deadline_latency_sum_ns) / (double) trigger.event_count,
+               ns_to_ms(trigger.deadline_latency_max_ns));
+    }
+    printf("  %s  %9lu line(s) dropped\n", "stdout   ", trigger.pending_dropped);
+    if (params->fifo_path != NULL) {
+        printf("  %s  %9lu line(s) dropped\n", "fifo     ", trigger.fifo_dropped);
+    }
+    if (params->hook != NULL) {
+        printf("  %s  %9lu started, %lu failed, %lu still running\n",
+               "hooks    ", trigger.hook_count, trigger.hook_failed,
+               trigger.hook_running);
+    }
+    meter_schedule_report(&schedule);
+    return ret;
+}
+
+
+static
+void usbdev_check_permissions(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_check_permissions(usbdev_T *usbdev)
+{
+    (void) usbdev;
+}
+
+
+typedef union {
+    struct {
+        uint8_t source_index;
+    } audio_routing;
+
+    struct {
+        uint8_t inputs;
+        uint16_t release_ms;
+    } ducker_on;
+
+    struct {
+        uint32_t range;
+    } ducker_range;
+
+    struct {
+        uint32_t thresh;
+    } ducker_threshold;
+
+    struct {
+        device_state_T scene;
+    } apply;
+
+    meter_params_T meter;
+
+    ramp_params_T ramp;
+
+    sweep_params_T sweep;
+
+    auto_threshold_params_T auto_threshold;
+
+    trigger_params_T trigger;
+} command_params_T;
+
+
+/* Returns LIBUSB_SUCCESS or a negative libusb error. */
+typedef int (*command_func_T)(usbdev_T *usbdev, command_params_T *params);
+
+
+static
+int commandfunc_audio_routing(usbdev_T *usbdev,
+                              command_params_T *params)
+{
+    return usbdev_audio_routing(usbdev,
+                                params->audio_routing.source_index);
+}
+
+
+static
+int commandfunc_ducker_off(usbdev_T *usbdev,
+                           command_params_T *params __attribute__(( unused )) )
+{
+    return usbdev_ducker_off(usbdev);
+}
+
+
+static
+int commandfunc_ducker_on(usbdev_T *usbdev,
+                          command_params_T *params)
+{
+    return usbdev_ducker_on(usbdev,
+                            params->ducker_on.inputs,
+                            params->ducker_on.release_ms);
+}
+
+
+static
+int commandfunc_ducker_range(usbdev_T *usbdev,
+                             command_params_T *params)
+{
+    return usbdev_ducker_range(usbdev,
+                               params->ducker_range.range);
+}
+
+
+static
+int commandfunc_ducker_threshold(usbdev_T *usbdev,
+                                 command_params_T *params)
+{
+    return usbdev_ducker_threshold(usbdev,
+                                   params->ducker_threshold.thresh);
+}
+
+
+static
+int commandfunc_apply(usbdev_T *usbdev,
+                      command_params_T *params)
+{
+    return usbdev_apply(usbdev,
+                        &params->apply.scene);
+}
+
+
+static
+int commandfunc_meter(usbdev_T *usbdev,
+                      command_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int commandfunc_meter(usbdev_T *usbdev,
+                      command_params_T *params)
+{
+    return usbdev_meter(usbdev, &params->meter);
+}
+
+
+static
+int commandfunc_ramp(usbdev_T *usbdev,
+                     command_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int commandfunc_ramp(usbdev_T *usbdev,
+                     command_params_T *params)
+{
+    return usbdev_ramp(usbdev, &params->ramp);
+}
+
+
+static
+int commandfunc_sweep(usbdev_T *usbdev,
+                      command_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int commandfunc_sweep(usbdev_T *usbdev,
+                      command_params_T *params)
+{
+    return usbdev_sweep(usbdev, &params->sweep);
+}
+
+
+static
+int commandfunc_auto_threshold(usbdev_T *usbdev,
+                               command_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int commandfunc_auto_threshold(usbdev_T *usbdev,
+                               command_params_T *params)
+{
+    return usbdev_auto_threshold(usbdev, &params->auto_threshold);
+}
+
+
+static
+int commandfunc_trigger(usbdev_T *usbdev,
+                        command_params_T *params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int commandfunc_trigger(usbdev_T *usbdev,
+                        command_params_T *params)
+{
+    return usbdev_trigger(usbdev, &params->trigger);
+}
+
+
+static
+int commandfunc_check_permissions(usbdev_T *usbdev,
+                                  command_params_T *params)
+    __attribute__(( nonnull(1) ));
+
+static
+int commandfunc_check_permissions(usbdev_T *usbdev,
+                                  command_params_T *params
+                                  __attribute__(( unused )) )
+{
+    usbdev_check_permissions(usbdev);
+    return LIBUSB_SUCCESS;
+}
+
+
+typedef struct {
+    command_func_T func;
+    command_params_T params;
+} command_T;
+
+
+/* Set up usbdev for the device which usbdev->device_handle has just
+ * been opened for. */
+static
+void usbdev_init_opened(usbdev_T *usbdev, libusb_device *device)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void usbdev_init_opened(usbdev_T *usbdev, libusb_device *device)
+{
+    usbdev->device = usb->ref_device(device);
+
+    /* Reading the serial number is cheap with the device cache. */
+    usbdev->shadow_enabled = false;
+    if (state_shadow_available()) {
+        char port_path[32];
+        usbdev_port_path(device, port_path, sizeof(port_path));
+        const device_cache_entry_T *const identity =
+            device_identity(device, &usbdev->descriptor, usbdev->device_handle);
+        device_cache_save(&device_cache);
+        usbdev->shadow_enabled =
+            state_shadow_open(&usbdev->shadow, identity->serial,
+                              port_path, usb->get_device_address(device),
+                              dry_run);
+    }
+    usbdev->sent_count = 0;
+    usbdev->skipped_count = 0;
+}
+
+
+/* Open the given supported device. Returns a libusb error code
+ * instead of failing, so that callers can retry. */
+static
+int usbdev_open_device(usbdev_T *usbdev, libusb_device *device)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_open_device(usbdev_T *usbdev, libusb_device *device)
+{
+    const int luret_get_dev_descr =
+        usb->get_device_descriptor(device, &usbdev->descriptor);
+    LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
+
+    usbdev->notepad_device =
+        notepad_device_from_idProduct(usbdev->descriptor.idProduct);
+    COND_OR_FAIL(usbdev->notepad_device != NULL, "unhandled idProduct");
+
+    const int luret_open =
+        usb->open(device, &usbdev->device_handle);
+    if (luret_open < 0) {
+        return luret_open;
+    }
+
+    usbdev_init_opened(usbdev, device);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Close the device, but keep libusb initialized. */
+static
+void usbdev_close_device(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_close_device(usbdev_T *usbdev)
+{
+    if (usbdev->shadow_enabled &&
+        ((usbdev->sent_count + usbdev->skipped_count) > 0)) {
+        printf("state: %lu setting(s) sent, %lu skipped as already in effect\n",
+               usbdev->sent_count, usbdev->skipped_count);
+    }
+    if ((transfer_counters.retries + transfer_counters.timeouts +
+         transfer_counters.failures) > 0) {
+        printf("usb: %lu transfer(s), %lu retried, %lu timed out, %lu failed\n",
+               transfer_counters.transfers, transfer_counters.retries,
+               transfer_counters.timeouts, transfer_counters.failures);
+    }
+    memset(&transfer_counters, 0, sizeof(transfer_counters));
+
+    usb->close(usbdev->device_handle);
+    usbdev->device_handle = NULL;
+
+    usb->unref_device(usbdev->device);
+    usbdev->device = NULL;
+}
+
+
+/* Open the one Notepad device selected by device_selector. */
+static
+void usbdev_open_selected(usbdev_T *usbdev, const bool verbose)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_open_selected(usbdev_T *usbdev, const bool verbose)
+{
+    const int luret_init =
+        usb->init();
+    LIBUSB_OR_FAIL(luret_init, "libusb_init");
+
+    libusb_device **dev_list;
+    ssize_t dev_count = supported_device_list(&dev_list, verbose);
+
+    if (dev_count == 0) {
+        fprintf(stderr, "No Notepad device found\n");
+        exit(EXIT_FAILURE);
+    }
+    if (dev_count > 1) {
+        fprintf(stderr, "Found %ld Notepad devices. Select one with --serial "
+                "or --bus and --address, or use --all.\n", (long) dev_count);
+        exit(EXIT_FAILURE);
+    }
+
+    const int luret_open = usbdev_open_device(usbdev, dev_list[0]);
+    LIBUSB_OR_FAIL(luret_open, "libusb_open");
+
+    /* usbdev keeps its own reference to the device, drop the list. */
+    for (ssize_t i=0; i<dev_count; ++i) {
+        usb->unref_device(dev_list[i]);
+    }
+    free(dev_list);
+}
+
+
+/* Open the device behind the --device file or the --fd file
+ * descriptor, without looking at any other USB device. */
+static
+void usbdev_open_sys_device(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_open_sys_device(usbdev_T *usbdev)
+{
+    int fd = sys_device_fd;
+    if (sys_device_path != NULL) {
+        fd = open(sys_device_path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "Fatal: cannot open %s: %s\n",
+                    sys_device_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        sys_device_opened_fd = fd;
+    }
+
+    const int luret_init =
+        usb->init_no_discovery();
+    LIBUSB_OR_FAIL(luret_init, "libusb_init without device discovery");
+
+    const int luret_wrap =
+        usb->wrap_sys_device((intptr_t) fd, &usbdev->device_handle);
+    LIBUSB_OR_FAIL(luret_wrap, "libusb_wrap_sys_device");
+
+    libusb_device *const device = usb->get_device(usbdev->device_handle);
+    const int luret_get_dev_descr =
+        usb->get_device_descriptor(device, &usbdev->descriptor);
+    LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
+
+    usbdev->notepad_device = (usbdev->descriptor.idVendor == 0x05fc) ?
+        notepad_device_from_idProduct(usbdev->descriptor.idProduct) : NULL;
+    if (usbdev->notepad_device == NULL) {
+        fprintf(stderr, "Fatal: %s is not a supported Notepad device (ID %04x:%04x)\n",
+                (sys_device_path != NULL) ? sys_device_path : "--fd",
+                usbdev->descriptor.idVendor, usbdev->descriptor.idProduct);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Bus %03d Device %03d: ID %04x:%04x %s (version %d.%d.%d)\n",
+           usb->get_bus_number(device), usb->get_device_address(device),
+           usbdev->descriptor.idVendor, usbdev->descriptor.idProduct,
+           usbdev->notepad_device->name,
+           (usbdev->descriptor.bcdDevice >> 8) & 0xff,
+           (usbdev->descriptor.bcdDevice >> 4) & 0x0f,
+           (usbdev->descriptor.bcdDevice >> 0) & 0x0f);
+
+    usbdev_init_opened(usbdev, device);
+}
+
+
+static
+void usbdev_open(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_open(usbdev_T *usbdev)
+{
+    if ((sys_device_path != NULL) || (sys_device_fd >= 0)) {
+        usbdev_open_sys_device(usbdev);
+    } else {
+        usbdev_open_selected(usbdev, true);
+    }
+}
+
+
+static
+void usbdev_close(usbdev_T *usbdev)
+    __attribute__(( nonnull(1) ));
+
+static
+void usbdev_close(usbdev_T *usbdev)
+{
+    usbdev_close_device(usbdev);
+    usb->exit();
+    if (sys_device_opened_fd >= 0) {
+        close(sys_device_opened_fd);
+        sys_device_opened_fd = -1;
+    }
+}
+
+
+#define FANOUT_DEVICES_MAX 64
+
+
+/* One of the devices a command runs on with --all. */
+typedef struct {
+    uint8_t busnum;
+    uint8_t devaddr;
+    bool ok;
+    uint64_t elapsed_ns;
+#if (defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H))
+    pid_t pid;
+    int result_fd;
+#endif
+} fanout_device_T;
+
+
+/* List the selected devices by location, and release libusb again, so
+ * that every worker can open its own device independently. */
+static
+size_t fanout_device_list(fanout_device_T *devices, const size_t max_count)
+    __attribute__(( nonnull(1) ));
+
+static
+size_t fanout_device_list(fanout_device_T *devices, const size_t max_count)
+{
+    const int luret_init =
+        usb->init();
+    LIBUSB_OR_FAIL(luret_init, "libusb_init");
+
+    libusb_device **dev_list;
+    const ssize_t dev_count = supported_device_list(&dev_list, true);
+    COND_OR_FAIL(((size_t) dev_count) <= max_count, "too many Notepad devices");
+
+    for (ssize_t i=0; i<dev_count; ++i) {
+        memset(&devices[i], 0, sizeof(devices[i]));
+        devices[i].busnum  = usb->get_bus_number(dev_list[i]);
+        devices[i].devaddr = usb->get_device_address(dev_list[i]);
+        usb->unref_device(dev_list[i]);
+    }
+    free(dev_list);
+
+    usb->exit();
+    return (size_t) dev_count;
+}
+
+
+/* Run the commands in order until one of them fails, and return
+ * EXIT_SUCCESS or EXIT_FAILURE. */
+static
+int usbdev_run_commands(usbdev_T *usbdev,
+                        command_T *commands, const size_t command_count)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int usbdev_run_commands(usbdev_T *usbdev,
+                        command_T *commands, const size_t command_count)
+{
+    for (size_t i=0; i<command_count; ++i) {
+        if (commands[i].func(usbdev, &commands[i].params) < 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* Open one device of a fan-out, run all commands on it, and store how
+ * long the commands took. Exits when the device cannot be opened, like
+ * usbdev_open(). Returns EXIT_SUCCESS or EXIT_FAILURE. */
+static
+int fanout_run_device(const fanout_device_T *device,
+                      command_T *commands, const size_t command_count,
+                      uint64_t *elapsed_ns)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(4) ));
+
+static
+int fanout_run_device(const fanout_device_T *device,
+                      command_T *commands, const size_t command_count,
+                      uint64_t *elapsed_ns)
+{
+    device_selector.serial  = NULL;
+    device_selector.busnum  = device->busnum;
+    device_selector.devaddr = device->devaddr;
+    device_selector.all     = false;
+
+    usbdev_T usbdev;
+    usbdev_open_selected(&usbdev, false);
+
+    const uint64_t start_ns = monotonic_ns();
+    const int result = usbdev_run_commands(&usbdev, commands, command_count);
+    *elapsed_ns = monotonic_ns() - start_ns;
+
+    usbdev_close(&usbdev);
+    return result;
+}
+
+
+/* Run the commands on all selected devices at the same time, with one
+ * worker process per device, so a change across a rack of devices
+ * takes about as long as on a single one. A failing device does not
+ * take the others down. Without fork(2), the devices are handled one
+ * after the other. */
+static
+void run_usbdev_commands_all(command_T *commands, const size_t command_count)
+    __attribute__(( nonnull(1) ));
+
+static
+void run_usbdev_commands_all(command_T *commands, const size_t command_count)
+{
+    fanout_device_T devices[FANOUT_DEVICES_MAX];
+    const size_t device_count = fanout_device_list(devices, FANOUT_DEVICES_MAX);
+    if (device_count == 0) {
+        fprintf(stderr, "No Notepad device found\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    const uint64_t start_ns = monotonic_ns();
+
+#if (defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H))
+    for (size_t i=0; i<device_count; ++i) {
+        int result_pipe[2];
+        if (pipe(result_pipe) < 0) {
+            perror("Fatal: pipe");
+            exit(EXIT_FAILURE);
+        }
+        const pid_t pid = fork();
+        if (pid < 0) {
+            perror("Fatal: fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            close(result_pipe[0]);
+            uint64_t elapsed_ns = 0;
+            const int result =
+                fanout_run_device(&devices[i], commands, command_count,
+                                  &elapsed_ns);
+            if (write(result_pipe[1], &elapsed_ns, sizeof(elapsed_ns)) < 0) {
+                exit(EXIT_FAILURE);
+            }
+            exit(result);
+        }
+        close(result_pipe[1]);
+        devices[i].pid = pid;
+        devices[i].result_fd = result_pipe[0];
+    }
+
+    for (size_t i=0; i<device_count; ++i) {
+        int status = 0;
+        while ((waitpid(devices[i].pid, &status, 0) < 0) && (errno == EINTR)) {
+            /* try again */
+        }
+        uint64_t elapsed_ns = 0;
+        const ssize_t r = read(devices[i].result_fd, &elapsed_ns, sizeof(elapsed_ns));
+        close(devices[i].result_fd);
+        devices[i].ok = WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS) &&
+            (r == ((ssize_t) sizeof(elapsed_ns)));
+        devices[i].elapsed_ns = elapsed_ns;
+    }
+#else
+    for (size_t i=0; i<device_count; ++i) {
+        devices[i].ok =
+            (fanout_run_device(&devices[i], commands, command_count,
+                               &devices[i].elapsed_ns) == EXIT_SUCCESS);
+    }
+#endif
+
+    const uint64_t total_ns = monotonic_ns() - start_ns;
+
+    size_t failed_count = 0;
+    for (size_t i=0; i<device_count; ++i) {
+        if (!devices[i].ok) {
+            ++failed_count;
+        }
+    }
+    printf("all: %zu device(s), %zu ok, %zu failed in %.3fms\n",
+           device_count, device_count - failed_count, failed_count,
+           ns_to_ms(total_ns));
+    for (size_t i=0; i<device_count; ++i) {
+        if (devices[i].ok) {
+            printf("  Bus %03d Device %03d  ok      %9.3fms\n",
+                   devices[i].busnum, devices[i].devaddr,
+                   ns_to_ms(devices[i].elapsed_ns));
+        } else {
+            printf("  Bus %03d Device %03d  FAILED\n",
+                   devices[i].busnum, devices[i].devaddr);
+        }
+    }
+
+    if (failed_count > 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* Run all commands on one libusb session and one device handle, until
+ * one of them fails. Returns EXIT_SUCCESS or EXIT_FAILURE. */
+static
+int run_usbdev_commands(command_T *commands, const size_t command_count)
+    __attribute__(( nonnull(1) ));
+
+static
+int run_usbdev_commands(command_T *commands, const size_t command_count)
+{
+    if (device_selector.all) {
+        run_usbdev_commands_all(commands, command_count);
+        return EXIT_SUCCESS;
+    }
+
+    usbdev_T usbdev;
+    usbdev_open(&usbdev);
+    const int result = usbdev_run_commands(&usbdev, commands, command_count);
+    usbdev_close(&usbdev);
+    return result;
+}
+
+
+static
+int run_usbdev_command(command_func_T command_func,
+                       command_params_T *command_params)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int run_usbdev_command(command_func_T command_func,
+                       command_params_T *command_params)
+{
+    command_T command;
+    command.func = command_func;
+    command.params = *command_params;
+    return run_usbdev_commands(&command, 1);
+}
+
+
+/* Watching for devices to appear and disappear. */
+#define WATCH_EVENTS_MAX 64
+#define WATCH_POLL_INTERVAL_MS 250U
+/* udev may need a moment to set up the permissions of a new device */
+#define WATCH_OPEN_RETRY_NS (2000ULL * 1000000ULL)
+#define WATCH_OPEN_RETRY_DELAY_MS 10U
+
+
+typedef struct {
+    /* referenced until the event has been handled */
+    libusb_device *device;
+    bool arrived;
+    /* when the event has been noticed */
+    uint64_t t_ns;
+} watch_event_T;
+
+
+typedef struct {
+    watch_event_T events[WATCH_EVENTS_MAX];
+    size_t count;
+    size_t dropped;
+} watch_queue_T;
+
+
+static
+void watch_queue_push(watch_queue_T *queue, libusb_device *device,
+                      const bool arrived, const uint64_t t_ns)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void watch_queue_push(watch_queue_T *queue, libusb_device *device,
+                      const bool arrived, const uint64_t t_ns)
+{
+    if (queue->count == WATCH_EVENTS_MAX) {
+        ++queue->dropped;
+        return;
+    }
+    watch_event_T *const event = &queue->events[queue->count++];
+    event->device = usb->ref_device(device);
+    event->arrived = arrived;
+    event->t_ns = t_ns;
+}
+
+
+/* Only queue the event here, as the callback must not do any
+ * blocking device I/O. */
+static
+int LIBUSB_CALL watch_hotplug_callback(libusb_context *ctx,
+                                       libusb_device *device,
+                                       libusb_hotplug_event event,
+                                       void *user_data)
+{
+    (void) ctx;
+    watch_queue_push(user_data, device,
+                     event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+                     monotonic_ns());
+    return 0; /* keep the callback registered */
+}
+
+
+/* Without hotplug support, compare the device list with the devices
+ * we already know about to find the arrived and the removed ones. */
+static
+void watch_poll_devices(watch_queue_T *queue,
+                        libusb_device **known, size_t *known_count)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+void watch_poll_devices(watch_queue_T *queue,
+                        libusb_device **known, size_t *known_count)
+{
+    libusb_device **devices = NULL;
+    const ssize_t luret_get_device_list =
+        usb->get_device_list(&devices);
+    COND_OR_FAIL(luret_get_device_list >= 0, "libusb_get_device_list");
+    const uint64_t now_ns = monotonic_ns();
+
+    for (size_t k=0; k<*known_count; ) {
+        bool present = false;
+        for (int i=0; devices[i] != NULL; ++i) {
+            if (devices[i] == known[k]) {
+                present = true;
+                break;
+            }
+        }
+        if (present) {
+            ++k;
+            continue;
+        }
+        watch_queue_push(queue, known[k], false, now_ns);
+        usb->unref_device(known[k]);
+        known[k] = known[--(*known_count)];
+    }
+
+    for (int i=0; devices[i] != NULL; ++i) {
+        struct libusb_device_descriptor desc;
+        if ((usb->get_device_descriptor(devices[i], &desc) < 0) ||
+            (desc.idVendor != 0x05fc)) {
+            continue;
+        }
+        bool is_known = false;
+        for (size_t k=0; k<*known_count; ++k) {
+            if (devices[i] == known[k]) {
+                is_known = true;
+                break;
+            }
+        }
+        if (!is_known && (*known_count < WATCH_EVENTS_MAX)) {
+            known[(*known_count)++] = usb->ref_device(devices[i]);
+            watch_queue_push(queue, devices[i], true, now_ns);
+        }
+    }
+
+    usb->free_device_list(devices, 1);
+}
+
+
+/* Bring a newly arrived device into the desired state. */
+static
+void watch_handle_event(const watch_event_T *event,
+                        command_T *commands, const size_t command_count)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void watch_handle_event(const watch_event_T *event,
+                        command_T *commands, const size_t command_count)
+{
+    struct libusb_device_descriptor desc;
+    const int luret_get_dev_descr =
+        usb->get_device_descriptor(event->device, &desc);
+    LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
+
+    const notepad_device_T *const np_dev =
+        notepad_device_from_idProduct(desc.idProduct);
+    if (np_dev == NULL) {
+        return;
+    }
+    const unsigned int busnum  = usb->get_bus_number(event->device);
+    const unsigned int devaddr = usb->get_device_address(event->device);
+
+    if (!event->arrived) {
+        printf("watch: Bus %03u Device %03u: %s removed\n",
+               busnum, devaddr, np_dev->name);
+        return;
+    }
+
+    const device_cache_entry_T *identity;
+    if (!usbdev_selected(event->device, &desc, &identity)) {
+        return;
+    }
+    printf("watch: Bus %03u Device %03u: %s arrived\n",
+           busnum, devaddr, np_dev->name);
+
+    usbdev_T usbdev;
+    while (true) {
+        const int luret_open = usbdev_open_device(&usbdev, event->device);
+        if (luret_open == LIBUSB_SUCCESS) {
+            break;
+        }
+        if (global_abort ||
+            ((monotonic_ns() - event->t_ns) >= WATCH_OPEN_RETRY_NS)) {
+            fprintf(stderr, "watch: Bus %03u Device %03u: cannot open: %s\n",
+                    busnum, devaddr, libusb_strerror(luret_open));
+            return;
+        }
+        milli_sleep(WATCH_OPEN_RETRY_DELAY_MS);
+    }
+
+    const int result = usbdev_run_commands(&usbdev, commands, command_count);
+    usbdev_close_device(&usbdev);
+
+    if (result != EXIT_SUCCESS) {
+        fprintf(stderr, "watch: Bus %03u Device %03u: restoring the state failed\n",
+                busnum, devaddr);
+        return;
+    }
+    printf("watch: Bus %03u Device %03u: state restored %.3fms after the device arrived\n",
+           busnum, devaddr, ns_to_ms(monotonic_ns() - event->t_ns));
+}
+
+
+/* Run the commands on every selected device which is connected now
+ * or later, until Ctrl-C. This restores the settings a Notepad loses
+ * when it is power cycled. */
+static
+void run_watch(command_T *commands, const size_t command_count)
+    __attribute__(( nonnull(1) ));
+
+static
+void run_watch(command_T *commands, const size_t command_count)
+{
+    const int luret_init =
+        usb->init();
+    LIBUSB_OR_FAIL(luret_init, "libusb_init");
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    static watch_queue_T queue;
+    static libusb_device *known[WATCH_EVENTS_MAX];
+    size_t known_count = 0;
+
+    const bool hotplug = usb->has_capability(LIBUSB_CAP_HAS_HOTPLUG);
+    libusb_hotplug_callback_handle hotplug_handle;
+    if (hotplug) {
+        printf("watch: waiting for hotplug events. Press Ctrl-C to quit.\n");
+        const int luret_register =
+            usb->hotplug_register_callback(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                           LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                           LIBUSB_HOTPLUG_ENUMERATE,
+                                           0x05fc,
+                                           LIBUSB_HOTPLUG_MATCH_ANY,
+                                           LIBUSB_HOTPLUG_MATCH_ANY,
+                                           watch_hotplug_callback, &queue,
+                                           &hotplug_handle);
+        LIBUSB_OR_FAIL(luret_register, "libusb_hotplug_register_callback");
+    } else {
+        printf("watch: no hotplug support, looking for devices every %ums."
+               " Press Ctrl-C to quit.\n", WATCH_POLL_INTERVAL_MS);
+    }
+    fflush(stdout);
+
+    while (!global_abort) {
+        if (hotplug) {
+            struct timeval tv = { 0, WATCH_POLL_INTERVAL_MS * 1000U };
+            const int luret_events =
+                usb->handle_events_timeout_completed(&tv, NULL);
+            if (luret_events != LIBUSB_ERROR_INTERRUPTED) {
+                LIBUSB_OR_FAIL(luret_events, "libusb_handle_events_timeout_completed");
+            }
+        } else {
+            watch_poll_devices(&queue, known, &known_count);
+        }
+
+        for (size_t i=0; i<queue.count; ++i) {
+            watch_handle_event(&queue.events[i], commands, command_count);
+            usb->unref_device(queue.events[i].device);
+        }
+        queue.count = 0;
+        if (queue.dropped > 0) {
+            fprintf(stderr, "watch: dropped %zu device event(s)\n", queue.dropped);
+            queue.dropped = 0;
+        }
+        fflush(stdout);
+
+        if (!hotplug && !global_abort) {
+            milli_sleep(WATCH_POLL_INTERVAL_MS);
+        }
+    }
+
+    if (hotplug) {
+        usb->hotplug_deregister_callback(hotplug_handle);
+    }
+    for (size_t k=0; k<known_count; ++k) {
+        usb->unref_device(known[k]);
+    }
+    usb->exit();
+
+    printf("watch: exiting\n");
+}
+
+
+static
+void print_version(const char *const prog);
+
+static
+void print_version(const char *const prog)
+{
+    printf("%s (%s) %s\n"
+           "Copyright (C) 2021 Jim Ramsay\n"
+           "Copyright (C) 2021,2022 Hans Ulrich Niedermann\n"
+           "\n"
+           "Permission is hereby granted, free of charge, to any person obtaining a copy\n"
+           "of this software and associated documentation files (the \"Software\"), to deal\n"
+           "in the Software without restriction, including without limitation the rights\n"
+           "to use, copy, modify, merge, publish, distribute, sublicense, and/or sell\n"
+           "copies of the Software, and to permit persons to whom the Software is\n"
+           "furnished to do so, subject to the following conditions:\n"
+           "\n"
+           "The above copyright notice and this permission notice shall be included in all\n"
+           "copies or substantial portions of the Software.\n"
+           "\n"
+           "THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR\n"
+           "IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,\n"
+           "FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE\n"
+           "AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER\n"
+           "LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,\n"
+           "OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE\n"
+           "SOFTWARE.\n"
+           "",
+           prog, PACKAGE_NAME, PACKAGE_VERSION);
+}
+
+
+static
+void print_usage(const char *const prog);
+
+static
+void print_usage(const char *const prog)
+{
+    printf("Usage: %s [<device_selection>] [--force] [<transfers>] [<tracing>] <command> <command_params...>\n"
+           "\n"
+           "Gives command line access to the USB control commands for the Soundcraft\n"
+           "Notepad series of mixers to help verify the USB protocol description document.\n"
+           "\n"
+           "Device selection:\n"
+           "\n"
+           "    --serial <SERIAL>  Only use the device with the given serial number.\n"
+           "    --bus <BUS> [--address <ADDR>]\n"
+           "                       Only use the device(s) at the given USB location.\n"
+           "    --all              Run the command on all selected devices at the same\n"
+           "                       time, and print a per-device summary. This does not\n"
+           "                       work for the daemon, exporter, meter, and sweep\n"
+           "                       commands.\n"
+           "    --device <PATH>    Only use the device behind the device file PATH, like\n"
+           "                       /dev/bus/usb/001/004, without enumerating the USB\n"
+           "                       devices. This does not work with list, watch, send,\n"
+           "                       and the other device selection options.\n"
+           "    --fd <N>           The same for the device file which is already open\n"
+           "                       as the inherited file descriptor N.\n"
+           "\n"
+           "    Without --all, the selection must match exactly one device.\n"
+           "\n"
+           "    --force            Send all settings, even those the state shadow in\n"
+           "                       $XDG_RUNTIME_DIR/scnp-cli/ says are in effect.\n"
+           "\n"
+           "Transfers:\n"
+           "\n"
+           "    --send-timeout <MS>, --read-timeout <MS>\n"
+           "                       Give up on a USB transfer sending a setting or\n"
+           "                       reading the meter after MS (1..60000, default 10000)\n"
+           "                       milliseconds.\n"
+           "    --retries <N>      Try a transfer which has timed out, stalled, or\n"
+           "                       overflowed up to N (0..10, default 2) more times,\n"
+           "                       waiting 10ms before the first retry and twice as long\n"
+           "                       before each further one. A setting which still fails\n"
+           "                       stops the command with an error, a meter read which\n"
+           "                       still fails is skipped and counted.\n"
+           "\n"
+           "Tracing:\n"
+           "\n"
+           "    --record <FILE>    Write every USB control transfer with its time stamp\n"
+           "                       and latency to the binary trace FILE.\n"
+           "    --replay <FILE> [--replay-speed <N>]\n"
+           "                       Answer the meter reads from the trace FILE instead of\n"
+           "                       the device, N (0..1000, default 1) times as fast as\n"
+           "                       recorded, or without waiting for N=0. Nothing is sent\n"
+           "                       to the device, and the meter stops at the end of FILE.\n"
+           "    --timings          When exiting, print the time spent in USB init, device\n"
+           "                       enumeration, open, string descriptors, transfers,\n"
+           "                       waiting for events, and teardown on stderr.\n"
+           "    --timings-json     The same, as one line of JSON.\n"
+           "\n"
+           "Commands:\n"
+           "\n"
+           "    --help     Print this usage message and exit.\n"
+           "\n"
+           "    --version  Print version message and exit.\n"
+           "\n"
+           "    apply <FILE>\n"
+           "               Set the settings from the scene FILE, a file like for batch\n"
+           "               with at most one audio-routing, ducker-on or ducker-off,\n"
+           "               ducker-range, and ducker-threshold line each, in any order.\n"
+           "               Only the settings which the state shadow does not know to be\n"
+           "               in effect are sent, ducker-on before range and threshold.\n"
+           "               The planned messages are printed before any of them is sent.\n"
+           "\n"
+           "    audio-routing <NUM>\n"
+           "               Find a supported device, and set its audio sources.\n"
+           "               There must be exactly one selected device connected.\n"
+           "               The valid source numbers are specific to the device:\n"
+           "\n",
+           prog);
+    for (int i=0; supported_devices[i].idProduct != 0; ++i) {
+        printf("               %s %s\n",
+               supported_devices[i].name, supported_devices[i].source_descr);
+        for (int k=0; k<NOTEPAD_SOURCES_MAX; k++) {
+            printf("                 %d  %s\n",
+                   k, supported_devices[i].sources[k]);
+        }
+        printf("\n");
+    }
+    printf("               Note that on the NOTEPAD-12FX 4-channel audio capture device,\n"
+           "               capture device channels 1+2 are always fed from mixer CH 1+2.\n"
+           "\n"
+           );
+    printf("    auto-threshold [--rate <HZ>] [--margin <N>dB] [--hysteresis <N>dB]\n"
+           "          [--interval <MS>] [--floor-rise <MS>] [--speech-decay <MS>]\n"
+           "          [--duration <SECS>]\n"
+           "               Read the meter, follow the noise floor and the speech level,\n"
+           "               and keep the ducker threshold the margin above the floor, or\n"
+           "               half way up to the speech level, until Ctrl-C.\n"
+           "               --rate HZ     read HZ (1..1000, default 20) samples per second\n"
+           "               --margin N    keep the threshold at least NdB (0..60, default\n"
+           "                             10) above the noise floor\n"
+           "               --hysteresis N  only move the threshold by NdB (default 3)\n"
+           "                             or more\n"
+           "               --interval MS move the threshold at most every MS (default\n"
+           "                             5000) milliseconds\n"
+           "               --floor-rise MS  time constant the floor rises with to a\n"
+           "                             louder room (default 30000)\n"
+           "               --speech-decay MS  time constant the speech level falls\n"
+           "                             with (default 10000)\n"
+           "               --duration S  stop after S seconds\n"
+           "\n"
+           );
+    printf("    batch <COMMAND>...\n"
+           "    batch --file <FILE>\n"
+           "    batch -\n"
+           "               Parse all commands first, then run them one after the other\n"
+           "               on the same opened device, and report the total time taken.\n"
+           "               Each COMMAND argument is one complete command line like\n"
+           "               'ducker-range 18dB'. With --file or - (stdin), every line\n"
+           "               is one command, and empty lines and # comments are ignored.\n"
+           "               The meter, sweep, auto-threshold, and trigger commands cannot\n"
+           "               be used in a batch.\n"
+           "\n"
+           "    check-permissions\n"
+           "               Just open the hardware device, but do not communicate.\n"
+           "\n"
+           "    daemon <SOCKET> [--board <NAME>] [--meter-rate <HZ>]\n"
+           "               Open the device once and keep it open, then run the commands\n"
+           "               received over the local Unix domain socket SOCKET until a\n"
+           "               shutdown request arrives or you press Ctrl-C.\n"
+           "               --board NAME  publish the applied settings in the shared\n"
+           "                             memory board NAME for scnp-board to read\n"
+           "               --meter-rate HZ  also publish HZ (1..10000) meter samples\n"
+           "                             per second to the board\n"
+           "\n"
+           "    ducker-off\n"
+           "               Turn off the ducker.\n"
+           "\n"
+           "    ducker-on <INPUTS> <RELEASE>ms\n"
+           "               Turn on the ducker and set the following values:\n"
+           "                 INPUTS (range 0..15) is a bitmask for the input \"selection\"\n"
+           "                         0b0000 =  0 = no inputs watched\n"
+           "                         0b1111 = 15 = all four inputs watched\n"
+           "                         where bit 0 is channel 1, bit 1 is channel 2, etc.\n"
+           "                 RELEASE (range 0..5000) is a the \"release\" time in ms\n"
+           "                         0 = release time 0, 5000 = release time 5000ms=5s\n"
+           "\n"
+           "    ducker-range <HEX_VALUE>|<RANGE>dB\n"
+           "               Set the \"duck range\" to the given value.\n"
+           "               Valid range is 0dB to 90dB, or 0 to 0x1fffffff.\n"
+           "               It may be best to only use this while ducker is on.\n"
+           "\n"
+           "    ducker-threshold <HEX_VALUE>|<THRESH>dB\n"
+           "               Set the \"threshold\" to the given value.\n"
+           "               Valid range is -60dB to 0dB, or 0x000000 to 0x7fffff.\n"
+           "               It may be best to only use this while ducker is on.\n"
+           "\n"
+           );
+    printf("    exporter <LISTEN> [--rate <HZ>] [--rms <MS>]... [--peak-decay <MS>]\n"
+           "               Open the device once and sample the meter, and serve the\n"
+           "               meter levels, the USB transfer statistics, and the settings\n"
+           "               recorded in the state shadow as OpenMetrics text at\n"
+           "               http://LISTEN/metrics until you press Ctrl-C. LISTEN is a\n"
+           "               local Unix domain socket path, or a TCP [ADDR:]PORT with ADDR\n"
+           "               defaulting to 127.0.0.1. Scrapes never talk to the device.\n"
+           "               --rate HZ     take HZ (1..10000, default 10) samples per second\n"
+           "               --rms MS      RMS window (1..60000ms, default 300), up to\n"
+           "                             three times for several windows\n"
+           "               --peak-decay MS  time constant the held peak falls with\n"
+           "                             (0..60000ms, default 1000, 0 holds forever)\n"
+           "\n"
+           );
+    printf("    list [--json] [--refresh]\n"
+           "               List the selected devices with their serial numbers, as\n"
+           "               text or as a JSON array. The device strings are cached per\n"
+           "               USB port, --refresh reads them from the devices again.\n"
+           "\n"
+           "    meter [--inflight <N>] [--rate <HZ>] [--refresh <HZ>] [--rt-priority <PRIO>]\n"
+           "          [--cpu <CPU>] [--mlock]\n"
+           "          [--stats] [--rms <MS>]... [--peak-decay <MS>]\n"
+           "          [--format bar|csv|ndjson|binary] [--output <FILE>]\n"
+           "          [--count <N>] [--duration <SECS>] [--board <NAME>]\n"
+           "               Show the meter until you press Ctrl-C\n"
+           "               It may be best to only use this while ducker is on.\n"
+           "               --format F    bar graph on a TTY (default), or write timestamped\n"
+           "                             samples as csv, ndjson, or 16 byte binary records\n"
+           "               --output FILE write csv/ndjson/binary samples to FILE instead\n"
+           "                             of stdout (other messages then go to stderr)\n"
+           "               --count N     stop after N samples\n"
+           "               --duration S  stop after S seconds\n"
+           "               --board NAME  publish the latest sample in the shared\n"
+           "                             memory board NAME for scnp-board to read\n"
+           "               --inflight N  keep N (1..32) asynchronous meter requests\n"
+           "                             in flight instead of polling the device\n"
+           "               --rate HZ     take HZ (1..10000) samples per second on fixed\n"
+           "                             deadlines (default 10, or as fast as possible\n"
+           "                             with --inflight)\n"
+           "               --refresh HZ  redraw the bar graph HZ (1..100) times per second\n"
+           "                             (default 10), showing the peak sample since\n"
+           "                             the previous redraw\n"
+           "               --stats       show RMS, held peak and p95 level on the bar\n"
+           "                             graph line (the summary always has them)\n"
+           "               --rms MS      RMS window (1..60000ms, default 300), up to\n"
+           "                             three times for several windows\n"
+           "               --peak-decay MS  time constant the held peak falls with\n"
+           "                             (0..60000ms, default 1000, 0 holds forever)\n"
+           "               --rt-priority PRIO  run with SCHED_FIFO priority PRIO (1..99)\n"
+           "               --cpu CPU     only run on the given CPU\n"
+           "               --mlock       lock all memory to avoid page faults\n"
+           "\n"
+           );
+    printf("    ramp range|threshold <FROM> <TO> [--duration <MS>] [--rate <HZ>]\n"
+           "         [--curve dB|uint]\n"
+           "               Fade the ducker range or threshold from FROM to TO, given\n"
+           "               like for ducker-range and ducker-threshold, on one open\n"
+           "               device. Steps which encode to the message just sent are\n"
+           "               dropped. Prints how far the ramp was off schedule.\n"
+           "               --duration MS take MS (1..600000, default 1000) milliseconds,\n"
+           "                             at most 250 when sent to the daemon\n"
+           "               --rate HZ     take HZ (1..1000, default 50) steps per second\n"
+           "                             on fixed deadlines\n"
+           "               --curve C     fade linearly in dB (default), or in the raw\n"
+           "                             uint value\n"
+           "\n"
+           "    send <SOCKET> <command> <command_params...>\n"
+           "    send <SOCKET> shutdown\n"
+           "               Send one command to the daemon listening on SOCKET, wait for\n"
+           "               it to be run, and report how long that took. The meter and\n"
+           "               sweep commands cannot be sent. The shutdown request makes the\n"
+           "               daemon exit.\n"
+           "\n"
+           "    sweep threshold|range|inputs|routing <FROM> <TO> [--step <N>]\n"
+           "          [--samples <N>] [--rate <HZ>] [--settle <MS>] [--release <MS>]\n"
+           "          [--format csv|ndjson] [--output <FILE>]\n"
+           "               Step one setting from FROM to TO (always included), and read\n"
+           "               a burst of meter samples after every step, on one open\n"
+           "               device. Writes one line of meter statistics per step.\n"
+           "               FROM, TO, and the step are whole dB (like -40dB) for\n"
+           "               threshold and range, and numbers otherwise.\n"
+           "               --step N      step size (default 1)\n"
+           "               --samples N   read N (1..100000, default 100) samples per step\n"
+           "               --rate HZ     read the samples at HZ (1..10000, default 1000)\n"
+           "               --settle MS   wait MS (0..60000, default 200) milliseconds\n"
+           "                             after every step before reading\n"
+           "               --release MS  release time for an inputs sweep (default 100)\n"
+           "               --format F    write csv (default) or ndjson lines\n"
+           "               --output FILE write the lines to FILE instead of stdout\n"
+           "\n"
+           );
+    printf("    trigger --level <N>dB... [--hysteresis <N>dB] [--hold <MS>] [--rate <HZ>]\n"
+           "          [--fifo <PATH>] [--exec <COMMAND>] [--duration <SECS>]\n"
+           "               Read the meter, and report every time it rises to or falls\n"
+           "               below one of the levels (-100dB..0dB, up to 8), until Ctrl-C.\n"
+           "               Every event is printed as a line like 'event t_ns=T\n"
+           "               edge=rising level=-30dB value=-27.51dB'.\n"
+           "               --hysteresis N  only fall NdB (default 0) below the level\n"
+           "               --hold MS     keep every edge for MS (default 0) milliseconds\n"
+           "                             before the next one of that level\n"
+           "               --rate HZ     read HZ (1..10000, default 100) samples per second\n"
+           "               --fifo PATH   also write the event lines to the FIFO PATH,\n"
+           "                             dropping them while it has no reader\n"
+           "               --exec CMD    start sh -c CMD for every event without waiting,\n"
+           "                             with the edge, level, value, and time as $1..$4\n"
+           "               --duration S  stop after S seconds\n"
+           "\n"
+           "    watch <COMMAND>...\n"
+           "    watch --file <FILE>\n"
+           "    watch -\n"
+           "               Run the commands (given like for batch) on every selected\n"
+           "               device which is connected now, or is connected or power\n"
+           "               cycled later, until you press Ctrl-C. This restores the\n"
+           "               settings the device forgets when it is switched off.\n"
+           );
+}
+
+
+static
+int parse_params_audio_routing(command_params_T *params,
+                               const char *const param_sources)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_params_audio_routing(command_params_T *params,
+                               const char *const param_sources)
+{
+    char *p = NULL;
+    errno = 0;
+    if (*(param_sources) == '\0') {
+        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
+        return EXIT_FAILURE;
+    }
+    const long lval = strtol(param_sources, &p, 10);
+    if ((p == NULL) || (*p != '\0')) {
+        fprintf(stderr, "Fatal: Error converting number\n");
+        return EXIT_FAILURE;
+    }
+    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
+        fprintf(stderr, "Fatal: Error converting number: number range\n");
+        return EXIT_FAILURE;
+    }
+    if (lval < 0) {
+        fprintf(stderr, "Fatal: Error converting number: negative\n");
+        return EXIT_FAILURE;
+    }
+    if (lval > UINT8_MAX) {
+        fprintf(stderr, "Fatal: Error converting number: too large\n");
+        return EXIT_FAILURE;
+    }
+
+    // printf("audio-routing lval=%ld\n", lval);
+    const uint8_t source_index = (uint8_t) lval;
+    COND_OR_RETURN(source_index < NOTEPAD_SOURCES_MAX,
+                   "sources index must be less than 4");
+
+    params->audio_routing.source_index = source_index;
+
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_params_ducker_on(command_params_T *params,
+                           const char *const param_inputs,
+                           const char *const param_release_ms)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+int parse_params_ducker_on(command_params_T *params,
+                           const char *const param_inputs,
+                           const char *const param_release)
+{
+    if (true) {
+        char *p = NULL;
+        errno = 0;
+        if (*(param_inputs) == '\0') {
+            fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
+            return EXIT_FAILURE;
+        }
+        long lval;
+        if (strncmp("0b", param_inputs, 2) == 0) {
+            lval = strtol(&param_inputs[2], &p, 2);
+        } else {
+            lval = strtol(param_inputs, &p, 0);
+        }
+        // fprintf(stderr, "value conversion: %s to %ld\n", param_inputs, lval);
+        if ((p == NULL) || (*p != '\0')) {
+            fprintf(stderr, "Fatal: Error converting number\n");
+            return EXIT_FAILURE;
+        }
+        if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
+            fprintf(stderr, "Fatal: Error converting number: number range\n");
+            return EXIT_FAILURE;
+        }
+        if (lval < 0) {
+            fprintf(stderr, "Fatal: Error converting number: negative\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > UINT8_MAX) {
+            fprintf(stderr, "Fatal: Error converting number: too large\n");
+            return EXIT_FAILURE;
+        }
+        /* range check input_set */
+        if (lval > 15) {
+            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+            return EXIT_FAILURE;
+        }
+        params->ducker_on.inputs = (uint8_t) lval;
+    }
+
+    if (true) {
+        char *p = NULL;
+        errno = 0;
+        if (*(param_release) == '\0') {
+            fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
+            return EXIT_FAILURE;
+        }
+        const long lval = strtol(param_release, &p, 10);
+        if (p == NULL) {
+            fprintf(stderr, "Fatal: Error converting number\n");
+            return EXIT_FAILURE;
+        }
+        if (strcmp(p, "ms") != 0) {
+            fprintf(stderr, "Fatal: Missing unit (ms)\n");
+            return EXIT_FAILURE;
         }
         if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
             fprintf(stderr, "Fatal: Error converting number: number range\n");
             return EXIT_FAILURE;
         }
-        if (lval < 0) {
-            fprintf(stderr, "Fatal: Error converting number: negative\n");
+        if (lval < 0) {
+            fprintf(stderr, "Fatal: Error converting number: negative\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > UINT16_MAX) {
+            fprintf(stderr, "Fatal: Error converting number: too large\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > 5000L) {
+            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+            return EXIT_FAILURE;
+        }
+        params->ducker_on.release_ms = (uint16_t) lval;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_params_ducker_range(command_params_T *params,
+                              const char *const param_range)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_params_ducker_range(command_params_T *params,
+                              const char *const param_range)
+{
+    char *p = NULL;
+    errno = 0;
+    if (*(param_range) == '\0') {
+        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
+        return EXIT_FAILURE;
+    }
+    const long lval = strtol(param_range, &p, 0);
+    if (p == NULL) {
+        fprintf(stderr, "Fatal: Error converting number\n");
+        return EXIT_FAILURE;
+    }
+    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
+        fprintf(stderr, "Fatal: Error converting number: number range\n");
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(p, "dB") == 0) { /* integer ending with unit "dB" */
+        if (lval < 0) {
+            fprintf(stderr, "Fatal: Error converting number: below 0dB\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > 90) {
+            fprintf(stderr, "Fatal: Error converting number: above 90dB\n");
+            return EXIT_FAILURE;
+        }
+        /* value range is now 0 .. 90 including */
+        const double dval   = (double) lval;
+        const uint32_t ui = dB_to_uint_range(dval);
+        params->ducker_range.range = ui;
+    } else if (*p == '\0') { /* integer without a unit */
+        if (lval < 0) {
+            fprintf(stderr, "Fatal: Error converting number: negative\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > 0x1fffffff) {
+            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+            return EXIT_FAILURE;
+        }
+        params->ducker_range.range = (uint32_t) lval;
+    } else {
+        fprintf(stderr, "Fatal: Invalid unit (must be integer or integer with dB)\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_params_ducker_threshold(command_params_T *params,
+                                  const char *const param_threshold)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_params_ducker_threshold(command_params_T *params,
+                                  const char *const param_threshold)
+{
+    char *p = NULL;
+    errno = 0;
+    if (*(param_threshold) == '\0') {
+        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
+        return EXIT_FAILURE;
+    }
+    const long lval = strtol(param_threshold, &p, 0);
+    if (p == NULL) {
+        fprintf(stderr, "Fatal: Error converting number\n");
+        return EXIT_FAILURE;
+    }
+    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
+        fprintf(stderr, "Fatal: Error converting number: number range\n");
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(p, "dB") == 0) { /* integer ending with unit "dB" */
+        if (lval < -60) {
+            fprintf(stderr, "Fatal: Error converting number: below -60dB\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > 0) {
+            fprintf(stderr, "Fatal: Error converting number: above 0dB\n");
+            return EXIT_FAILURE;
+        }
+        /* value range is now -60 .. 0 including */
+        const double dval = (double) lval;
+        const uint32_t ui = dB_to_uint_threshold(dval);
+        params->ducker_threshold.thresh = ui;
+    } else if (*p == '\0') { /* integer without a unit */
+        if (lval < 0) {
+            fprintf(stderr, "Fatal: Error converting number: negative\n");
+            return EXIT_FAILURE;
+        }
+        if (lval > 0x1fffffff) {
+            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+            return EXIT_FAILURE;
+        }
+        params->ducker_threshold.thresh = (uint32_t) lval;
+    } else {
+        fprintf(stderr, "Fatal: Invalid unit (must be integer or integer with dB)\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse an unsigned decimal number in the range min..max (including) */
+static
+int parse_ulong_range(unsigned long *value, const char *const str,
+                      const unsigned long min, const unsigned long max)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_ulong_range(unsigned long *value, const char *const str,
+                      const unsigned long min, const unsigned long max)
+{
+    char *p = NULL;
+    errno = 0;
+    if ((*str == '\0') || (*str == '-')) {
+        fprintf(stderr, "Fatal: Looking for number, got '%s'.\n", str);
+        return EXIT_FAILURE;
+    }
+    const unsigned long ulval = strtoul(str, &p, 10);
+    if ((p == NULL) || (*p != '\0') || (errno != 0)) {
+        fprintf(stderr, "Fatal: Error converting number '%s'\n", str);
+        return EXIT_FAILURE;
+    }
+    if ((ulval < min) || (ulval > max)) {
+        fprintf(stderr, "Fatal: Number %lu outside valid range (%lu to %lu)\n",
+                ulval, min, max);
+        return EXIT_FAILURE;
+    }
+    *value = ulval;
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_params_meter(command_params_T *params,
+                       const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_params_meter(command_params_T *params,
+                       const int argc, const char *const argv[])
+{
+    memset(&params->meter, 0, sizeof(params->meter));
+    params->meter.rate_hz = METER_RATE_DEFAULT;
+    params->meter.refresh_hz = METER_REFRESH_DEFAULT;
+    params->meter.peak_decay_ms = METER_PEAK_DECAY_DEFAULT_MS;
+    params->meter.cpu = -1;
+
+    bool rate_given = false;
+    for (int i=0; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--inflight") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_INFLIGHT_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.inflight = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.rate_hz = (unsigned int) ulval;
+            rate_given = true;
+        } else if ((strcmp(argv[i], "--refresh") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_REFRESH_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.refresh_hz = (unsigned int) ulval;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            params->meter.stats = true;
+        } else if ((strcmp(argv[i], "--rms") == 0) && ((i+1) < argc)) {
+            COND_OR_RETURN(params->meter.rms_window_count <
+                           METER_STATS_RMS_WINDOWS_MAX,
+                           "too many --rms windows");
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_STATS_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.rms_window_ms[params->meter.rms_window_count++] =
+                (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--peak-decay") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  0, METER_STATS_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.peak_decay_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rt-priority") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, 99) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.rt_priority = (int) ulval;
+        } else if ((strcmp(argv[i], "--cpu") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 0, 1023) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.cpu = (int) ulval;
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            params->meter.mlock = true;
+        } else if ((strcmp(argv[i], "--format") == 0) && ((i+1) < argc)) {
+            const char *const format = argv[++i];
+            if (strcmp(format, "bar") == 0) {
+                params->meter.format = METER_FORMAT_BAR;
+            } else if (strcmp(format, "csv") == 0) {
+                params->meter.format = METER_FORMAT_CSV;
+            } else if (strcmp(format, "ndjson") == 0) {
+                params->meter.format = METER_FORMAT_NDJSON;
+            } else if (strcmp(format, "binary") == 0) {
+                params->meter.format = METER_FORMAT_BINARY;
+            } else {
+                fprintf(stderr, "Fatal: Unknown meter format: %s\n", format);
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--output") == 0) && ((i+1) < argc)) {
+            params->meter.output_path = argv[++i];
+            if (strcmp(params->meter.output_path, "-") == 0) {
+                params->meter.output_path = NULL;
+            }
+        } else if ((strcmp(argv[i], "--count") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, ULONG_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.count = ulval;
+        } else if ((strcmp(argv[i], "--duration") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, ULONG_MAX/1000000000UL) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params->meter.duration_s = ulval;
+        } else if ((strcmp(argv[i], "--board") == 0) && ((i+1) < argc)) {
+            params->meter.board_name = argv[++i];
+        } else {
+            fprintf(stderr, "Fatal: Unhandled meter argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* The asynchronous meter runs as fast as it can unless asked for
+     * a specific rate, and a replayed trace comes at its own pace. */
+    if (((params->meter.inflight > 0) || (replay_path != NULL)) && !rate_given) {
+        params->meter.rate_hz = 0;
+    }
+
+    if (params->meter.rms_window_count == 0) {
+        params->meter.rms_window_ms[0] = METER_RMS_WINDOW_DEFAULT_MS;
+        params->meter.rms_window_count = 1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* ramp range|threshold <FROM> <TO> [options...], with FROM and TO
+ * given like for ducker-range and ducker-threshold. */
+static
+int parse_params_ramp(command_params_T *params,
+                      const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_params_ramp(command_params_T *params,
+                      const int argc, const char *const argv[])
+{
+    COND_OR_RETURN(argc >= 3, "ramp needs the setting, FROM, and TO");
+
+    ramp_params_T ramp;
+    memset(&ramp, 0, sizeof(ramp));
+    ramp.duration_ms = RAMP_DURATION_DEFAULT_MS;
+    ramp.rate_hz = RAMP_RATE_DEFAULT;
+    ramp.curve = RAMP_CURVE_DB;
+
+    command_params_T value_params;
+    if (strcmp(argv[0], "range") == 0) {
+        ramp.setting = DEVICE_STATE_RANGE;
+        if ((parse_params_ducker_range(&value_params, argv[1]) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        ramp.from_value = value_params.ducker_range.range;
+        if ((parse_params_ducker_range(&value_params, argv[2]) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        ramp.to_value = value_params.ducker_range.range;
+    } else if (strcmp(argv[0], "threshold") == 0) {
+        ramp.setting = DEVICE_STATE_THRESHOLD;
+        if ((parse_params_ducker_threshold(&value_params, argv[1]) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        ramp.from_value = value_params.ducker_threshold.thresh;
+        if ((parse_params_ducker_threshold(&value_params, argv[2]) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        ramp.to_value = value_params.ducker_threshold.thresh;
+        /* ducker-threshold takes raw values the device rejects, which
+         * would only fail once the ramp is running */
+        if ((ramp.from_value > REF_VALUE_THRESHOLD) ||
+            (ramp.to_value > REF_VALUE_THRESHOLD)) {
+            fprintf(stderr, "Fatal: ramp threshold values must not be above 0x%lx\n",
+                    REF_VALUE_THRESHOLD);
+            return EXIT_FAILURE;
+        }
+    } else {
+        fprintf(stderr, "Fatal: Unknown ramp setting: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i=3; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--duration") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, RAMP_DURATION_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            ramp.duration_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, RAMP_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            ramp.rate_hz = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--curve") == 0) && ((i+1) < argc)) {
+            const char *const curve = argv[++i];
+            if (strcmp(curve, "dB") == 0) {
+                ramp.curve = RAMP_CURVE_DB;
+            } else if (strcmp(curve, "uint") == 0) {
+                ramp.curve = RAMP_CURVE_UINT;
+            } else {
+                fprintf(stderr, "Fatal: Unknown ramp curve: %s\n", curve);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Fatal: Unhandled ramp argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* 0 is minus infinity dB */
+    COND_OR_RETURN((ramp.curve != RAMP_CURVE_DB) ||
+                   ((ramp.from_value > 0) && (ramp.to_value > 0)),
+                   "the dB curve needs values above 0, use --curve uint");
+
+    params->ramp = ramp;
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse a whole number from MIN to MAX, with the unit "dB" if DB is
+ * set, like the ends of a sweep or the trigger levels. */
+static
+int parse_whole_value(long *value, const char *const str, const bool dB,
+                      const long min, const long max)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_whole_value(long *value, const char *const str, const bool dB,
+                      const long min, const long max)
+{
+    char *p = NULL;
+    errno = 0;
+    const long lval = strtol(str, &p, 10);
+    if ((p == str) || (errno != 0) ||
+        (strcmp(p, dB ? "dB" : "") != 0)) {
+        fprintf(stderr, "Fatal: Invalid value: %s (must be an integer%s)\n",
+                str, dB ? " with dB" : "");
+        return EXIT_FAILURE;
+    }
+    if ((lval < min) || (lval > max)) {
+        fprintf(stderr, "Fatal: Value %s outside valid range (%ld to %ld)\n",
+                str, min, max);
+        return EXIT_FAILURE;
+    }
+    *value = lval;
+    return EXIT_SUCCESS;
+}
+
+
+/* sweep threshold|range|inputs|routing <FROM> <TO> [options...] */
+static
+int parse_params_sweep(command_params_T *params,
+                       const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_params_sweep(command_params_T *params,
+                       const int argc, const char *const argv[])
+{
+    COND_OR_RETURN(argc >= 3, "sweep needs the parameter, FROM, and TO");
+
+    sweep_params_T sweep;
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.step = 1;
+    sweep.samples = SWEEP_SAMPLES_DEFAULT;
+    sweep.rate_hz = SWEEP_RATE_DEFAULT;
+    sweep.settle_ms = SWEEP_SETTLE_DEFAULT_MS;
+    sweep.release_ms = SWEEP_RELEASE_DEFAULT_MS;
+    sweep.format = METER_FORMAT_CSV;
+
+    bool dB = false;
+    long min = 0;
+    long max = 0;
+    if (strcmp(argv[0], "threshold") == 0) {
+        sweep.parameter = SWEEP_THRESHOLD;
+        dB = true;
+        min = -60;
+        max = 0;
+    } else if (strcmp(argv[0], "range") == 0) {
+        sweep.parameter = SWEEP_RANGE;
+        dB = true;
+        min = 0;
+        max = 90;
+    } else if (strcmp(argv[0], "inputs") == 0) {
+        sweep.parameter = SWEEP_INPUTS;
+        max = 15;
+    } else if (strcmp(argv[0], "routing") == 0) {
+        sweep.parameter = SWEEP_ROUTING;
+        max = NOTEPAD_SOURCES_MAX - 1;
+    } else {
+        fprintf(stderr, "Fatal: Unknown sweep parameter: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if ((parse_whole_value(&sweep.from, argv[1], dB, min, max) != EXIT_SUCCESS) ||
+        (parse_whole_value(&sweep.to, argv[2], dB, min, max) != EXIT_SUCCESS)) {
+        return EXIT_FAILURE;
+    }
+
+    for (int i=3; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--step") == 0) && ((i+1) < argc)) {
+            if (parse_whole_value(&sweep.step, argv[++i], dB,
+                                  1, max - min) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--samples") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, SWEEP_SAMPLES_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            sweep.samples = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            sweep.rate_hz = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--settle") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  0, SWEEP_SETTLE_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            sweep.settle_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--release") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 0, 5000) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            sweep.release_ms = (uint16_t) ulval;
+        } else if ((strcmp(argv[i], "--format") == 0) && ((i+1) < argc)) {
+            const char *const format = argv[++i];
+            if (strcmp(format, "csv") == 0) {
+                sweep.format = METER_FORMAT_CSV;
+            } else if (strcmp(format, "ndjson") == 0) {
+                sweep.format = METER_FORMAT_NDJSON;
+            } else {
+                fprintf(stderr, "Fatal: Unknown sweep format: %s\n", format);
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--output") == 0) && ((i+1) < argc)) {
+            sweep.output_path = argv[++i];
+            if (strcmp(sweep.output_path, "-") == 0) {
+                sweep.output_path = NULL;
+            }
+        } else {
+            fprintf(stderr, "Fatal: Unhandled sweep argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    params->sweep = sweep;
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse a whole number of dB from 0dB to MAX_DB. */
+static
+int parse_dB_range(unsigned int *value, const char *const str,
+                   const unsigned int max_dB)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int parse_dB_range(unsigned int *value, const char *const str,
+                   const unsigned int max_dB)
+{
+    long lval;
+    if (parse_whole_value(&lval, str, true, 0, (long) max_dB) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    *value = (unsigned int) lval;
+    return EXIT_SUCCESS;
+}
+
+
+/* auto-threshold [options...] */
+static
+int parse_params_auto_threshold(command_params_T *params,
+                                const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_params_auto_threshold(command_params_T *params,
+                                const int argc, const char *const argv[])
+{
+    auto_threshold_params_T at;
+    memset(&at, 0, sizeof(at));
+    at.rate_hz = AUTO_THRESHOLD_RATE_DEFAULT;
+    at.margin_dB = AUTO_THRESHOLD_MARGIN_DEFAULT_DB;
+    at.hysteresis_dB = AUTO_THRESHOLD_HYSTERESIS_DEFAULT_DB;
+    at.interval_ms = AUTO_THRESHOLD_INTERVAL_DEFAULT_MS;
+    at.floor_rise_ms = AUTO_THRESHOLD_FLOOR_RISE_DEFAULT_MS;
+    at.speech_decay_ms = AUTO_THRESHOLD_SPEECH_DECAY_DEFAULT_MS;
+
+    for (int i=0; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, 1000) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            at.rate_hz = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--margin") == 0) && ((i+1) < argc)) {
+            if ((parse_dB_range(&at.margin_dB, argv[++i], 60) != EXIT_SUCCESS)) {
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--hysteresis") == 0) && ((i+1) < argc)) {
+            if ((parse_dB_range(&at.hysteresis_dB, argv[++i], 60) != EXIT_SUCCESS)) {
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--interval") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, AUTO_THRESHOLD_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            at.interval_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--floor-rise") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, AUTO_THRESHOLD_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            at.floor_rise_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--speech-decay") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, AUTO_THRESHOLD_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            at.speech_decay_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--duration") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, 31536000) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            at.duration_s = ulval;
+        } else {
+            fprintf(stderr, "Fatal: Unhandled auto-threshold argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    params->auto_threshold = at;
+    return EXIT_SUCCESS;
+}
+
+
+/* trigger --level <N>dB... [options...] */
+static
+int parse_params_trigger(command_params_T *params,
+                         const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_params_trigger(command_params_T *params,
+                         const int argc, const char *const argv[])
+{
+    trigger_params_T trigger;
+    memset(&trigger, 0, sizeof(trigger));
+    trigger.rate_hz = TRIGGER_RATE_DEFAULT;
+
+    for (int i=0; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--level") == 0) && ((i+1) < argc)) {
+            COND_OR_RETURN(trigger.level_count < TRIGGER_LEVELS_MAX,
+                           "too many trigger levels");
+            if (parse_whole_value(&trigger.level_dB[trigger.level_count],
+                                  argv[++i], true, -100, 0) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            ++trigger.level_count;
+        } else if ((strcmp(argv[i], "--hysteresis") == 0) && ((i+1) < argc)) {
+            if ((parse_dB_range(&trigger.hysteresis_dB, argv[++i], 60) != EXIT_SUCCESS)) {
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--hold") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  0, TRIGGER_HOLD_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            trigger.hold_ms = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            trigger.rate_hz = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--fifo") == 0) && ((i+1) < argc)) {
+            trigger.fifo_path = argv[++i];
+        } else if ((strcmp(argv[i], "--exec") == 0) && ((i+1) < argc)) {
+#if defined(HAVE_POSIX_SPAWN) && defined(HAVE_SPAWN_H) && defined(HAVE_SYS_WAIT_H)
+            trigger.hook = argv[++i];
+#else
+            fprintf(stderr, "Fatal: --exec is not supported on this system\n");
+            return EXIT_FAILURE;
+#endif
+        } else if ((strcmp(argv[i], "--duration") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i], 1, 31536000) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            trigger.duration_s = ulval;
+        } else {
+            fprintf(stderr, "Fatal: Unhandled trigger argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    COND_OR_RETURN(trigger.level_count > 0, "trigger needs at least one --level");
+
+    params->trigger = trigger;
+    return EXIT_SUCCESS;
+}
+
+
+/* Scene files are parsed like batch files, see below. */
+static
+int parse_params_apply(command_params_T *params, const char *const filename)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+
+static
+int parse_command(command_T *command,
+                  const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_command(command_T *command,
+                  const int argc, const char *const argv[])
+{
+    /* argv[0] is the command name, followed by the command's params */
+    COND_OR_RETURN(argc >= 1, "missing command");
+
+    if (false) {
+        /* nothing */
+    } else if ((argc == 2) && (strcmp(argv[0], "audio-routing") == 0)) {
+        command->func = commandfunc_audio_routing;
+        return parse_params_audio_routing(&command->params, argv[1]);
+    } else if (strcmp(argv[0], "meter") == 0) {
+        command->func = commandfunc_meter;
+        return parse_params_meter(&command->params, argc-1, &argv[1]);
+    } else if ((argc == 1) && (strcmp(argv[0], "check-permissions") == 0)) {
+        /* no params needed to just open the device special file */
+        command->func = commandfunc_check_permissions;
+        return EXIT_SUCCESS;
+    } else if ((argc == 1) && (strcmp(argv[0], "ducker-off") == 0)) {
+        /* no params needed to turn off ducker  */
+        command->func = commandfunc_ducker_off;
+        return EXIT_SUCCESS;
+    } else if ((argc == 3) && (strcmp(argv[0], "ducker-on") == 0)) {
+        command->func = commandfunc_ducker_on;
+        return parse_params_ducker_on(&command->params, argv[1], argv[2]);
+    } else if ((argc == 2) && (strcmp(argv[0], "ducker-range") == 0)) {
+        command->func = commandfunc_ducker_range;
+        return parse_params_ducker_range(&command->params, argv[1]);
+    } else if ((argc == 2) && (strcmp(argv[0], "ducker-threshold") == 0)) {
+        command->func = commandfunc_ducker_threshold;
+        return parse_params_ducker_threshold(&command->params, argv[1]);
+    } else if ((argc == 2) && (strcmp(argv[0], "apply") == 0)) {
+        command->func = commandfunc_apply;
+        return parse_params_apply(&command->params, argv[1]);
+    } else if (strcmp(argv[0], "ramp") == 0) {
+        command->func = commandfunc_ramp;
+        return parse_params_ramp(&command->params, argc-1, &argv[1]);
+    } else if (strcmp(argv[0], "sweep") == 0) {
+        command->func = commandfunc_sweep;
+        return parse_params_sweep(&command->params, argc-1, &argv[1]);
+    } else if (strcmp(argv[0], "auto-threshold") == 0) {
+        command->func = commandfunc_auto_threshold;
+        return parse_params_auto_threshold(&command->params, argc-1, &argv[1]);
+    } else if (strcmp(argv[0], "trigger") == 0) {
+        command->func = commandfunc_trigger;
+        return parse_params_trigger(&command->params, argc-1, &argv[1]);
+    } else {
+        fprintf(stderr, "Fatal: Unhandled command line argument(s)\n");
+        return EXIT_FAILURE;
+    }
+}
+
+
+#define BATCH_COMMANDS_MAX 256
+#define BATCH_WORDS_MAX      8
+#define BATCH_LINE_MAX     256
+
+
+/* Split one batch line into words and parse it as a single command.
+ *
+ * Blank lines and lines starting with '#' are not commands, so they
+ * return EXIT_SUCCESS with *is_command set to false.
+ */
+static
+int parse_batch_line(command_T *command, bool *is_command,
+                     char *line, const char *const where)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3), nonnull(4) ));
+
+static
+int parse_batch_line(command_T *command, bool *is_command,
+                     char *line, const char *const where)
+{
+    const char *words[BATCH_WORDS_MAX];
+    int word_count = 0;
+
+    *is_command = false;
+
+    char *p = line;
+    while (true) {
+        while (isspace((unsigned char) *p)) {
+            ++p;
+        }
+        if ((*p == '\0') || (*p == '#')) {
+            break;
+        }
+        if (word_count == BATCH_WORDS_MAX) {
+            fprintf(stderr, "Fatal: %s: too many words\n", where);
+            return EXIT_FAILURE;
+        }
+        words[word_count++] = p;
+        while ((*p != '\0') && !isspace((unsigned char) *p)) {
+            ++p;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+
+    if (word_count == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    if (parse_command(command, word_count, words) != EXIT_SUCCESS) {
+        fprintf(stderr, "Fatal: %s: cannot parse command\n", where);
+        return EXIT_FAILURE;
+    }
+    if (command->func == commandfunc_meter) {
+        fprintf(stderr, "Fatal: %s: meter cannot be run in a batch\n", where);
+        return EXIT_FAILURE;
+    }
+    if (command->func == commandfunc_sweep) {
+        fprintf(stderr, "Fatal: %s: sweep cannot be run in a batch\n", where);
+        return EXIT_FAILURE;
+    }
+    if (command->func == commandfunc_auto_threshold) {
+        fprintf(stderr, "Fatal: %s: auto-threshold cannot be run in a batch\n", where);
+        return EXIT_FAILURE;
+    }
+    if (command->func == commandfunc_trigger) {
+        fprintf(stderr, "Fatal: %s: trigger cannot be run in a batch\n", where);
+        return EXIT_FAILURE;
+    }
+
+    *is_command = true;
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_batch_file(command_T *commands, size_t *command_count,
+                     FILE *file, const char *const filename)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3), nonnull(4) ));
+
+static
+int parse_batch_file(command_T *commands, size_t *command_count,
+                     FILE *file, const char *const filename)
+{
+    char line[BATCH_LINE_MAX];
+    unsigned long lineno = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++lineno;
+        char where[BATCH_LINE_MAX];
+        snprintf(where, sizeof(where), "%s:%lu", filename, lineno);
+
+        const size_t len = strlen(line);
+        if ((len > 0) && (line[len-1] != '\n') && !feof(file)) {
+            fprintf(stderr, "Fatal: %s: line too long\n", where);
+            return EXIT_FAILURE;
+        }
+        if (*command_count == BATCH_COMMANDS_MAX) {
+            fprintf(stderr, "Fatal: %s: too many commands\n", where);
             return EXIT_FAILURE;
         }
-        if (lval > UINT16_MAX) {
-            fprintf(stderr, "Fatal: Error converting number: too large\n");
+
+        bool is_command;
+        if (parse_batch_line(&commands[*command_count], &is_command,
+                             line, where) != EXIT_SUCCESS) {
             return EXIT_FAILURE;
         }
-        if (lval > 5000L) {
-            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+        if (is_command) {
+            ++(*command_count);
+        }
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "Fatal: %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* Read a scene file. It has the same format as a batch file, but may
+ * only set each of the settings once, and the order of the lines does
+ * not matter. */
+static
+int parse_params_apply(command_params_T *params, const char *const filename)
+{
+    /* keep scene files from applying scene files */
+    static bool parsing_scene = false;
+    COND_OR_RETURN(!parsing_scene, "scenes cannot apply other scenes");
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Fatal: %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    static command_T commands[BATCH_COMMANDS_MAX];
+    size_t command_count = 0;
+    parsing_scene = true;
+    const int retval = parse_batch_file(commands, &command_count,
+                                        file, filename);
+    parsing_scene = false;
+    fclose(file);
+    if (retval != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    device_state_T *const scene = &params->apply.scene;
+    memset(scene, 0, sizeof(*scene));
+    for (size_t i=0; i<command_count; ++i) {
+        const command_T *const command = &commands[i];
+        const command_params_T *const cparams = &command->params;
+        uint32_t setting;
+        if (command->func == commandfunc_audio_routing) {
+            setting = DEVICE_STATE_ROUTING;
+            scene->routing_source = cparams->audio_routing.source_index;
+        } else if (command->func == commandfunc_ducker_off) {
+            setting = DEVICE_STATE_DUCKER;
+            scene->ducker_on = false;
+        } else if (command->func == commandfunc_ducker_on) {
+            setting = DEVICE_STATE_DUCKER;
+            scene->ducker_on = true;
+            scene->ducker_inputs = cparams->ducker_on.inputs;
+            scene->ducker_release_ms = cparams->ducker_on.release_ms;
+        } else if (command->func == commandfunc_ducker_range) {
+            setting = DEVICE_STATE_RANGE;
+            scene->ducker_range = cparams->ducker_range.range;
+        } else if (command->func == commandfunc_ducker_threshold) {
+            setting = DEVICE_STATE_THRESHOLD;
+            scene->ducker_threshold = cparams->ducker_threshold.thresh;
+        } else {
+            fprintf(stderr, "Fatal: %s: scenes can only contain settings\n",
+                    filename);
+            return EXIT_FAILURE;
+        }
+        if (scene->valid & setting) {
+            fprintf(stderr, "Fatal: %s: %s set more than once\n", filename,
+                    setting_name(setting, scene->ducker_on));
+            return EXIT_FAILURE;
+        }
+        scene->valid |= setting;
+    }
+
+    if (scene->valid == 0) {
+        fprintf(stderr, "Fatal: %s: scene contains no settings\n", filename);
+        return EXIT_FAILURE;
+    }
+    if ((scene->valid & (DEVICE_STATE_RANGE | DEVICE_STATE_THRESHOLD)) &&
+        !((scene->valid & DEVICE_STATE_DUCKER) && scene->ducker_on)) {
+        fprintf(stderr, "Fatal: %s: ducker-range and ducker-threshold "
+                "need ducker-on in the same scene\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse the commands given as arguments, or read from --file FILE or
+ * from stdin, for the batch and watch commands. */
+static
+int parse_batch_args(command_T *commands, size_t *command_count,
+                     const int argc, const char *const argv[],
+                     const char *const what)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(4), nonnull(5) ));
+
+static
+int parse_batch_args(command_T *commands, size_t *command_count,
+                     const int argc, const char *const argv[],
+                     const char *const what)
+{
+    if (argc < 1) {
+        fprintf(stderr, "Fatal: %s requires commands, --file FILE, or -\n", what);
+        return EXIT_FAILURE;
+    }
+
+    if ((argc == 1) && (strcmp(argv[0], "-") == 0)) {
+        if (parse_batch_file(commands, command_count,
+                             stdin, "<stdin>") != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } else if ((argc == 2) && (strcmp(argv[0], "--file") == 0)) {
+        FILE *file = fopen(argv[1], "r");
+        if (file == NULL) {
+            fprintf(stderr, "Fatal: %s: %s\n", argv[1], strerror(errno));
+            return EXIT_FAILURE;
+        }
+        const int retval = parse_batch_file(commands, command_count,
+                                            file, argv[1]);
+        fclose(file);
+        if (retval != EXIT_SUCCESS) {
             return EXIT_FAILURE;
         }
-        params.ducker_on.release_ms = (uint16_t) lval;
+    } else {
+        for (int i=0; i<argc; ++i) {
+            char line[BATCH_LINE_MAX];
+            char where[BATCH_LINE_MAX];
+            snprintf(where, sizeof(where), "%s argument %d", what, i+1);
+            if (strlen(argv[i]) >= sizeof(line)) {
+                fprintf(stderr, "Fatal: %s: too long\n", where);
+                return EXIT_FAILURE;
+            }
+            if (*command_count == BATCH_COMMANDS_MAX) {
+                fprintf(stderr, "Fatal: %s: too many commands\n", where);
+                return EXIT_FAILURE;
+            }
+            strcpy(line, argv[i]);
+
+            bool is_command;
+            if (parse_batch_line(&commands[*command_count], &is_command,
+                                 line, where) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            if (is_command) {
+                ++(*command_count);
+            }
+        }
+    }
+
+    if (*command_count == 0) {
+        fprintf(stderr, "Fatal: %s contains no commands\n", what);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static
+int parse_command_watch(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
+
+static
+int parse_command_watch(const int argc, const char *const argv[])
+{
+    static command_T commands[BATCH_COMMANDS_MAX];
+    size_t command_count = 0;
+
+    if (parse_batch_args(commands, &command_count,
+                         argc, argv, "watch") != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    run_watch(commands, command_count);
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse all batch commands before touching the device, then run them
+ * all on the same libusb session and device handle. */
+static
+int parse_command_batch(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
+
+static
+int parse_command_batch(const int argc, const char *const argv[])
+{
+    static command_T commands[BATCH_COMMANDS_MAX];
+    size_t command_count = 0;
+
+    if (parse_batch_args(commands, &command_count,
+                         argc, argv, "batch") != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    const uint64_t start_ns = monotonic_ns();
+    const int result = run_usbdev_commands(commands, command_count);
+    const uint64_t stop_ns = monotonic_ns();
+
+    if (result != EXIT_SUCCESS) {
+        fprintf(stderr, "batch: failed after %.3fms\n",
+                ns_to_ms(stop_ns - start_ns));
+        return EXIT_FAILURE;
+    }
+    printf("batch: ran %zu command(s) in %.3fms\n",
+           command_count, ns_to_ms(stop_ns - start_ns));
+    return EXIT_SUCCESS;
+}
+
+
+/* The daemon keeps the libusb session and the device handle open and
+ * runs commands it receives over a local Unix domain socket.
+ *
+ * Every request and every response is one fixed size record. The
+ * request carries the command_params_T union in host byte order and
+ * layout, so daemon and client must be the same scnp-cli build on the
+ * same host. A client may send any number of requests over one
+ * connection, and gets exactly one response per request. The socket
+ * and the clients are handled by scnp_daemon.c.
+ */
+
+
+#define DAEMON_MAGIC   0x4e /* 'N' */
+#define DAEMON_VERSION 1
+
+
+/* The daemon runs a ramp inside its poll loop, where it keeps all
+ * other clients and the board waiting, so it only takes short ones. */
+#define DAEMON_RAMP_DURATION_MAX_MS 250U
+
+
+typedef enum {
+    DAEMON_REQUEST_SHUTDOWN          = 0,
+    DAEMON_REQUEST_AUDIO_ROUTING     = 1,
+    DAEMON_REQUEST_CHECK_PERMISSIONS = 2,
+    DAEMON_REQUEST_DUCKER_OFF        = 3,
+    DAEMON_REQUEST_DUCKER_ON         = 4,
+    DAEMON_REQUEST_DUCKER_RANGE      = 5,
+    DAEMON_REQUEST_DUCKER_THRESHOLD  = 6,
+    DAEMON_REQUEST_APPLY             = 7,
+    DAEMON_REQUEST_RAMP              = 8,
+    DAEMON_REQUEST_COUNT
+} daemon_request_id_T;
+
+
+typedef enum {
+    DAEMON_STATUS_OK          = 0,
+    DAEMON_STATUS_BAD_VERSION = 1,
+    DAEMON_STATUS_BAD_REQUEST = 2,
+    DAEMON_STATUS_USB_ERROR   = 3,
+} daemon_status_T;
+
+
+static
+const command_func_T daemon_command_funcs[DAEMON_REQUEST_COUNT] = {
+    [DAEMON_REQUEST_SHUTDOWN]          = NULL,
+    [DAEMON_REQUEST_AUDIO_ROUTING]     = commandfunc_audio_routing,
+    [DAEMON_REQUEST_CHECK_PERMISSIONS] = commandfunc_check_permissions,
+    [DAEMON_REQUEST_DUCKER_OFF]        = commandfunc_ducker_off,
+    [DAEMON_REQUEST_DUCKER_ON]         = commandfunc_ducker_on,
+    [DAEMON_REQUEST_DUCKER_RANGE]      = commandfunc_ducker_range,
+    [DAEMON_REQUEST_DUCKER_THRESHOLD]  = commandfunc_ducker_threshold,
+    [DAEMON_REQUEST_APPLY]             = commandfunc_apply,
+    [DAEMON_REQUEST_RAMP]              = commandfunc_ramp,
+};
+
+
+typedef struct {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t request_id;
+    uint8_t reserved;
+    command_params_T params;
+} daemon_request_T;
+
+
+typedef struct {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t status;
+    uint8_t reserved;
+    uint32_t elapsed_ns; /* time spent running the command in the daemon */
+} daemon_response_T;
+
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+
+
+/* Whether the SCENE only has settings the device accepts, with the
+ * same limits as the commands setting them. */
+static
+bool daemon_scene_valid(const device_state_T *scene)
+    __attribute__(( nonnull(1) ));
+
+static
+bool daemon_scene_valid(const device_state_T *scene)
+{
+    const uint32_t all = DEVICE_STATE_ROUTING | DEVICE_STATE_DUCKER |
+        DEVICE_STATE_RANGE | DEVICE_STATE_THRESHOLD;
+    if ((scene->valid == 0) || (scene->valid & ~all)) {
+        return false;
+    }
+    if ((scene->valid & DEVICE_STATE_ROUTING) &&
+        (scene->routing_source >= NOTEPAD_SOURCES_MAX)) {
+        return false;
+    }
+    if ((scene->valid & DEVICE_STATE_DUCKER) && scene->ducker_on &&
+        ((scene->ducker_inputs > 15) || (scene->ducker_release_ms > 5000))) {
+        return false;
+    }
+    if ((scene->valid & DEVICE_STATE_RANGE) &&
+        (scene->ducker_range > 0x1fffffff)) {
+        return false;
+    }
+    if ((scene->valid & DEVICE_STATE_THRESHOLD) &&
+        (scene->ducker_threshold > 0x007fffff)) {
+        return false;
+    }
+    /* like parse_params_apply */
+    if ((scene->valid & (DEVICE_STATE_RANGE | DEVICE_STATE_THRESHOLD)) &&
+        !((scene->valid & DEVICE_STATE_DUCKER) && scene->ducker_on)) {
+        return false;
+    }
+    return true;
+}
+
+
+/* The params come from another process, so check them against the
+ * same limits the command line parser applies before running the
+ * command. The commands fail the whole process on values outside
+ * those, and a ramp without a duration would never end. A ramp must
+ * also fit into DAEMON_RAMP_DURATION_MAX_MS. */
+static
+bool daemon_params_valid(const uint8_t request_id,
+                         const command_params_T *params)
+    __attribute__(( nonnull(2) ));
+
+static
+bool daemon_params_valid(const uint8_t request_id,
+                         const command_params_T *params)
+{
+    switch (request_id) {
+    case DAEMON_REQUEST_AUDIO_ROUTING:
+        return params->audio_routing.source_index < NOTEPAD_SOURCES_MAX;
+    case DAEMON_REQUEST_CHECK_PERMISSIONS:
+    case DAEMON_REQUEST_DUCKER_OFF:
+        return true;
+    case DAEMON_REQUEST_DUCKER_ON:
+        return (params->ducker_on.inputs <= 15) &&
+            (params->ducker_on.release_ms <= 5000);
+    case DAEMON_REQUEST_DUCKER_RANGE:
+        return params->ducker_range.range <= 0x1fffffff;
+    case DAEMON_REQUEST_DUCKER_THRESHOLD:
+        return params->ducker_threshold.thresh <= 0x007fffff;
+    case DAEMON_REQUEST_APPLY:
+        return daemon_scene_valid(&params->apply.scene);
+    case DAEMON_REQUEST_RAMP: {
+        const ramp_params_T *const ramp = &params->ramp;
+        uint32_t max;
+        if (ramp->setting == DEVICE_STATE_RANGE) {
+            max = 0x1fffffff;
+        } else if (ramp->setting == DEVICE_STATE_THRESHOLD) {
+            max = 0x007fffff;
+        } else {
+            return false;
+        }
+        if ((ramp->from_value > max) || (ramp->to_value > max) ||
+            (ramp->duration_ms < 1) ||
+            (ramp->duration_ms > DAEMON_RAMP_DURATION_MAX_MS) ||
+            (ramp->rate_hz < 1) || (ramp->rate_hz > RAMP_RATE_MAX)) {
+            return false;
+        }
+        if (ramp->curve == RAMP_CURVE_DB) {
+            /* 0 is minus infinity dB */
+            return (ramp->from_value > 0) && (ramp->to_value > 0);
+        }
+        return ramp->curve == RAMP_CURVE_UINT;
+    }
+    default:
+        return false;
+    }
+}
+
+
+/* Run one complete request from a daemon client. */
+static
+void daemon_serve_request(void *data, const void *request_buf,
+                          void *response_buf, bool *shutdown)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3), nonnull(4) ));
+
+static
+void daemon_serve_request(void *data, const void *request_buf,
+                          void *response_buf, bool *shutdown)
+{
+    usbdev_T *const usbdev = data;
+    const daemon_request_T *const request = request_buf;
+    daemon_response_T *const response = response_buf;
+    response->magic = DAEMON_MAGIC;
+    response->version = DAEMON_VERSION;
+
+    if ((request->magic != DAEMON_MAGIC) ||
+        (request->version != DAEMON_VERSION)) {
+        response->status = DAEMON_STATUS_BAD_VERSION;
+    } else if (request->request_id >= DAEMON_REQUEST_COUNT) {
+        response->status = DAEMON_STATUS_BAD_REQUEST;
+    } else if (request->request_id == DAEMON_REQUEST_SHUTDOWN) {
+        printf("daemon: shutdown requested\n");
+        response->status = DAEMON_STATUS_OK;
+        *shutdown = true;
+    } else if (!daemon_params_valid(request->request_id, &request->params)) {
+        fprintf(stderr, "daemon: rejecting request %u with invalid params\n",
+                request->request_id);
+        response->status = DAEMON_STATUS_BAD_REQUEST;
+    } else {
+        /* the command functions take the params as non-const */
+        command_params_T params = request->params;
+        const uint64_t start_ns = monotonic_ns();
+        const int ret =
+            daemon_command_funcs[request->request_id](usbdev, &params);
+        const uint64_t elapsed_ns = monotonic_ns() - start_ns;
+        response->status = (ret < 0) ? DAEMON_STATUS_USB_ERROR : DAEMON_STATUS_OK;
+        response->elapsed_ns =
+            (elapsed_ns > UINT32_MAX) ? UINT32_MAX : (uint32_t) elapsed_ns;
+    }
+    fflush(stdout);
+}
+
+
+typedef struct {
+    const char *socket_path;
+
+    /* NULL, or the name of the shared memory board to publish to */
+    const char *board_name;
+
+    /* meter samples per second published to the board, 0 for none */
+    unsigned int meter_rate_hz;
+} daemon_params_T;
+
+
+/* Publish the daemon's meter samples on the board. */
+static
+int daemon_board_sample(void *data, const uint32_t value, const uint64_t t_ns);
+
+static
+int daemon_board_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    (void) data;
+    (void) t_ns;
+    board_publish_meter(value, uint_to_dB_meter(value), realtime_ns());
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+int run_daemon(const daemon_params_T *params)
+    __attribute__(( nonnull(1) ));
+
+static
+int run_daemon(const daemon_params_T *params)
+{
+    const char *const socket_path = params->socket_path;
+
+    /* Open the device before the socket appears, so that the first
+     * client does not have to wait for device discovery. */
+    usbdev_T usbdev;
+    usbdev_open(&usbdev);
+
+    if (params->board_name != NULL) {
+        board_create_or_fail(&usbdev, params->board_name);
+    }
+
+    daemon_server_T server;
+    if (!daemon_server_open(&server, socket_path,
+                            sizeof(daemon_request_T), sizeof(daemon_response_T),
+                            daemon_serve_request, &usbdev)) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* No SA_RESTART, so that Ctrl-C interrupts a blocking poll(2). */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("daemon: listening on %s\n", socket_path);
+    fflush(stdout);
+
+    meter_schedule_T schedule;
+    meter_schedule_init(&schedule, params->meter_rate_hz);
+    meter_sampler_T sampler;
+    meter_sampler_init(&sampler, &schedule, daemon_board_sample, NULL);
+
+    /* Polling the clients never blocks for longer than until the next
+     * meter sample for the board is due. */
+    bool shutdown = false;
+    bool sampling = (params->meter_rate_hz > 0);
+    while (!global_abort && !shutdown) {
+        int timeout_ms = -1;
+        if (sampling) {
+            const uint64_t now_ns = monotonic_ns();
+            if (meter_sampler_due(&sampler, now_ns)) {
+                const int ret = meter_sampler_sample(&usbdev, &sampler, now_ns);
+                if ((ret == LUDH_END_OF_REPLAY) ||
+                    (ret == LIBUSB_ERROR_NO_DEVICE)) {
+                    /* the replayed trace has ended, or the device is gone */
+                    sampling = false;
+                }
+                /* on other errors, try again on the next deadline */
+                continue;
+            }
+            timeout_ms = (int) ((schedule.next_ns - now_ns + 999999ULL) / 1000000ULL);
+        }
+        if (!daemon_server_poll(&server, timeout_ms, &shutdown)) {
+            break;
+        }
+    }
+
+    daemon_server_close(&server);
+    board_close();
+    usbdev_close(&usbdev);
+
+    printf("daemon: exiting\n");
+    return EXIT_SUCCESS;
+}
+
+
+static
+int send_daemon_request(const char *const socket_path,
+                        daemon_request_T *request)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int send_daemon_request(const char *const socket_path,
+                        daemon_request_T *request)
+{
+    const uint64_t start_ns = monotonic_ns();
+    daemon_response_T response;
+    if (!daemon_transact(socket_path, request, sizeof(*request),
+                         &response, sizeof(response))) {
+        return EXIT_FAILURE;
+    }
+    const uint64_t stop_ns = monotonic_ns();
+
+    if ((response.magic != DAEMON_MAGIC) ||
+        (response.version != DAEMON_VERSION)) {
+        fprintf(stderr, "Fatal: daemon protocol version mismatch\n");
+        return EXIT_FAILURE;
+    }
+    if (response.status == DAEMON_STATUS_USB_ERROR) {
+        fprintf(stderr, "Error: daemon failed to talk to the device\n");
+        return EXIT_FAILURE;
+    } else if (response.status != DAEMON_STATUS_OK) {
+        fprintf(stderr, "Fatal: daemon rejected request (status %u)\n",
+                response.status);
+        return EXIT_FAILURE;
     }
 
-    run_usbdev_command(commandfunc_ducker_on, &params);
+    printf("send: done in %.3fms (%.3fms in daemon)\n",
+           ns_to_ms(stop_ns - start_ns), ns_to_ms(response.elapsed_ns));
     return EXIT_SUCCESS;
 }
 
 
+/* The exporter samples the meter on the schedule's deadlines like the
+ * daemon, and keeps the metrics scnp_exporter.c serves up to date. */
+
+
+/* how often the settings are reloaded from the state shadow, and the
+ * achieved sample rate is updated */
+#define EXPORTER_REFRESH_NS 1000000000ULL
+
+
+typedef struct {
+    const char *listen;
+
+    unsigned int rate_hz;
+    unsigned int rms_window_ms[METER_STATS_RMS_WINDOWS_MAX];
+    unsigned int rms_window_count;
+    unsigned int peak_decay_ms;
+} exporter_params_T;
+
+
+typedef struct {
+    meter_schedule_T schedule;
+    meter_sampler_T sampler;
+    exporter_metrics_T metrics;
+
+    uint64_t rate_since_ns;
+    uint64_t rate_since_count;
+} exporter_T;
+
+
+static
+int exporter_sample(void *data, const uint32_t value, const uint64_t t_ns)
+    __attribute__(( nonnull(1) ));
+
+static
+int exporter_sample(void *data, const uint32_t value, const uint64_t t_ns)
+{
+    exporter_metrics_T *const metrics = data;
+    metrics->level_dB = uint_to_dB_meter(value);
+    meter_stats_add(&metrics->stats,
+                    ((double) value) / ((double) REF_VALUE_METER),
+                    metrics->level_dB, t_ns);
+    return LIBUSB_SUCCESS;
+}
+
+
+/* Copy the counters kept elsewhere into the metrics. */
+static
+void exporter_update_counts(exporter_T *ex)
+    __attribute__(( nonnull(1) ));
+
+static
+void exporter_update_counts(exporter_T *ex)
+{
+    exporter_metrics_T *const metrics = &ex->metrics;
+    metrics->sample_count = ex->sampler.sample_count;
+    metrics->read_error_count = ex->sampler.error_count;
+    metrics->deadline_missed_count = ex->schedule.missed_count;
+    metrics->usb_transfers = transfer_counters.transfers;
+    metrics->usb_retries = transfer_counters.retries;
+    metrics->usb_timeouts = transfer_counters.timeouts;
+    metrics->usb_failures = transfer_counters.failures;
+}
+
+
+/* Reload the settings other scnp-cli runs have sent, and update the
+ * achieved sample rate. */
+static
+void exporter_refresh(exporter_T *ex, usbdev_T *usbdev, const uint64_t now_ns)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void exporter_refresh(exporter_T *ex, usbdev_T *usbdev, const uint64_t now_ns)
+{
+    exporter_metrics_T *const metrics = &ex->metrics;
+    if (usbdev->shadow_enabled) {
+        state_shadow_T shadow;
+        metrics->state_known =
+            state_shadow_open(&shadow, metrics->serial, usbdev->shadow.port_path,
+                              usbdev->shadow.devaddr, dry_run);
+        metrics->state = shadow.state;
+        metrics->ducker_range_dB =
+            0.0 - uint_to_dB(REF_VALUE_RANGE, shadow.state.ducker_range);
+        metrics->ducker_threshold_dB =
+            uint_to_dB(REF_VALUE_THRESHOLD, shadow.state.ducker_threshold);
+    }
+    if (now_ns > ex->rate_since_ns) {
+        metrics->sample_rate_hz =
+            ((double) (ex->sampler.sample_count - ex->rate_since_count)) * 1.0e9 /
+            ((double) (now_ns - ex->rate_since_ns));
+    }
+    ex->rate_since_ns = now_ns;
+    ex->rate_since_count = ex->sampler.sample_count;
+}
+
+
 static
-int parse_command_ducker_range(const char *const param_range)
+int run_exporter(const exporter_params_T *params)
     __attribute__(( nonnull(1) ));
 
 static
-int parse_command_ducker_range(const char *const param_range)
+int run_exporter(const exporter_params_T *params)
 {
-    command_params_T params;
-
-    char *p = NULL;
-    errno = 0;
-    if (*(param_range) == '\0') {
-        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
-        return EXIT_FAILURE;
-    }
-    const long lval = strtol(param_range, &p, 0);
-    if (p == NULL) {
-        fprintf(stderr, "Fatal: Error converting number\n");
-        return EXIT_FAILURE;
-    }
-    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
-        fprintf(stderr, "Fatal: Error converting number: number range\n");
+    /* the clients' buffers are too large for the stack */
+    static exporter_server_T server;
+    static exporter_T ex;
+    memset(&ex, 0, sizeof(ex));
+    exporter_metrics_T *const metrics = &ex.metrics;
+
+    usbdev_T usbdev;
+    usbdev_open(&usbdev);
+    const device_cache_entry_T *const identity =
+        device_identity(usbdev.device, &usbdev.descriptor, usbdev.device_handle);
+    snprintf(metrics->serial, sizeof(metrics->serial), "%s", identity->serial);
+    metrics->model = usbdev.notepad_device->name;
+    device_cache_save(&device_cache);
+
+    if (!exporter_server_open(&server, params->listen)) {
+        usbdev_close(&usbdev);
         return EXIT_FAILURE;
     }
 
-    if (strcmp(p, "dB") == 0) { /* integer ending with unit "dB" */
-        if (lval < 0) {
-            fprintf(stderr, "Fatal: Error converting number: below 0dB\n");
-            return EXIT_FAILURE;
+    /* No SA_RESTART, so that Ctrl-C interrupts a blocking poll(2). */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("exporter: serving %s metrics at %uHz on %s\n",
+           metrics->serial, params->rate_hz, params->listen);
+    fflush(stdout);
+
+    meter_stats_init(&metrics->stats, params->rms_window_ms,
+                     params->rms_window_count, params->peak_decay_ms);
+    meter_schedule_init(&ex.schedule, params->rate_hz);
+    meter_sampler_init(&ex.sampler, &ex.schedule, exporter_sample, metrics);
+    ex.rate_since_ns = ex.schedule.next_ns;
+    exporter_refresh(&ex, &usbdev, ex.schedule.next_ns);
+    uint64_t refresh_ns = ex.schedule.next_ns + EXPORTER_REFRESH_NS;
+
+    bool sampling = true;
+    int ret = LIBUSB_SUCCESS;
+    while (!global_abort) {
+        const uint64_t now_ns = monotonic_ns();
+        if (sampling && meter_sampler_due(&ex.sampler, now_ns)) {
+            ret = meter_sampler_sample(&usbdev, &ex.sampler, now_ns);
+            exporter_metrics_add_latency(metrics, ex.sampler.read_ns);
+            if ((ret == LUDH_END_OF_REPLAY) || (ret == LIBUSB_ERROR_NO_DEVICE)) {
+                ret = (ret == LUDH_END_OF_REPLAY) ? LIBUSB_ERROR_NOT_FOUND : ret;
+                /* keep serving what we have got so far */
+                fprintf(stderr, "exporter: sampling stopped: %s\n",
+                        libusb_strerror(ret));
+                sampling = false;
+            } else if (ret < 0) {
+                /* try again on the next deadline */
+                ++ex.sampler.error_count;
+                ret = LIBUSB_SUCCESS;
+            }
+            continue;
         }
-        if (lval > 90) {
-            fprintf(stderr, "Fatal: Error converting number: above 90dB\n");
-            return EXIT_FAILURE;
+        if (now_ns >= refresh_ns) {
+            exporter_refresh(&ex, &usbdev, now_ns);
+            refresh_ns += EXPORTER_REFRESH_NS;
+            if (refresh_ns <= now_ns) {
+                refresh_ns = now_ns + EXPORTER_REFRESH_NS;
+            }
         }
-        /* value range is now 0 .. 90 including */
-        const double dval   = (double) lval;
-        const uint32_t ui = dB_to_uint_range(dval);
-        params.ducker_range.range = ui;
-    } else if (*p == '\0') { /* integer without a unit */
-        if (lval < 0) {
-            fprintf(stderr, "Fatal: Error converting number: negative\n");
+
+        uint64_t wakeup_ns = refresh_ns;
+        if (sampling && (ex.schedule.next_ns < wakeup_ns)) {
+            wakeup_ns = ex.schedule.next_ns;
+        }
+        const int timeout_ms = (wakeup_ns > now_ns)
+            ? (int) ((wakeup_ns - now_ns + 999999ULL) / 1000000ULL) : 0;
+        exporter_update_counts(&ex);
+        if (!exporter_server_poll(&server, metrics, timeout_ms)) {
+            break;
+        }
+    }
+    exporter_server_close(&server);
+
+    printf("exporter summary:\n"
+           "  %s  %9" PRIu64 " read, %" PRIu64 " failed read(s)\n"
+           "  %s  %9" PRIu64 " served\n",
+           "samples  ", ex.sampler.sample_count, ex.sampler.error_count,
+           "scrapes  ", metrics->scrape_count);
+    meter_schedule_report(&ex.schedule);
+    usbdev_close(&usbdev);
+    return (ret < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+#endif /* HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H */
+
+
+/* argv[0] is the socket path, followed by the daemon options */
+static
+int parse_command_daemon(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
+
+static
+int parse_command_daemon(const int argc, const char *const argv[])
+{
+    COND_OR_RETURN(argc >= 1, "daemon requires a socket path");
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+    daemon_params_T params;
+    memset(&params, 0, sizeof(params));
+    params.socket_path = argv[0];
+
+    for (int i=1; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--board") == 0) && ((i+1) < argc)) {
+            params.board_name = argv[++i];
+        } else if ((strcmp(argv[i], "--meter-rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params.meter_rate_hz = (unsigned int) ulval;
+        } else {
+            fprintf(stderr, "Fatal: Unhandled daemon argument: %s\n", argv[i]);
             return EXIT_FAILURE;
         }
-        if (lval > 0x1fffffff) {
-            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+    }
+    COND_OR_RETURN((params.meter_rate_hz == 0) || (params.board_name != NULL),
+                   "--meter-rate requires --board");
+
+    return run_daemon(&params);
+#else
+    (void) argv;
+    fprintf(stderr, "Fatal: daemon requires Unix domain sockets\n");
+    return EXIT_FAILURE;
+#endif
+}
+
+
+/* argv[0] is the socket path or port, followed by the exporter options */
+static
+int parse_command_exporter(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
+
+static
+int parse_command_exporter(const int argc, const char *const argv[])
+{
+    COND_OR_RETURN(argc >= 1, "exporter requires a socket path or port");
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+    exporter_params_T params;
+    memset(&params, 0, sizeof(params));
+    params.listen = argv[0];
+    params.rate_hz = METER_RATE_DEFAULT;
+    params.peak_decay_ms = METER_PEAK_DECAY_DEFAULT_MS;
+
+    for (int i=1; i<argc; ++i) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--rate") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_RATE_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params.rate_hz = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--rms") == 0) && ((i+1) < argc)) {
+            COND_OR_RETURN(params.rms_window_count < METER_STATS_RMS_WINDOWS_MAX,
+                           "too many --rms windows");
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  1, METER_STATS_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params.rms_window_ms[params.rms_window_count++] = (unsigned int) ulval;
+        } else if ((strcmp(argv[i], "--peak-decay") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[++i],
+                                  0, METER_STATS_TIME_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            params.peak_decay_ms = (unsigned int) ulval;
+        } else {
+            fprintf(stderr, "Fatal: Unhandled exporter argument: %s\n", argv[i]);
             return EXIT_FAILURE;
         }
-        params.ducker_range.range = (uint32_t) lval;
-    } else {
-        fprintf(stderr, "Fatal: Invalid unit (must be integer or integer with dB)\n");
-        return EXIT_FAILURE;
+    }
+    if (params.rms_window_count == 0) {
+        params.rms_window_ms[0] = METER_RMS_WINDOW_DEFAULT_MS;
+        params.rms_window_count = 1;
     }
 
-    run_usbdev_command(commandfunc_ducker_range, &params);
-    return EXIT_SUCCESS;
+    return run_exporter(&params);
+#else
+    (void) argv;
+    fprintf(stderr, "Fatal: exporter requires sockets\n");
+    return EXIT_FAILURE;
+#endif
 }
 
 
+/* argv[0] is the socket path, followed by the command and its params */
 static
-int parse_command_ducker_threshold(const char *const param_threshold)
-    __attribute__(( nonnull(1) ));
+int parse_command_send(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
 
 static
-int parse_command_ducker_threshold(const char *const param_threshold)
+int parse_command_send(const int argc, const char *const argv[])
 {
-    command_params_T params;
+    COND_OR_RETURN(argc >= 2, "send requires a socket path and a command");
 
-    char *p = NULL;
-    errno = 0;
-    if (*(param_threshold) == '\0') {
-        fprintf(stderr, "Fatal: Looking for number, got empty string.\n");
-        return EXIT_FAILURE;
-    }
-    const long lval = strtol(param_threshold, &p, 0);
-    if (p == NULL) {
-        fprintf(stderr, "Fatal: Error converting number\n");
-        return EXIT_FAILURE;
-    }
-    if ((lval == LONG_MIN) || (lval == LONG_MAX)) {
-        fprintf(stderr, "Fatal: Error converting number: number range\n");
-        return EXIT_FAILURE;
-    }
+    daemon_request_T request;
+    memset(&request, 0, sizeof(request));
+    request.magic = DAEMON_MAGIC;
+    request.version = DAEMON_VERSION;
 
-    if (strcmp(p, "dB") == 0) { /* integer ending with unit "dB" */
-        if (lval < -60) {
-            fprintf(stderr, "Fatal: Error converting number: below -60dB\n");
-            return EXIT_FAILURE;
-        }
-        if (lval > 0) {
-            fprintf(stderr, "Fatal: Error converting number: above 0dB\n");
+    if ((argc == 2) && (strcmp(argv[1], "shutdown") == 0)) {
+        request.request_id = DAEMON_REQUEST_SHUTDOWN;
+    } else {
+        command_T command;
+        if (parse_command(&command, argc-1, &argv[1]) != EXIT_SUCCESS) {
             return EXIT_FAILURE;
         }
-        /* value range is now -60 .. 0 including */
-        const double dval = (double) lval;
-        const uint32_t ui = dB_to_uint_threshold(dval);
-        params.ducker_threshold.thresh = ui;
-    } else if (*p == '\0') { /* integer without a unit */
-        if (lval < 0) {
-            fprintf(stderr, "Fatal: Error converting number: negative\n");
-            return EXIT_FAILURE;
+        request.request_id = DAEMON_REQUEST_COUNT;
+        for (uint8_t i=0; i<DAEMON_REQUEST_COUNT; ++i) {
+            if ((daemon_command_funcs[i] != NULL) &&
+                (daemon_command_funcs[i] == command.func)) {
+                request.request_id = i;
+            }
         }
-        if (lval > 0x1fffffff) {
-            fprintf(stderr, "Fatal: Error converting number: outside valid range\n");
+        if (request.request_id == DAEMON_REQUEST_COUNT) {
+            fprintf(stderr, "Fatal: %s cannot be sent to the daemon\n",
+                    argv[1]);
             return EXIT_FAILURE;
         }
-        params.ducker_threshold.thresh = (uint32_t) lval;
-    } else {
-        fprintf(stderr, "Fatal: Invalid unit (must be integer or integer with dB)\n");
-        return EXIT_FAILURE;
+        request.params = command.params;
     }
 
-    run_usbdev_command(commandfunc_ducker_threshold, &params);
-    return EXIT_SUCCESS;
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+    return send_daemon_request(argv[0], &request);
+#else
+    fprintf(stderr, "Fatal: send requires Unix domain sockets\n");
+    return EXIT_FAILURE;
+#endif
 }
 
 
@@ -1350,6 +6842,94 @@ int parse_command_dump_tables(void)
 }
 
 
+/* Compare one of the value tables with dB_to_uint(), and return the
+ * number of values which differ. */
+static
+unsigned int check_value_table(const char *const name,
+                               uint32_t (*table_func)(const double dB),
+                               const uint32_t ref_value, const int sign,
+                               const int min_dB, const int max_dB)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+unsigned int check_value_table(const char *const name,
+                               uint32_t (*table_func)(const double dB),
+                               const uint32_t ref_value, const int sign,
+                               const int min_dB, const int max_dB)
+{
+    unsigned int differ_count = 0;
+    for (int dB=min_dB; dB<=max_dB; ++dB) {
+        const uint32_t table_value = table_func((double) dB);
+        const uint32_t libm_value = dB_to_uint(ref_value, (double) (sign*dB));
+        if (table_value != libm_value) {
+            printf("    %s %ddB: table 0x%08x, libm 0x%08x\n",
+                   name, dB, table_value, libm_value);
+            ++differ_count;
+        }
+    }
+    printf("%-16s %4d values, %u differ\n", name,
+           max_dB - min_dB + 1, differ_count);
+    return differ_count;
+}
+
+
+/* undocumented/unsupported command: compare the table driven dB
+ * conversions with the libm ones for all values they are used for */
+static
+int parse_command_check_tables(void)
+{
+    unsigned int differ_count = 0;
+    differ_count += check_value_table("ducker range", dB_to_uint_range,
+                                      REF_VALUE_RANGE, -1, 0, 90);
+    differ_count += check_value_table("ducker threshold", dB_to_uint_threshold,
+                                      REF_VALUE_THRESHOLD, 1, -60, 0);
+    differ_count += check_value_table("meter", dB_to_uint_meter,
+                                      REF_VALUE_METER, 1, -100, 0);
+
+    COND_OR_RETURN(isinf(uint_to_dB_meter(0)) && (uint_to_dB_meter(0) < 0.0),
+                   "meter value 0 must be -infinity dB");
+
+    double max_error = 0.0;
+    uint32_t max_error_value = 0;
+    for (uint32_t value=1; value<=REF_VALUE_METER; ++value) {
+        const double error = fabs(uint_to_dB_meter(value) -
+                                  uint_to_dB(REF_VALUE_METER, value));
+        if (error > max_error) {
+            max_error = error;
+            max_error_value = value;
+        }
+    }
+
+    /* time both over all meter values, summing up the results so
+     * that the compiler cannot drop the calls */
+    double sum = 0.0;
+    const uint64_t table_start_ns = monotonic_ns();
+    for (uint32_t value=1; value<=REF_VALUE_METER; ++value) {
+        sum += uint_to_dB_meter(value);
+    }
+    const uint64_t libm_start_ns = monotonic_ns();
+    for (uint32_t value=1; value<=REF_VALUE_METER; ++value) {
+        sum -= uint_to_dB(REF_VALUE_METER, value);
+    }
+    const uint64_t libm_stop_ns = monotonic_ns();
+
+    const double count = (double) REF_VALUE_METER;
+    printf("%-16s %lu values, max error %.7fdB at 0x%06x (limit %gdB)\n",
+           "meter dB", (unsigned long) REF_VALUE_METER,
+           max_error, max_error_value, DB_CONV_METER_MAX_ERROR_dB);
+    printf("%-16s table %.1fns, libm %.1fns per value (sum of differences %g)\n",
+           "meter dB",
+           ((double) (libm_start_ns - table_start_ns)) / count,
+           ((double) (libm_stop_ns - libm_start_ns)) / count,
+           sum);
+
+    COND_OR_RETURN(differ_count == 0, "value tables differ from libm");
+    COND_OR_RETURN(max_error <= DB_CONV_METER_MAX_ERROR_dB,
+                   "meter dB conversion error above limit");
+    return EXIT_SUCCESS;
+}
+
+
 static
 const char *arg0_to_prog(const char *const arg0);
 
@@ -1372,6 +6952,254 @@ const char *arg0_to_prog(const char *const arg0)
 }
 
 
+static
+void json_print_string(const char *const str)
+    __attribute__(( nonnull(1) ));
+
+static
+void json_print_string(const char *const str)
+{
+    /* device strings in the cache only contain printable ASCII */
+    putchar('"');
+    for (const char *p = str; *p != '\0'; ++p) {
+        if ((*p == '"') || (*p == '\\')) {
+            putchar('\\');
+        }
+        putchar(*p);
+    }
+    putchar('"');
+}
+
+
+static
+int parse_command_list(const int argc, const char *const argv[])
+    __attribute__(( nonnull(2) ));
+
+static
+int parse_command_list(const int argc, const char *const argv[])
+{
+    bool json = false;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--refresh") == 0) {
+            device_cache_refresh = true;
+        } else {
+            fprintf(stderr, "Fatal: Unhandled list argument: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const int luret_init =
+        usb->init();
+    LIBUSB_OR_FAIL(luret_init, "libusb_init");
+
+    libusb_device **dev_list;
+    const ssize_t dev_count = supported_device_list(&dev_list, false);
+
+    if (json) {
+        printf("[\n");
+    }
+    for (ssize_t i=0; i<dev_count; ++i) {
+        libusb_device *const dev = dev_list[i];
+        struct libusb_device_descriptor desc;
+        const int luret_get_dev_descr =
+            usb->get_device_descriptor(dev, &desc);
+        LIBUSB_OR_FAIL(luret_get_dev_descr, "libusb_get_device_descriptor");
+
+        const notepad_device_T *const np_dev =
+            notepad_device_from_idProduct(desc.idProduct);
+        const device_cache_entry_T *const identity = device_identity(dev, &desc, NULL);
+        const unsigned int busnum  = usb->get_bus_number(dev);
+        const unsigned int devaddr = usb->get_device_address(dev);
+        char version[16];
+        snprintf(version, sizeof(version), "%d.%d.%d",
+                 (desc.bcdDevice >> 8) & 0xff,
+                 (desc.bcdDevice >> 4) & 0x0f,
+                 (desc.bcdDevice >> 0) & 0x0f);
+
+        if (json) {
+            printf("  {\"bus\": %u, \"address\": %u, \"port\": ", busnum, devaddr);
+            json_print_string(identity->port_path);
+            printf(", \"idVendor\": \"%04x\", \"idProduct\": \"%04x\", \"name\": ",
+                   desc.idVendor, desc.idProduct);
+            json_print_string(np_dev->name);
+            printf(", \"version\": \"%s\", \"manufacturer\": ", version);
+            json_print_string(identity->manufacturer);
+            printf(", \"product\": ");
+            json_print_string(identity->product);
+            printf(", \"serial\": ");
+            json_print_string(identity->serial);
+            printf("}%s\n", ((i+1) < dev_count) ? "," : "");
+        } else {
+            printf("Bus %03u Device %03u: ID %04x:%04x %s %s (%s, version %s, serial %s, port %s)\n",
+                   busnum, devaddr, desc.idVendor, desc.idProduct,
+                   identity->manufacturer, identity->product, np_dev->name,
+                   version, identity->serial, identity->port_path);
+        }
+        usb->unref_device(dev);
+    }
+    if (json) {
+        printf("]\n");
+    }
+    free(dev_list);
+
+    device_cache_save(&device_cache);
+    usb->exit();
+    return EXIT_SUCCESS;
+}
+
+
+/* Parse the device selection options, --force, the transfer options,
+ * and the --timings, --record, and --replay options in front of the
+ * command, and advance *argi to the command name. */
+static
+int parse_device_selector(int *argi, const int argc, const char *const argv[])
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int parse_device_selector(int *argi, const int argc, const char *const argv[])
+{
+    int i = *argi;
+    while (i < argc) {
+        unsigned long ulval;
+        if ((strcmp(argv[i], "--serial") == 0) && ((i+1) < argc)) {
+            device_selector.serial = argv[i+1];
+            i += 2;
+        } else if ((strcmp(argv[i], "--bus") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1], 0, 255) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            device_selector.busnum = (int) ulval;
+            i += 2;
+        } else if ((strcmp(argv[i], "--address") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1], 0, 255) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            device_selector.devaddr = (int) ulval;
+            i += 2;
+        } else if (strcmp(argv[i], "--all") == 0) {
+            device_selector.all = true;
+            i += 1;
+        } else if ((strcmp(argv[i], "--device") == 0) && ((i+1) < argc)) {
+            sys_device_path = argv[i+1];
+            i += 2;
+        } else if ((strcmp(argv[i], "--fd") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1], 0, INT_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            sys_device_fd = (int) ulval;
+            i += 2;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force_send = true;
+            i += 1;
+        } else if (strcmp(argv[i], "--timings") == 0) {
+            timings = TIMINGS_TEXT;
+            i += 1;
+        } else if (strcmp(argv[i], "--timings-json") == 0) {
+            timings = TIMINGS_JSON;
+            i += 1;
+        } else if ((strcmp(argv[i], "--record") == 0) && ((i+1) < argc)) {
+            record_path = argv[i+1];
+            i += 2;
+        } else if ((strcmp(argv[i], "--replay") == 0) && ((i+1) < argc)) {
+            replay_path = argv[i+1];
+            i += 2;
+        } else if ((strcmp(argv[i], "--replay-speed") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1], 0, 1000) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            replay_speed = (unsigned int) ulval;
+            i += 2;
+        } else if ((strcmp(argv[i], "--send-timeout") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1],
+                                  1, TRANSFER_TIMEOUT_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            send_timeout_ms = (unsigned int) ulval;
+            i += 2;
+        } else if ((strcmp(argv[i], "--read-timeout") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1],
+                                  1, TRANSFER_TIMEOUT_MAX_MS) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            read_timeout_ms = (unsigned int) ulval;
+            i += 2;
+        } else if ((strcmp(argv[i], "--retries") == 0) && ((i+1) < argc)) {
+            if (parse_ulong_range(&ulval, argv[i+1],
+                                  0, TRANSFER_RETRIES_MAX) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            transfer_retries = (unsigned int) ulval;
+            i += 2;
+        } else {
+            break;
+        }
+    }
+
+    COND_OR_RETURN((device_selector.devaddr < 0) || (device_selector.busnum >= 0),
+                   "--address requires --bus");
+    COND_OR_RETURN((sys_device_path == NULL) || (sys_device_fd < 0),
+                   "--device and --fd do not work together");
+    COND_OR_RETURN(((sys_device_path == NULL) && (sys_device_fd < 0)) ||
+                   ((device_selector.serial == NULL) &&
+                    (device_selector.busnum < 0) && !device_selector.all),
+                   "--device and --fd do not work with --serial, --bus, or --all");
+    /* The devices of --all are run in child processes, which cannot
+     * share one trace file. */
+    COND_OR_RETURN(!device_selector.all || (record_path == NULL),
+                   "--all does not work with --record");
+    COND_OR_RETURN(!device_selector.all || (replay_path == NULL),
+                   "--all does not work with --replay");
+
+    *argi = i;
+    return EXIT_SUCCESS;
+}
+
+
+static
+bool device_selector_given(void)
+{
+    return ((device_selector.serial != NULL) ||
+            (device_selector.busnum >= 0) ||
+            (device_selector.devaddr >= 0) ||
+            device_selector.all ||
+            (sys_device_path != NULL) ||
+            (sys_device_fd >= 0));
+}
+
+
+static
+void timings_print(void);
+
+static
+void timings_print(void)
+{
+    if (getpid() == timings_pid) {
+        fflush(stdout);
+        usb_timing_print(stderr, timings == TIMINGS_JSON);
+    }
+}
+
+
+/* Time the USB operations from now on, and print the timings when
+ * the process exits, whether through main() or exit(). */
+static
+void timings_start(void);
+
+static
+void timings_start(void)
+{
+    usb_timing_start(usb);
+    usb = &usb_transport_timing;
+    timings_pid = getpid();
+    if (atexit(timings_print) != 0) {
+        fprintf(stderr, "Fatal: atexit failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
 static
 int parse_cmdline(const int argc, const char *const argv[]);
 
@@ -1388,46 +7216,88 @@ int parse_cmdline(const int argc, const char *const argv[])
 
     const char *const prog = arg0_to_prog(argv[0]);
 
-    COND_OR_RETURN(argc >= 2, "too few command line arguments");
-    COND_OR_RETURN(argc <= 4, "too many command line arguments");
+    int argi = 1;
+    if (parse_device_selector(&argi, argc, argv) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    /* args[0] is the command name */
+    const int nargs = argc - argi;
+    const char *const *const args = &argv[argi];
+
+    COND_OR_RETURN(nargs >= 1, "too few command line arguments");
+
+    if (timings != TIMINGS_OFF) {
+        timings_start();
+    }
+    if (replay_path != NULL) {
+        if (usb_trace_open(&replay_trace, replay_path) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        /* nothing must reach the device */
+        dry_run = true;
+    }
+    if (record_path != NULL) {
+        if (usb_trace_create(&record_trace, record_path,
+                             monotonic_ns(), realtime_ns()) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
 
     if (false) {
         /* nothing */
-    } else if ((argc == 2) && (strcmp(argv[1], "--help") == 0)) {
+    } else if ((nargs == 1) && (strcmp(args[0], "--help") == 0)) {
         print_usage(prog);
         return EXIT_SUCCESS;
-    } else if ((argc == 2) && (strcmp(argv[1], "--version") == 0)) {
+    } else if ((nargs == 1) && (strcmp(args[0], "--version") == 0)) {
         print_version(prog);
         return EXIT_SUCCESS;
-    } else if ((argc == 3) && (strcmp(argv[1], "audio-routing") == 0)) {
-        return parse_command_audio_routing(argv[2]);
-    } else if ((argc == 2) && (strcmp(argv[1], "dump-tables") == 0)) {
+    } else if ((nargs == 1) && (strcmp(args[0], "dump-tables") == 0)) {
         /* undocumented/unsupported command */
         return parse_command_dump_tables();
-    } else if ((argc == 2) && (strcmp(argv[1], "meter") == 0)) {
-        command_params_T params;
-        /* no params needed to run the meter */
-        run_usbdev_command(commandfunc_meter, &params);
-        return EXIT_SUCCESS;
-    } else if ((argc == 2) && (strcmp(argv[1], "check-permissions") == 0)) {
-        command_params_T params;
-        /* no params needed to just open the device special file */
-        run_usbdev_command(commandfunc_check_permissions, &params);
-        return EXIT_SUCCESS;
-    } else if ((argc == 2) && (strcmp(argv[1], "ducker-off") == 0)) {
-        command_params_T params;
-        /* no params needed to turn off ducker  */
-        run_usbdev_command(commandfunc_ducker_off, &params);
-        return EXIT_SUCCESS;
-    } else if ((argc == 4) && (strcmp(argv[1], "ducker-on") == 0)) {
-        return parse_command_ducker_on(argv[2], argv[3]);
-    } else if ((argc == 3) && (strcmp(argv[1], "ducker-range") == 0)) {
-        return parse_command_ducker_range(argv[2]);
-    } else if ((argc == 3) && (strcmp(argv[1], "ducker-threshold") == 0)) {
-        return parse_command_ducker_threshold(argv[2]);
+    } else if ((nargs == 1) && (strcmp(args[0], "check-tables") == 0)) {
+        /* undocumented/unsupported command */
+        return parse_command_check_tables();
+    } else if (strcmp(args[0], "watch") == 0) {
+        COND_OR_RETURN((sys_device_path == NULL) && (sys_device_fd < 0),
+                       "--device and --fd do not work with watch");
+        return parse_command_watch(nargs-1, &args[1]);
+    } else if (strcmp(args[0], "list") == 0) {
+        COND_OR_RETURN((sys_device_path == NULL) && (sys_device_fd < 0),
+                       "--device and --fd do not work with list");
+        return parse_command_list(nargs-1, &args[1]);
+    } else if (strcmp(args[0], "batch") == 0) {
+        return parse_command_batch(nargs-1, &args[1]);
+    } else if ((nargs >= 2) && (strcmp(args[0], "daemon") == 0)) {
+        COND_OR_RETURN(!device_selector.all, "--all does not work with daemon");
+        return parse_command_daemon(nargs-1, &args[1]);
+    } else if ((nargs >= 2) && (strcmp(args[0], "exporter") == 0)) {
+        COND_OR_RETURN(!device_selector.all, "--all does not work with exporter");
+        return parse_command_exporter(nargs-1, &args[1]);
+    } else if (strcmp(args[0], "send") == 0) {
+        COND_OR_RETURN(!device_selector_given(),
+                       "select the device when starting the daemon instead");
+        COND_OR_RETURN(!force_send, "--force does not work with send");
+        COND_OR_RETURN((record_path == NULL) && (replay_path == NULL),
+                       "--record and --replay do not work with send");
+        return parse_command_send(nargs-1, &args[1]);
     } else {
-        fprintf(stderr, "Fatal: Unhandled command line argument(s)\n");
-        return EXIT_FAILURE;
+        command_T command;
+        if (parse_command(&command, nargs, args) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        if (command.func == commandfunc_meter) {
+            COND_OR_RETURN(!device_selector.all, "--all does not work with meter");
+            if (meter_open_output(&command.params.meter) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        }
+        if (command.func == commandfunc_sweep) {
+            COND_OR_RETURN(!device_selector.all, "--all does not work with sweep");
+            if (sweep_open_output(&command.params.sweep) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        }
+        return run_usbdev_command(command.func, &command.params);
     }
 }
 
@@ -1453,9 +7323,47 @@ void init_dry_run_from_env(void)
 }
 
 
+static
+void init_transport_from_env(void);
+
+static
+void init_transport_from_env(void)
+{
+    const char *const env_scnp_cli_sim = getenv("SCNP_CLI_SIM");
+    if (env_scnp_cli_sim && (*env_scnp_cli_sim != '\0')) {
+        if (usb_sim_setup(env_scnp_cli_sim) != EXIT_SUCCESS) {
+            exit(EXIT_FAILURE);
+        }
+        usb = &usb_transport_sim;
+    }
+}
+
+
+static
+void init_timings_from_env(void);
+
+static
+void init_timings_from_env(void)
+{
+    const char *const env_scnp_cli_timings = getenv("SCNP_CLI_TIMINGS");
+    if (env_scnp_cli_timings && (*env_scnp_cli_timings != '\0')) {
+        timings = (strcmp(env_scnp_cli_timings, "json") == 0) ?
+            TIMINGS_JSON : TIMINGS_TEXT;
+    }
+}
+
+
 int main(const int argc, const char *const argv[])
 {
     detect_output_charset();
     init_dry_run_from_env();
-    return parse_cmdline(argc, argv);
+    init_transport_from_env();
+    init_timings_from_env();
+    int ret = parse_cmdline(argc, argv);
+    if ((record_path != NULL) &&
+        (usb_trace_close(&record_trace) != EXIT_SUCCESS)) {
+        fprintf(stderr, "Fatal: error writing trace file %s\n", record_path);
+        ret = EXIT_FAILURE;
+    }
+    return ret;
 }
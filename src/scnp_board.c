@@ -0,0 +1,278 @@
+/* scnp_board.c - shared memory board with the latest Notepad state
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "scnp_board.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+
+/* The shared memory layout.
+ *
+ * The payload words are atomics accessed with relaxed memory order, so
+ * that a reader racing with the publisher reads stale or torn
+ * snapshots (which the sequence check then rejects) instead of running
+ * into undefined behaviour.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+
+    /* odd while the publisher is updating the payload */
+    _Atomic uint32_t seq;
+
+    _Atomic uint32_t valid;
+    _Atomic uint64_t meter_sample_count;
+    _Atomic uint64_t meter_t_ns;
+    _Atomic uint32_t meter_value;
+    _Atomic int32_t  meter_mdB;
+    _Atomic uint64_t state_t_ns;
+    _Atomic uint32_t routing_source;
+    _Atomic uint32_t ducker_on;
+    _Atomic uint32_t ducker_inputs;
+    _Atomic uint32_t ducker_release_ms;
+    _Atomic uint32_t ducker_range;
+    _Atomic uint32_t ducker_threshold;
+    _Atomic uint32_t idProduct;
+} scnp_board_shm_T;
+
+
+struct scnp_board {
+    scnp_board_shm_T *shm;
+    char *name; /* only set for the publisher */
+};
+
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H)
+
+
+static
+scnp_board_T *board_map(const int fd, const int prot, const char *const name)
+{
+    void *addr = mmap(NULL, sizeof(scnp_board_shm_T), prot, MAP_SHARED, fd, 0);
+    const int saved_errno = errno;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        errno = saved_errno;
+        return NULL;
+    }
+
+    scnp_board_T *board = calloc(1, sizeof(*board));
+    if (board == NULL) {
+        munmap(addr, sizeof(scnp_board_shm_T));
+        errno = ENOMEM;
+        return NULL;
+    }
+    board->shm = addr;
+    if (name != NULL) {
+        board->name = malloc(strlen(name) + 1);
+        if (board->name == NULL) {
+            munmap(addr, sizeof(scnp_board_shm_T));
+            free(board);
+            errno = ENOMEM;
+            return NULL;
+        }
+        strcpy(board->name, name);
+    }
+    return board;
+}
+
+
+scnp_board_T *scnp_board_create(const char *const name)
+{
+    const int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(scnp_board_shm_T)) < 0) {
+        const int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+    scnp_board_T *board = board_map(fd, PROT_READ | PROT_WRITE, name);
+    if (board == NULL) {
+        return NULL;
+    }
+
+    /* Start from an empty board with the sequence number still even. */
+    scnp_board_shm_T *shm = board->shm;
+    const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->seq, (seq + 2U) & ~1U, memory_order_relaxed);
+    atomic_store_explicit(&shm->valid, 0, memory_order_relaxed);
+    shm->version = SCNP_BOARD_VERSION;
+    atomic_thread_fence(memory_order_release);
+    shm->magic = SCNP_BOARD_MAGIC;
+    return board;
+}
+
+
+void scnp_board_close(scnp_board_T *board)
+{
+    if (board == NULL) {
+        return;
+    }
+    munmap(board->shm, sizeof(scnp_board_shm_T));
+    if (board->name != NULL) {
+        shm_unlink(board->name);
+        free(board->name);
+    }
+    free(board);
+}
+
+
+scnp_board_T *scnp_board_open(const char *const name)
+{
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) < 0) ||
+        (((size_t) st.st_size) < sizeof(scnp_board_shm_T))) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    scnp_board_T *board = board_map(fd, PROT_READ, NULL);
+    if (board == NULL) {
+        return NULL;
+    }
+    if ((board->shm->magic != SCNP_BOARD_MAGIC) ||
+        (board->shm->version != SCNP_BOARD_VERSION)) {
+        scnp_board_close(board);
+        errno = EPROTO;
+        return NULL;
+    }
+    return board;
+}
+
+
+#else /* !(HAVE_SHM_OPEN && HAVE_SYS_MMAN_H) */
+
+
+scnp_board_T *scnp_board_create(const char *const name)
+{
+    (void) name;
+    errno = ENOSYS;
+    return NULL;
+}
+
+
+void scnp_board_close(scnp_board_T *board)
+{
+    (void) board;
+}
+
+
+scnp_board_T *scnp_board_open(const char *const name)
+{
+    (void) name;
+    errno = ENOSYS;
+    return NULL;
+}
+
+
+#endif /* !(HAVE_SHM_OPEN && HAVE_SYS_MMAN_H) */
+
+
+#define LOAD(FIELD) atomic_load_explicit(&shm->FIELD, memory_order_relaxed)
+#define STORE(FIELD, VALUE) \
+    atomic_store_explicit(&shm->FIELD, (VALUE), memory_order_relaxed)
+
+
+bool scnp_board_read(const scnp_board_T *board,
+                     scnp_board_snapshot_T *snapshot)
+{
+    scnp_board_shm_T *shm = board->shm;
+    for (unsigned long tries=0; tries<SCNP_BOARD_READ_TRIES; ++tries) {
+        const uint32_t seq1 = atomic_load_explicit(&shm->seq, memory_order_acquire);
+        if (seq1 & 1U) {
+            /* publisher is in the middle of an update */
+            continue;
+        }
+
+        snapshot->valid              = LOAD(valid);
+        snapshot->meter_sample_count = LOAD(meter_sample_count);
+        snapshot->meter_t_ns         = LOAD(meter_t_ns);
+        snapshot->meter_value        = LOAD(meter_value);
+        snapshot->meter_mdB          = LOAD(meter_mdB);
+        snapshot->state_t_ns         = LOAD(state_t_ns);
+        snapshot->routing_source     = (uint8_t) LOAD(routing_source);
+        snapshot->ducker_on          = LOAD(ducker_on) != 0;
+        snapshot->ducker_inputs      = (uint8_t) LOAD(ducker_inputs);
+        snapshot->ducker_release_ms  = (uint16_t) LOAD(ducker_release_ms);
+        snapshot->ducker_range       = LOAD(ducker_range);
+        snapshot->ducker_threshold   = LOAD(ducker_threshold);
+        snapshot->idProduct          = (uint16_t) LOAD(idProduct);
+
+        atomic_thread_fence(memory_order_acquire);
+        const uint32_t seq2 = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+        if (seq1 == seq2) {
+            snapshot->update_count = seq1 / 2U;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void scnp_board_write(scnp_board_T *board,
+                      const scnp_board_snapshot_T *snapshot)
+{
+    scnp_board_shm_T *shm = board->shm;
+    const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1U, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    STORE(valid,              snapshot->valid);
+    STORE(meter_sample_count, snapshot->meter_sample_count);
+    STORE(meter_t_ns,         snapshot->meter_t_ns);
+    STORE(meter_value,        snapshot->meter_value);
+    STORE(meter_mdB,          snapshot->meter_mdB);
+    STORE(state_t_ns,         snapshot->state_t_ns);
+    STORE(routing_source,     snapshot->routing_source);
+    STORE(ducker_on,          snapshot->ducker_on ? 1U : 0U);
+    STORE(ducker_inputs,      snapshot->ducker_inputs);
+    STORE(ducker_release_ms,  snapshot->ducker_release_ms);
+    STORE(ducker_range,       snapshot->ducker_range);
+    STORE(ducker_threshold,   snapshot->ducker_threshold);
+    STORE(idProduct,          snapshot->idProduct);
+
+    atomic_store_explicit(&shm->seq, seq + 2U, memory_order_release);
+}
@@ -0,0 +1,129 @@
+/* scnp_board.h - shared memory board with the latest Notepad state
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef SCNP_BOARD_H
+#define SCNP_BOARD_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* One scnp-cli process which owns the device publishes the latest
+ * meter sample and the last applied mixer settings in a POSIX shared
+ * memory object. Any number of readers can map that object and read
+ * consistent snapshots from it without taking a lock and without any
+ * syscall, using the seqlock protocol implemented by
+ * scnp_board_read().
+ *
+ * Readers only need this header and scnp_board.c.
+ */
+
+
+#define SCNP_BOARD_MAGIC   0x504e4353UL /* "SCNP" in little endian */
+#define SCNP_BOARD_VERSION 1U
+
+
+/* An update takes the publisher a few dozen stores, so this many
+ * attempts in a row only all fail on a board which is stuck. */
+#define SCNP_BOARD_READ_TRIES 1000000UL
+
+
+/* bits for scnp_board_snapshot_T.valid */
+#define SCNP_BOARD_VALID_METER     0x01U
+#define SCNP_BOARD_VALID_ROUTING   0x02U
+#define SCNP_BOARD_VALID_DUCKER    0x04U
+#define SCNP_BOARD_VALID_RANGE     0x08U
+#define SCNP_BOARD_VALID_THRESHOLD 0x10U
+
+
+/* A consistent copy of the board contents. Fields are only meaningful
+ * when the corresponding valid bit is set. */
+typedef struct {
+    /* number of completed board updates */
+    uint32_t update_count;
+    uint32_t valid;
+
+    /* number of meter samples published so far */
+    uint64_t meter_sample_count;
+    /* time of the latest meter sample in ns since the Unix epoch */
+    uint64_t meter_t_ns;
+    uint32_t meter_value;
+    /* meter value in 1/1000 dB, INT32_MIN for a meter_value of 0 */
+    int32_t meter_mdB;
+
+    /* time of the latest settings change in ns since the Unix epoch */
+    uint64_t state_t_ns;
+    uint8_t routing_source;
+    bool ducker_on;
+    uint8_t ducker_inputs;
+    uint16_t ducker_release_ms;
+    uint32_t ducker_range;
+    uint32_t ducker_threshold;
+
+    /* the idProduct of the device the board describes */
+    uint16_t idProduct;
+} scnp_board_snapshot_T;
+
+
+typedef struct scnp_board scnp_board_T;
+
+
+/* Create (or take over) the named board for publishing. The name is a
+ * POSIX shared memory object name like "/scnp". Returns NULL and sets
+ * errno on failure. */
+extern
+scnp_board_T *scnp_board_create(const char *const name);
+
+
+/* Unmap the board, and remove its name if this is the publisher. */
+extern
+void scnp_board_close(scnp_board_T *board);
+
+
+/* Open an existing board read-only. Returns NULL and sets errno on
+ * failure, with errno set to EPROTO for a board of another version. */
+extern
+scnp_board_T *scnp_board_open(const char *const name);
+
+
+/* Copy a consistent snapshot of the board. Never blocks the publisher
+ * and does not do any syscalls. A torn read is retried up to
+ * SCNP_BOARD_READ_TRIES times; when the publisher has died in the
+ * middle of an update, the board never becomes consistent again, so
+ * this returns false instead of spinning forever. */
+extern
+bool scnp_board_read(const scnp_board_T *board,
+                     scnp_board_snapshot_T *snapshot);
+
+
+/* Publish a complete new snapshot. Only the publisher may call this. */
+extern
+void scnp_board_write(scnp_board_T *board,
+                      const scnp_board_snapshot_T *snapshot);
+
+
+#endif /* !defined(SCNP_BOARD_H) */
@@ -0,0 +1,363 @@
+/* scnp_daemon.c - the daemon's local socket, and its clients
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "scnp_daemon.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+#include "unix_socket.h"
+
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+
+
+/* Returns the number of bytes transferred, which is less than size
+ * only on EOF, or -1 on error. */
+static
+ssize_t fd_read_full(const int fd, void *buf, const size_t size)
+    __attribute__(( nonnull(2) ));
+
+static
+ssize_t fd_read_full(const int fd, void *buf, const size_t size)
+{
+    uint8_t *p = buf;
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t r = read(fd, &p[done], size - done);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        done += (size_t) r;
+    }
+    return (ssize_t) done;
+}
+
+
+static
+ssize_t fd_write_full(const int fd, const void *buf, const size_t size)
+    __attribute__(( nonnull(2) ));
+
+static
+ssize_t fd_write_full(const int fd, const void *buf, const size_t size)
+{
+    const uint8_t *p = buf;
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t r = write(fd, &p[done], size - done);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t) r;
+    }
+    return (ssize_t) done;
+}
+
+
+bool daemon_server_open(daemon_server_T *server, const char *const socket_path,
+                        const size_t request_size, const size_t response_size,
+                        const daemon_serve_func_T func, void *data)
+{
+    memset(server, 0, sizeof(*server));
+    server->socket_path = socket_path;
+    server->request_size = request_size;
+    server->response_size = response_size;
+    server->func = func;
+    server->data = data;
+
+    unsigned char *const requests = calloc(DAEMON_CLIENTS_MAX, request_size);
+    unsigned char *const responses = calloc(DAEMON_CLIENTS_MAX, response_size);
+    if ((requests == NULL) || (responses == NULL)) {
+        perror("daemon: calloc");
+        free(requests);
+        free(responses);
+        return false;
+    }
+    for (size_t i=0; i<DAEMON_CLIENTS_MAX; ++i) {
+        server->clients[i].fd = -1;
+        server->clients[i].request = &requests[i * request_size];
+        server->clients[i].response = &responses[i * response_size];
+    }
+
+    /* Anyone who can connect can change the settings, so only let
+     * our own user connect. */
+    server->listen_fd = unix_socket_listen(socket_path, DAEMON_CLIENTS_MAX, true);
+    if (server->listen_fd < 0) {
+        free(requests);
+        free(responses);
+        return false;
+    }
+    return true;
+}
+
+
+/* Send as much of the client's response as its socket takes without
+ * blocking. Returns false when the connection has failed. */
+static
+bool daemon_send_response(daemon_client_T *client)
+    __attribute__(( nonnull(1) ));
+
+static
+bool daemon_send_response(daemon_client_T *client)
+{
+    while (client->response_done < client->response_len) {
+        const ssize_t r = write(client->fd, &client->response[client->response_done],
+                                client->response_len - client->response_done);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                /* the rest goes out on POLLOUT */
+                return true;
+            }
+            perror("daemon: write");
+            return false;
+        }
+        client->response_done += (size_t) r;
+    }
+    client->response_len = 0;
+    client->response_done = 0;
+    return true;
+}
+
+
+/* Send the rest of the client's response, or read what the client has
+ * sent so far without blocking and serve its request once it is
+ * complete. Returns false when the client has closed the connection or
+ * the connection has failed. */
+static
+bool daemon_serve_client(daemon_server_T *server, daemon_client_T *client,
+                         bool *shutdown)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+bool daemon_serve_client(daemon_server_T *server, daemon_client_T *client,
+                         bool *shutdown)
+{
+    if (client->response_len > 0) {
+        return daemon_send_response(client);
+    }
+
+    const ssize_t r = read(client->fd, &client->request[client->request_len],
+                           server->request_size - client->request_len);
+    if (r < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+            return true;
+        }
+        perror("daemon: read");
+        return false;
+    }
+    if (r == 0) {
+        /* client has closed the connection */
+        return false;
+    }
+    client->request_len += (size_t) r;
+    if (client->request_len < server->request_size) {
+        return true;
+    }
+    client->request_len = 0;
+
+    memset(client->response, 0, server->response_size);
+    server->func(server->data, client->request, client->response, shutdown);
+    client->response_len = server->response_size;
+    client->response_done = 0;
+    return daemon_send_response(client);
+}
+
+
+bool daemon_server_poll(daemon_server_T *server, const int timeout_ms,
+                        bool *shutdown)
+{
+    daemon_client_T *const clients = server->clients;
+
+    /* pfds[i] is for clients[i], the last one for listen_fd */
+    struct pollfd pfds[DAEMON_CLIENTS_MAX + 1];
+    bool slot_free = false;
+    for (size_t i=0; i<DAEMON_CLIENTS_MAX; ++i) {
+        pfds[i].fd = clients[i].fd; /* poll(2) skips negative fds */
+        pfds[i].events = (clients[i].response_len > 0) ? POLLOUT : POLLIN;
+        pfds[i].revents = 0;
+        slot_free = slot_free || (clients[i].fd < 0);
+    }
+    pfds[DAEMON_CLIENTS_MAX].fd = slot_free ? server->listen_fd : -1;
+    pfds[DAEMON_CLIENTS_MAX].events = POLLIN;
+    pfds[DAEMON_CLIENTS_MAX].revents = 0;
+
+    const int r = poll(pfds, DAEMON_CLIENTS_MAX + 1, timeout_ms);
+    if (r < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        perror("daemon: poll");
+        return false;
+    }
+    if (r == 0) {
+        return true;
+    }
+
+    for (size_t i=0; (i<DAEMON_CLIENTS_MAX) && !*shutdown; ++i) {
+        if ((clients[i].fd < 0) || (pfds[i].revents == 0)) {
+            continue;
+        }
+        if (!daemon_serve_client(server, &clients[i], shutdown)) {
+            close(clients[i].fd);
+            clients[i].fd = -1;
+        }
+    }
+
+    if (pfds[DAEMON_CLIENTS_MAX].revents & POLLIN) {
+        const int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if ((errno != EINTR) && (errno != EAGAIN) &&
+                (errno != EWOULDBLOCK) && (errno != ECONNABORTED)) {
+                perror("daemon: accept");
+                return false;
+            }
+        } else if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+            perror("daemon: fcntl");
+            close(fd);
+        } else {
+            for (size_t i=0; i<DAEMON_CLIENTS_MAX; ++i) {
+                if (clients[i].fd < 0) {
+                    clients[i].fd = fd;
+                    clients[i].request_len = 0;
+                    clients[i].response_len = 0;
+                    clients[i].response_done = 0;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+void daemon_server_close(daemon_server_T *server)
+{
+    for (size_t i=0; i<DAEMON_CLIENTS_MAX; ++i) {
+        if (server->clients[i].fd >= 0) {
+            close(server->clients[i].fd);
+            server->clients[i].fd = -1;
+        }
+    }
+    close(server->listen_fd);
+    unlink(server->socket_path);
+    /* the first client's buffers are the start of all of them */
+    free(server->clients[0].request);
+    free(server->clients[0].response);
+}
+
+
+bool daemon_transact(const char *const socket_path,
+                     const void *request, const size_t request_size,
+                     void *response, const size_t response_size)
+{
+    const int fd = unix_socket_connect(socket_path);
+    if (fd < 0) {
+        return false;
+    }
+    if ((fd_write_full(fd, request, request_size) < 0) ||
+        (fd_read_full(fd, response, response_size) != (ssize_t) response_size)) {
+        fprintf(stderr, "Fatal: no response from daemon at %s\n", socket_path);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+
+#else /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
+
+
+bool daemon_server_open(daemon_server_T *server, const char *const socket_path,
+                        const size_t request_size, const size_t response_size,
+                        const daemon_serve_func_T func, void *data)
+{
+    memset(server, 0, sizeof(*server));
+    (void) request_size;
+    (void) response_size;
+    (void) func;
+    (void) data;
+    fprintf(stderr, "Fatal: no Unix domain sockets for %s\n", socket_path);
+    return false;
+}
+
+
+bool daemon_server_poll(daemon_server_T *server, const int timeout_ms,
+                        bool *shutdown)
+{
+    (void) server;
+    (void) timeout_ms;
+    (void) shutdown;
+    errno = ENOSYS;
+    return false;
+}
+
+
+void daemon_server_close(daemon_server_T *server)
+{
+    (void) server;
+}
+
+
+bool daemon_transact(const char *const socket_path,
+                     const void *request, const size_t request_size,
+                     void *response, const size_t response_size)
+{
+    (void) request;
+    (void) request_size;
+    (void) response;
+    (void) response_size;
+    fprintf(stderr, "Fatal: no Unix domain sockets for %s\n", socket_path);
+    return false;
+}
+
+
+#endif /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
@@ -0,0 +1,113 @@
+/* scnp_daemon.h - the daemon's local socket, and its clients
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef SCNP_DAEMON_H
+#define SCNP_DAEMON_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* The daemon listens on a Unix domain socket only our own user can
+ * connect to, and exchanges fixed size records with its clients: a
+ * client sends a request record, and gets exactly one response record
+ * back, any number of times over one connection. What the records
+ * mean is up to the caller.
+ *
+ * The clients are read and written without blocking, so a client
+ * which sends a request or drains its responses slowly or not at all
+ * holds up neither the other clients nor whatever else the daemon
+ * polls for. A client's next request is only read once the response
+ * to its last one has been sent. Only serving a complete request
+ * blocks.
+ */
+
+
+#define DAEMON_CLIENTS_MAX 8U
+
+
+/* Fill in the RESPONSE to one complete REQUEST, and set *SHUTDOWN to
+ * stop serving after this response. */
+typedef void (*daemon_serve_func_T)(void *data, const void *request,
+                                    void *response, bool *shutdown);
+
+
+/* A connected client, the part of its next request read so far, and
+ * the response it has not got yet */
+typedef struct {
+    int fd;
+    size_t request_len;
+    unsigned char *request;
+    /* the response being sent, from response_done to response_len */
+    size_t response_len;
+    size_t response_done;
+    unsigned char *response;
+} daemon_client_T;
+
+
+typedef struct {
+    const char *socket_path;
+    int listen_fd;
+    size_t request_size;
+    size_t response_size;
+    daemon_serve_func_T func;
+    void *data;
+    daemon_client_T clients[DAEMON_CLIENTS_MAX];
+} daemon_server_T;
+
+
+/* Listen on SOCKET_PATH for records of the given sizes. Prints the
+ * error and returns false on failure. */
+extern
+bool daemon_server_open(daemon_server_T *server, const char *const socket_path,
+                        const size_t request_size, const size_t response_size,
+                        const daemon_serve_func_T func, void *data);
+
+
+/* Wait up to TIMEOUT_MS (-1 for no limit) for new clients and for
+ * requests, and serve the complete requests. Returns false when
+ * polling has failed; a wait interrupted by a signal is no failure. */
+extern
+bool daemon_server_poll(daemon_server_T *server, const int timeout_ms,
+                        bool *shutdown);
+
+
+/* Disconnect all clients, and remove the socket. */
+extern
+void daemon_server_close(daemon_server_T *server);
+
+
+/* Connect to the daemon at SOCKET_PATH, send it one REQUEST, and read
+ * its RESPONSE. Prints the error and returns false on failure. */
+extern
+bool daemon_transact(const char *const socket_path,
+                     const void *request, const size_t request_size,
+                     void *response, const size_t response_size);
+
+
+#endif /* !defined(SCNP_DAEMON_H) */
@@ -0,0 +1,622 @@
+/* scnp_exporter.c - serve the meter and device metrics as OpenMetrics
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "scnp_exporter.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+#if (defined(HAVE_NETINET_IN_H) && defined(HAVE_ARPA_INET_H))
+# include <netinet/in.h>
+# include <arpa/inet.h>
+#endif
+
+#include "monotonic_time.h"
+#include "unix_socket.h"
+
+
+/* upper bounds of the transfer latency histogram buckets, in seconds */
+static
+const double exporter_latency_le_s[EXPORTER_LATENCY_BUCKETS] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+    0.01, 0.025, 0.05, 0.1, 0.25, 1.0
+};
+
+
+void exporter_metrics_add_latency(exporter_metrics_T *metrics,
+                                  const uint64_t read_ns)
+{
+    const double latency_s = ((double) read_ns) / 1.0e9;
+    ++metrics->latency_count;
+    metrics->latency_sum_s += latency_s;
+    for (size_t i=0; i<EXPORTER_LATENCY_BUCKETS; ++i) {
+        if (latency_s <= exporter_latency_le_s[i]) {
+            ++metrics->latency_bucket[i];
+        }
+    }
+}
+
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool truncated;
+} exporter_text_T;
+
+
+static
+void exporter_printf(exporter_text_T *text, const char *const format, ...)
+    __attribute__(( nonnull(1), nonnull(2), format(printf, 2, 3) ));
+
+static
+void exporter_printf(exporter_text_T *text, const char *const format, ...)
+{
+    if (text->truncated) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, format);
+    const int r = vsnprintf(&text->buf[text->len], text->size - text->len,
+                            format, ap);
+    va_end(ap);
+    if ((r < 0) || (((size_t) r) >= (text->size - text->len))) {
+        text->truncated = true;
+        return;
+    }
+    text->len += (size_t) r;
+}
+
+
+/* Print a value the OpenMetrics way, where -infinity is "-Inf". */
+static
+void exporter_print_value(exporter_text_T *text, const double value)
+    __attribute__(( nonnull(1) ));
+
+static
+void exporter_print_value(exporter_text_T *text, const double value)
+{
+    if (isnan(value)) {
+        exporter_printf(text, "NaN\n");
+    } else if (isinf(value)) {
+        exporter_printf(text, "%sInf\n", (value < 0.0) ? "-" : "+");
+    } else {
+        exporter_printf(text, "%.3f\n", value);
+    }
+}
+
+
+/* Copy VALUE into BUF as an OpenMetrics label value, with backslash,
+ * double quote, and newline escaped. A value too long for BUF is cut
+ * short, but never in the middle of an escape. */
+static
+void exporter_escape_label(char *buf, const size_t size, const char *value)
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+void exporter_escape_label(char *buf, const size_t size, const char *value)
+{
+    size_t len = 0;
+    for (const char *p = value; *p != '\0'; ++p) {
+        char escaped[2] = { '\\', *p };
+        size_t n = 2;
+        switch (*p) {
+        case '\\':
+        case '"':
+            break;
+        case '\n':
+            escaped[1] = 'n';
+            break;
+        default:
+            escaped[0] = *p;
+            n = 1;
+            break;
+        }
+        if ((len + n) >= size) {
+            break;
+        }
+        memcpy(&buf[len], escaped, n);
+        len += n;
+    }
+    buf[len] = '\0';
+}
+
+
+static
+void exporter_render_metrics(const exporter_metrics_T *metrics,
+                             exporter_text_T *text)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void exporter_render_metrics(const exporter_metrics_T *metrics,
+                             exporter_text_T *text)
+{
+    /* every label value goes through the escaper; the others are numbers */
+    char serial[2 * DEVICE_CACHE_STRING_MAX];
+    char model[2 * DEVICE_CACHE_STRING_MAX];
+    exporter_escape_label(serial, sizeof(serial), metrics->serial);
+    exporter_escape_label(model, sizeof(model), metrics->model);
+
+    exporter_printf(text,
+                    "# TYPE scnp_device info\n"
+                    "# HELP scnp_device The device the metrics are for.\n"
+                    "scnp_device_info{serial=\"%s\",model=\"%s\"} 1\n",
+                    serial, model);
+
+    if (metrics->sample_count > 0) {
+        exporter_printf(text,
+                        "# TYPE scnp_meter_level_db gauge\n"
+                        "# HELP scnp_meter_level_db The last meter level in dB.\n"
+                        "scnp_meter_level_db{serial=\"%s\"} ", serial);
+        exporter_print_value(text, metrics->level_dB);
+        exporter_printf(text,
+                        "# TYPE scnp_meter_peak_db gauge\n"
+                        "# HELP scnp_meter_peak_db The held peak meter level in dB.\n"
+                        "scnp_meter_peak_db{serial=\"%s\"} ", serial);
+        exporter_print_value(text, meter_stats_peak_hold_dB(&metrics->stats));
+        exporter_printf(text,
+                        "# TYPE scnp_meter_rms_db gauge\n"
+                        "# HELP scnp_meter_rms_db The RMS meter level in dB over a moving window.\n");
+        for (unsigned int i=0; i<metrics->stats.rms_window_count; ++i) {
+            exporter_printf(text, "scnp_meter_rms_db{serial=\"%s\",window=\"%.3f\"} ",
+                            serial, metrics->stats.rms_window_ns[i] / 1.0e9);
+            exporter_print_value(text, meter_stats_rms_dB(&metrics->stats, i));
+        }
+    }
+
+    exporter_printf(text,
+                    "# TYPE scnp_meter_samples counter\n"
+                    "# HELP scnp_meter_samples The meter samples read.\n"
+                    "scnp_meter_samples_total{serial=\"%s\"} %" PRIu64 "\n"
+                    "# TYPE scnp_meter_read_errors counter\n"
+                    "# HELP scnp_meter_read_errors The meter reads which have failed.\n"
+                    "scnp_meter_read_errors_total{serial=\"%s\"} %" PRIu64 "\n"
+                    "# TYPE scnp_meter_deadlines_missed counter\n"
+                    "# HELP scnp_meter_deadlines_missed The sample deadlines skipped as too late.\n"
+                    "scnp_meter_deadlines_missed_total{serial=\"%s\"} %" PRIu64 "\n"
+                    "# TYPE scnp_meter_sample_rate_hz gauge\n"
+                    "# HELP scnp_meter_sample_rate_hz The sample rate achieved over the last second.\n"
+                    "scnp_meter_sample_rate_hz{serial=\"%s\"} %.3f\n",
+                    serial, metrics->sample_count,
+                    serial, metrics->read_error_count,
+                    serial, metrics->deadline_missed_count,
+                    serial, metrics->sample_rate_hz);
+
+    exporter_printf(text,
+                    "# TYPE scnp_usb_transfer_seconds histogram\n"
+                    "# HELP scnp_usb_transfer_seconds The time a meter read takes, including retries.\n");
+    for (size_t i=0; i<EXPORTER_LATENCY_BUCKETS; ++i) {
+        exporter_printf(text,
+                        "scnp_usb_transfer_seconds_bucket{serial=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+                        serial, exporter_latency_le_s[i], metrics->latency_bucket[i]);
+    }
+    exporter_printf(text,
+                    "scnp_usb_transfer_seconds_bucket{serial=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+                    "scnp_usb_transfer_seconds_count{serial=\"%s\"} %" PRIu64 "\n"
+                    "scnp_usb_transfer_seconds_sum{serial=\"%s\"} %.9f\n",
+                    serial, metrics->latency_count,
+                    serial, metrics->latency_count,
+                    serial, metrics->latency_sum_s);
+
+    exporter_printf(text,
+                    "# TYPE scnp_usb_transfers counter\n"
+                    "# HELP scnp_usb_transfers The USB control transfers attempted.\n"
+                    "scnp_usb_transfers_total{serial=\"%s\"} %lu\n"
+                    "# TYPE scnp_usb_retries counter\n"
+                    "# HELP scnp_usb_retries The USB control transfers retried.\n"
+                    "scnp_usb_retries_total{serial=\"%s\"} %lu\n"
+                    "# TYPE scnp_usb_timeouts counter\n"
+                    "# HELP scnp_usb_timeouts The USB control transfers timed out.\n"
+                    "scnp_usb_timeouts_total{serial=\"%s\"} %lu\n"
+                    "# TYPE scnp_usb_failures counter\n"
+                    "# HELP scnp_usb_failures The USB control transfers failed otherwise.\n"
+                    "scnp_usb_failures_total{serial=\"%s\"} %lu\n",
+                    serial, metrics->usb_transfers,
+                    serial, metrics->usb_retries,
+                    serial, metrics->usb_timeouts,
+                    serial, metrics->usb_failures);
+
+    const device_state_T *const state = &metrics->state;
+    if (metrics->state_known && (state->valid & DEVICE_STATE_ROUTING)) {
+        exporter_printf(text,
+                        "# TYPE scnp_routing_source gauge\n"
+                        "# HELP scnp_routing_source The audio source number last set.\n"
+                        "scnp_routing_source{serial=\"%s\"} %u\n",
+                        serial, state->routing_source);
+    }
+    if (metrics->state_known && (state->valid & DEVICE_STATE_DUCKER)) {
+        exporter_printf(text,
+                        "# TYPE scnp_ducker_on gauge\n"
+                        "# HELP scnp_ducker_on Whether the ducker was last turned on.\n"
+                        "scnp_ducker_on{serial=\"%s\"} %u\n",
+                        serial, state->ducker_on ? 1U : 0U);
+        if (state->ducker_on) {
+            exporter_printf(text,
+                            "# TYPE scnp_ducker_inputs gauge\n"
+                            "# HELP scnp_ducker_inputs The ducker input bitmask last set.\n"
+                            "scnp_ducker_inputs{serial=\"%s\"} %u\n"
+                            "# TYPE scnp_ducker_release_seconds gauge\n"
+                            "# HELP scnp_ducker_release_seconds The ducker release time last set.\n"
+                            "scnp_ducker_release_seconds{serial=\"%s\"} %.3f\n",
+                            serial, state->ducker_inputs,
+                            serial, state->ducker_release_ms / 1000.0);
+        }
+    }
+    if (metrics->state_known && (state->valid & DEVICE_STATE_RANGE)) {
+        exporter_printf(text,
+                        "# TYPE scnp_ducker_range_db gauge\n"
+                        "# HELP scnp_ducker_range_db The ducker range last set, in dB.\n"
+                        "scnp_ducker_range_db{serial=\"%s\"} ", serial);
+        exporter_print_value(text, metrics->ducker_range_dB);
+    }
+    if (metrics->state_known && (state->valid & DEVICE_STATE_THRESHOLD)) {
+        exporter_printf(text,
+                        "# TYPE scnp_ducker_threshold_db gauge\n"
+                        "# HELP scnp_ducker_threshold_db The ducker threshold last set, in dB.\n"
+                        "scnp_ducker_threshold_db{serial=\"%s\"} ", serial);
+        exporter_print_value(text, metrics->ducker_threshold_dB);
+    }
+
+    exporter_printf(text,
+                    "# TYPE scnp_exporter_scrapes counter\n"
+                    "# HELP scnp_exporter_scrapes The scrapes served.\n"
+                    "scnp_exporter_scrapes_total %" PRIu64 "\n"
+                    "# EOF\n",
+                    metrics->scrape_count);
+}
+
+
+/* The room kept for the HTTP header in front of the body in a
+ * client's response buffer. The longest header is about 150 bytes. */
+#define EXPORTER_HEADER_MAX 256U
+
+
+/* Put the HTTP response to the request the client has sent into its
+ * response buffer. The body is rendered right into the buffer, behind
+ * the room for the header, so a body which does not fit is always
+ * caught as truncated. */
+static
+void exporter_respond(exporter_metrics_T *metrics, exporter_client_T *client)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void exporter_respond(exporter_metrics_T *metrics, exporter_client_T *client)
+{
+    char *const body = &client->response[EXPORTER_HEADER_MAX];
+    exporter_text_T text = {
+        body, sizeof(client->response) - EXPORTER_HEADER_MAX, 0, false
+    };
+
+    const char *status = "200 OK";
+    const char *content_type =
+        "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    if ((strncmp(client->request, "GET /metrics ", 13) == 0) ||
+        (strncmp(client->request, "GET / ", 6) == 0)) {
+        ++metrics->scrape_count;
+        exporter_render_metrics(metrics, &text);
+        if (text.truncated) {
+            fprintf(stderr, "exporter: response too large\n");
+            status = "500 Internal Server Error";
+            content_type = "text/plain; charset=utf-8";
+            text.len = 0;
+            text.truncated = false;
+            exporter_printf(&text, "response too large\n");
+        }
+    } else {
+        status = "404 Not Found";
+        content_type = "text/plain; charset=utf-8";
+        exporter_printf(&text, "only /metrics is served here\n");
+    }
+
+    char header[EXPORTER_HEADER_MAX];
+    const int r = snprintf(header, sizeof(header),
+                           "HTTP/1.0 %s\r\n"
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %zu\r\n"
+                           "Connection: close\r\n"
+                           "\r\n",
+                           status, content_type, text.len);
+    const size_t header_len = (size_t) r;
+    /* close the gap between the header and the body */
+    memmove(&client->response[header_len], body, text.len);
+    memcpy(client->response, header, header_len);
+    client->response_len = header_len + text.len;
+    client->response_done = 0;
+}
+
+
+/* Read what the client has sent, and send what it has not got yet.
+ * Returns false when the client is done or has failed. */
+static
+bool exporter_serve_client(exporter_metrics_T *metrics,
+                           exporter_client_T *client, const short revents)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+bool exporter_serve_client(exporter_metrics_T *metrics,
+                           exporter_client_T *client, const short revents)
+{
+    if ((revents & POLLIN) && (client->response_len == 0)) {
+        const ssize_t r = read(client->fd, &client->request[client->request_len],
+                               sizeof(client->request) - 1 - client->request_len);
+        if (r < 0) {
+            return (errno == EAGAIN) || (errno == EINTR);
+        }
+        if (r == 0) {
+            return false;
+        }
+        client->request_len += (size_t) r;
+        client->request[client->request_len] = '\0';
+        if (strstr(client->request, "\r\n\r\n") != NULL) {
+            exporter_respond(metrics, client);
+        } else if (client->request_len >= (sizeof(client->request) - 1)) {
+            return false;
+        }
+    } else if (revents & (POLLHUP | POLLERR)) {
+        return false;
+    }
+
+    if (client->response_done < client->response_len) {
+        const ssize_t r = write(client->fd, &client->response[client->response_done],
+                                client->response_len - client->response_done);
+        if (r < 0) {
+            return (errno == EAGAIN) || (errno == EINTR);
+        }
+        client->response_done += (size_t) r;
+        if (client->response_done == client->response_len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* Whether LISTEN is a [ADDR:]PORT with a numeric IPv4 address, and
+ * not a Unix domain socket path. */
+static
+bool exporter_listen_is_port(const char *const listen_str)
+    __attribute__(( nonnull(1) ));
+
+static
+bool exporter_listen_is_port(const char *const listen_str)
+{
+    const char *const colon = strrchr(listen_str, ':');
+    const char *const port_str = (colon != NULL) ? (colon + 1) : listen_str;
+    return (*port_str != '\0') &&
+        (strspn(port_str, "0123456789") == strlen(port_str)) &&
+        ((colon == NULL) ||
+         (strspn(listen_str, "0123456789.") == (size_t) (colon - listen_str)));
+}
+
+
+/* Listen on the Unix domain socket path, or on [ADDR:]PORT for
+ * LISTEN strings which look like that. Returns the socket, or -1. */
+static
+int exporter_listen(const char *const listen_str)
+    __attribute__(( nonnull(1) ));
+
+static
+int exporter_listen(const char *const listen_str)
+{
+    if (!exporter_listen_is_port(listen_str)) {
+        return unix_socket_listen(listen_str, EXPORTER_CLIENTS_MAX, false);
+    }
+
+#if (defined(HAVE_NETINET_IN_H) && defined(HAVE_ARPA_INET_H))
+    const char *const colon = strrchr(listen_str, ':');
+    const char *const port_str = (colon != NULL) ? (colon + 1) : listen_str;
+    errno = 0;
+    const unsigned long port = strtoul(port_str, NULL, 10);
+    if ((errno != 0) || (port < 1) || (port > 65535)) {
+        fprintf(stderr, "Fatal: port out of range (1 to 65535): %s\n", port_str);
+        return -1;
+    }
+    char addr_str[INET_ADDRSTRLEN];
+    snprintf(addr_str, sizeof(addr_str), "%.*s",
+             (colon != NULL) ? (int) (colon - listen_str) : 0, listen_str);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) port);
+    if (inet_pton(AF_INET, (colon != NULL) ? addr_str : EXPORTER_PORT_ADDR_DEFAULT,
+                  &addr.sin_addr) != 1) {
+        fprintf(stderr, "Fatal: invalid address: %s\n", listen_str);
+        return -1;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("exporter: socket");
+        return -1;
+    }
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Fatal: bind %s: %s\n", listen_str, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((listen(fd, EXPORTER_CLIENTS_MAX) < 0) ||
+        (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)) {
+        perror("exporter: listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    fprintf(stderr, "Fatal: exporter cannot listen on TCP ports here\n");
+    return -1;
+#endif
+}
+
+
+bool exporter_server_open(exporter_server_T *server, const char *const listen)
+{
+    server->listen = listen;
+    for (size_t i=0; i<EXPORTER_CLIENTS_MAX; ++i) {
+        server->clients[i].fd = -1;
+    }
+    server->listen_fd = exporter_listen(listen);
+    return server->listen_fd >= 0;
+}
+
+
+bool exporter_server_poll(exporter_server_T *server,
+                          exporter_metrics_T *metrics, const int timeout_ms)
+{
+    exporter_client_T *const clients = server->clients;
+
+    struct pollfd pfds[1 + EXPORTER_CLIENTS_MAX];
+    nfds_t nfds = 0;
+    bool slot_free = false;
+    for (size_t i=0; i<EXPORTER_CLIENTS_MAX; ++i) {
+        if (clients[i].fd < 0) {
+            slot_free = true;
+            continue;
+        }
+        pfds[nfds].fd = clients[i].fd;
+        pfds[nfds].events = (clients[i].response_len > 0) ? POLLOUT : POLLIN;
+        pfds[nfds].revents = 0;
+        ++nfds;
+    }
+    const nfds_t client_nfds = nfds;
+    if (slot_free) {
+        pfds[nfds].fd = server->listen_fd;
+        pfds[nfds].events = POLLIN;
+        pfds[nfds].revents = 0;
+        ++nfds;
+    }
+
+    const int r = poll(pfds, nfds, timeout_ms);
+    if (r < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        perror("exporter: poll");
+        return false;
+    }
+
+    const uint64_t now_ns = monotonic_ns();
+    nfds_t k = 0;
+    for (size_t i=0; i<EXPORTER_CLIENTS_MAX; ++i) {
+        exporter_client_T *const client = &clients[i];
+        if (client->fd < 0) {
+            continue;
+        }
+        const short revents = (k < client_nfds) ? pfds[k++].revents : 0;
+        const bool timed_out =
+            ((now_ns - client->since_ns) / 1000000ULL) > EXPORTER_CLIENT_TIMEOUT_MS;
+        if (timed_out ||
+            ((revents != 0) && !exporter_serve_client(metrics, client, revents))) {
+            close(client->fd);
+            client->fd = -1;
+        }
+    }
+    if (slot_free && (pfds[client_nfds].revents & POLLIN)) {
+        for (size_t i=0; i<EXPORTER_CLIENTS_MAX; ++i) {
+            if (clients[i].fd >= 0) {
+                continue;
+            }
+            const int fd = accept(server->listen_fd, NULL, NULL);
+            if (fd < 0) {
+                break;
+            }
+            if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+                close(fd);
+                break;
+            }
+            clients[i].fd = fd;
+            clients[i].since_ns = now_ns;
+            clients[i].request_len = 0;
+            clients[i].response_len = 0;
+            clients[i].response_done = 0;
+        }
+    }
+    return true;
+}
+
+
+void exporter_server_close(exporter_server_T *server)
+{
+    for (size_t i=0; i<EXPORTER_CLIENTS_MAX; ++i) {
+        if (server->clients[i].fd >= 0) {
+            close(server->clients[i].fd);
+            server->clients[i].fd = -1;
+        }
+    }
+    close(server->listen_fd);
+    if (!exporter_listen_is_port(server->listen)) {
+        unlink(server->listen);
+    }
+}
+
+
+#else /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
+
+
+bool exporter_server_open(exporter_server_T *server, const char *const listen)
+{
+    server->listen = listen;
+    server->listen_fd = -1;
+    fprintf(stderr, "Fatal: exporter requires sockets\n");
+    return false;
+}
+
+
+bool exporter_server_poll(exporter_server_T *server,
+                          exporter_metrics_T *metrics, const int timeout_ms)
+{
+    (void) server;
+    (void) metrics;
+    (void) timeout_ms;
+    errno = ENOSYS;
+    return false;
+}
+
+
+void exporter_server_close(exporter_server_T *server)
+{
+    (void) server;
+}
+
+
+#endif /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
@@ -0,0 +1,138 @@
+/* scnp_exporter.h - serve the meter and device metrics as OpenMetrics
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef SCNP_EXPORTER_H
+#define SCNP_EXPORTER_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_cache.h"
+#include "meter_stats.h"
+#include "state_shadow.h"
+
+
+/* The exporter serves OpenMetrics text over HTTP for a monitoring
+ * system to scrape. Whoever samples the meter keeps everything to be
+ * exported as running values in an exporter_metrics_T. A scrape only
+ * formats those values, so it never causes a USB transfer, and the
+ * clients are served without blocking so that a slow one cannot hold
+ * up the sampling.
+ */
+
+
+#define EXPORTER_CLIENTS_MAX       8U
+#define EXPORTER_REQUEST_MAX       2048U
+#define EXPORTER_RESPONSE_MAX      (16U*1024U)
+#define EXPORTER_CLIENT_TIMEOUT_MS 5000U
+#define EXPORTER_PORT_ADDR_DEFAULT "127.0.0.1"
+
+#define EXPORTER_LATENCY_BUCKETS   12U
+
+
+/* Everything a scrape reports. */
+typedef struct {
+    char serial[DEVICE_CACHE_STRING_MAX];
+    const char *model;
+
+    /* the level and stats are only reported after the first sample */
+    uint64_t sample_count;
+    uint64_t read_error_count;
+    uint64_t deadline_missed_count;
+    double sample_rate_hz;
+    double level_dB;
+    meter_stats_T stats;
+
+    /* cumulative counts like in the OpenMetrics histogram, see
+     * exporter_metrics_add_latency() */
+    uint64_t latency_bucket[EXPORTER_LATENCY_BUCKETS];
+    uint64_t latency_count;
+    double latency_sum_s;
+
+    unsigned long usb_transfers;
+    unsigned long usb_retries;
+    unsigned long usb_timeouts;
+    unsigned long usb_failures;
+
+    /* the settings last sent, with the range and threshold in dB */
+    device_state_T state;
+    bool state_known;
+    double ducker_range_dB;
+    double ducker_threshold_dB;
+
+    uint64_t scrape_count;
+} exporter_metrics_T;
+
+
+/* Count one meter read which has taken READ_NS, including retries. */
+extern
+void exporter_metrics_add_latency(exporter_metrics_T *metrics,
+                                  const uint64_t read_ns);
+
+
+typedef struct {
+    int fd;
+    uint64_t since_ns;
+    size_t request_len;
+    char request[EXPORTER_REQUEST_MAX];
+    /* the response being sent, from response_done to response_len */
+    size_t response_len;
+    size_t response_done;
+    char response[EXPORTER_RESPONSE_MAX];
+} exporter_client_T;
+
+
+/* This is too large for the stack. */
+typedef struct {
+    const char *listen;
+    int listen_fd;
+    exporter_client_T clients[EXPORTER_CLIENTS_MAX];
+} exporter_server_T;
+
+
+/* Listen on the Unix domain socket path LISTEN, or on [ADDR:]PORT for
+ * LISTEN strings which look like that. Prints the error and returns
+ * false on failure. */
+extern
+bool exporter_server_open(exporter_server_T *server, const char *const listen);
+
+
+/* Wait up to TIMEOUT_MS for scrapers, and serve them from METRICS
+ * without blocking. Returns false when polling has failed; a wait
+ * interrupted by a signal is no failure. */
+extern
+bool exporter_server_poll(exporter_server_T *server,
+                          exporter_metrics_T *metrics, const int timeout_ms);
+
+
+/* Disconnect all clients, and remove the Unix domain socket. */
+extern
+void exporter_server_close(exporter_server_T *server);
+
+
+#endif /* !defined(SCNP_EXPORTER_H) */
@@ -0,0 +1,318 @@
+/* state_shadow.c - last written Notepad settings per device
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "state_shadow.h"
+
+#include "auto-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(HAVE_FLOCK) && defined(HAVE_SYS_FILE_H)
+# include <fcntl.h>
+# include <sys/file.h>
+#endif
+
+
+#define STATE_SHADOW_HEADER "# scnp-cli state shadow 1\n"
+
+
+bool device_state_matches(const device_state_T *state, const uint32_t setting,
+                          const device_state_T *values)
+{
+    if (!(state->valid & setting)) {
+        return false;
+    }
+    switch (setting) {
+    case DEVICE_STATE_ROUTING:
+        return state->routing_source == values->routing_source;
+    case DEVICE_STATE_DUCKER:
+        if (state->ducker_on != values->ducker_on) {
+            return false;
+        }
+        return !values->ducker_on ||
+            ((state->ducker_inputs == values->ducker_inputs) &&
+             (state->ducker_release_ms == values->ducker_release_ms));
+    case DEVICE_STATE_RANGE:
+        return state->ducker_range == values->ducker_range;
+    case DEVICE_STATE_THRESHOLD:
+        return state->ducker_threshold == values->ducker_threshold;
+    default:
+        return false;
+    }
+}
+
+
+/* Read the state of the shadow's device from the shadow file into
+ * STATE, which is left empty when there is none. */
+static
+void state_shadow_load(const state_shadow_T *shadow, device_state_T *state_out)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void state_shadow_load(const state_shadow_T *shadow, device_state_T *state_out)
+{
+    memset(state_out, 0, sizeof(*state_out));
+
+    FILE *file = fopen(shadow->path, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[128];
+    if ((fgets(line, sizeof(line), file) == NULL) ||
+        (strcmp(line, STATE_SHADOW_HEADER) != 0)) {
+        fclose(file);
+        return;
+    }
+
+    device_state_T state;
+    memset(&state, 0, sizeof(state));
+    bool same_device = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char port_path[sizeof(shadow->port_path)];
+        unsigned int u1, u2;
+        unsigned long ul;
+        if (sscanf(line, "device %31s %u", port_path, &u1) == 2) {
+            same_device = (strcmp(port_path, shadow->port_path) == 0) &&
+                (u1 == shadow->devaddr);
+        } else if ((sscanf(line, "routing %u", &u1) == 1) && (u1 <= 0xff)) {
+            state.routing_source = (uint8_t) u1;
+            state.valid |= DEVICE_STATE_ROUTING;
+        } else if (strcmp(line, "ducker off\n") == 0) {
+            state.ducker_on = false;
+            state.valid |= DEVICE_STATE_DUCKER;
+        } else if ((sscanf(line, "ducker on %u %u", &u1, &u2) == 2) &&
+                   (u1 <= 0xff) && (u2 <= 0xffff)) {
+            state.ducker_on = true;
+            state.ducker_inputs = (uint8_t) u1;
+            state.ducker_release_ms = (uint16_t) u2;
+            state.valid |= DEVICE_STATE_DUCKER;
+        } else if ((sscanf(line, "range %lu", &ul) == 1) && (ul <= UINT32_MAX)) {
+            state.ducker_range = (uint32_t) ul;
+            state.valid |= DEVICE_STATE_RANGE;
+        } else if ((sscanf(line, "threshold %lu", &ul) == 1) && (ul <= UINT32_MAX)) {
+            state.ducker_threshold = (uint32_t) ul;
+            state.valid |= DEVICE_STATE_THRESHOLD;
+        }
+    }
+    fclose(file);
+
+    /* values for an earlier enumeration of the device are stale */
+    if (same_device) {
+        *state_out = state;
+    }
+}
+
+
+bool state_shadow_available(void)
+{
+    const char *const runtime_dir = getenv("XDG_RUNTIME_DIR");
+    return (runtime_dir != NULL) && (runtime_dir[0] == '/');
+}
+
+
+bool state_shadow_open(state_shadow_T *shadow,
+                       const char *const serial,
+                       const char *const port_path, const uint8_t devaddr,
+                       const bool dry_run)
+{
+    memset(shadow, 0, sizeof(*shadow));
+    snprintf(shadow->port_path, sizeof(shadow->port_path), "%s", port_path);
+    shadow->devaddr = devaddr;
+
+    if (!state_shadow_available() || (serial == NULL) || (serial[0] == '\0')) {
+        return false;
+    }
+    const char *const runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    char dir[sizeof(shadow->path)];
+    int len = snprintf(dir, sizeof(dir), "%s/scnp-cli", runtime_dir);
+    if ((len < 0) || (((size_t) len) >= sizeof(dir))) {
+        return false;
+    }
+#if defined(HAVE_WINDOWS_H)
+    mkdir(dir);
+#else
+    mkdir(dir, 0700);
+#endif
+
+    /* keep the serial number from making up a path */
+    char safe_serial[64];
+    size_t i;
+    for (i=0; (serial[i] != '\0') && (i < (sizeof(safe_serial)-1)); ++i) {
+        const char c = serial[i];
+        const bool safe = ((c >= '0') && (c <= '9')) ||
+            ((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')) ||
+            (c == '-') || (c == '_');
+        safe_serial[i] = safe ? c : '_';
+    }
+    safe_serial[i] = '\0';
+
+    len = snprintf(shadow->path, sizeof(shadow->path), "%s/state-%s%s",
+                   dir, safe_serial, dry_run ? ".dry-run" : "");
+    if ((len < 0) || (((size_t) len) >= sizeof(shadow->path))) {
+        shadow->path[0] = '\0';
+        return false;
+    }
+
+    state_shadow_load(shadow, &shadow->state);
+    return true;
+}
+
+
+/* Take the lock serializing the updates of one shadow file. The shadow
+ * file itself is replaced on every update, so the lock is on a lock
+ * file next to it. Returns the lock file's fd, or -1 without a lock. */
+static
+int state_shadow_lock(const state_shadow_T *shadow)
+    __attribute__(( nonnull(1) ));
+
+static
+int state_shadow_lock(const state_shadow_T *shadow)
+{
+#if defined(HAVE_FLOCK) && defined(HAVE_SYS_FILE_H)
+    char lock_path[sizeof(shadow->path) + 8];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", shadow->path);
+    const int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void) shadow;
+    return -1;
+#endif
+}
+
+
+static
+void state_shadow_unlock(const int lock_fd)
+{
+    if (lock_fd >= 0) {
+        /* closing the only fd of the lock file releases the lock */
+        close(lock_fd);
+    }
+}
+
+
+/* Copy the SETTINGS from FROM to TO, known or not. */
+static
+void device_state_merge(device_state_T *to, const device_state_T *from,
+                        const uint32_t settings)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void device_state_merge(device_state_T *to, const device_state_T *from,
+                        const uint32_t settings)
+{
+    if (settings & DEVICE_STATE_ROUTING) {
+        to->routing_source = from->routing_source;
+    }
+    if (settings & DEVICE_STATE_DUCKER) {
+        to->ducker_on = from->ducker_on;
+        to->ducker_inputs = from->ducker_inputs;
+        to->ducker_release_ms = from->ducker_release_ms;
+    }
+    if (settings & DEVICE_STATE_RANGE) {
+        to->ducker_range = from->ducker_range;
+    }
+    if (settings & DEVICE_STATE_THRESHOLD) {
+        to->ducker_threshold = from->ducker_threshold;
+    }
+    to->valid = (to->valid & ~settings) | (from->valid & settings);
+}
+
+
+/* Write STATE to the shadow file by replacing it. */
+static
+void state_shadow_write(const state_shadow_T *shadow,
+                        const device_state_T *state)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void state_shadow_write(const state_shadow_T *shadow,
+                        const device_state_T *state)
+{
+    char tmp_path[sizeof(shadow->path) + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", shadow->path, (long) getpid());
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    fputs(STATE_SHADOW_HEADER, file);
+    fprintf(file, "device %s %u\n", shadow->port_path, shadow->devaddr);
+    if (state->valid & DEVICE_STATE_ROUTING) {
+        fprintf(file, "routing %u\n", state->routing_source);
+    }
+    if (state->valid & DEVICE_STATE_DUCKER) {
+        if (state->ducker_on) {
+            fprintf(file, "ducker on %u %u\n",
+                    state->ducker_inputs, state->ducker_release_ms);
+        } else {
+            fprintf(file, "ducker off\n");
+        }
+    }
+    if (state->valid & DEVICE_STATE_RANGE) {
+        fprintf(file, "range %lu\n", (unsigned long) state->ducker_range);
+    }
+    if (state->valid & DEVICE_STATE_THRESHOLD) {
+        fprintf(file, "threshold %lu\n", (unsigned long) state->ducker_threshold);
+    }
+
+    if ((fclose(file) != 0) || (rename(tmp_path, shadow->path) != 0)) {
+        remove(tmp_path);
+    }
+}
+
+
+void state_shadow_save(state_shadow_T *shadow, const uint32_t settings)
+{
+    if (shadow->path[0] == '\0') {
+        return;
+    }
+
+    const int lock_fd = state_shadow_lock(shadow);
+    device_state_T state;
+    state_shadow_load(shadow, &state);
+    device_state_merge(&state, &shadow->state, settings);
+    state_shadow_write(shadow, &state);
+    state_shadow_unlock(lock_fd);
+
+    /* also take over what the other runs have changed */
+    shadow->state = state;
+}
@@ -0,0 +1,109 @@
+/* state_shadow.h - last written Notepad settings per device
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef STATE_SHADOW_H
+#define STATE_SHADOW_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* The Notepad settings cannot be read back from the device, so we
+ * remember the last values we have successfully sent to each device
+ * (by serial number) in a small file under $XDG_RUNTIME_DIR. Sending
+ * a value which is already in effect can then be skipped.
+ *
+ * The shadow also records the USB port path and device address it is
+ * valid for. A device which has been power cycled or plugged in again
+ * gets a new address, has forgotten its settings, and the shadow
+ * values are discarded.
+ */
+
+
+/* bits for device_state_T.valid */
+#define DEVICE_STATE_ROUTING   0x01U
+#define DEVICE_STATE_DUCKER    0x02U
+#define DEVICE_STATE_RANGE     0x04U
+#define DEVICE_STATE_THRESHOLD 0x08U
+
+
+typedef struct {
+    uint32_t valid;
+    uint8_t routing_source;
+    bool ducker_on;
+    /* only meaningful while ducker_on */
+    uint8_t ducker_inputs;
+    uint16_t ducker_release_ms;
+    uint32_t ducker_range;
+    uint32_t ducker_threshold;
+} device_state_T;
+
+
+/* Whether the SETTING (one of the DEVICE_STATE_* bits) is known and
+ * has the same value in STATE as in VALUES. */
+extern
+bool device_state_matches(const device_state_T *state, const uint32_t setting,
+                          const device_state_T *values);
+
+
+typedef struct {
+    /* empty when the shadow is disabled */
+    char path[1024];
+    char port_path[32];
+    uint8_t devaddr;
+    device_state_T state;
+} state_shadow_T;
+
+
+/* Whether $XDG_RUNTIME_DIR is set for keeping the shadow files in. */
+extern
+bool state_shadow_available(void);
+
+
+/* Set up and load the shadow for the device. Returns false and
+ * disables the shadow when $XDG_RUNTIME_DIR is not set or the device
+ * has no serial number. Dry runs use a separate shadow file, so that
+ * they never cause a real transfer to be skipped. */
+extern
+bool state_shadow_open(state_shadow_T *shadow,
+                       const char *const serial,
+                       const char *const port_path, const uint8_t devaddr,
+                       const bool dry_run);
+
+
+/* Write the SETTINGS (DEVICE_STATE_* bits) which have changed to the
+ * shadow file. Other scnp-cli runs may have changed other settings of
+ * the same device since the shadow was loaded, so this re-reads the
+ * file, merges the changed settings into it, and writes it back, all
+ * under an exclusive lock, and then keeps the merged state. Failures
+ * are ignored, as they only cost us redundant transfers later. */
+extern
+void state_shadow_save(state_shadow_T *shadow, const uint32_t settings);
+
+
+#endif /* !defined(STATE_SHADOW_H) */
@@ -0,0 +1,231 @@
+/* term_line.c - redraw a single terminal line with as little output as possible
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "term_line.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+
+/* Rewriting up to this many unchanged cells between two changed ones
+ * is shorter than the escape sequence to skip them. */
+#define TERM_LINE_GAP_MAX 4
+
+
+void term_line_init(term_line_T *line, const int fd, const bool diff)
+{
+    memset(line, 0, sizeof(*line));
+    line->fd = fd;
+    line->diff = diff;
+}
+
+
+void term_line_invalidate(term_line_T *line)
+{
+    line->shown_valid = false;
+}
+
+
+void term_line_frame_clear(term_line_frame_T *frame)
+{
+    frame->count = 0;
+}
+
+
+void term_line_frame_add_cell(term_line_frame_T *frame, const char *cell)
+{
+    if (frame->count < TERM_LINE_CELLS_MAX) {
+        snprintf(frame->cells[frame->count++], TERM_LINE_CELL_SIZE, "%s", cell);
+    }
+}
+
+
+void term_line_frame_add_text(term_line_frame_T *frame, const char *text)
+{
+    for (const char *p = text; (*p != '\0') && (frame->count < TERM_LINE_CELLS_MAX); ++p) {
+        frame->cells[frame->count][0] = *p;
+        frame->cells[frame->count][1] = '\0';
+        ++frame->count;
+    }
+}
+
+
+/* The cell in the frame, or a space to blank out what was there. */
+static
+const char *frame_cell(const term_line_frame_T *frame, const size_t i)
+    __attribute__(( nonnull(1) ));
+
+static
+const char *frame_cell(const term_line_frame_T *frame, const size_t i)
+{
+    return (i < frame->count) ? frame->cells[i] : " ";
+}
+
+
+static
+bool cell_changed(const term_line_T *line, const term_line_frame_T *frame,
+                  const size_t i)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+bool cell_changed(const term_line_T *line, const term_line_frame_T *frame,
+                  const size_t i)
+{
+    return strcmp(frame_cell(&line->shown, i), frame_cell(frame, i)) != 0;
+}
+
+
+typedef struct {
+    char buf[TERM_LINE_CELLS_MAX * (TERM_LINE_CELL_SIZE + 8) + 16];
+    size_t len;
+} output_T;
+
+
+static
+void output_add(output_T *output, const char *str)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void output_add(output_T *output, const char *str)
+{
+    const size_t len = strlen(str);
+    if ((output->len + len) < sizeof(output->buf)) {
+        memcpy(&output->buf[output->len], str, len);
+        output->len += len;
+    }
+}
+
+
+/* Move the cursor from line->cursor to column. */
+static
+void output_move(output_T *output, term_line_T *line, const size_t column)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void output_move(output_T *output, term_line_T *line, const size_t column)
+{
+    size_t from = line->cursor;
+    if (column < from) {
+        output_add(output, "\r");
+        from = 0;
+    }
+    if (column > from) {
+        char seq[32];
+        snprintf(seq, sizeof(seq), "\033[%zuC", column - from);
+        output_add(output, seq);
+    }
+    line->cursor = column;
+}
+
+
+static
+int write_all(const int fd, const char *buf, size_t len)
+    __attribute__(( nonnull(2) ));
+
+static
+int write_all(const int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        const ssize_t written = write(fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += written;
+        len -= (size_t) written;
+    }
+    return 0;
+}
+
+
+int term_line_draw(term_line_T *line, const term_line_frame_T *frame)
+{
+    output_T output;
+    output.len = 0;
+
+    const size_t count =
+        (line->shown_valid && (line->shown.count > frame->count)) ?
+        line->shown.count : frame->count;
+
+    if (!line->diff || !line->shown_valid) {
+        output_add(&output, "\r");
+        for (size_t i=0; i<count; ++i) {
+            output_add(&output, frame_cell(frame, i));
+        }
+        line->cursor = count;
+    } else {
+        size_t i = 0;
+        while (i < count) {
+            if (!cell_changed(line, frame, i)) {
+                ++i;
+                continue;
+            }
+
+            /* extend the run over short gaps of unchanged cells */
+            const size_t start = i;
+            size_t end = i + 1;
+            size_t gap = 0;
+            for (size_t k=end; (k < count) && (gap <= TERM_LINE_GAP_MAX); ++k) {
+                if (cell_changed(line, frame, k)) {
+                    end = k + 1;
+                    gap = 0;
+                } else {
+                    ++gap;
+                }
+            }
+
+            output_move(&output, line, start);
+            for (size_t k=start; k<end; ++k) {
+                output_add(&output, frame_cell(frame, k));
+            }
+            line->cursor = end;
+            i = end;
+        }
+    }
+
+    /* remember the blanked out cells as spaces */
+    for (size_t i=0; i<count; ++i) {
+        snprintf(line->shown.cells[i], TERM_LINE_CELL_SIZE, "%s",
+                 frame_cell(frame, i));
+    }
+    line->shown.count = count;
+    line->shown_valid = true;
+
+    ++line->frame_count;
+    if (output.len == 0) {
+        return 0;
+    }
+    line->byte_count += output.len;
+    return write_all(line->fd, output.buf, output.len);
+}
@@ -0,0 +1,99 @@
+/* term_line.h - redraw a single terminal line with as little output as possible
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef TERM_LINE_H
+#define TERM_LINE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* A frame is the content of the line as a list of cells, each of
+ * which is one character on the terminal: ASCII, or a UTF-8 sequence
+ * of up to 3 bytes.
+ *
+ * term_line_draw() compares the frame with the one shown before, and
+ * only writes the changed cells, moving the cursor over the unchanged
+ * ones with the ANSI "cursor forward" escape sequence. The output for
+ * one frame goes to the terminal with a single write().
+ */
+
+
+#define TERM_LINE_CELLS_MAX 96
+#define TERM_LINE_CELL_SIZE 4
+
+
+typedef struct {
+    char cells[TERM_LINE_CELLS_MAX][TERM_LINE_CELL_SIZE];
+    size_t count;
+} term_line_frame_T;
+
+
+typedef struct {
+    int fd;
+    /* When false, always write the whole line, e.g. when not writing
+     * to a terminal. */
+    bool diff;
+    bool shown_valid;
+    term_line_frame_T shown;
+    /* the column the cursor is in */
+    size_t cursor;
+    uint64_t frame_count;
+    uint64_t byte_count;
+} term_line_T;
+
+
+extern
+void term_line_init(term_line_T *line, const int fd, const bool diff);
+
+
+/* Make the next term_line_draw() write the whole line, e.g. after
+ * something else has been written to the terminal. */
+extern
+void term_line_invalidate(term_line_T *line);
+
+
+extern
+void term_line_frame_clear(term_line_frame_T *frame);
+
+
+/* Append one cell, or one cell for every character of ASCII text. */
+extern
+void term_line_frame_add_cell(term_line_frame_T *frame, const char *cell);
+
+extern
+void term_line_frame_add_text(term_line_frame_T *frame, const char *text);
+
+
+/* Show the frame. Returns 0, or -1 with errno set when writing fails. */
+extern
+int term_line_draw(term_line_T *line, const term_line_frame_T *frame);
+
+
+#endif /* !defined(TERM_LINE_H) */
@@ -0,0 +1,146 @@
+/* unix_socket.c - local stream sockets for the daemon and the exporter
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "unix_socket.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+# include <fcntl.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+
+
+#if (defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H))
+
+
+static
+bool unix_socket_address(struct sockaddr_un *addr, const char *const path)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+bool unix_socket_address(struct sockaddr_un *addr, const char *const path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Fatal: socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+
+int unix_socket_listen(const char *const path, const int backlog,
+                       const bool owner_only)
+{
+    struct sockaddr_un addr;
+    if (!unix_socket_address(&addr, path)) {
+        return -1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if ((unlink(path) < 0) && (errno != ENOENT)) {
+        fprintf(stderr, "Fatal: unlink stale socket %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* Linux gives the socket the mode 0777 minus the umask */
+    const mode_t old_umask = owner_only ? umask(0177) : 0;
+    const int bind_ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    if (owner_only) {
+        umask(old_umask);
+    }
+    if (bind_ret < 0) {
+        fprintf(stderr, "Fatal: bind %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((listen(fd, backlog) < 0) ||
+        (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)) {
+        fprintf(stderr, "Fatal: listen %s: %s\n", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+
+int unix_socket_connect(const char *const path)
+{
+    struct sockaddr_un addr;
+    if (!unix_socket_address(&addr, path)) {
+        return -1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Fatal: connect %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+#else /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
+
+
+int unix_socket_listen(const char *const path, const int backlog,
+                       const bool owner_only)
+{
+    (void) backlog;
+    (void) owner_only;
+    fprintf(stderr, "Fatal: no Unix domain sockets for %s\n", path);
+    return -1;
+}
+
+
+int unix_socket_connect(const char *const path)
+{
+    fprintf(stderr, "Fatal: no Unix domain sockets for %s\n", path);
+    return -1;
+}
+
+
+#endif /* !(HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H) */
@@ -0,0 +1,50 @@
+/* unix_socket.h - local stream sockets for the daemon and the exporter
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef UNIX_SOCKET_H
+#define UNIX_SOCKET_H
+
+
+#include <stdbool.h>
+
+
+/* Listen on a Unix domain stream socket at PATH, after removing a stale
+ * socket left there. The socket does not block on accept(2). With
+ * OWNER_ONLY, only our own user can connect. Prints the error and
+ * returns -1 on failure, or without Unix domain sockets. */
+extern
+int unix_socket_listen(const char *const path, const int backlog,
+                       const bool owner_only);
+
+
+/* Connect to the Unix domain stream socket at PATH. Prints the error
+ * and returns -1 on failure, or without Unix domain sockets. */
+extern
+int unix_socket_connect(const char *const path);
+
+
+#endif /* !defined(UNIX_SOCKET_H) */
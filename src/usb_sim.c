@@ -0,0 +1,1116 @@
+/* usb_sim.c - simulated Notepad devices
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "usb_sim.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dB_conv.h"
+#include "monotonic_time.h"
+
+
+#define USB_SIM_DEVICES_MAX 8
+#define USB_SIM_PENDING_MAX 64
+#define USB_SIM_SCRIPT_MAX  64
+
+#define USB_SIM_VENDOR      0x05fc
+
+#define USB_SIM_TWO_PI      6.283185307179586
+
+
+typedef enum {
+    SIM_SIGNAL_CONST,
+    SIM_SIGNAL_SINE,
+    SIM_SIGNAL_SQUARE,
+    SIM_SIGNAL_NOISE,
+} sim_signal_T;
+
+
+typedef struct {
+    const char *name;
+    uint16_t idProduct;
+    const char *product;
+} sim_model_T;
+
+
+static
+const sim_model_T sim_models[] = {
+    { "5",    0x0030, "Soundcraft Notepad-5" },
+    { "8fx",  0x0031, "Soundcraft Notepad-8FX" },
+    { "12fx", 0x0032, "Soundcraft Notepad-12FX" },
+    { NULL, 0, NULL }
+};
+
+
+/* Handed out as both libusb_device and libusb_device_handle. */
+typedef struct {
+    const sim_model_T *model;
+    char serial[16];
+    uint8_t address;
+    unsigned int open_count;
+
+    /* the settings as far as they have been set, like state_shadow.h */
+    uint32_t valid;
+    uint8_t routing_source;
+    bool ducker_on;
+    uint8_t ducker_inputs;
+    uint16_t ducker_release_ms;
+    uint32_t ducker_range;
+    uint32_t ducker_threshold;
+    bool dirty;
+} sim_device_T;
+
+
+#define SIM_VALID_ROUTING   0x1U
+#define SIM_VALID_DUCKER    0x2U
+#define SIM_VALID_RANGE     0x4U
+#define SIM_VALID_THRESHOLD 0x8U
+
+
+typedef struct {
+    struct libusb_transfer *transfer;
+    uint64_t due_ns;
+    bool cancelled;
+} sim_pending_T;
+
+
+/* One line of a level script: hold level_dB for duration_ns. */
+typedef struct {
+    uint64_t duration_ns;
+    double level_dB;
+} sim_script_step_T;
+
+
+static struct {
+    sim_device_T devices[USB_SIM_DEVICES_MAX];
+    size_t device_count;
+
+    sim_signal_T signal;
+    double level_dB;
+    double freq_hz;
+
+    sim_script_step_T script[USB_SIM_SCRIPT_MAX];
+    size_t script_count;
+    uint64_t script_ns;
+
+    uint64_t latency_ns;
+    uint64_t jitter_ns;
+    double fail;
+    int error;
+    uint64_t random_state;
+
+    char state_dir[1024];
+
+    uint64_t start_ns;
+
+    sim_pending_T pending[USB_SIM_PENDING_MAX];
+    size_t pending_count;
+} sim;
+
+
+static
+sim_device_T *sim_device(void *dev)
+    __attribute__(( nonnull(1) ));
+
+static
+sim_device_T *sim_device(void *dev)
+{
+    return (sim_device_T *) dev;
+}
+
+
+/* xorshift64*, plenty for jitter, failures, and noise */
+static
+double sim_random(void);
+
+static
+double sim_random(void)
+{
+    sim.random_state ^= sim.random_state >> 12;
+    sim.random_state ^= sim.random_state << 25;
+    sim.random_state ^= sim.random_state >> 27;
+    const uint64_t r = sim.random_state * 0x2545f4914f6cdd1dULL;
+    return ((double) (r >> 11)) / 9007199254740992.0;
+}
+
+
+/* Parse a number with an optional unit suffix like "ms" or "dB". */
+static
+int sim_parse_double(double *value, const char *const str,
+                     const char *const unit, const double min, const double max)
+    __attribute__(( nonnull(1), nonnull(2), nonnull(3) ));
+
+static
+int sim_parse_double(double *value, const char *const str,
+                     const char *const unit, const double min, const double max)
+{
+    char *endp = NULL;
+    errno = 0;
+    const double d = strtod(str, &endp);
+    if ((endp == str) || (errno != 0) ||
+        ((*endp != '\0') && (strcmp(endp, unit) != 0)) ||
+        !(d >= min) || !(d <= max)) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: invalid value '%s' (%g%s to %g%s)\n",
+                str, min, unit, max, unit);
+        return EXIT_FAILURE;
+    }
+    *value = d;
+    return EXIT_SUCCESS;
+}
+
+
+/* Load a level script: lines of "DURATIONms LEVELdB", with empty lines
+ * and # comments ignored. */
+static
+int sim_load_script(const char *const path)
+    __attribute__(( nonnull(1) ));
+
+static
+int sim_load_script(const char *const path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int retval = EXIT_SUCCESS;
+    char line[256];
+    unsigned int lineno = 0;
+    sim.script_count = 0;
+    sim.script_ns = 0;
+    while ((retval == EXIT_SUCCESS) && (fgets(line, sizeof(line), file) != NULL)) {
+        ++lineno;
+        char *const comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char duration[64];
+        char level[64];
+        char extra[2];
+        const int n = sscanf(line, "%63s %63s %1s", duration, level, extra);
+        if (n <= 0) {
+            continue;
+        }
+        double duration_ms;
+        sim_script_step_T *const step = &sim.script[sim.script_count];
+        if (n != 2) {
+            fprintf(stderr, "Fatal: SCNP_CLI_SIM: %s:%u: expected DURATIONms LEVELdB\n",
+                    path, lineno);
+            retval = EXIT_FAILURE;
+        } else if (sim.script_count >= USB_SIM_SCRIPT_MAX) {
+            fprintf(stderr, "Fatal: SCNP_CLI_SIM: %s:%u: more than %u lines\n",
+                    path, lineno, USB_SIM_SCRIPT_MAX);
+            retval = EXIT_FAILURE;
+        } else if ((sim_parse_double(&duration_ms, duration, "ms",
+                                     1.0, 86400000.0) != EXIT_SUCCESS) ||
+                   (sim_parse_double(&step->level_dB, level, "dB",
+                                     -150.0, 0.0) != EXIT_SUCCESS)) {
+            retval = EXIT_FAILURE;
+        } else {
+            step->duration_ns = (uint64_t) (duration_ms * 1.0e6);
+            sim.script_ns += step->duration_ns;
+            ++sim.script_count;
+        }
+    }
+    if ((retval == EXIT_SUCCESS) && ferror(file)) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: %s: read error\n", path);
+        retval = EXIT_FAILURE;
+    }
+    if ((retval == EXIT_SUCCESS) && (sim.script_count == 0)) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: %s: empty script\n", path);
+        retval = EXIT_FAILURE;
+    }
+    fclose(file);
+    return retval;
+}
+
+
+static
+int sim_parse_item(char *item)
+    __attribute__(( nonnull(1) ));
+
+static
+int sim_parse_item(char *item)
+{
+    for (size_t i=0; sim_models[i].name != NULL; ++i) {
+        if (strcmp(item, sim_models[i].name) == 0) {
+            if (sim.device_count >= USB_SIM_DEVICES_MAX) {
+                fprintf(stderr, "Fatal: SCNP_CLI_SIM: too many devices\n");
+                return EXIT_FAILURE;
+            }
+            sim_device_T *const dev = &sim.devices[sim.device_count++];
+            dev->model = &sim_models[i];
+            snprintf(dev->serial, sizeof(dev->serial), "SIM%04u",
+                     (unsigned int) sim.device_count);
+            dev->address = (uint8_t) (1 + sim.device_count);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    char *const value = strchr(item, '=');
+    if (value == NULL) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: unknown device '%s'\n", item);
+        return EXIT_FAILURE;
+    }
+    *value = '\0';
+    const char *const key = item;
+    const char *const val = value + 1;
+
+    double d;
+    if (strcmp(key, "signal") == 0) {
+        if (strcmp(val, "const") == 0) {
+            sim.signal = SIM_SIGNAL_CONST;
+        } else if (strcmp(val, "sine") == 0) {
+            sim.signal = SIM_SIGNAL_SINE;
+        } else if (strcmp(val, "square") == 0) {
+            sim.signal = SIM_SIGNAL_SQUARE;
+        } else if (strcmp(val, "noise") == 0) {
+            sim.signal = SIM_SIGNAL_NOISE;
+        } else {
+            fprintf(stderr, "Fatal: SCNP_CLI_SIM: unknown signal '%s'\n", val);
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "level") == 0) {
+        if (sim_parse_double(&sim.level_dB, val, "dB", -150.0, 0.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "script") == 0) {
+        if (sim_load_script(val) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "freq") == 0) {
+        if (sim_parse_double(&sim.freq_hz, val, "Hz", 0.001, 10000.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "latency") == 0) {
+        if (sim_parse_double(&d, val, "ms", 0.0, 60000.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        sim.latency_ns = (uint64_t) (d * 1.0e6);
+    } else if (strcmp(key, "jitter") == 0) {
+        if (sim_parse_double(&d, val, "ms", 0.0, 60000.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        sim.jitter_ns = (uint64_t) (d * 1.0e6);
+    } else if (strcmp(key, "fail") == 0) {
+        if (sim_parse_double(&sim.fail, val, "", 0.0, 1.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "error") == 0) {
+        if (strcmp(val, "timeout") == 0) {
+            sim.error = LIBUSB_ERROR_TIMEOUT;
+        } else if (strcmp(val, "pipe") == 0) {
+            sim.error = LIBUSB_ERROR_PIPE;
+        } else if (strcmp(val, "overflow") == 0) {
+            sim.error = LIBUSB_ERROR_OVERFLOW;
+        } else if (strcmp(val, "io") == 0) {
+            sim.error = LIBUSB_ERROR_IO;
+        } else if (strcmp(val, "no-device") == 0) {
+            sim.error = LIBUSB_ERROR_NO_DEVICE;
+        } else {
+            fprintf(stderr, "Fatal: SCNP_CLI_SIM: unknown error '%s'\n", val);
+            return EXIT_FAILURE;
+        }
+    } else if (strcmp(key, "seed") == 0) {
+        if (sim_parse_double(&d, val, "", 1.0, 4294967295.0) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        sim.random_state = (uint64_t) d;
+    } else if (strcmp(key, "state") == 0) {
+        const int len = snprintf(sim.state_dir, sizeof(sim.state_dir), "%s", val);
+        if ((len <= 0) || (((size_t) len) >= sizeof(sim.state_dir))) {
+            fprintf(stderr, "Fatal: SCNP_CLI_SIM: invalid state directory\n");
+            return EXIT_FAILURE;
+        }
+    } else {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM: unknown setting '%s'\n", key);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int usb_sim_setup(const char *const spec)
+{
+    memset(&sim, 0, sizeof(sim));
+    sim.signal = SIM_SIGNAL_CONST;
+    sim.level_dB = -20.0;
+    sim.freq_hz = 1.0;
+    sim.error = LIBUSB_ERROR_TIMEOUT;
+    sim.random_state = 1;
+
+    char buf[1024];
+    const int len = snprintf(buf, sizeof(buf), "%s", spec);
+    if ((len < 0) || (((size_t) len) >= sizeof(buf))) {
+        fprintf(stderr, "Fatal: SCNP_CLI_SIM is too long\n");
+        return EXIT_FAILURE;
+    }
+
+    char *item = buf;
+    while (item != NULL) {
+        char *const next = strchr(item, ',');
+        if (next != NULL) {
+            *next = '\0';
+        }
+        if ((*item != '\0') && (sim_parse_item(item) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        item = (next != NULL) ? (next + 1) : NULL;
+    }
+
+    if (sim.device_count == 0) {
+        char model[] = "12fx";
+        (void) sim_parse_item(model);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* The state file is written like the state shadow, see state_shadow.h */
+static
+void sim_state_path(const sim_device_T *dev, char *path, const size_t size)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+void sim_state_path(const sim_device_T *dev, char *path, const size_t size)
+{
+    snprintf(path, size, "%s/%s", sim.state_dir, dev->serial);
+}
+
+
+static
+void sim_state_load(sim_device_T *dev)
+    __attribute__(( nonnull(1) ));
+
+static
+void sim_state_load(sim_device_T *dev)
+{
+    char path[1100];
+    sim_state_path(dev, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned int a, b;
+        unsigned long ul;
+        if (sscanf(line, "routing %u", &a) == 1) {
+            dev->routing_source = (uint8_t) a;
+            dev->valid |= SIM_VALID_ROUTING;
+        } else if (sscanf(line, "ducker on %u %u", &a, &b) == 2) {
+            dev->ducker_on = true;
+            dev->ducker_inputs = (uint8_t) a;
+            dev->ducker_release_ms = (uint16_t) b;
+            dev->valid |= SIM_VALID_DUCKER;
+        } else if (strcmp(line, "ducker off\n") == 0) {
+            dev->ducker_on = false;
+            dev->valid |= SIM_VALID_DUCKER;
+        } else if (sscanf(line, "range %lx", &ul) == 1) {
+            dev->ducker_range = (uint32_t) ul;
+            dev->valid |= SIM_VALID_RANGE;
+        } else if (sscanf(line, "threshold %lx", &ul) == 1) {
+            dev->ducker_threshold = (uint32_t) ul;
+            dev->valid |= SIM_VALID_THRESHOLD;
+        }
+    }
+    fclose(file);
+}
+
+
+static
+void sim_state_save(sim_device_T *dev)
+    __attribute__(( nonnull(1) ));
+
+static
+void sim_state_save(sim_device_T *dev)
+{
+    char path[1100];
+    sim_state_path(dev, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "sim: cannot save %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (dev->valid & SIM_VALID_ROUTING) {
+        fprintf(file, "routing %u\n", (unsigned int) dev->routing_source);
+    }
+    if ((dev->valid & SIM_VALID_DUCKER) && dev->ducker_on) {
+        fprintf(file, "ducker on %u %u\n", (unsigned int) dev->ducker_inputs,
+                (unsigned int) dev->ducker_release_ms);
+    } else if (dev->valid & SIM_VALID_DUCKER) {
+        fprintf(file, "ducker off\n");
+    }
+    if (dev->valid & SIM_VALID_RANGE) {
+        fprintf(file, "range 0x%08lx\n", (unsigned long) dev->ducker_range);
+    }
+    if (dev->valid & SIM_VALID_THRESHOLD) {
+        fprintf(file, "threshold 0x%06lx\n", (unsigned long) dev->ducker_threshold);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "sim: cannot save %s\n", path);
+    }
+    dev->dirty = false;
+}
+
+
+/* Apply an OUT message like the device would. */
+static
+int sim_device_receive(sim_device_T *dev, const uint8_t *data)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int sim_device_receive(sim_device_T *dev, const uint8_t *data)
+{
+    const uint32_t be32 =
+        (((uint32_t) data[4]) << 24) | (((uint32_t) data[5]) << 16) |
+        (((uint32_t) data[6]) <<  8) | (((uint32_t) data[7]) <<  0);
+
+    if ((data[0] != 0x00) || (data[1] != 0x00)) {
+        return LIBUSB_ERROR_PIPE;
+    } else if ((data[2] == 0x04) && (data[3] == 0x00) && (data[4] < 4)) {
+        dev->routing_source = data[4];
+        dev->valid |= SIM_VALID_ROUTING;
+    } else if ((data[2] == 0x02) && (data[3] == 0x80) && (data[4] == 0x00)) {
+        dev->ducker_on = false;
+        dev->valid |= SIM_VALID_DUCKER;
+    } else if ((data[2] == 0x02) && (data[3] == 0x80) && (data[4] == 0x01)) {
+        dev->ducker_on = true;
+        dev->ducker_inputs = data[5];
+        dev->ducker_release_ms =
+            (uint16_t) ((((uint16_t) data[6]) << 8) | data[7]);
+        /* enabling the ducker resets its range and threshold */
+        dev->valid |= SIM_VALID_DUCKER;
+        dev->valid &= ~(SIM_VALID_RANGE | SIM_VALID_THRESHOLD);
+    } else if ((data[2] == 0x02) && (data[3] == 0x81)) {
+        dev->ducker_range = be32;
+        dev->valid |= SIM_VALID_RANGE;
+    } else if ((data[2] == 0x02) && (data[3] == 0x82)) {
+        dev->ducker_threshold = be32;
+        dev->valid |= SIM_VALID_THRESHOLD;
+    } else {
+        return LIBUSB_ERROR_PIPE;
+    }
+    dev->dirty = true;
+    return LIBUSB_SUCCESS;
+}
+
+
+/* The peak level at the monotonic time now_ns, from the level script
+ * (which starts over after its last line) if there is one. */
+static
+double sim_level_dB(const uint64_t now_ns);
+
+static
+double sim_level_dB(const uint64_t now_ns)
+{
+    if (sim.script_count == 0) {
+        return sim.level_dB;
+    }
+    uint64_t t_ns = (now_ns - sim.start_ns) % sim.script_ns;
+    for (size_t i=0; i<sim.script_count; ++i) {
+        if (t_ns < sim.script[i].duration_ns) {
+            return sim.script[i].level_dB;
+        }
+        t_ns -= sim.script[i].duration_ns;
+    }
+    return sim.script[sim.script_count-1].level_dB;
+}
+
+
+/* The meter value of the signal at the monotonic time now_ns. */
+static
+uint32_t sim_meter_value(const uint64_t now_ns);
+
+static
+uint32_t sim_meter_value(const uint64_t now_ns)
+{
+    const double t = ((double) (now_ns - sim.start_ns)) / 1.0e9;
+    const double peak = pow(10.0, sim_level_dB(now_ns) / 20.0);
+    double v = peak;
+    switch (sim.signal) {
+    case SIM_SIGNAL_CONST:
+        break;
+    case SIM_SIGNAL_SINE:
+        v = peak * fabs(sin(USB_SIM_TWO_PI * sim.freq_hz * t));
+        break;
+    case SIM_SIGNAL_SQUARE:
+        v = (fmod(t * sim.freq_hz, 1.0) < 0.5) ? peak : (peak * 0.01);
+        break;
+    case SIM_SIGNAL_NOISE:
+        v = peak * sim_random();
+        break;
+    }
+    return (uint32_t) lround(v * REF_VALUE_METER);
+}
+
+
+/* Answer an IN transfer, or handle an OUT transfer. Returns the
+ * number of bytes transferred, or a LIBUSB_ERROR_* code. */
+static
+int sim_transfer(sim_device_T *dev, const uint8_t request_type,
+                 const uint8_t bRequest, unsigned char *data,
+                 const uint16_t wLength, const uint64_t now_ns)
+    __attribute__(( nonnull(1), nonnull(4) ));
+
+static
+int sim_transfer(sim_device_T *dev, const uint8_t request_type,
+                 const uint8_t bRequest, unsigned char *data,
+                 const uint16_t wLength, const uint64_t now_ns)
+{
+    if ((sim.fail > 0.0) && (sim_random() < sim.fail)) {
+        return sim.error;
+    }
+    if ((bRequest != 16) || (wLength != 8)) {
+        return LIBUSB_ERROR_PIPE;
+    }
+    if (request_type & 0x80 /* device to host */) {
+        const uint32_t value = sim_meter_value(now_ns);
+        memset(data, 0, wLength);
+        data[0] = (value >>  0) & 0xff;
+        data[1] = (value >>  8) & 0xff;
+        data[2] = (value >> 16) & 0xff;
+        data[3] = (value >> 24) & 0xff;
+        return wLength;
+    }
+    const int ret = sim_device_receive(dev, data);
+    return (ret < 0) ? ret : wLength;
+}
+
+
+/* When a transfer started now completes. */
+static
+uint64_t sim_due_ns(void);
+
+static
+uint64_t sim_due_ns(void)
+{
+    uint64_t delay_ns = sim.latency_ns;
+    if (sim.jitter_ns > 0) {
+        delay_ns += (uint64_t) (sim_random() * ((double) sim.jitter_ns));
+    }
+    return monotonic_ns() + delay_ns;
+}
+
+
+static
+int LIBUSB_CALL sim_init(void);
+
+static
+int LIBUSB_CALL sim_init(void)
+{
+    if (sim.start_ns == 0) {
+        sim.start_ns = monotonic_ns();
+    }
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+void LIBUSB_CALL sim_exit(void);
+
+static
+void LIBUSB_CALL sim_exit(void)
+{
+}
+
+
+static
+int LIBUSB_CALL sim_has_capability(uint32_t capability);
+
+static
+int LIBUSB_CALL sim_has_capability(uint32_t capability)
+{
+    return (capability == LIBUSB_CAP_HAS_CAPABILITY);
+}
+
+
+static
+ssize_t LIBUSB_CALL sim_get_device_list(libusb_device ***list)
+    __attribute__(( nonnull(1) ));
+
+static
+ssize_t LIBUSB_CALL sim_get_device_list(libusb_device ***list)
+{
+    libusb_device **ret = calloc(sim.device_count + 1, sizeof(*ret));
+    if (ret == NULL) {
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    for (size_t i=0; i<sim.device_count; ++i) {
+        ret[i] = (libusb_device *) (void *) &sim.devices[i];
+    }
+    *list = ret;
+    return (ssize_t) sim.device_count;
+}
+
+
+static
+void LIBUSB_CALL sim_free_device_list(libusb_device **list, int unref_devices);
+
+static
+void LIBUSB_CALL sim_free_device_list(libusb_device **list, int unref_devices)
+{
+    (void) unref_devices;
+    free(list);
+}
+
+
+/* The simulated devices live as long as the process, so there is no
+ * need to count references. */
+static
+libusb_device *LIBUSB_CALL sim_ref_device(libusb_device *dev);
+
+static
+libusb_device *LIBUSB_CALL sim_ref_device(libusb_device *dev)
+{
+    return dev;
+}
+
+
+static
+void LIBUSB_CALL sim_unref_device(libusb_device *dev);
+
+static
+void LIBUSB_CALL sim_unref_device(libusb_device *dev)
+{
+    (void) dev;
+}
+
+
+static
+int LIBUSB_CALL sim_get_device_descriptor(libusb_device *dev,
+                                          struct libusb_device_descriptor *desc)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int LIBUSB_CALL sim_get_device_descriptor(libusb_device *dev,
+                                          struct libusb_device_descriptor *desc)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->bLength = 18;
+    desc->bDescriptorType = 0x01; /* DEVICE */
+    desc->bcdUSB = 0x0200;
+    desc->bMaxPacketSize0 = 64;
+    desc->idVendor = USB_SIM_VENDOR;
+    desc->idProduct = sim_device(dev)->model->idProduct;
+    desc->bcdDevice = 0x0100;
+    desc->iManufacturer = 1;
+    desc->iProduct = 2;
+    desc->iSerialNumber = 3;
+    desc->bNumConfigurations = 1;
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+uint8_t LIBUSB_CALL sim_get_bus_number(libusb_device *dev);
+
+static
+uint8_t LIBUSB_CALL sim_get_bus_number(libusb_device *dev)
+{
+    (void) dev;
+    return 1;
+}
+
+
+static
+uint8_t LIBUSB_CALL sim_get_device_address(libusb_device *dev)
+    __attribute__(( nonnull(1) ));
+
+static
+uint8_t LIBUSB_CALL sim_get_device_address(libusb_device *dev)
+{
+    return sim_device(dev)->address;
+}
+
+
+/* Every device is on its own port of the root hub. */
+static
+int LIBUSB_CALL sim_get_port_numbers(libusb_device *dev,
+                                     uint8_t *port_numbers, int port_numbers_len)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int LIBUSB_CALL sim_get_port_numbers(libusb_device *dev,
+                                     uint8_t *port_numbers, int port_numbers_len)
+{
+    if (port_numbers_len < 1) {
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+    port_numbers[0] = (uint8_t) (sim_device(dev) - sim.devices + 1);
+    return 1;
+}
+
+
+static
+int LIBUSB_CALL sim_open(libusb_device *dev, libusb_device_handle **dev_handle)
+    __attribute__(( nonnull(1), nonnull(2) ));
+
+static
+int LIBUSB_CALL sim_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+    sim_device_T *const sdev = sim_device(dev);
+    if ((sdev->open_count++ == 0) && (sim.state_dir[0] != '\0')) {
+        sim_state_load(sdev);
+    }
+    *dev_handle = (libusb_device_handle *) (void *) sdev;
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+void LIBUSB_CALL sim_close(libusb_device_handle *dev_handle)
+    __attribute__(( nonnull(1) ));
+
+static
+void LIBUSB_CALL sim_close(libusb_device_handle *dev_handle)
+{
+    sim_device_T *const sdev = sim_device(dev_handle);
+    if ((--sdev->open_count == 0) && sdev->dirty && (sim.state_dir[0] != '\0')) {
+        sim_state_save(sdev);
+    }
+}
+
+
+/* Without device discovery, the simulated devices are still there. */
+static
+int LIBUSB_CALL sim_init_no_discovery(void);
+
+static
+int LIBUSB_CALL sim_init_no_discovery(void)
+{
+    return sim_init();
+}
+
+
+/* Any open file descriptor stands for the first simulated device. */
+static
+int LIBUSB_CALL sim_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+    __attribute__(( nonnull(2) ));
+
+static
+int LIBUSB_CALL sim_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+{
+    if ((sys_dev < 0) || (sys_dev > INT_MAX) || (fcntl((int) sys_dev, F_GETFD) < 0)) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (sim.device_count == 0) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    return sim_open((libusb_device *) (void *) &sim.devices[0], dev_handle);
+}
+
+
+static
+libusb_device *LIBUSB_CALL sim_get_device(libusb_device_handle *dev_handle);
+
+static
+libusb_device *LIBUSB_CALL sim_get_device(libusb_device_handle *dev_handle)
+{
+    /* the handle and the device are the same sim_device_T */
+    return (libusb_device *) (void *) dev_handle;
+}
+
+
+static
+int LIBUSB_CALL sim_get_string_descriptor_ascii(libusb_device_handle *dev_handle,
+                                                uint8_t desc_index,
+                                                unsigned char *data, int length)
+    __attribute__(( nonnull(1), nonnull(3) ));
+
+static
+int LIBUSB_CALL sim_get_string_descriptor_ascii(libusb_device_handle *dev_handle,
+                                                uint8_t desc_index,
+                                                unsigned char *data, int length)
+{
+    const sim_device_T *const sdev = sim_device(dev_handle);
+    const char *str;
+    switch (desc_index) {
+    case 1:  str = "Harman"; break;
+    case 2:  str = sdev->model->product; break;
+    case 3:  str = sdev->serial; break;
+    default: return LIBUSB_ERROR_PIPE;
+    }
+    if (length < 1) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    size_t len = strlen(str);
+    if (len >= (size_t) length) {
+        len = (size_t) length - 1;
+    }
+    memcpy(data, str, len);
+    data[len] = '\0';
+    return (int) len;
+}
+
+
+static
+int LIBUSB_CALL sim_control_transfer(libusb_device_handle *dev_handle,
+                                     uint8_t request_type, uint8_t bRequest,
+                                     uint16_t wValue, uint16_t wIndex,
+                                     unsigned char *data, uint16_t wLength,
+                                     unsigned int timeout)
+    __attribute__(( nonnull(1), nonnull(6) ));
+
+static
+int LIBUSB_CALL sim_control_transfer(libusb_device_handle *dev_handle,
+                                     uint8_t request_type, uint8_t bRequest,
+                                     uint16_t wValue, uint16_t wIndex,
+                                     unsigned char *data, uint16_t wLength,
+                                     unsigned int timeout)
+{
+    (void) wValue;
+    (void) wIndex;
+    const uint64_t start_ns = monotonic_ns();
+    const uint64_t due_ns = sim_due_ns();
+    if (timeout > 0) {
+        /* a device slower than the timeout times out like libusb would */
+        const uint64_t timeout_ns = ((uint64_t) timeout) * 1000000ULL;
+        if ((due_ns - start_ns) > timeout_ns) {
+            sleep_until_ns(start_ns + timeout_ns);
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+    }
+    sleep_until_ns(due_ns);
+    return sim_transfer(sim_device(dev_handle), request_type, bRequest,
+                        data, wLength, due_ns);
+}
+
+
+static
+int LIBUSB_CALL sim_submit_transfer(struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL sim_submit_transfer(struct libusb_transfer *transfer)
+{
+    for (size_t i=0; i<sim.pending_count; ++i) {
+        if (sim.pending[i].transfer == transfer) {
+            return LIBUSB_ERROR_BUSY;
+        }
+    }
+    if (sim.pending_count >= USB_SIM_PENDING_MAX) {
+        return LIBUSB_ERROR_BUSY;
+    }
+    sim_pending_T *const pending = &sim.pending[sim.pending_count++];
+    pending->transfer = transfer;
+    pending->due_ns = sim_due_ns();
+    pending->cancelled = false;
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+int LIBUSB_CALL sim_cancel_transfer(struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL sim_cancel_transfer(struct libusb_transfer *transfer)
+{
+    for (size_t i=0; i<sim.pending_count; ++i) {
+        if ((sim.pending[i].transfer == transfer) && !sim.pending[i].cancelled) {
+            sim.pending[i].cancelled = true;
+            sim.pending[i].due_ns = monotonic_ns();
+            return LIBUSB_SUCCESS;
+        }
+    }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+
+/* Complete a transfer which is due, and call its callback. */
+static
+void sim_complete_transfer(const sim_pending_T *pending)
+    __attribute__(( nonnull(1) ));
+
+static
+void sim_complete_transfer(const sim_pending_T *pending)
+{
+    struct libusb_transfer *const transfer = pending->transfer;
+    transfer->actual_length = 0;
+    if (pending->cancelled) {
+        transfer->status = LIBUSB_TRANSFER_CANCELLED;
+    } else {
+        const unsigned char *const setup = transfer->buffer;
+        const uint16_t wLength =
+            (uint16_t) (setup[6] | (((uint16_t) setup[7]) << 8));
+        const int ret =
+            sim_transfer(sim_device(transfer->dev_handle), setup[0], setup[1],
+                         libusb_control_transfer_get_data(transfer), wLength,
+                         pending->due_ns);
+        switch (ret) {
+        case LIBUSB_ERROR_TIMEOUT:
+            transfer->status = LIBUSB_TRANSFER_TIMED_OUT;
+            break;
+        case LIBUSB_ERROR_PIPE:
+            transfer->status = LIBUSB_TRANSFER_STALL;
+            break;
+        case LIBUSB_ERROR_OVERFLOW:
+            transfer->status = LIBUSB_TRANSFER_OVERFLOW;
+            break;
+        case LIBUSB_ERROR_NO_DEVICE:
+            transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+            break;
+        default:
+            if (ret < 0) {
+                transfer->status = LIBUSB_TRANSFER_ERROR;
+            } else {
+                transfer->status = LIBUSB_TRANSFER_COMPLETED;
+                transfer->actual_length = ret;
+            }
+            break;
+        }
+    }
+    transfer->callback(transfer);
+}
+
+
+/* Wait for the next transfer to complete, for at most *tv. */
+static
+int LIBUSB_CALL sim_handle_events_timeout_completed(struct timeval *tv,
+                                                    int *completed)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL sim_handle_events_timeout_completed(struct timeval *tv,
+                                                    int *completed)
+{
+    (void) completed;
+    const uint64_t deadline_ns = monotonic_ns() +
+        ((uint64_t) tv->tv_sec) * 1000000000ULL +
+        ((uint64_t) tv->tv_usec) * 1000ULL;
+
+    uint64_t next_ns = deadline_ns;
+    for (size_t i=0; i<sim.pending_count; ++i) {
+        if (sim.pending[i].due_ns < next_ns) {
+            next_ns = sim.pending[i].due_ns;
+        }
+    }
+    sleep_until_ns(next_ns);
+
+    /* The callbacks may submit transfers again, so take the due ones
+     * out of the list first. */
+    const uint64_t now_ns = monotonic_ns();
+    sim_pending_T due[USB_SIM_PENDING_MAX];
+    size_t due_count = 0;
+    for (size_t i=0; i<sim.pending_count; ) {
+        if (sim.pending[i].due_ns <= now_ns) {
+            due[due_count++] = sim.pending[i];
+            sim.pending[i] = sim.pending[--sim.pending_count];
+        } else {
+            ++i;
+        }
+    }
+    for (size_t i=0; i<due_count; ++i) {
+        sim_complete_transfer(&due[i]);
+    }
+    return LIBUSB_SUCCESS;
+}
+
+
+static
+int LIBUSB_CALL sim_hotplug_register_callback(int events, int flags,
+                                              int vendor_id, int product_id,
+                                              int dev_class,
+                                              libusb_hotplug_callback_fn cb_fn,
+                                              void *user_data,
+                                              libusb_hotplug_callback_handle *handle);
+
+static
+int LIBUSB_CALL sim_hotplug_register_callback(int events, int flags,
+                                              int vendor_id, int product_id,
+                                              int dev_class,
+                                              libusb_hotplug_callback_fn cb_fn,
+                                              void *user_data,
+                                              libusb_hotplug_callback_handle *handle)
+{
+    (void) events;
+    (void) flags;
+    (void) vendor_id;
+    (void) product_id;
+    (void) dev_class;
+    (void) cb_fn;
+    (void) user_data;
+    (void) handle;
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+
+static
+void LIBUSB_CALL sim_hotplug_deregister_callback(libusb_hotplug_callback_handle handle);
+
+static
+void LIBUSB_CALL sim_hotplug_deregister_callback(libusb_hotplug_callback_handle handle)
+{
+    (void) handle;
+}
+
+
+const usb_transport_T usb_transport_sim = {
+    "simulator",
+
+    sim_init,
+    sim_exit,
+    sim_has_capability,
+
+    sim_get_device_list,
+    sim_free_device_list,
+    sim_ref_device,
+    sim_unref_device,
+
+    sim_get_device_descriptor,
+    sim_get_bus_number,
+    sim_get_device_address,
+    sim_get_port_numbers,
+
+    sim_open,
+    sim_close,
+    sim_get_string_descriptor_ascii,
+
+    sim_init_no_discovery,
+    sim_wrap_sys_device,
+    sim_get_device,
+
+    sim_control_transfer,
+    sim_submit_transfer,
+    sim_cancel_transfer,
+    sim_handle_events_timeout_completed,
+
+    sim_hotplug_register_callback,
+    sim_hotplug_deregister_callback,
+};
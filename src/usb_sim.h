@@ -0,0 +1,78 @@
+/* usb_sim.h - simulated Notepad devices
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef USB_SIM_H
+#define USB_SIM_H
+
+
+#include "usb_transport.h"
+
+
+/* The simulator stands in for libusb with Notepad devices which only
+ * exist inside the process. They enumerate like the real devices,
+ * keep the routing and ducker settings sent to them, answer meter
+ * reads from a generated signal, and can be made slow and unreliable.
+ *
+ * The SPEC is a comma separated list of
+ *
+ *   5, 8fx, 12fx      add a NOTEPAD-5, -8FX, or -12FX device, with the
+ *                     serial numbers SIM0001, SIM0002, ... (default:
+ *                     one NOTEPAD-12FX)
+ *   signal=KIND       the meter signal: const, sine (rectified),
+ *                     square (level and 40dB below), or noise
+ *   level=DB          the peak level of the signal (default -20dB)
+ *   script=FILE       change the peak level over time: every line of
+ *                     FILE is "DURATIONms LEVELdB", and the script
+ *                     starts over after its last line
+ *   freq=HZ           the frequency of sine and square (default 1Hz)
+ *   latency=MS        the time every transfer takes (default 0ms)
+ *   jitter=MS         up to this much random extra time per transfer
+ *   fail=P            let every transfer fail with the probability P
+ *                     (0.0 to 1.0, default 0.0)
+ *   error=ERR         how transfers fail: timeout (default), pipe,
+ *                     overflow, io, or no-device
+ *   seed=N            seed for the random numbers (default 1)
+ *   state=DIR         load the device settings from DIR/SERIAL when the
+ *                     device is opened, and save them there when it is
+ *                     closed, so they survive the process
+ *
+ * Unknown OUT messages fail with LIBUSB_ERROR_PIPE like a stall. There
+ * is no hotplug support, devices never come and go.
+ */
+
+
+/* Set up the simulated devices. Prints the error and returns
+ * EXIT_FAILURE for an invalid SPEC. */
+extern
+int usb_sim_setup(const char *const spec);
+
+
+extern
+const usb_transport_T usb_transport_sim;
+
+
+#endif /* !defined(USB_SIM_H) */
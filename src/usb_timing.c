@@ -0,0 +1,448 @@
+/* usb_timing.c - time the USB operations of a transport by phase
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "usb_timing.h"
+
+#include "auto-config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "monotonic_time.h"
+
+
+static
+const char *const phase_names[USB_TIMING_PHASE_COUNT] = {
+    "init",
+    "device-list",
+    "open",
+    "strings",
+    "transfer",
+    "events",
+    "teardown",
+};
+
+
+static
+const usb_transport_T *inner = NULL;
+
+
+static
+uint64_t start_ns = 0;
+
+
+static
+uint64_t phase_ns[USB_TIMING_PHASE_COUNT];
+
+
+static
+unsigned long phase_calls[USB_TIMING_PHASE_COUNT];
+
+
+static
+void phase_add(const usb_timing_phase_T phase, const uint64_t begin_ns);
+
+static
+void phase_add(const usb_timing_phase_T phase, const uint64_t begin_ns)
+{
+    phase_ns[phase] += monotonic_ns() - begin_ns;
+    ++phase_calls[phase];
+}
+
+
+void usb_timing_start(const usb_transport_T *transport)
+{
+    inner = transport;
+    start_ns = monotonic_ns();
+}
+
+
+void usb_timing_print(FILE *stream, const bool json)
+{
+    const uint64_t total_ns = monotonic_ns() - start_ns;
+    uint64_t usb_ns = 0;
+    for (unsigned int i=0; i<USB_TIMING_PHASE_COUNT; ++i) {
+        usb_ns += phase_ns[i];
+    }
+    const uint64_t other_ns = (total_ns > usb_ns) ? (total_ns - usb_ns) : 0;
+
+    if (json) {
+        fprintf(stream, "{\"timings\": {");
+        for (unsigned int i=0; i<USB_TIMING_PHASE_COUNT; ++i) {
+            fprintf(stream, "\"%s\": {\"calls\": %lu, \"ns\": %" PRIu64 "}, ",
+                    phase_names[i], phase_calls[i], phase_ns[i]);
+        }
+        fprintf(stream, "\"other\": {\"ns\": %" PRIu64 "}, "
+                "\"total\": {\"ns\": %" PRIu64 "}}}\n",
+                other_ns, total_ns);
+        return;
+    }
+
+    fprintf(stream, "timings: %-12s %7s %10s\n", "phase", "calls", "ms");
+    for (unsigned int i=0; i<USB_TIMING_PHASE_COUNT; ++i) {
+        fprintf(stream, "timings: %-12s %7lu %10.3f\n",
+                phase_names[i], phase_calls[i], ns_to_ms(phase_ns[i]));
+    }
+    fprintf(stream, "timings: %-12s %7s %10.3f\n", "other", "", ns_to_ms(other_ns));
+    fprintf(stream, "timings: %-12s %7s %10.3f\n", "total", "", ns_to_ms(total_ns));
+}
+
+
+static
+int LIBUSB_CALL timing_init(void);
+
+static
+int LIBUSB_CALL timing_init(void)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->init();
+    phase_add(USB_TIMING_INIT, begin_ns);
+    return ret;
+}
+
+
+static
+void LIBUSB_CALL timing_exit(void);
+
+static
+void LIBUSB_CALL timing_exit(void)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    inner->exit();
+    phase_add(USB_TIMING_TEARDOWN, begin_ns);
+}
+
+
+static
+int LIBUSB_CALL timing_has_capability(uint32_t capability);
+
+static
+int LIBUSB_CALL timing_has_capability(uint32_t capability)
+{
+    return inner->has_capability(capability);
+}
+
+
+static
+ssize_t LIBUSB_CALL timing_get_device_list(libusb_device ***list)
+    __attribute__(( nonnull(1) ));
+
+static
+ssize_t LIBUSB_CALL timing_get_device_list(libusb_device ***list)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const ssize_t ret = inner->get_device_list(list);
+    phase_add(USB_TIMING_DEVICE_LIST, begin_ns);
+    return ret;
+}
+
+
+static
+void LIBUSB_CALL timing_free_device_list(libusb_device **list, int unref_devices);
+
+static
+void LIBUSB_CALL timing_free_device_list(libusb_device **list, int unref_devices)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    inner->free_device_list(list, unref_devices);
+    phase_add(USB_TIMING_DEVICE_LIST, begin_ns);
+}
+
+
+static
+libusb_device *timing_ref_device(libusb_device *dev);
+
+static
+libusb_device *timing_ref_device(libusb_device *dev)
+{
+    return inner->ref_device(dev);
+}
+
+
+static
+void LIBUSB_CALL timing_unref_device(libusb_device *dev);
+
+static
+void LIBUSB_CALL timing_unref_device(libusb_device *dev)
+{
+    inner->unref_device(dev);
+}
+
+
+static
+int LIBUSB_CALL timing_get_device_descriptor(libusb_device *dev,
+                                             struct libusb_device_descriptor *desc)
+    __attribute__(( nonnull(2) ));
+
+static
+int LIBUSB_CALL timing_get_device_descriptor(libusb_device *dev,
+                                             struct libusb_device_descriptor *desc)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->get_device_descriptor(dev, desc);
+    phase_add(USB_TIMING_DEVICE_LIST, begin_ns);
+    return ret;
+}
+
+
+static
+uint8_t LIBUSB_CALL timing_get_bus_number(libusb_device *dev);
+
+static
+uint8_t LIBUSB_CALL timing_get_bus_number(libusb_device *dev)
+{
+    return inner->get_bus_number(dev);
+}
+
+
+static
+uint8_t LIBUSB_CALL timing_get_device_address(libusb_device *dev);
+
+static
+uint8_t LIBUSB_CALL timing_get_device_address(libusb_device *dev)
+{
+    return inner->get_device_address(dev);
+}
+
+
+static
+int LIBUSB_CALL timing_get_port_numbers(libusb_device *dev,
+                                        uint8_t *port_numbers, int port_numbers_len);
+
+static
+int LIBUSB_CALL timing_get_port_numbers(libusb_device *dev,
+                                        uint8_t *port_numbers, int port_numbers_len)
+{
+    return inner->get_port_numbers(dev, port_numbers, port_numbers_len);
+}
+
+
+static
+int LIBUSB_CALL timing_open(libusb_device *dev, libusb_device_handle **dev_handle)
+    __attribute__(( nonnull(2) ));
+
+static
+int LIBUSB_CALL timing_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->open(dev, dev_handle);
+    phase_add(USB_TIMING_OPEN, begin_ns);
+    return ret;
+}
+
+
+static
+void LIBUSB_CALL timing_close(libusb_device_handle *dev_handle);
+
+static
+void LIBUSB_CALL timing_close(libusb_device_handle *dev_handle)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    inner->close(dev_handle);
+    phase_add(USB_TIMING_TEARDOWN, begin_ns);
+}
+
+
+static
+int LIBUSB_CALL timing_get_string_descriptor_ascii(libusb_device_handle *dev_handle,
+                                                   uint8_t desc_index,
+                                                   unsigned char *data, int length);
+
+static
+int LIBUSB_CALL timing_get_string_descriptor_ascii(libusb_device_handle *dev_handle,
+                                                   uint8_t desc_index,
+                                                   unsigned char *data, int length)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->get_string_descriptor_ascii(dev_handle, desc_index,
+                                                       data, length);
+    phase_add(USB_TIMING_STRINGS, begin_ns);
+    return ret;
+}
+
+
+static
+int LIBUSB_CALL timing_init_no_discovery(void);
+
+static
+int LIBUSB_CALL timing_init_no_discovery(void)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->init_no_discovery();
+    phase_add(USB_TIMING_INIT, begin_ns);
+    return ret;
+}
+
+
+static
+int LIBUSB_CALL timing_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+    __attribute__(( nonnull(2) ));
+
+static
+int LIBUSB_CALL timing_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->wrap_sys_device(sys_dev, dev_handle);
+    phase_add(USB_TIMING_OPEN, begin_ns);
+    return ret;
+}
+
+
+static
+libusb_device *LIBUSB_CALL timing_get_device(libusb_device_handle *dev_handle);
+
+static
+libusb_device *LIBUSB_CALL timing_get_device(libusb_device_handle *dev_handle)
+{
+    return inner->get_device(dev_handle);
+}
+
+
+static
+int LIBUSB_CALL timing_control_transfer(libusb_device_handle *dev_handle,
+                                        uint8_t request_type, uint8_t bRequest,
+                                        uint16_t wValue, uint16_t wIndex,
+                                        unsigned char *data, uint16_t wLength,
+                                        unsigned int timeout);
+
+static
+int LIBUSB_CALL timing_control_transfer(libusb_device_handle *dev_handle,
+                                        uint8_t request_type, uint8_t bRequest,
+                                        uint16_t wValue, uint16_t wIndex,
+                                        unsigned char *data, uint16_t wLength,
+                                        unsigned int timeout)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->control_transfer(dev_handle, request_type, bRequest,
+                                            wValue, wIndex, data, wLength,
+                                            timeout);
+    phase_add(USB_TIMING_TRANSFER, begin_ns);
+    return ret;
+}
+
+
+static
+int LIBUSB_CALL timing_submit_transfer(struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL timing_submit_transfer(struct libusb_transfer *transfer)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->submit_transfer(transfer);
+    phase_add(USB_TIMING_TRANSFER, begin_ns);
+    return ret;
+}
+
+
+static
+int LIBUSB_CALL timing_cancel_transfer(struct libusb_transfer *transfer)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL timing_cancel_transfer(struct libusb_transfer *transfer)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->cancel_transfer(transfer);
+    phase_add(USB_TIMING_TRANSFER, begin_ns);
+    return ret;
+}
+
+
+/* Waiting for the asynchronous transfers to complete, which includes
+ * running their callbacks. */
+static
+int LIBUSB_CALL timing_handle_events_timeout_completed(struct timeval *tv, int *completed)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL timing_handle_events_timeout_completed(struct timeval *tv, int *completed)
+{
+    const uint64_t begin_ns = monotonic_ns();
+    const int ret = inner->handle_events_timeout_completed(tv, completed);
+    phase_add(USB_TIMING_EVENTS, begin_ns);
+    return ret;
+}
+
+
+static
+int LIBUSB_CALL timing_hotplug_register_callback(int events, int flags,
+                                                 int vendor_id, int product_id,
+                                                 int dev_class,
+                                                 libusb_hotplug_callback_fn cb_fn,
+                                                 void *user_data,
+                                                 libusb_hotplug_callback_handle *handle);
+
+static
+int LIBUSB_CALL timing_hotplug_register_callback(int events, int flags,
+                                                 int vendor_id, int product_id,
+                                                 int dev_class,
+                                                 libusb_hotplug_callback_fn cb_fn,
+                                                 void *user_data,
+                                                 libusb_hotplug_callback_handle *handle)
+{
+    return inner->hotplug_register_callback(events, flags, vendor_id, product_id,
+                                            dev_class, cb_fn, user_data, handle);
+}
+
+
+static
+void LIBUSB_CALL timing_hotplug_deregister_callback(libusb_hotplug_callback_handle handle);
+
+static
+void LIBUSB_CALL timing_hotplug_deregister_callback(libusb_hotplug_callback_handle handle)
+{
+    inner->hotplug_deregister_callback(handle);
+}
+
+
+const usb_transport_T usb_transport_timing = {
+    "timing",
+    timing_init,
+    timing_exit,
+    timing_has_capability,
+    timing_get_device_list,
+    timing_free_device_list,
+    timing_ref_device,
+    timing_unref_device,
+    timing_get_device_descriptor,
+    timing_get_bus_number,
+    timing_get_device_address,
+    timing_get_port_numbers,
+    timing_open,
+    timing_close,
+    timing_get_string_descriptor_ascii,
+    timing_init_no_discovery,
+    timing_wrap_sys_device,
+    timing_get_device,
+    timing_control_transfer,
+    timing_submit_transfer,
+    timing_cancel_transfer,
+    timing_handle_events_timeout_completed,
+    timing_hotplug_register_callback,
+    timing_hotplug_deregister_callback,
+};
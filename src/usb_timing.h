@@ -0,0 +1,71 @@
+/* usb_timing.h - time the USB operations of a transport by phase
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef USB_TIMING_H
+#define USB_TIMING_H
+
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "usb_transport.h"
+
+
+/* The phases of an invocation the time is accounted to. The time not
+ * spent in any of the USB operations is shown as "other". */
+typedef enum {
+    USB_TIMING_INIT,
+    USB_TIMING_DEVICE_LIST,
+    USB_TIMING_OPEN,
+    USB_TIMING_STRINGS,
+    USB_TIMING_TRANSFER,
+    USB_TIMING_EVENTS,
+    USB_TIMING_TEARDOWN,
+    USB_TIMING_PHASE_COUNT
+} usb_timing_phase_T;
+
+
+/* Start timing the operations of the transport inner. From now on,
+ * the caller must use usb_transport_timing instead of transport. The
+ * total time is measured from this call on. */
+extern
+void usb_timing_start(const usb_transport_T *transport);
+
+
+/* Print the time spent in every phase so far, as lines of text or as
+ * one JSON object. */
+extern
+void usb_timing_print(FILE *stream, const bool json);
+
+
+/* Forwards every operation to the inner transport, and adds the time
+ * each one takes to its phase. */
+extern
+const usb_transport_T usb_transport_timing;
+
+
+#endif /* !defined(USB_TIMING_H) */
@@ -0,0 +1,210 @@
+/* usb_trace.c - compact binary trace of the USB control transfers
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "usb_trace.h"
+
+#include "auto-config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Records go out in blocks, traces of fast meters get large. */
+#define USB_TRACE_BUFSIZE (64U*1024U)
+
+
+static
+void put_le16(uint8_t *dst, const uint16_t value)
+    __attribute__(( nonnull(1) ));
+
+static
+void put_le16(uint8_t *dst, const uint16_t value)
+{
+    dst[0] = (value >> 0) & 0xff;
+    dst[1] = (value >> 8) & 0xff;
+}
+
+
+static
+void put_le32(uint8_t *dst, const uint32_t value)
+    __attribute__(( nonnull(1) ));
+
+static
+void put_le32(uint8_t *dst, const uint32_t value)
+{
+    put_le16(&dst[0], (uint16_t) (value >>  0));
+    put_le16(&dst[2], (uint16_t) (value >> 16));
+}
+
+
+static
+void put_le64(uint8_t *dst, const uint64_t value)
+    __attribute__(( nonnull(1) ));
+
+static
+void put_le64(uint8_t *dst, const uint64_t value)
+{
+    put_le32(&dst[0], (uint32_t) (value >>  0));
+    put_le32(&dst[4], (uint32_t) (value >> 32));
+}
+
+
+static
+uint16_t get_le16(const uint8_t *src)
+    __attribute__(( nonnull(1) ));
+
+static
+uint16_t get_le16(const uint8_t *src)
+{
+    return (uint16_t) (((uint16_t) src[0]) | (((uint16_t) src[1]) << 8));
+}
+
+
+static
+uint32_t get_le32(const uint8_t *src)
+    __attribute__(( nonnull(1) ));
+
+static
+uint32_t get_le32(const uint8_t *src)
+{
+    return ((uint32_t) get_le16(&src[0])) | (((uint32_t) get_le16(&src[2])) << 16);
+}
+
+
+static
+uint64_t get_le64(const uint8_t *src)
+    __attribute__(( nonnull(1) ));
+
+static
+uint64_t get_le64(const uint8_t *src)
+{
+    return ((uint64_t) get_le32(&src[0])) | (((uint64_t) get_le32(&src[4])) << 32);
+}
+
+
+int usb_trace_create(usb_trace_T *trace, const char *const path,
+                     const uint64_t start_ns, const uint64_t start_realtime_ns)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->start_ns = start_ns;
+
+    trace->stream = fopen(path, "wb");
+    if (trace->stream == NULL) {
+        fprintf(stderr, "Fatal: Cannot create trace file %s: %s\n",
+                path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    (void) setvbuf(trace->stream, NULL, _IOFBF, USB_TRACE_BUFSIZE);
+
+    uint8_t header[USB_TRACE_HEADER_SIZE];
+    memcpy(&header[0], USB_TRACE_MAGIC, 8);
+    put_le64(&header[8], start_realtime_ns);
+    if (fwrite(header, sizeof(header), 1, trace->stream) != 1) {
+        fprintf(stderr, "Fatal: Cannot write trace file %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int usb_trace_open(usb_trace_T *trace, const char *const path)
+{
+    memset(trace, 0, sizeof(*trace));
+
+    trace->stream = fopen(path, "rb");
+    if (trace->stream == NULL) {
+        fprintf(stderr, "Fatal: Cannot open trace file %s: %s\n",
+                path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    uint8_t header[USB_TRACE_HEADER_SIZE];
+    if ((fread(header, sizeof(header), 1, trace->stream) != 1) ||
+        (memcmp(&header[0], USB_TRACE_MAGIC, 8) != 0)) {
+        fprintf(stderr, "Fatal: Not a scnp-cli trace file: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int usb_trace_write(usb_trace_T *trace,
+                    const uint64_t start_ns, const uint64_t latency_ns,
+                    const uint8_t request_type, const uint8_t request,
+                    const int status, const uint8_t *data)
+{
+    uint8_t buf[USB_TRACE_RECORD_SIZE];
+    put_le64(&buf[0], start_ns - trace->start_ns);
+    put_le32(&buf[8], (latency_ns < UINT32_MAX) ?
+             (uint32_t) latency_ns : UINT32_MAX);
+    buf[12] = request_type;
+    buf[13] = request;
+    put_le16(&buf[14], (uint16_t) (int16_t) status);
+    memcpy(&buf[16], data, USB_TRACE_DATA_SIZE);
+
+    if (fwrite(buf, sizeof(buf), 1, trace->stream) != 1) {
+        return EXIT_FAILURE;
+    }
+    ++trace->record_count;
+    return EXIT_SUCCESS;
+}
+
+
+int usb_trace_read(usb_trace_T *trace, usb_trace_record_T *record)
+{
+    uint8_t buf[USB_TRACE_RECORD_SIZE];
+    const size_t size = fread(buf, 1, sizeof(buf), trace->stream);
+    if (size == 0) {
+        return ferror(trace->stream) ? -1 : 0;
+    }
+    if (size != sizeof(buf)) {
+        return -1;
+    }
+
+    record->t_ns         = get_le64(&buf[0]);
+    record->latency_ns   = get_le32(&buf[8]);
+    record->request_type = buf[12];
+    record->request      = buf[13];
+    record->status       = (int16_t) get_le16(&buf[14]);
+    memcpy(record->data, &buf[16], USB_TRACE_DATA_SIZE);
+    ++trace->record_count;
+    return 1;
+}
+
+
+int usb_trace_close(usb_trace_T *trace)
+{
+    if (trace->stream == NULL) {
+        return EXIT_SUCCESS;
+    }
+    const bool failed = (ferror(trace->stream) != 0);
+    const int ret = fclose(trace->stream);
+    trace->stream = NULL;
+    return (failed || (ret != 0)) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/* usb_trace.h - compact binary trace of the USB control transfers
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef USB_TRACE_H
+#define USB_TRACE_H
+
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* A trace file starts with a 16 byte header:
+ *
+ *   offset 0  char[8]   "SCNPTRC" followed by the format version 1
+ *   offset 8  uint64_t  realtime in ns when the trace was started
+ *
+ * followed by one 24 byte record per control transfer:
+ *
+ *   offset 0  uint64_t  monotonic ns since the trace was started,
+ *                       taken when the transfer was started
+ *   offset 8  uint32_t  latency in ns, UINT32_MAX for 4.29s and more
+ *   offset 12 uint8_t   bmRequestType, 0x40 for OUT and 0xc0 for IN
+ *   offset 13 uint8_t   bRequest
+ *   offset 14 int16_t   0, or the LIBUSB_ERROR_* the transfer failed with
+ *   offset 16 uint8_t[8] the data sent or received
+ *
+ * All fields are little endian.
+ */
+
+
+#define USB_TRACE_MAGIC       "SCNPTRC\x01"
+#define USB_TRACE_HEADER_SIZE 16U
+#define USB_TRACE_RECORD_SIZE 24U
+#define USB_TRACE_DATA_SIZE   8U
+
+#define USB_TRACE_OUT 0x40U
+#define USB_TRACE_IN  0xc0U
+
+
+typedef struct {
+    uint64_t t_ns;
+    uint32_t latency_ns;
+    uint8_t request_type;
+    uint8_t request;
+    int16_t status;
+    uint8_t data[USB_TRACE_DATA_SIZE];
+} usb_trace_record_T;
+
+
+typedef struct {
+    FILE *stream;
+    /* monotonic ns the record times are relative to */
+    uint64_t start_ns;
+    uint64_t record_count;
+} usb_trace_T;
+
+
+/* Create the trace file for writing. Prints the error and returns
+ * EXIT_FAILURE if that fails. */
+extern
+int usb_trace_create(usb_trace_T *trace, const char *const path,
+                     const uint64_t start_ns, const uint64_t start_realtime_ns);
+
+
+/* Open the trace file for reading and check the header. Prints the
+ * error and returns EXIT_FAILURE if that fails. */
+extern
+int usb_trace_open(usb_trace_T *trace, const char *const path);
+
+
+/* Record a transfer which started at the monotonic time start_ns and
+ * took latency_ns. Returns EXIT_FAILURE on write errors. */
+extern
+int usb_trace_write(usb_trace_T *trace,
+                    const uint64_t start_ns, const uint64_t latency_ns,
+                    const uint8_t request_type, const uint8_t request,
+                    const int status, const uint8_t *data);
+
+
+/* Read the next record. Returns 1 for a record, 0 at the end of the
+ * trace, and -1 for a truncated trace or a read error. */
+extern
+int usb_trace_read(usb_trace_T *trace, usb_trace_record_T *record);
+
+
+/* Close the trace file. Returns EXIT_FAILURE if writing it has failed
+ * at any time. */
+extern
+int usb_trace_close(usb_trace_T *trace);
+
+
+#endif /* !defined(USB_TRACE_H) */
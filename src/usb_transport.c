@@ -0,0 +1,189 @@
+/* usb_transport.c - the USB operations, on libusb or the simulator
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include "usb_transport.h"
+
+#include "auto-config.h"
+
+
+static
+int LIBUSB_CALL lu_init(void);
+
+static
+int LIBUSB_CALL lu_init(void)
+{
+    return libusb_init(NULL);
+}
+
+
+static
+void LIBUSB_CALL lu_exit(void);
+
+static
+void LIBUSB_CALL lu_exit(void)
+{
+    libusb_exit(NULL);
+}
+
+
+/* Device discovery can only be disabled with libusb 1.0.24 and later,
+ * see configure.ac. */
+static
+int LIBUSB_CALL lu_init_no_discovery(void);
+
+static
+int LIBUSB_CALL lu_init_no_discovery(void)
+{
+#if defined(HAVE_LIBUSB_WRAP_SYS_DEVICE)
+    const int luret_set_option =
+        libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+    if (luret_set_option < 0) {
+        return luret_set_option;
+    }
+    return libusb_init(NULL);
+#else
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+static
+int LIBUSB_CALL lu_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+    __attribute__(( nonnull(2) ));
+
+static
+int LIBUSB_CALL lu_wrap_sys_device(intptr_t sys_dev, libusb_device_handle **dev_handle)
+{
+#if defined(HAVE_LIBUSB_WRAP_SYS_DEVICE)
+    return libusb_wrap_sys_device(NULL, sys_dev, dev_handle);
+#else
+    (void) sys_dev;
+    (void) dev_handle;
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+static
+int LIBUSB_CALL lu_has_capability(uint32_t capability);
+
+static
+int LIBUSB_CALL lu_has_capability(uint32_t capability)
+{
+    return libusb_has_capability(capability);
+}
+
+
+static
+ssize_t LIBUSB_CALL lu_get_device_list(libusb_device ***list)
+    __attribute__(( nonnull(1) ));
+
+static
+ssize_t LIBUSB_CALL lu_get_device_list(libusb_device ***list)
+{
+    return libusb_get_device_list(NULL, list);
+}
+
+
+static
+int LIBUSB_CALL lu_handle_events_timeout_completed(struct timeval *tv, int *completed)
+    __attribute__(( nonnull(1) ));
+
+static
+int LIBUSB_CALL lu_handle_events_timeout_completed(struct timeval *tv, int *completed)
+{
+    return libusb_handle_events_timeout_completed(NULL, tv, completed);
+}
+
+
+static
+int LIBUSB_CALL lu_hotplug_register_callback(int events, int flags,
+                                 int vendor_id, int product_id, int dev_class,
+                                 libusb_hotplug_callback_fn cb_fn,
+                                 void *user_data,
+                                 libusb_hotplug_callback_handle *handle)
+    __attribute__(( nonnull(6) ));
+
+static
+int LIBUSB_CALL lu_hotplug_register_callback(int events, int flags,
+                                 int vendor_id, int product_id, int dev_class,
+                                 libusb_hotplug_callback_fn cb_fn,
+                                 void *user_data,
+                                 libusb_hotplug_callback_handle *handle)
+{
+    return libusb_hotplug_register_callback(NULL,
+                                            events, flags,
+                                            vendor_id, product_id, dev_class,
+                                            cb_fn, user_data, handle);
+}
+
+
+static
+void LIBUSB_CALL lu_hotplug_deregister_callback(libusb_hotplug_callback_handle handle);
+
+static
+void LIBUSB_CALL lu_hotplug_deregister_callback(libusb_hotplug_callback_handle handle)
+{
+    libusb_hotplug_deregister_callback(NULL, handle);
+}
+
+
+/* The functions without a libusb_context argument are used directly,
+ * the others get the default context here. */
+const usb_transport_T usb_transport_libusb = {
+    "libusb",
+
+    lu_init,
+    lu_exit,
+    lu_has_capability,
+
+    lu_get_device_list,
+    libusb_free_device_list,
+    libusb_ref_device,
+    libusb_unref_device,
+
+    libusb_get_device_descriptor,
+    libusb_get_bus_number,
+    libusb_get_device_address,
+    libusb_get_port_numbers,
+
+    libusb_open,
+    libusb_close,
+    libusb_get_string_descriptor_ascii,
+
+    lu_init_no_discovery,
+    lu_wrap_sys_device,
+    libusb_get_device,
+
+    libusb_control_transfer,
+    libusb_submit_transfer,
+    libusb_cancel_transfer,
+    lu_handle_events_timeout_completed,
+
+    lu_hotplug_register_callback,
+    lu_hotplug_deregister_callback,
+};
@@ -0,0 +1,106 @@
+/* usb_transport.h - the USB operations, on libusb or the simulator
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Hans Ulrich Niedermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef USB_TRANSPORT_H
+#define USB_TRANSPORT_H
+
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <libusb.h>
+
+
+/* The USB operations scnp-cli uses. They have the signatures and the
+ * semantics of the libusb functions with the same names, minus the
+ * libusb_context argument, as scnp-cli only uses the default context.
+ *
+ * The libusb_device and libusb_device_handle pointers are opaque, so
+ * a transport may hand out pointers to its own types as long as they
+ * are only ever passed back to the same transport. The struct
+ * libusb_transfer of the asynchronous transfers is allocated and
+ * freed with libusb_alloc_transfer() and libusb_free_transfer() for
+ * all transports.
+ */
+typedef struct {
+    const char *name;
+
+    int (LIBUSB_CALL *init)(void);
+    void (LIBUSB_CALL *exit)(void);
+    int (LIBUSB_CALL *has_capability)(uint32_t capability);
+
+    ssize_t (LIBUSB_CALL *get_device_list)(libusb_device ***list);
+    void (LIBUSB_CALL *free_device_list)(libusb_device **list, int unref_devices);
+    libusb_device *(*ref_device)(libusb_device *dev);
+    void (LIBUSB_CALL *unref_device)(libusb_device *dev);
+
+    int (LIBUSB_CALL *get_device_descriptor)(libusb_device *dev,
+                                 struct libusb_device_descriptor *desc);
+    uint8_t (LIBUSB_CALL *get_bus_number)(libusb_device *dev);
+    uint8_t (LIBUSB_CALL *get_device_address)(libusb_device *dev);
+    int (LIBUSB_CALL *get_port_numbers)(libusb_device *dev,
+                            uint8_t *port_numbers, int port_numbers_len);
+
+    int (LIBUSB_CALL *open)(libusb_device *dev, libusb_device_handle **dev_handle);
+    void (LIBUSB_CALL *close)(libusb_device_handle *dev_handle);
+    int (LIBUSB_CALL *get_string_descriptor_ascii)(libusb_device_handle *dev_handle,
+                                       uint8_t desc_index,
+                                       unsigned char *data, int length);
+
+    /* For --device and --fd: init without device discovery, and open
+     * the device behind an already open device file descriptor. They
+     * fail with LIBUSB_ERROR_NOT_SUPPORTED where libusb cannot. */
+    int (LIBUSB_CALL *init_no_discovery)(void);
+    int (LIBUSB_CALL *wrap_sys_device)(intptr_t sys_dev, libusb_device_handle **dev_handle);
+    libusb_device *(LIBUSB_CALL *get_device)(libusb_device_handle *dev_handle);
+
+    int (LIBUSB_CALL *control_transfer)(libusb_device_handle *dev_handle,
+                            uint8_t request_type, uint8_t bRequest,
+                            uint16_t wValue, uint16_t wIndex,
+                            unsigned char *data, uint16_t wLength,
+                            unsigned int timeout);
+    int (LIBUSB_CALL *submit_transfer)(struct libusb_transfer *transfer);
+    int (LIBUSB_CALL *cancel_transfer)(struct libusb_transfer *transfer);
+    int (LIBUSB_CALL *handle_events_timeout_completed)(struct timeval *tv, int *completed);
+
+    int (LIBUSB_CALL *hotplug_register_callback)(int events, int flags,
+                                     int vendor_id, int product_id,
+                                     int dev_class,
+                                     libusb_hotplug_callback_fn cb_fn,
+                                     void *user_data,
+                                     libusb_hotplug_callback_handle *handle);
+    void (LIBUSB_CALL *hotplug_deregister_callback)(libusb_hotplug_callback_handle handle);
+} usb_transport_T;
+
+
+/* The actual USB devices, through libusb. */
+extern
+const usb_transport_T usb_transport_libusb;
+
+
+#endif /* !defined(USB_TRANSPORT_H) */